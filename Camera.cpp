@@ -1,5 +1,6 @@
 #include "Camera.h"
 #include "Input.h"
+#include "FrustumCuller.h"
 #include <iostream> 
 using namespace std;
 
@@ -31,13 +32,30 @@ Camera::Camera(float x, float y, float z, float aspectRatio, float fieldOfView,
 
 DirectX::XMFLOAT4X4 Camera::GetView() { return viewMatrix; }
 DirectX::XMFLOAT4X4 Camera::GetProjection() { return projMatrix; }
+DirectX::XMFLOAT4X4 Camera::GetViewProjection() { return viewProjMatrix; }
+
+DirectX::BoundingFrustum Camera::GetWorldFrustum()
+{
+	// The projection gives a view-space frustum, which the inverse view moves into the world
+	BoundingFrustum frustum(XMLoadFloat4x4(&projMatrix));
+	frustum.Transform(frustum, XMMatrixInverse(nullptr, XMLoadFloat4x4(&viewMatrix)));
+	return frustum;
+}
+
+void Camera::GetFrustumPlanes(DirectX::XMFLOAT4 planes[6])
+{
+	ExtractFrustumPlanes(XMLoadFloat4x4(&viewProjMatrix), planes);
+}
+
 Transform* Camera::GetTransform() { return &transform; }
 float Camera::GetFieldOfView() { return fieldOfView; }
+float Camera::GetFarClip() { return farClip; }
 
 void Camera::UpdateProjectionMatrix(float aspectRatio)
 {
 	XMMATRIX projection = XMMatrixPerspectiveFovLH(fieldOfView,	aspectRatio, nearClip, farClip);
 	XMStoreFloat4x4(&projMatrix, projection);
+	XMStoreFloat4x4(&viewProjMatrix, XMLoadFloat4x4(&viewMatrix) * projection);
 }
 
 void Camera::UpdateViewMatrix()
@@ -46,6 +64,7 @@ void Camera::UpdateViewMatrix()
 	XMFLOAT3 forward = transform.GetForward();
 	XMMATRIX view = XMMatrixLookToLH(XMLoadFloat3(&position), XMLoadFloat3(&forward), XMVectorSet(0, 1, 0, 0));
 	XMStoreFloat4x4(&viewMatrix, view);
+	XMStoreFloat4x4(&viewProjMatrix, view * XMLoadFloat4x4(&projMatrix));
 }
 
 void Camera::Update(float dt)
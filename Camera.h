@@ -1,5 +1,6 @@
 #pragma once
 #include <DirectXMath.h>
+#include <DirectXCollision.h>
 #include "Transform.h"
 
 class Camera
@@ -9,6 +10,7 @@ private:
 
 	DirectX::XMFLOAT4X4 viewMatrix;
 	DirectX::XMFLOAT4X4 projMatrix;
+	DirectX::XMFLOAT4X4 viewProjMatrix; // Kept up to date by both Update...Matrix() methods
 
 	float fieldOfView;
 	float nearClip;
@@ -23,8 +25,12 @@ public:
 
 	DirectX::XMFLOAT4X4 GetView();
 	DirectX::XMFLOAT4X4 GetProjection();
+	DirectX::XMFLOAT4X4 GetViewProjection();
+	DirectX::BoundingFrustum GetWorldFrustum();
+	void GetFrustumPlanes(DirectX::XMFLOAT4 planes[6]); // World space, see ExtractFrustumPlanes()
 	Transform* GetTransform();
 	float GetFieldOfView();
+	float GetFarClip();
 
 	void UpdateProjectionMatrix(float aspectRatio);
 	void UpdateViewMatrix();
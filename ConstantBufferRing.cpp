@@ -0,0 +1,132 @@
+#include "ConstantBufferRing.h"
+
+#include <cstring>
+
+// Ranges have to start on, and be a multiple of, 16 constants of 16 bytes
+static const unsigned int RangeAlignment = 256;
+
+ConstantBufferRing::ConstantBufferRing(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	std::shared_ptr<RenderContext> state,
+	unsigned int size) :
+	context(context),
+	state(state),
+	ring(size / RangeAlignment * RangeAlignment, RangeAlignment),
+	supported(false),
+	discard(true),
+	nextFence(1),
+	stats(),
+	frameStartWraps(0)
+{
+	// Offsets need 11.1, and mapping a constant buffer without discarding
+	// is optional even there
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context1;
+	if (device->GetFeatureLevel() < D3D_FEATURE_LEVEL_11_1 ||
+		FAILED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) ||
+		!options.ConstantBufferOffsetting ||
+		!options.MapNoOverwriteOnDynamicConstantBuffer ||
+		FAILED(context.As(&context1)))
+		return;
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.ByteWidth = ring.GetSize();
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	if (FAILED(device->CreateBuffer(&desc, 0, buffer.GetAddressOf())))
+		return;
+
+	D3D11_QUERY_DESC queryDesc = {};
+	queryDesc.Query = D3D11_QUERY_EVENT;
+	for (auto& query : queries)
+	{
+		if (FAILED(device->CreateQuery(&queryDesc, query.GetAddressOf())))
+			return;
+	}
+
+	supported = true;
+}
+
+bool ConstantBufferRing::IsSupported() { return supported; }
+
+void ConstantBufferRing::BeginFrame()
+{
+	stats = {};
+	frameStartWraps = ring.GetWrapCount();
+
+	// Queries finish in order, so stop at the first one that hasn't
+	while (!pending.empty())
+	{
+		BOOL done = FALSE;
+		ID3D11Query* query = queries[pending.front() % QueryCount].Get();
+		if (context->GetData(query, &done, sizeof(done), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK || !done)
+			break;
+		ring.Retire(pending.front());
+		pending.pop_front();
+	}
+}
+
+bool ConstantBufferRing::Upload(ShaderStage stage, const SimpleConstantBuffer* cb)
+{
+	if (!supported || !cb)
+		return false;
+
+	// No room without overwriting what the GPU may still read: start a
+	// new buffer instead (the driver renames it, the GPU keeps the old one)
+	unsigned int offset = 0;
+	D3D11_MAP mapType = D3D11_MAP_WRITE_NO_OVERWRITE;
+	if (discard || !ring.Allocate(cb->Size, offset))
+	{
+		if (!discard)
+			stats.Discards++;
+		ring.Reset();
+		if (!ring.Allocate(cb->Size, offset))
+			return false; // Bigger than the whole ring
+		mapType = D3D11_MAP_WRITE_DISCARD;
+		discard = false;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(buffer.Get(), 0, mapType, 0, &mapped)))
+	{
+		discard = true;
+		return false;
+	}
+	memcpy((unsigned char*)mapped.pData + offset, cb->LocalDataBuffer, cb->Size);
+	context->Unmap(buffer.Get(), 0);
+
+	unsigned int constants = (cb->Size + RangeAlignment - 1) / RangeAlignment * RangeAlignment / 16;
+	state->SetConstantBufferRange(stage, cb->BindIndex, buffer.Get(), offset / 16, constants);
+
+	stats.Uploads++;
+	stats.Bytes += cb->Size;
+	return true;
+}
+
+void ConstantBufferRing::EndFrame()
+{
+	if (!supported)
+		return;
+
+	// Every query in use means the GPU is further behind than the ring can
+	// track, so give up on those frames' space and discard next time
+	if (pending.size() == QueryCount)
+	{
+		ring.Reset();
+		pending.clear();
+		discard = true;
+	}
+
+	uint64_t fence = nextFence++;
+	ring.EndFrame(fence);
+	context->End(queries[fence % QueryCount].Get());
+	pending.push_back(fence);
+
+	stats.Wraps = ring.GetWrapCount() - frameStartWraps;
+	stats.FramesInFlight = ring.GetFrameCount();
+	stats.UsedBytes = ring.GetUsed();
+}
+
+ConstantBufferRingStats ConstantBufferRing::GetStats() { return stats; }
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <wrl/client.h>
+#include <deque>
+#include <memory>
+
+#include "ConstantRing.h"
+#include "RenderContext.h"
+#include "SimpleShader.h"
+
+// --------------------------------------------------------
+// What went through the ring since the last BeginFrame()
+// --------------------------------------------------------
+struct ConstantBufferRingStats
+{
+	unsigned int Uploads;
+	unsigned int Bytes;			// Constant data, without the alignment padding
+	unsigned int Wraps;			// Times it went back to the start of the ring
+	unsigned int Discards;		// Times the GPU was too far behind, and the ring was replaced
+	unsigned int FramesInFlight;
+	unsigned int UsedBytes;		// Including frames in flight
+};
+
+// --------------------------------------------------------
+// One big dynamic constant buffer that per-draw constants
+// are suballocated from, instead of each shader's own buffer
+// being updated (and renamed by the driver) for every draw
+//  - Each upload maps the buffer with no-overwrite, copies
+//    the shader's local data into fresh space, and binds
+//    just that range (VSSetConstantBuffers1)
+//  - An event query per frame tells the ring when the GPU is
+//    done with that frame's space, without waiting for it
+//  - When there's no room left the whole buffer is discarded,
+//    which costs a rename but never a stall
+//  - Needs Direct3D 11.1 and its constant buffer offsets; on
+//    feature level 11.0 IsSupported() is false and Upload()
+//    does nothing, so callers use the old path
+// --------------------------------------------------------
+class ConstantBufferRing
+{
+public:
+	ConstantBufferRing(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		std::shared_ptr<RenderContext> state,
+		unsigned int size);
+
+	bool IsSupported();
+
+	// Gives the ring back whatever the GPU has finished with
+	void BeginFrame();
+
+	// Copies a shader's local copy of a constant buffer into the ring, and binds
+	// it in that buffer's slot; false when it didn't (use CopyBufferData() then)
+	bool Upload(ShaderStage stage, const SimpleConstantBuffer* buffer);
+
+	// Marks the end of the frame's uploads in the GPU's command stream
+	void EndFrame();
+
+	ConstantBufferRingStats GetStats();
+
+private:
+	// Frames in flight the ring can keep track of; more than that and it
+	// discards instead (the swap chain never gets this far ahead anyway)
+	static const unsigned int QueryCount = 8;
+
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::shared_ptr<RenderContext> state;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	Microsoft::WRL::ComPtr<ID3D11Query> queries[QueryCount];
+	ConstantRing ring;
+	bool supported;
+	bool discard;					// The next map has to discard (the first one, and after giving up on a frame)
+	uint64_t nextFence;
+	std::deque<uint64_t> pending;	// Fences whose queries haven't come back, oldest first
+	ConstantBufferRingStats stats;
+	unsigned int frameStartWraps;
+};
@@ -0,0 +1,185 @@
+#include "ConstantRing.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+ConstantRing::ConstantRing(unsigned int size, unsigned int alignment) :
+	size(size),
+	alignment(alignment),
+	written(0),
+	freed(0),
+	wraps(0)
+{ }
+
+bool ConstantRing::Allocate(unsigned int bytes, unsigned int& offset)
+{
+	uint64_t aligned = ((std::max)(bytes, 1u) + (uint64_t)alignment - 1) / alignment * alignment;
+	if (aligned > size)
+		return false;
+
+	// Skip to the start when it would run off the end
+	unsigned int position = (unsigned int)(written % size);
+	uint64_t skip = position + aligned > size ? size - position : 0;
+	if (written + skip + aligned - freed > size)
+		return false;
+
+	if (skip > 0)
+		wraps++;
+	written += skip;
+	offset = (unsigned int)(written % size);
+	written += aligned;
+	return true;
+}
+
+void ConstantRing::EndFrame(uint64_t fence)
+{
+	frames.push_back({ fence, written });
+}
+
+void ConstantRing::Retire(uint64_t completedFence)
+{
+	while (!frames.empty() && frames.front().Fence <= completedFence)
+	{
+		freed = frames.front().End;
+		frames.pop_front();
+	}
+}
+
+void ConstantRing::Reset()
+{
+	freed = written;
+	frames.clear();
+}
+
+unsigned int ConstantRing::GetSize() { return size; }
+unsigned int ConstantRing::GetUsed() { return (unsigned int)(written - freed); }
+unsigned int ConstantRing::GetFrameCount() { return (unsigned int)frames.size(); }
+unsigned int ConstantRing::GetWrapCount() { return wraps; }
+
+
+// --------------------------------------------------------
+// Self test
+// --------------------------------------------------------
+ConstantRingTestResult TestConstantRing()
+{
+	ConstantRingTestResult result = {};
+
+	unsigned int offset = 0;
+
+	// Filling up, with every allocation rounded up to the alignment
+	{
+		ConstantRing ring(1024, 256);
+		result.Check(ring.Allocate(100, offset) && offset == 0, "First allocation starts at 0");
+		result.Check(ring.Allocate(300, offset) && offset == 256, "Allocations are aligned");
+		result.Check(ring.Allocate(256, offset) && offset == 768 && ring.GetUsed() == 1024, "Ring fills up exactly");
+		result.Check(!ring.Allocate(1, offset), "Full ring refuses allocations");
+
+		// Space only comes back once the frame's fence has passed
+		ring.EndFrame(1);
+		ring.Retire(0);
+		result.Check(!ring.Allocate(1, offset), "Unfinished frames keep their space");
+		ring.Retire(1);
+		result.Check(ring.Allocate(1, offset) && offset == 0 && ring.GetFrameCount() == 0, "Retired frames give their space back");
+	}
+
+	// Wrapping around
+	{
+		ConstantRing ring(1024, 256);
+		ring.Allocate(768, offset);
+		ring.EndFrame(1);
+		ring.Retire(1);
+		result.Check(ring.Allocate(512, offset) && offset == 0 && ring.GetWrapCount() == 1, "Allocation that doesn't fit at the end starts over at 0");
+		result.Check(ring.GetUsed() == 768, "Skipped bytes count as used");
+		result.Check(!ring.Allocate(512, offset), "Wrapped allocations can't pass the oldest frame");
+		result.Check(ring.Allocate(256, offset) && offset == 512, "Space up to the oldest frame is still usable");
+		ring.EndFrame(2);
+		ring.Retire(2);
+		result.Check(ring.GetUsed() == 0, "Skipped bytes come back with their frame");
+	}
+
+	// Several frames in flight, retired in order
+	{
+		ConstantRing ring(1024, 256);
+		ring.Allocate(256, offset);
+		ring.EndFrame(5);
+		ring.Allocate(256, offset);
+		ring.EndFrame(6);
+		ring.EndFrame(7); // Nothing allocated
+		ring.Retire(5);
+		result.Check(ring.GetUsed() == 256 && ring.GetFrameCount() == 2, "Retiring a fence leaves later frames alone");
+		ring.Retire(7);
+		result.Check(ring.GetUsed() == 0 && ring.GetFrameCount() == 0, "Retiring a later fence retires everything before it");
+	}
+
+	// Sizes and resets
+	{
+		ConstantRing ring(1024, 256);
+		result.Check(!ring.Allocate(1025, offset), "Allocations bigger than the ring fail");
+		result.Check(ring.Allocate(1024, offset) && offset == 0, "An allocation can take the whole ring");
+		ring.EndFrame(1);
+		ring.Reset();
+		result.Check(ring.GetUsed() == 0 && ring.GetFrameCount() == 0 && ring.Allocate(512, offset), "Reset() frees frames in flight");
+	}
+
+	// Random frames against a GPU a few frames behind, checking every allocation
+	// against everything still in flight; a full ring is discarded and reset
+	{
+		const unsigned int size = 64 * 1024;
+		const unsigned int alignment = 256;
+		const unsigned int latency = 3;
+		const unsigned int frameCount = 2000;
+
+		struct Range { unsigned int Offset, Size; };
+		std::deque<std::vector<Range>> inFlight; // Oldest first, the current frame last
+		ConstantRing ring(size, alignment);
+		std::mt19937 rng(540);
+		std::uniform_int_distribution<unsigned int> countDist(10, 60);
+		std::uniform_int_distribution<unsigned int> sizeDist(16, 512);
+		bool aligned = true;
+
+		for (unsigned int f = 1; f <= frameCount; f++)
+		{
+			inFlight.push_back({});
+			unsigned int count = countDist(rng);
+			for (unsigned int a = 0; a < count; a++)
+			{
+				unsigned int bytes = sizeDist(rng);
+				if (!ring.Allocate(bytes, offset))
+				{
+					// What a renderer would do: discard, so the GPU keeps the old memory
+					result.StressFull++;
+					ring.Reset();
+					inFlight.clear();
+					inFlight.push_back({});
+					if (!ring.Allocate(bytes, offset))
+						continue;
+				}
+
+				aligned = aligned && offset % alignment == 0 && offset + bytes <= size;
+				for (auto& frame : inFlight)
+					for (Range& r : frame)
+						if (offset < r.Offset + r.Size && r.Offset < offset + bytes)
+							result.StressOverlaps++;
+				inFlight.back().push_back({ offset, bytes });
+				result.StressAllocations++;
+			}
+
+			ring.EndFrame(f);
+			if (f > latency)
+			{
+				ring.Retire(f - latency);
+				while (inFlight.size() > latency)
+					inFlight.pop_front();
+			}
+		}
+
+		result.StressFrames = frameCount;
+		result.StressWraps = ring.GetWrapCount();
+		result.Check(aligned, "Stress allocations are aligned and inside the ring");
+		result.Check(result.StressOverlaps == 0, "Stress allocations never overlap data in flight");
+		result.Check(result.StressWraps > 0, "Stress run wraps around");
+	}
+
+	return result;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+#include "SelfTest.h"
+
+// --------------------------------------------------------
+// Hands out space in a ring of bytes, linearly, for data the
+// GPU reads a frame or two later
+//  - Space comes back once the frame that allocated it is
+//    retired, which the owner does when the GPU is done with
+//    it (a fence, or a query in Direct3D 11)
+//  - An allocation that doesn't fit before the end of the
+//    ring skips to the start; the skipped bytes come back
+//    with the rest of that frame
+//  - Allocate() fails instead of waiting when the GPU hasn't
+//    caught up, so the owner can discard the whole ring and
+//    Reset() it instead
+//  - Nothing here touches a graphics API
+// --------------------------------------------------------
+class ConstantRing
+{
+public:
+	// Offsets are multiples of alignment, which has to divide the size
+	ConstantRing(unsigned int size, unsigned int alignment);
+
+	bool Allocate(unsigned int size, unsigned int& offset);
+
+	// Everything allocated since the last EndFrame() belongs to this fence
+	void EndFrame(uint64_t fence);
+
+	// The GPU is done with every frame up to and including this fence
+	void Retire(uint64_t completedFence);
+
+	// Frees everything at once (after the memory behind it was discarded)
+	void Reset();
+
+	unsigned int GetSize();
+	unsigned int GetUsed();			// Including bytes still in flight
+	unsigned int GetFrameCount();	// Ended but not retired
+	unsigned int GetWrapCount();	// Times an allocation went back to the start
+
+private:
+	struct Frame
+	{
+		uint64_t Fence;
+		uint64_t End; // How much had been written when it ended
+	};
+
+	unsigned int size;
+	unsigned int alignment;
+	uint64_t written;	// Bytes ever handed out, counting skipped ones
+	uint64_t freed;		// ...and ever given back
+	std::deque<Frame> frames;
+	unsigned int wraps;
+};
+
+// --------------------------------------------------------
+// Results from scripted checks on a ring, and a stress run
+// against a simulated GPU that's a few frames behind
+// --------------------------------------------------------
+struct ConstantRingTestResult : TestResult
+{
+	unsigned int StressFrames;
+	unsigned int StressAllocations;
+	unsigned int StressWraps;
+	unsigned int StressFull;		// Allocations refused because the GPU was behind
+	unsigned int StressOverlaps;	// Allocations that overlapped data still in flight (should be 0)
+};
+
+ConstantRingTestResult TestConstantRing();
@@ -0,0 +1,187 @@
+#include "CookedMesh.h"
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+
+using namespace DirectX;
+
+namespace
+{
+	unsigned long long Align(unsigned long long offset)
+	{
+		return (offset + COOKED_MESH_ALIGNMENT - 1) & ~(unsigned long long)(COOKED_MESH_ALIGNMENT - 1);
+	}
+
+	void AddAttribute(CookedMeshHeader& header, const char* semantic, DXGI_FORMAT format, size_t offset)
+	{
+		CookedVertexAttribute& a = header.Attributes[header.AttributeCount++];
+		strncpy_s(a.SemanticName, semantic, _TRUNCATE);
+		a.SemanticIndex = 0;
+		a.Format = format;
+		a.ByteOffset = (unsigned int)offset;
+	}
+
+	// The layout descriptor for our Vertex struct
+	void DescribeVertexLayout(CookedMeshHeader& header)
+	{
+		header.VertexStride = sizeof(Vertex);
+		header.AttributeCount = 0;
+		AddAttribute(header, "POSITION", DXGI_FORMAT_R32G32B32_FLOAT, offsetof(Vertex, Position));
+		AddAttribute(header, "TEXCOORD", DXGI_FORMAT_R32G32_FLOAT, offsetof(Vertex, UV));
+		AddAttribute(header, "NORMAL", DXGI_FORMAT_R32G32B32_FLOAT, offsetof(Vertex, Normal));
+		AddAttribute(header, "TANGENT", DXGI_FORMAT_R32G32B32A32_FLOAT, offsetof(Vertex, Tangent));
+	}
+
+	void WritePadding(std::ofstream& out, unsigned long long from, unsigned long long to)
+	{
+		const char zeros[COOKED_MESH_ALIGNMENT] = {};
+		out.write(zeros, (std::streamsize)(to - from));
+	}
+}
+
+unsigned long long HashBytes(const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	unsigned long long hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+std::wstring GetCookedMeshPath(const std::wstring& sourceFile)
+{
+	size_t dot = sourceFile.find_last_of(L'.');
+	size_t slash = sourceFile.find_last_of(L"\\/");
+	if (dot == std::wstring::npos || (slash != std::wstring::npos && dot < slash))
+		return sourceFile + L".mesh";
+
+	return sourceFile.substr(0, dot) + L".mesh";
+}
+
+bool IsCookedMeshPath(const std::wstring& file)
+{
+	const std::wstring ext = L".mesh";
+	return file.size() >= ext.size() &&
+		_wcsicmp(file.c_str() + file.size() - ext.size(), ext.c_str()) == 0;
+}
+
+bool WriteCookedMesh(
+	const std::wstring& cookedFile,
+	unsigned long long sourceHash,
+	unsigned long long sourceSize,
+	unsigned long long sourceWriteTime,
+	unsigned int flags,
+	const Vertex* vertices, unsigned int vertexCount,
+	const unsigned int* indices, unsigned int indexCount,
+	const CookedMeshLod* lods, unsigned int lodCount,
+	const BoundingBox& box,
+	const BoundingSphere& sphere,
+	const BoundingOrientedBox& orientedBox)
+{
+	if (lodCount == 0 || lodCount > COOKED_MESH_MAX_LODS)
+		return false;
+
+	CookedMeshHeader header;
+	memset(&header, 0, sizeof(header));
+	header.Magic = COOKED_MESH_MAGIC;
+	header.Version = COOKED_MESH_VERSION;
+	header.SourceHash = sourceHash;
+	header.SourceSize = sourceSize;
+	header.SourceWriteTime = sourceWriteTime;
+	DescribeVertexLayout(header);
+
+	header.VertexCount = vertexCount;
+	header.IndexCount = indexCount;
+	header.IndexStride = sizeof(unsigned int);
+	header.Flags = flags;
+	header.VertexDataOffset = Align(sizeof(CookedMeshHeader));
+	header.IndexDataOffset = Align(header.VertexDataOffset + (unsigned long long)header.VertexStride * vertexCount);
+
+	header.Box = box;
+	header.Sphere = sphere;
+	header.OrientedBox = orientedBox;
+
+	header.LodCount = lodCount;
+	memcpy(header.Lods, lods, sizeof(CookedMeshLod) * lodCount);
+
+	std::ofstream out(cookedFile, std::ios::binary | std::ios::trunc);
+	if (!out.is_open())
+		return false;
+
+	unsigned long long vertexBytes = (unsigned long long)header.VertexStride * vertexCount;
+	out.write((const char*)&header, sizeof(header));
+	WritePadding(out, sizeof(header), header.VertexDataOffset);
+	out.write((const char*)vertices, (std::streamsize)vertexBytes);
+	WritePadding(out, header.VertexDataOffset + vertexBytes, header.IndexDataOffset);
+	out.write((const char*)indices, (std::streamsize)header.IndexStride * indexCount);
+
+	return out.good();
+}
+
+bool UpdateCookedMeshWriteTime(const std::wstring& cookedFile, unsigned long long sourceWriteTime)
+{
+	std::fstream file(cookedFile, std::ios::binary | std::ios::in | std::ios::out);
+	if (!file.is_open())
+		return false;
+
+	file.seekp(offsetof(CookedMeshHeader, SourceWriteTime));
+	file.write((const char*)&sourceWriteTime, sizeof(sourceWriteTime));
+	return file.good();
+}
+
+bool ReadCookedMesh(
+	const char* data, size_t size,
+	const CookedMeshHeader** header,
+	const Vertex** vertices,
+	const unsigned int** indices)
+{
+	if (!data || size < sizeof(CookedMeshHeader))
+		return false;
+
+	const CookedMeshHeader* h = (const CookedMeshHeader*)data;
+	if (h->Magic != COOKED_MESH_MAGIC || h->Version != COOKED_MESH_VERSION)
+		return false;
+
+	// The layout has to match our Vertex struct exactly
+	CookedMeshHeader expected;
+	memset(&expected, 0, sizeof(expected));
+	DescribeVertexLayout(expected);
+	if (h->VertexStride != expected.VertexStride ||
+		h->AttributeCount != expected.AttributeCount ||
+		memcmp(h->Attributes, expected.Attributes, sizeof(expected.Attributes)) != 0 ||
+		h->IndexStride != sizeof(unsigned int))
+		return false;
+
+	// Blobs must be aligned and fully inside the file
+	unsigned long long vertexEnd = h->VertexDataOffset + (unsigned long long)h->VertexStride * h->VertexCount;
+	unsigned long long indexEnd = h->IndexDataOffset + (unsigned long long)h->IndexStride * h->IndexCount;
+	if (h->VertexDataOffset % COOKED_MESH_ALIGNMENT != 0 ||
+		h->IndexDataOffset % COOKED_MESH_ALIGNMENT != 0 ||
+		h->VertexDataOffset < sizeof(CookedMeshHeader) ||
+		vertexEnd > size ||
+		indexEnd > size ||
+		h->VertexCount == 0 ||
+		h->IndexCount == 0)
+		return false;
+
+	// Every level has to be a non-empty range of whole triangles
+	if (h->LodCount == 0 || h->LodCount > COOKED_MESH_MAX_LODS)
+		return false;
+	for (unsigned int i = 0; i < h->LodCount; i++)
+	{
+		const CookedMeshLod& lod = h->Lods[i];
+		if (lod.IndexCount == 0 ||
+			lod.IndexCount % 3 != 0 ||
+			(unsigned long long)lod.IndexStart + lod.IndexCount > h->IndexCount)
+			return false;
+	}
+
+	*header = h;
+	*vertices = (const Vertex*)(data + h->VertexDataOffset);
+	*indices = (const unsigned int*)(data + h->IndexDataOffset);
+	return true;
+}
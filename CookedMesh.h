@@ -0,0 +1,111 @@
+#pragma once
+
+#include <d3d11.h>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <string>
+#include "Vertex.h"
+
+#define COOKED_MESH_MAGIC			0x4853454D // "MESH"
+#define COOKED_MESH_VERSION			4
+#define COOKED_MESH_ALIGNMENT		16
+#define COOKED_MESH_MAX_ATTRIBUTES	8
+#define COOKED_MESH_MAX_LODS		8
+
+// Flags recording how the source was processed
+#define COOKED_MESH_FLAG_OPTIMIZED	0x1 // Vertex cache, overdraw & fetch optimized
+#define COOKED_MESH_FLAG_MIKKTSPACE	0x2 // Tangents generated with TangentMode::MikkTSpace
+
+// --------------------------------------------------------
+// One element of the vertex layout stored in a cooked mesh
+// (mirrors the parts of D3D11_INPUT_ELEMENT_DESC we need)
+// --------------------------------------------------------
+struct CookedVertexAttribute
+{
+	char SemanticName[16];
+	unsigned int SemanticIndex;
+	unsigned int Format;		// DXGI_FORMAT
+	unsigned int ByteOffset;
+};
+
+// --------------------------------------------------------
+// One level of detail, as a range of the index blob
+// --------------------------------------------------------
+struct CookedMeshLod
+{
+	unsigned int IndexStart;
+	unsigned int IndexCount;
+	float Error;				// Object-space simplification error
+};
+
+// --------------------------------------------------------
+// Header at the very start of a cooked (.mesh) file
+//
+// The vertex and index blobs follow at aligned offsets, so
+// a memory-mapped file can be handed straight to D3D
+// --------------------------------------------------------
+struct CookedMeshHeader
+{
+	unsigned int Magic;
+	unsigned int Version;
+
+	// Identifies the source file this was cooked from.  A matching size and
+	// last write time (a FILETIME) are trusted as is; the hash is only
+	// checked when the size matches but the time doesn't
+	unsigned long long SourceHash;
+	unsigned long long SourceSize;
+	unsigned long long SourceWriteTime;
+
+	// Vertex layout descriptor
+	unsigned int VertexStride;
+	unsigned int AttributeCount;
+	CookedVertexAttribute Attributes[COOKED_MESH_MAX_ATTRIBUTES];
+
+	// Buffer blobs
+	unsigned int VertexCount;
+	unsigned int IndexCount;
+	unsigned int IndexStride;
+	unsigned int Flags;
+	unsigned long long VertexDataOffset;
+	unsigned long long IndexDataOffset;
+
+	// Object-space bounds, exactly as Mesh computed them
+	DirectX::BoundingBox Box;
+	DirectX::BoundingSphere Sphere;
+	DirectX::BoundingOrientedBox OrientedBox;
+
+	// Levels of detail, back to back in the index blob (level 0 is the full mesh)
+	unsigned int LodCount;
+	CookedMeshLod Lods[COOKED_MESH_MAX_LODS];
+};
+
+// 64-bit FNV-1a hash, used to detect stale cooked files
+unsigned long long HashBytes(const void* data, size_t size);
+
+// "Models/cube.obj" -> "Models/cube.mesh"
+std::wstring GetCookedMeshPath(const std::wstring& sourceFile);
+bool IsCookedMeshPath(const std::wstring& file);
+
+bool WriteCookedMesh(
+	const std::wstring& cookedFile,
+	unsigned long long sourceHash,
+	unsigned long long sourceSize,
+	unsigned long long sourceWriteTime,
+	unsigned int flags,
+	const Vertex* vertices, unsigned int vertexCount,
+	const unsigned int* indices, unsigned int indexCount,
+	const CookedMeshLod* lods, unsigned int lodCount,
+	const DirectX::BoundingBox& box,
+	const DirectX::BoundingSphere& sphere,
+	const DirectX::BoundingOrientedBox& orientedBox);
+
+// Records a new source write time in an existing cooked file, once its
+// hash has shown the source is unchanged (so the next load skips the hash)
+bool UpdateCookedMeshWriteTime(const std::wstring& cookedFile, unsigned long long sourceWriteTime);
+
+// Validates a mapped cooked file and returns pointers into it (no copies)
+bool ReadCookedMesh(
+	const char* data, size_t size,
+	const CookedMeshHeader** header,
+	const Vertex** vertices,
+	const unsigned int** indices);
@@ -1,12 +1,16 @@
 
 #include "ShaderIncludes.hlsli"
 
-cbuffer ExternalData : register(b0)
+cbuffer PerFrame : register(b0)
 {
-	float4 colorTint;
 	float time;
 }
 
+cbuffer PerMaterial : register(b1)
+{
+	float3 colorTint;
+}
+
 // --------------------------------------------------------
 // The entry point (main method) for our pixel shader
 // 
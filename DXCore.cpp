@@ -223,20 +223,40 @@ HRESULT DXCore::InitDirect3D()
 	// Result variable for below function calls
 	HRESULT hr = S_OK;
 
+	// Ask for 11.1 first (constant buffer offsets), then the same levels
+	// the default list has; a runtime that doesn't know 11.1 rejects the
+	// whole list, so try again without it
+	D3D_FEATURE_LEVEL featureLevels[] =
+	{
+		D3D_FEATURE_LEVEL_11_1,
+		D3D_FEATURE_LEVEL_11_0,
+		D3D_FEATURE_LEVEL_10_1,
+		D3D_FEATURE_LEVEL_10_0,
+		D3D_FEATURE_LEVEL_9_3,
+		D3D_FEATURE_LEVEL_9_2,
+		D3D_FEATURE_LEVEL_9_1,
+	};
+	UINT featureLevelCount = ARRAYSIZE(featureLevels);
+
 	// Attempt to initialize Direct3D
-	hr = D3D11CreateDeviceAndSwapChain(
-		0,							// Video adapter (physical GPU) to use, or null for default
-		D3D_DRIVER_TYPE_HARDWARE,	// We want to use the hardware (GPU)
-		0,							// Used when doing software rendering
-		deviceFlags,				// Any special options
-		0,							// Optional array of possible verisons we want as fallbacks
-		0,							// The number of fallbacks in the above param
-		D3D11_SDK_VERSION,			// Current version of the SDK
-		&swapDesc,					// Address of swap chain options
-		swapChain.GetAddressOf(),	// Pointer to our Swap Chain pointer
-		device.GetAddressOf(),		// Pointer to our Device pointer
-		&dxFeatureLevel,			// This will hold the actual feature level the app will use
-		context.GetAddressOf());	// Pointer to our Device Context pointer
+	for (UINT firstLevel = 0; firstLevel < 2; firstLevel++)
+	{
+		hr = D3D11CreateDeviceAndSwapChain(
+			0,							// Video adapter (physical GPU) to use, or null for default
+			D3D_DRIVER_TYPE_HARDWARE,	// We want to use the hardware (GPU)
+			0,							// Used when doing software rendering
+			deviceFlags,				// Any special options
+			featureLevels + firstLevel,	// Optional array of possible verisons we want as fallbacks
+			featureLevelCount - firstLevel,	// The number of fallbacks in the above param
+			D3D11_SDK_VERSION,			// Current version of the SDK
+			&swapDesc,					// Address of swap chain options
+			swapChain.GetAddressOf(),	// Pointer to our Swap Chain pointer
+			device.GetAddressOf(),		// Pointer to our Device pointer
+			&dxFeatureLevel,			// This will hold the actual feature level the app will use
+			context.GetAddressOf());	// Pointer to our Device Context pointer
+		if (hr != E_INVALIDARG)
+			break;
+	}
 	if (FAILED(hr)) return hr;
 
 	// Create the Render Target View for the back buffer render target
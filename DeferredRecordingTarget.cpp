@@ -0,0 +1,58 @@
+#include "DeferredRecordingTarget.h"
+
+DeferredRecordingTarget::DeferredRecordingTarget(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> immediate,
+	unsigned int contextCount) :
+	immediate(immediate)
+{
+	for (unsigned int c = 0; c < contextCount && c < MaxRecordingSlots; c++)
+	{
+		Recorder r;
+		if (FAILED(device->CreateDeferredContext(0, r.Context.GetAddressOf())))
+			break;
+		r.State = std::make_shared<StateCache>(std::make_shared<D3D11RenderContext>(r.Context));
+		recorders.push_back(r);
+	}
+}
+
+unsigned int DeferredRecordingTarget::GetContextCount() { return (unsigned int)recorders.size(); }
+
+RenderContext& DeferredRecordingTarget::BeginRecording(unsigned int context)
+{
+	// Deferred contexts start out, and are left by FinishCommandList(), with default state
+	Recorder& r = recorders[context];
+	r.State->AssumeDefaultState();
+	return *r.State;
+}
+
+void DeferredRecordingTarget::EndRecording(unsigned int context)
+{
+	Recorder& r = recorders[context];
+	r.Context->FinishCommandList(FALSE, r.Commands.ReleaseAndGetAddressOf());
+}
+
+void DeferredRecordingTarget::Execute(unsigned int context)
+{
+	Recorder& r = recorders[context];
+	if (!r.Commands)
+		return;
+	immediate->ExecuteCommandList(r.Commands.Get(), FALSE);
+	r.Commands.Reset();
+}
+
+Microsoft::WRL::ComPtr<ID3D11DeviceContext> DeferredRecordingTarget::GetDeviceContext(unsigned int context) { return recorders[context].Context; }
+
+void DeferredRecordingTarget::ResetStats()
+{
+	for (Recorder& r : recorders)
+		r.State->ResetStats();
+}
+
+StateCacheStats DeferredRecordingTarget::GetStats()
+{
+	StateCacheStats total = {};
+	for (Recorder& r : recorders)
+		total.Add(r.State->GetStats());
+	return total;
+}
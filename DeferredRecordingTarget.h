@@ -0,0 +1,54 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include <vector>
+
+#include "ParallelRecorder.h"
+#include "StateCache.h"
+
+// --------------------------------------------------------
+// Records each range into its own Direct3D deferred context,
+// through its own state cache, and executes the command lists
+// on the immediate context
+//  - A deferred context starts every recording with default
+//    state (no render targets, viewport or topology), so the
+//    recording has to set whatever the draws need first
+//  - Executing a command list leaves the immediate context in
+//    its default state too, so the caller has to set things
+//    like render targets again afterwards, and invalidate
+//    anything caching that state
+// --------------------------------------------------------
+class DeferredRecordingTarget : public CommandRecordingTarget
+{
+public:
+	// Makes up to contextCount deferred contexts (fewer if it can't)
+	DeferredRecordingTarget(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> immediate,
+		unsigned int contextCount);
+
+	unsigned int GetContextCount();
+	RenderContext& BeginRecording(unsigned int context);
+	void EndRecording(unsigned int context);
+	void Execute(unsigned int context);
+
+	// For draws, which don't go through a render context
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> GetDeviceContext(unsigned int context);
+
+	// Every context's state calls since the last ResetStats()
+	void ResetStats();
+	StateCacheStats GetStats();
+
+private:
+	struct Recorder
+	{
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> Context;
+		std::shared_ptr<StateCache> State;
+		Microsoft::WRL::ComPtr<ID3D11CommandList> Commands;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> immediate;
+	std::vector<Recorder> recorders;
+};
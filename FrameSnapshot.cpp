@@ -0,0 +1,287 @@
+#include "FrameSnapshot.h"
+#include "TransformSystem.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+
+using namespace DirectX;
+
+namespace
+{
+	double MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// FNV-1a, continuing from an earlier hash
+	uint64_t Hash(uint64_t hash, const void* data, size_t size)
+	{
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++)
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		return hash;
+	}
+
+	// --------------------------------------------------------
+	// The test scene: everything is a function of the frame
+	// number, like a game running at a fixed time step
+	//  - Every third object has a non-uniform scale, so both
+	//    kinds of object snapshot get exercised
+	// --------------------------------------------------------
+	void UpdateScene(TransformSystem& transforms, const std::vector<unsigned int>& ids, FrameSnapshot& frame)
+	{
+		const float deltaTime = 1.0f / 60.0f;
+		float time = frame.Frame * deltaTime;
+		frame.DeltaTime = deltaTime;
+		frame.TotalTime = time;
+
+		for (unsigned int i = 0; i < ids.size(); i++)
+		{
+			float phase = time + i * 0.01f;
+			transforms.SetPosition(ids[i], XMFLOAT3(cosf(phase) * (i % 100), sinf(phase * 0.5f), sinf(phase) * (i / 100)));
+			transforms.SetPitchYawRoll(ids[i], XMFLOAT3(phase * 0.5f, phase, 0.0f));
+			transforms.SetScale(ids[i], i % 3 == 0 ? XMFLOAT3(1.0f, 1.0f + 0.5f * sinf(phase), 1.0f) : XMFLOAT3(1.0f, 1.0f, 1.0f));
+		}
+		transforms.UpdateMatrices();
+
+		frame.Objects.resize(ids.size());
+		for (unsigned int i = 0; i < ids.size(); i++)
+		{
+			ObjectSnapshot& object = frame.Objects[i];
+			object.Entity = i;
+			object.Lod = i % 4;
+			object.World = transforms.GetWorldMatrix(ids[i]);
+			object.UniformScale = transforms.HasUniformScale(ids[i]);
+			if (!object.UniformScale)
+				object.WorldInverseTranspose = transforms.GetWorldInverseTransposeMatrix(ids[i]);
+		}
+
+		// A camera circling the scene, and a light turning overhead
+		XMVECTOR eye = XMVectorSet(sinf(time) * 50.0f, 10.0f, cosf(time) * 50.0f, 0.0f);
+		XMMATRIX view = XMMatrixLookAtLH(eye, XMVectorZero(), XMVectorSet(0, 1, 0, 0));
+		XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.01f, 100.0f);
+		XMStoreFloat4x4(&frame.Camera.View, view);
+		XMStoreFloat4x4(&frame.Camera.Projection, projection);
+		XMStoreFloat3(&frame.Camera.Position, eye);
+		BoundingFrustum frustum(projection);
+		frustum.Transform(frame.Camera.WorldFrustum, XMMatrixInverse(0, view));
+
+		Light light = {};
+		light.Type = LIGHT_TYPE_DIRECTIONAL;
+		light.Direction = XMFLOAT3(cosf(time), -1.0f, sinf(time));
+		light.Intensity = 1.0f;
+		light.Color = XMFLOAT3(1, 1, 1);
+		frame.Lights.assign(1, light);
+	}
+
+	// --------------------------------------------------------
+	// Stands in for drawing: hashes exactly what a renderer
+	// would read, and reports stats back like one would
+	// --------------------------------------------------------
+	uint64_t NullRender(FrameSnapshot& frame)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		hash = Hash(hash, &frame.Frame, sizeof(frame.Frame));
+		hash = Hash(hash, &frame.TotalTime, sizeof(frame.TotalTime));
+		hash = Hash(hash, &frame.Camera.View, sizeof(frame.Camera.View));
+		hash = Hash(hash, &frame.Camera.Projection, sizeof(frame.Camera.Projection));
+		hash = Hash(hash, &frame.Camera.Position, sizeof(frame.Camera.Position));
+		for (ObjectSnapshot& object : frame.Objects)
+		{
+			hash = Hash(hash, &object.Entity, sizeof(object.Entity));
+			hash = Hash(hash, &object.Lod, sizeof(object.Lod));
+			hash = Hash(hash, &object.World, sizeof(object.World));
+			if (!object.UniformScale)
+				hash = Hash(hash, &object.WorldInverseTranspose, sizeof(object.WorldInverseTranspose));
+
+			// Count what a culling renderer would, so the work looks like one
+			BoundingSphere bounds(XMFLOAT3(object.World.m[3][0], object.World.m[3][1], object.World.m[3][2]), 1.0f);
+			if (!frame.Camera.WorldFrustum.Intersects(bounds))
+				frame.Stats.Meshlets.Outside++;
+		}
+		for (Light& light : frame.Lights)
+			hash = Hash(hash, &light, sizeof(Light));
+
+		// Which frame these came from, so the update side can check it gets
+		// them back from the right one
+		frame.Stats.Meshlets.Total = frame.Frame + 1;
+		return hash;
+	}
+}
+
+// --------------------------------------------------------
+// UISnapshot
+// --------------------------------------------------------
+void UISnapshot::Capture(ImDrawData* drawData)
+{
+	Clear();
+	DrawData.Valid = drawData->Valid;
+	DrawData.DisplayPos = drawData->DisplayPos;
+	DrawData.DisplaySize = drawData->DisplaySize;
+	DrawData.FramebufferScale = drawData->FramebufferScale;
+	for (int i = 0; i < drawData->CmdListsCount; i++)
+	{
+		DrawLists.push_back(drawData->CmdLists[i]->CloneOutput());
+		DrawData.AddDrawList(DrawLists.back());
+	}
+}
+
+void UISnapshot::Clear()
+{
+	for (ImDrawList* list : DrawLists)
+		IM_DELETE(list);
+	DrawLists.clear();
+	DrawData.Clear();
+}
+
+UISnapshot::~UISnapshot() { Clear(); }
+
+// --------------------------------------------------------
+// FrameSnapshotQueue
+//  - Frame N always uses snapshot N % 2, so the update side
+//    can reuse a snapshot once frame N - 2 has been drawn
+// --------------------------------------------------------
+FrameSnapshotQueue::FrameSnapshotQueue() :
+	published(0),
+	rendered(0),
+	closed(false)
+{ }
+
+FrameSnapshot& FrameSnapshotQueue::BeginUpdate()
+{
+	unsigned int frame = published.load(std::memory_order_relaxed);
+	while (frame - rendered.load(std::memory_order_acquire) >= 2)
+		std::this_thread::yield();
+
+	FrameSnapshot& snapshot = snapshots[frame % 2];
+	snapshot.Frame = frame;
+	return snapshot;
+}
+
+void FrameSnapshotQueue::Publish()
+{
+	published.fetch_add(1, std::memory_order_release);
+}
+
+FrameSnapshot* FrameSnapshotQueue::BeginRender()
+{
+	unsigned int frame = rendered.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		// Check closed first: nothing is published after closing, so if it's
+		// closed and there's still nothing new, there never will be
+		bool wasClosed = closed.load(std::memory_order_acquire);
+		if (published.load(std::memory_order_acquire) != frame)
+			return &snapshots[frame % 2];
+		if (wasClosed)
+			return nullptr;
+		std::this_thread::yield();
+	}
+}
+
+void FrameSnapshotQueue::EndRender()
+{
+	rendered.fetch_add(1, std::memory_order_release);
+}
+
+void FrameSnapshotQueue::WaitForRender()
+{
+	while (rendered.load(std::memory_order_acquire) != published.load(std::memory_order_relaxed))
+		std::this_thread::yield();
+}
+
+void FrameSnapshotQueue::Close() { closed.store(true, std::memory_order_release); }
+void FrameSnapshotQueue::Reopen() { closed.store(false, std::memory_order_release); }
+
+unsigned int FrameSnapshotQueue::GetPublishedCount() { return published.load(std::memory_order_acquire); }
+unsigned int FrameSnapshotQueue::GetRenderedCount() { return rendered.load(std::memory_order_acquire); }
+
+SnapshotTestResult TestFrameSnapshots(unsigned int frameCount, unsigned int objectCount)
+{
+	SnapshotTestResult result = {};
+	result.FrameCount = frameCount;
+	result.ObjectCount = objectCount;
+
+	// Each run gets its own transforms, starting from the same place
+	auto createObjects = [&](TransformSystem& transforms)
+	{
+		std::vector<unsigned int> ids(objectCount);
+		for (unsigned int& id : ids)
+			id = transforms.Create();
+		return ids;
+	};
+
+	// The stats in a reused snapshot have to be the ones from two frames ago
+	auto statsFromTwoFramesAgo = [](FrameSnapshot& frame)
+	{
+		return frame.Frame < 2 || frame.Stats.Meshlets.Total == frame.Frame - 1;
+	};
+
+	// Update then render, one frame at a time
+	std::vector<uint64_t> serialHashes;
+	bool statsReturned = true;
+	{
+		TransformSystem transforms;
+		std::vector<unsigned int> ids = createObjects(transforms);
+		FrameSnapshotQueue queue;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (unsigned int f = 0; f < frameCount; f++)
+		{
+			FrameSnapshot& update = queue.BeginUpdate();
+			statsReturned = statsReturned && statsFromTwoFramesAgo(update);
+			update.Stats = {};
+			UpdateScene(transforms, ids, update);
+			queue.Publish();
+
+			FrameSnapshot* render = queue.BeginRender();
+			serialHashes.push_back(NullRender(*render));
+			queue.EndRender();
+		}
+		result.SerialMs = MillisecondsSince(start);
+	}
+
+	// The same frames with rendering on its own thread
+	std::vector<uint64_t> threadedHashes;
+	std::vector<unsigned int> renderedFrames;
+	{
+		TransformSystem transforms;
+		std::vector<unsigned int> ids = createObjects(transforms);
+		FrameSnapshotQueue queue;
+		threadedHashes.reserve(frameCount);
+		renderedFrames.reserve(frameCount);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		std::thread renderThread([&]()
+		{
+			while (FrameSnapshot* render = queue.BeginRender())
+			{
+				renderedFrames.push_back(render->Frame);
+				threadedHashes.push_back(NullRender(*render));
+				queue.EndRender();
+			}
+		});
+
+		for (unsigned int f = 0; f < frameCount; f++)
+		{
+			FrameSnapshot& update = queue.BeginUpdate();
+			if (queue.GetRenderedCount() < f)
+				result.OverlappedFrames++;
+			statsReturned = statsReturned && statsFromTwoFramesAgo(update);
+			update.Stats = {};
+			UpdateScene(transforms, ids, update);
+			queue.Publish();
+		}
+		queue.Close();
+		renderThread.join();
+		result.ThreadedMs = MillisecondsSince(start);
+	}
+
+	bool inOrder = renderedFrames.size() == frameCount;
+	for (unsigned int f = 0; inOrder && f < frameCount; f++)
+		inOrder = renderedFrames[f] == f;
+	result.Deterministic = inOrder && statsReturned && threadedHashes == serialHashes;
+	return result;
+}
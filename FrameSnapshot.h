@@ -0,0 +1,193 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <atomic>
+#include <vector>
+
+#include "Lights.h"
+#include "Meshlet.h"
+#include "GeometryArena.h"
+#include "RenderQueue.h"
+#include "InstanceBuffer.h"
+#include "StateCache.h"
+#include "ConstantBufferRing.h"
+#include "ParallelRecorder.h"
+#include "ImGui/imgui.h"
+
+// --------------------------------------------------------
+// One object as the renderer sees it
+//  - Entity is an index into the game's entity list, which
+//    only grows, and only while no frame is being drawn
+// --------------------------------------------------------
+struct ObjectSnapshot
+{
+	unsigned int Entity;
+	unsigned int Lod;
+	DirectX::XMFLOAT4X4 World;
+	DirectX::XMFLOAT4X4 WorldInverseTranspose; // Not filled in for uniform scales
+	bool UniformScale;
+};
+
+struct CameraSnapshot
+{
+	DirectX::XMFLOAT4X4 View;
+	DirectX::XMFLOAT4X4 Projection;
+	DirectX::XMFLOAT3 Position;
+	DirectX::BoundingFrustum WorldFrustum;
+};
+
+// --------------------------------------------------------
+// Milliseconds from the start of Game::Init() to each step
+// of starting up (0 until it happens)
+// --------------------------------------------------------
+struct StartupTimeline
+{
+	double Shaders;
+	double TexturesQueued;	// Or loaded, without the background loader
+	double Meshes;
+	double Init;
+	double FirstFrame;		// Presented
+	double TexturesLoaded;	// The last one in its material
+};
+
+// --------------------------------------------------------
+// What the renderer found out while drawing a frame
+//  - Written into that frame's snapshot, so the update side
+//    sees it when the snapshot comes back around for reuse
+// --------------------------------------------------------
+struct RenderStats
+{
+	MeshletCullStats Meshlets;
+	GeometryBindStats Binds;
+	RenderBindStats Pipeline;			// Main pass shaders, textures and samplers
+	StateCacheStats State;				// Every pass's state calls, and how many changed anything
+	ConstantBufferRingStats Ring;		// Per-object constants, when they come from the ring
+	RecordingStats Recording;			// Main pass draws recorded on several threads (no ranges when it wasn't)
+	unsigned int ShadowDraws;
+	unsigned int ShadowVertexBytes;		// Vertex data the shadow pass bound
+	unsigned int ShadowFullVertexBytes;	// ...and what the full vertices would have been
+	unsigned int TexturesLoading;		// Materials' textures still showing a placeholder
+	StartupTimeline Startup;
+};
+
+// --------------------------------------------------------
+// A copy of ImGui's draw lists, since the next ImGui frame
+// reuses the originals while this one may still be drawing
+// --------------------------------------------------------
+struct UISnapshot
+{
+	std::vector<ImDrawList*> DrawLists;
+	ImDrawData DrawData; // Points at the copies above
+
+	void Capture(ImDrawData* drawData);
+	void Clear();
+
+	UISnapshot() = default;
+	UISnapshot(const UISnapshot&) = delete;
+	UISnapshot& operator=(const UISnapshot&) = delete;
+	~UISnapshot();
+};
+
+// --------------------------------------------------------
+// Everything a frame needs to be drawn, copied out of the
+// game at the end of its update
+//  - Drawing reads nothing else that the update can change,
+//    so the next update can run while this one is drawn
+// --------------------------------------------------------
+struct FrameSnapshot
+{
+	unsigned int Frame;
+	float DeltaTime;
+	float TotalTime;
+	unsigned int Width;
+	unsigned int Height;
+	bool Vsync;
+
+	CameraSnapshot Camera;
+	std::vector<ObjectSnapshot> Objects;	// Everything, for the shadow pass
+	std::vector<unsigned int> Visible;		// Objects the camera may see, as indices into Objects
+	RenderQueue Queue;						// Draws for the visible objects, sorted when SortDraws is set
+	RenderQueue ShadowQueue;				// ...and for every object, grouped by mesh
+	std::vector<InstanceData> Instances;	// For both queues' instanced batches
+	std::vector<Light> Lights;
+
+	// Settings from the UI
+	bool MeshletCulling;
+	bool SortDraws;
+	bool ShadowPositionStream;
+	bool RingConstants;
+	unsigned int RecordThreads;
+	int BlurRadius;
+	UISnapshot UI;
+
+	RenderStats Stats; // Filled in by the renderer
+};
+
+// --------------------------------------------------------
+// Hands frame snapshots from one update thread to one render
+// thread, with two snapshots flipping between them
+//  - The update fills the back snapshot while the render
+//    thread draws the front one, so frame N+1 is simulated
+//    while frame N is drawn
+//  - Each side only waits when it gets a whole frame ahead
+//    of the other; the hand off itself is two atomic
+//    counters, with no locks
+//  - Every published frame is drawn exactly once, in order,
+//    so the output doesn't depend on thread timing
+// --------------------------------------------------------
+class FrameSnapshotQueue
+{
+public:
+	FrameSnapshotQueue();
+	FrameSnapshotQueue(const FrameSnapshotQueue&) = delete;
+	FrameSnapshotQueue& operator=(const FrameSnapshotQueue&) = delete;
+
+	// Update side: the next snapshot to fill (waiting until the renderer
+	// is done with it), then hands it over
+	// - Its Stats are still the renderer's from two frames ago
+	FrameSnapshot& BeginUpdate();
+	void Publish();
+
+	// Render side: the oldest published snapshot not yet drawn (waiting for
+	// one if needed), then gives it back
+	// - Returns nullptr once Close() has been called and everything
+	//   published has been drawn
+	FrameSnapshot* BeginRender();
+	void EndRender();
+
+	// Waits until every published snapshot has been drawn
+	void WaitForRender();
+
+	// Lets a waiting render thread finish, and Reopen() starts over
+	void Close();
+	void Reopen();
+
+	unsigned int GetPublishedCount();
+	unsigned int GetRenderedCount();
+
+private:
+	FrameSnapshot snapshots[2];
+	std::atomic<unsigned int> published;
+	std::atomic<unsigned int> rendered;
+	std::atomic<bool> closed;
+};
+
+// --------------------------------------------------------
+// Results from running the same simulation through the queue
+// on one thread and on two
+// --------------------------------------------------------
+struct SnapshotTestResult
+{
+	unsigned int FrameCount;
+	unsigned int ObjectCount;
+	double SerialMs;			// Update then render, one thread
+	double ThreadedMs;			// Update and render threads
+	unsigned int OverlappedFrames;	// Updates that started before the previous frame was drawn
+	bool Deterministic;			// Every frame drawn once, in order, identical to the serial run
+};
+
+// Runs a scripted scene (fixed time steps, no input) through update and render
+// threads with a null renderer that only hashes what it's given, and compares
+// those hashes with a run on a single thread
+SnapshotTestResult TestFrameSnapshots(unsigned int frameCount, unsigned int objectCount);
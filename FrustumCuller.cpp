@@ -0,0 +1,208 @@
+#include "FrustumCuller.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdint>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+	// Below this many groups of four per thread, culling stays on one thread
+	const size_t MinGroupsPerRange = 4096;
+
+	XMVECTOR LoadGroup(const std::vector<float>& values, size_t first) { return XMLoadFloat4((const XMFLOAT4*)&values[first]); }
+
+	double MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+// Clip space x, y and z come from the matrix's columns; each plane is
+// one of the -w <= x <= w, -w <= y <= w, 0 <= z <= w limits rearranged
+void ExtractFrustumPlanes(FXMMATRIX viewProjection, XMFLOAT4 planes[6])
+{
+	XMMATRIX columns = XMMatrixTranspose(viewProjection);
+	XMVECTOR unnormalized[6] =
+	{
+		columns.r[3] + columns.r[0],
+		columns.r[3] - columns.r[0],
+		columns.r[3] + columns.r[1],
+		columns.r[3] - columns.r[1],
+		columns.r[2],
+		columns.r[3] - columns.r[2],
+	};
+	for (int p = 0; p < 6; p++)
+		XMStoreFloat4(&planes[p], XMPlaneNormalize(unnormalized[p]));
+}
+
+FrustumCuller::FrustumCuller() :
+	count(0)
+{ }
+
+void FrustumCuller::Resize(unsigned int count)
+{
+	// A negative radius keeps padding (and unset spheres) out of every result
+	size_t padded = (count + 3) & ~3u;
+	for (auto* values : { &centerX, &centerY, &centerZ })
+		values->resize(padded, 0.0f);
+	radius.resize(padded, -FLT_MAX);
+	for (size_t i = count; i < padded; i++)
+		radius[i] = -FLT_MAX;
+	this->count = count;
+}
+
+void FrustumCuller::SetBounds(unsigned int index, const BoundingSphere& bounds)
+{
+	centerX[index] = bounds.Center.x;
+	centerY[index] = bounds.Center.y;
+	centerZ[index] = bounds.Center.z;
+	radius[index] = bounds.Radius;
+}
+
+unsigned int FrustumCuller::GetCount() { return count; }
+
+FrustumCullStats FrustumCuller::Cull(const XMFLOAT4 planes[6], std::vector<unsigned int>& visible)
+{
+	// Each plane's components, repeated across all four lanes
+	XMVECTOR a[6], b[6], c[6], d[6];
+	for (int p = 0; p < 6; p++)
+	{
+		XMVECTOR plane = XMLoadFloat4(&planes[p]);
+		a[p] = XMVectorSplatX(plane);
+		b[p] = XMVectorSplatY(plane);
+		c[p] = XMVectorSplatZ(plane);
+		d[p] = XMVectorSplatW(plane);
+	}
+
+	// Culls spheres [first, last) into out, returning how many were kept
+	auto cullRange = [&](size_t first, size_t last, unsigned int* out)
+	{
+		unsigned int kept = 0;
+		for (size_t group = first; group < last; group += 4)
+		{
+			XMVECTOR x = LoadGroup(centerX, group);
+			XMVECTOR y = LoadGroup(centerY, group);
+			XMVECTOR z = LoadGroup(centerZ, group);
+			XMVECTOR negativeRadius = -LoadGroup(radius, group);
+
+			// Inside unless the center is more than a radius behind some plane
+			XMVECTOR inside = XMVectorTrueInt();
+			for (int p = 0; p < 6; p++)
+				inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(x * a[p] + y * b[p] + z * c[p] + d[p], negativeRadius));
+
+			// Every index gets written, but only the kept ones are moved past,
+			// so there's no branch on the result
+			uint32_t mask[4];
+			XMStoreInt4(mask, inside);
+			for (unsigned int k = 0; k < 4; k++)
+			{
+				out[kept] = (unsigned int)group + k;
+				kept += mask[k] & 1;
+			}
+		}
+		return kept;
+	};
+
+	// Room for everything, then trimmed to what was kept; big sets are split
+	// into ranges culled as jobs, each into its own part of visible, and the
+	// parts closed up in order afterwards
+	visible.resize(centerX.size());
+	size_t groupCount = centerX.size() / 4;
+	size_t rangeCount = (std::min)((size_t)GetJobSystem().GetThreadCount(), groupCount / MinGroupsPerRange);
+	unsigned int kept = 0;
+	if (rangeCount < 2)
+		kept = cullRange(0, centerX.size(), visible.data());
+	else
+	{
+		std::vector<unsigned int> rangeKept(rangeCount);
+		RunParallel(rangeCount, [&](size_t r)
+		{
+			size_t first = groupCount * r / rangeCount * 4;
+			size_t last = groupCount * (r + 1) / rangeCount * 4;
+			rangeKept[r] = cullRange(first, last, &visible[first]);
+		});
+
+		for (size_t r = 0; r < rangeCount; r++)
+		{
+			size_t first = groupCount * r / rangeCount * 4;
+			if (first != kept)
+				std::copy(visible.begin() + first, visible.begin() + first + rangeKept[r], visible.begin() + kept);
+			kept += rangeKept[r];
+		}
+	}
+	visible.resize(kept);
+
+	FrustumCullStats stats = { count, count - kept };
+	return stats;
+}
+
+FrustumCullBenchmarkResult BenchmarkFrustumCulling(unsigned int objectCount)
+{
+	FrustumCullBenchmarkResult result = {};
+	result.ObjectCount = objectCount;
+
+	// A camera like the game's, in the middle of everything
+	XMMATRIX view = XMMatrixLookToLH(XMVectorSet(0, 1.5f, 0, 0), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0));
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.01f, 100.0f);
+	XMFLOAT4 planes[6];
+	ExtractFrustumPlanes(view * projection, planes);
+	BoundingFrustum frustum(projection);
+	frustum.Transform(frustum, XMMatrixInverse(0, view));
+
+	// Spheres all around and past the far plane, so most get culled
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(-150.0f, 150.0f);
+	std::uniform_real_distribution<float> size(0.1f, 3.0f);
+	std::vector<BoundingSphere> spheres(objectCount);
+	FrustumCuller culler;
+	culler.Resize(objectCount);
+	for (unsigned int i = 0; i < objectCount; i++)
+	{
+		spheres[i] = BoundingSphere(XMFLOAT3(position(random), position(random), position(random)), size(random));
+		culler.SetBounds(i, spheres[i]);
+	}
+
+	// One at a time, the way Camera::GetWorldFrustum() gets used
+	std::vector<unsigned int> referenceVisible;
+	referenceVisible.reserve(objectCount);
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i < objectCount; i++)
+		if (frustum.Intersects(spheres[i]))
+			referenceVisible.push_back(i);
+	result.ReferenceMs = MillisecondsSince(start);
+
+	std::vector<unsigned int> visible;
+	visible.reserve(objectCount + 4);
+	start = std::chrono::high_resolution_clock::now();
+	FrustumCullStats stats = culler.Cull(planes, visible);
+	result.CullMs = MillisecondsSince(start);
+	result.Culled = stats.Culled;
+
+	// The same test in plain floats, in the same order, should agree exactly
+	size_t next = 0;
+	for (unsigned int i = 0; i < objectCount; i++)
+	{
+		bool kept = next < visible.size() && visible[next] == i;
+		if (kept)
+			next++;
+
+		bool inside = true;
+		for (int p = 0; p < 6; p++)
+		{
+			const XMFLOAT4& plane = planes[p];
+			const XMFLOAT3& center = spheres[i].Center;
+			inside = inside && center.x * plane.x + center.y * plane.y + center.z * plane.z + plane.w >= -spheres[i].Radius;
+		}
+		if (inside != kept)
+			result.Mismatches++;
+		if (kept && !frustum.Intersects(spheres[i]))
+			result.Conservative++;
+	}
+
+	return result;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+
+// --------------------------------------------------------
+// The six planes bounding what a view-projection matrix can
+// see, as (normal, distance) with the normals pointing in,
+// so a point p is inside all of them when dot(n, p) + d >= 0
+//  - Left, right, bottom, top, near, far
+// --------------------------------------------------------
+void ExtractFrustumPlanes(DirectX::FXMMATRIX viewProjection, DirectX::XMFLOAT4 planes[6]);
+
+// --------------------------------------------------------
+// Objects looked at and thrown away by one Cull()
+// --------------------------------------------------------
+struct FrustumCullStats
+{
+	unsigned int Tested;
+	unsigned int Culled;
+};
+
+// --------------------------------------------------------
+// Timings and checks from culling random spheres both ways
+// --------------------------------------------------------
+struct FrustumCullBenchmarkResult
+{
+	unsigned int ObjectCount;
+	unsigned int Culled;
+	double ReferenceMs;		// BoundingFrustum::Intersects() one sphere at a time
+	double CullMs;			// FrustumCuller, four spheres at a time (split into jobs when there are plenty)
+	unsigned int Mismatches;	// Against the same plane test done one sphere at a time
+	unsigned int Conservative;	// Kept here, but rejected by BoundingFrustum (near corners)
+};
+
+// --------------------------------------------------------
+// Culls bounding spheres against a frustum four at a time
+//  - Spheres are stored as structure of arrays, so one SIMD
+//    register holds the same component of four spheres
+//  - A sphere is kept unless it's entirely behind a plane,
+//    which can keep a few near the frustum's corners that
+//    don't actually touch it, but never loses a visible one
+//  - Large sets are culled in ranges on the job system
+// --------------------------------------------------------
+class FrustumCuller
+{
+public:
+	FrustumCuller();
+
+	// Sets how many spheres there are (new ones are culled until set)
+	void Resize(unsigned int count);
+	void SetBounds(unsigned int index, const DirectX::BoundingSphere& bounds);
+	unsigned int GetCount();
+
+	// Replaces visible with the indices of every sphere that may be in view,
+	// in increasing order
+	FrustumCullStats Cull(const DirectX::XMFLOAT4 planes[6], std::vector<unsigned int>& visible);
+
+private:
+	unsigned int count;
+
+	// Padded to a whole number of groups of four
+	std::vector<float> centerX, centerY, centerZ, radius;
+};
+
+// Scatters objectCount random spheres around a camera and times culling them
+FrustumCullBenchmarkResult BenchmarkFrustumCulling(unsigned int objectCount);
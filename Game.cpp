@@ -4,7 +4,10 @@
 #include "PathHelpers.h"
 #include "SimpleShader.h"
 #include "WICTextureLoader.h"
+#include "VertexPacking.h"
 #include <memory>
+#include <chrono>
+#include <climits>
 
 #include "ImGui/imgui.h"
 #include "ImGui/imgui_impl_dx11.h"
@@ -17,6 +20,41 @@
 // For the DirectX Math library
 using namespace DirectX;
 
+// Fewer draws than this per thread aren't worth a deferred context
+static const unsigned int MinDrawsPerRecording = 256;
+
+// False loads textures the old way, one by one during Init(), to compare startups
+static const bool AsyncTextureLoading = true;
+
+static double MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Prints a self test's tally to the console, for when it was just run
+static void PrintTestResult(const char* name, const TestResult& result)
+{
+	printf("%s: %u checks, %u failed%s%s\n",
+		name,
+		result.Checks,
+		result.Failures,
+		result.FirstFailure ? ", first: " : "",
+		result.FirstFailure ? result.FirstFailure : "");
+}
+
+// Shows a self test's tally in the UI, once it has run at least once,
+// and returns whether it did so the caller can add the test's details
+static bool ShowTestResult(const TestResult& result)
+{
+	if (result.Checks == 0)
+		return false;
+
+	ImGui::Text("Checks: %u, failed: %u", result.Checks, result.Failures);
+	if (result.FirstFailure)
+		ImGui::Text("First failure: %s", result.FirstFailure);
+	return true;
+}
+
 // --------------------------------------------------------
 // Constructor
 //
@@ -33,13 +71,40 @@ Game::Game(HINSTANCE hInstance)
 		720,				// Height of the window's client area
 		false,				// Sync the framerate to the monitor refresh? (lock framerate)
 		true),				// Show extra stats (fps) in title bar?
-	cam(true),
 	ambientColor(0.0f, 0.1f, 0.25f),
-	shadowMapResolution(1024),
-	shadowProjectionSize(10.0f),
+	cam(true),
+	blurriness(0),
+	objParseBenchmark(),
+	meshOptimizerTest(),
+	tangentBenchmark(),
+	meshletCulling(true),
+	meshletSweep(),
+	frustumCulling(true),
+	frustumStats(),
+	frustumBenchmarks(),
+	sortDraws(true),
+	instancing(true),
+	ringConstants(true),
+	recordThreads(1),
+	lodPixelError(1.0f),
+	lodReport(false),
+	transformBenchmark(),
+	hierarchyBenchmark(),
+	snapshotTest(),
+	stateCacheTest(),
+	constantRingTest(),
+	recordingTest(),
+	jobSystemTest(),
+	jobSystemBenchmark(),
+	startup(),
+	startupPrinted(false),
+	threadedRendering(true),
+	renderStats(),
 	shadowViewMatrix(),
 	shadowProjectionMatrix(),
-	blurriness(0)
+	shadowMapResolution(1024),
+	shadowProjectionSize(10.0f),
+	shadowPositionStream(true)
 {
 #if defined(DEBUG) || defined(_DEBUG)
 	// Do we want a console window?  Probably only in debug mode
@@ -63,6 +128,9 @@ Game::~Game()
 	// Call Release() on any Direct3D objects made within this class
 	// - Note: this is unnecessary for D3D objects stored in ComPtrs
 
+	// Nothing can still be drawing once things start going away
+	StopRenderThread();
+
 	// ImGui clean up
 	ImGui_ImplDX11_Shutdown();
 	ImGui_ImplWin32_Shutdown();
@@ -75,6 +143,8 @@ Game::~Game()
 // --------------------------------------------------------
 void Game::Init()
 {
+	startupStart = std::chrono::high_resolution_clock::now();
+
 	// Initialize ImGui itself & platform/renderer backends
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
@@ -82,7 +152,15 @@ void Game::Init()
 	ImGui_ImplDX11_Init(device.Get(), context.Get());
 	ImGui::StyleColorsDark();
 
+	// Shaders, geometry and the renderer bind through this, so
+	// it has to exist before any of them
+	stateCache = std::make_shared<StateCache>(std::make_shared<D3D11RenderContext>(context));
+	constantRing = std::make_shared<ConstantBufferRing>(device, context, stateCache, 4 * 1024 * 1024);
+	deferredContexts = std::make_shared<DeferredRecordingTarget>(device, context, std::thread::hardware_concurrency());
+	recordThreads = (int)(std::max)(1u, (std::min)(4u, deferredContexts->GetContextCount()));
+
 	LoadShaders();
+	startup.Shaders = MillisecondsSince(startupStart);
 	CreateGeometry();
 	CreateLight();
 	CreateShadowMap();
@@ -95,7 +173,7 @@ void Game::Init()
 		// Tell the input assembler (IA) stage of the pipeline what kind of
 		// geometric primitives (points, lines or triangles) we want to draw.  
 		// Essentially: "What kind of shape should the GPU draw with our vertices?"
-		context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		stateCache->SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 	}
 
 	// Make camera
@@ -118,6 +196,8 @@ void Game::Init()
 		0.01f,								// Near clip
 		100.0f								// Far clip
 	);
+
+	startup.Init = MillisecondsSince(startupStart);
 }
 
 // --------------------------------------------------------
@@ -137,6 +217,62 @@ void Game::LoadShaders()
 	skyPS = std::make_shared<SimplePixelShader>(device, context, FixPath(L"SkyPS.cso").c_str());
 	ppVS = std::make_shared<SimpleVertexShader>(device, context, FixPath(L"FullscreenVS.cso").c_str());
 	ppPS = std::make_shared<SimplePixelShader>(device, context, FixPath(L"PostProcessPS.cso").c_str());
+	shadowVS = std::make_shared<SimpleVertexShader>(device, context, FixPath(L"ShadowVS.cso").c_str());
+
+	// Reflection can't tell packed formats apart from full floats, so
+	// the packed shaders get an explicit input layout instead, made
+	// from a mesh layout plus any per-instance elements
+	auto createInputLayout = [&](const wchar_t* shaderFile, const D3D11_INPUT_ELEMENT_DESC* meshLayout, unsigned int meshElements, unsigned int instanceElements)
+	{
+		std::vector<D3D11_INPUT_ELEMENT_DESC> elements(meshLayout, meshLayout + meshElements);
+		elements.insert(elements.end(), InstanceLayout, InstanceLayout + instanceElements);
+
+		Microsoft::WRL::ComPtr<ID3DBlob> blob;
+		Microsoft::WRL::ComPtr<ID3D11InputLayout> layout;
+		D3DReadFileToBlob(FixPath(shaderFile).c_str(), blob.GetAddressOf());
+		device->CreateInputLayout(
+			&elements[0],
+			(unsigned int)elements.size(),
+			blob->GetBufferPointer(),
+			blob->GetBufferSize(),
+			layout.GetAddressOf());
+		return layout;
+	};
+
+	// Both packed shaders take the same input struct, so they can share the layout
+	Microsoft::WRL::ComPtr<ID3D11InputLayout> packedInputLayout = createInputLayout(L"VertexShaderPacked.cso", PackedVertexLayout, ARRAYSIZE(PackedVertexLayout), 0);
+	packedVertexShader = std::make_shared<SimpleVertexShader>(device, context, FixPath(L"VertexShaderPacked.cso").c_str(), packedInputLayout, false);
+	shadowPackedVS = std::make_shared<SimpleVertexShader>(device, context, FixPath(L"ShadowVSPacked.cso").c_str(), packedInputLayout, false);
+
+	// Position-only streams for depth passes, where the packed one
+	// needs its UNORM16 format spelled out the same way
+	shadowPositionVS = std::make_shared<SimpleVertexShader>(device, context, FixPath(L"ShadowVSPosition.cso").c_str());
+	Microsoft::WRL::ComPtr<ID3D11InputLayout> packedPositionInputLayout = createInputLayout(L"ShadowVSPackedPosition.cso", PackedPositionLayout, ARRAYSIZE(PackedPositionLayout), 0);
+	shadowPackedPositionVS = std::make_shared<SimpleVertexShader>(device, context, FixPath(L"ShadowVSPackedPosition.cso").c_str(), packedPositionInputLayout, false);
+
+	// Instanced versions of all of the above, reading matrices from input slot 1
+	// (reflection spots the _PER_INSTANCE semantics, so only packed ones need help)
+	instancedVS = std::make_shared<SimpleVertexShader>(device, context, FixPath(L"VertexShaderInstanced.cso").c_str());
+	shadowInstancedVS = std::make_shared<SimpleVertexShader>(device, context, FixPath(L"ShadowVSInstanced.cso").c_str());
+	shadowPositionInstancedVS = std::make_shared<SimpleVertexShader>(device, context, FixPath(L"ShadowVSPositionInstanced.cso").c_str());
+
+	packedInstancedVS = std::make_shared<SimpleVertexShader>(device, context, FixPath(L"VertexShaderPackedInstanced.cso").c_str(),
+		createInputLayout(L"VertexShaderPackedInstanced.cso", PackedVertexLayout, ARRAYSIZE(PackedVertexLayout), 8), true);
+	shadowPackedInstancedVS = std::make_shared<SimpleVertexShader>(device, context, FixPath(L"ShadowVSPackedInstanced.cso").c_str(),
+		createInputLayout(L"ShadowVSPackedInstanced.cso", PackedVertexLayout, ARRAYSIZE(PackedVertexLayout), 4), true);
+	shadowPackedPositionInstancedVS = std::make_shared<SimpleVertexShader>(device, context, FixPath(L"ShadowVSPackedPositionInstanced.cso").c_str(),
+		createInputLayout(L"ShadowVSPackedPositionInstanced.cso", PackedPositionLayout, ARRAYSIZE(PackedPositionLayout), 4), true);
+
+	// Everything the shaders bind goes through the state cache
+	std::shared_ptr<ISimpleShader> shaders[] =
+	{
+		vertexShader, pixelShader, customPS, skyVS, skyPS, ppVS, ppPS,
+		packedVertexShader, instancedVS, packedInstancedVS,
+		shadowVS, shadowPackedVS, shadowPositionVS, shadowPackedPositionVS,
+		shadowInstancedVS, shadowPackedInstancedVS, shadowPositionInstancedVS, shadowPackedPositionInstancedVS
+	};
+	for (std::shared_ptr<ISimpleShader>& shader : shaders)
+		shader->SetRenderContext(stateCache);
 }
 
 // --------------------------------------------------------
@@ -170,121 +306,90 @@ void Game::CreateGeometry()
 	ppSampDesc.MaxLOD = D3D11_FLOAT32_MAX;
 	device->CreateSamplerState(&ppSampDesc, ppSampler.GetAddressOf());
 
-	// Load texture
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cobbleA, cobbleN, cobbleR, cobbleM;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> floorA, floorN, floorR, floorM;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> paintA, paintN, paintR, paintM;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> scratchedA, scratchedN, scratchedR, scratchedM;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bronzeA, bronzeN, bronzeR, bronzeM;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> roughA, roughN, roughR, roughM;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> woodA, woodN, woodR, woodM;
-
-// From demo - Quick pre-processor macro for simplifying texture loading calls below
-#define LoadTexture(path, srv) CreateWICTextureFromFile(device.Get(), context.Get(), FixPath(path).c_str(), 0, srv.GetAddressOf());
-
-	LoadTexture(L"../../Assets/Textures/cobblestone_albedo.png", cobbleA);
-	LoadTexture(L"../../Assets/Textures/cobblestone_normals.png", cobbleN);
-	LoadTexture(L"../../Assets/Textures/cobblestone_roughness.png", cobbleR);
-	LoadTexture(L"../../Assets/Textures/cobblestone_metal.png", cobbleM);
-
-	LoadTexture(L"../../Assets/Textures/floor_albedo.png", floorA);
-	LoadTexture(L"../../Assets/Textures/floor_normals.png", floorN);
-	LoadTexture(L"../../Assets/Textures/floor_roughness.png", floorR);
-	LoadTexture(L"../../Assets/Textures/floor_metal.png", floorM);
-
-	LoadTexture(L"../../Assets/Textures/paint_albedo.png", paintA);
-	LoadTexture(L"../../Assets/Textures/paint_normals.png", paintN);
-	LoadTexture(L"../../Assets/Textures/paint_roughness.png", paintR);
-	LoadTexture(L"../../Assets/Textures/paint_metal.png", paintM);
-
-	LoadTexture(L"../../Assets/Textures/scratched_albedo.png", scratchedA);
-	LoadTexture(L"../../Assets/Textures/scratched_normals.png", scratchedN);
-	LoadTexture(L"../../Assets/Textures/scratched_roughness.png", scratchedR);
-	LoadTexture(L"../../Assets/Textures/scratched_metal.png", scratchedM);
-
-	LoadTexture(L"../../Assets/Textures/bronze_albedo.png", bronzeA);
-	LoadTexture(L"../../Assets/Textures/bronze_normals.png", bronzeN);
-	LoadTexture(L"../../Assets/Textures/bronze_roughness.png", bronzeR);
-	LoadTexture(L"../../Assets/Textures/bronze_metal.png", bronzeM);
-
-	LoadTexture(L"../../Assets/Textures/rough_albedo.png", roughA);
-	LoadTexture(L"../../Assets/Textures/rough_normals.png", roughN);
-	LoadTexture(L"../../Assets/Textures/rough_roughness.png", roughR);
-	LoadTexture(L"../../Assets/Textures/rough_metal.png", roughM);
-
-	LoadTexture(L"../../Assets/Textures/wood_albedo.png", woodA);
-	LoadTexture(L"../../Assets/Textures/wood_normals.png", woodN);
-	LoadTexture(L"../../Assets/Textures/wood_roughness.png", woodR);
-	LoadTexture(L"../../Assets/Textures/wood_metal.png", woodM);
-	
-	// Load meshes
-	std::shared_ptr<Mesh> cubeMesh = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/cube.obj").c_str(), device);
-	std::shared_ptr<Mesh> cylinderMesh = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/cylinder.obj").c_str(), device);
-	std::shared_ptr<Mesh> helixMesh = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/helix.obj").c_str(), device);
-	std::shared_ptr<Mesh> sphereMesh = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/sphere.obj").c_str(), device);
-	std::shared_ptr<Mesh> torusMesh = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/torus.obj").c_str(), device);
-	std::shared_ptr<Mesh> quadMesh = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/quad.obj").c_str(), device);
-	std::shared_ptr<Mesh> quadDSMesh = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/quad_double_sided.obj").c_str(), device);
-	meshes.insert(meshes.end(), { cubeMesh, cylinderMesh, helixMesh, sphereMesh, torusMesh, quadMesh, quadDSMesh });
+	// Load textures
+	//  - Every material's maps decode on the texture loader's threads while
+	//    the meshes load below, and the materials draw with flat placeholders
+	//    until they land (see ApplyLoadedTextures())
+	textureLoader = std::make_shared<TextureLoader>(device);
+	const char* mapNames[4] = { "Albedo", "NormalMap", "RoughnessMap", "MetalnessMap" };
+	const wchar_t* mapFiles[4] = { L"albedo", L"normals", L"roughness", L"metal" };
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> placeholders[4] =
+	{
+		textureLoader->CreateSolidTexture(128, 128, 128, 255),	// Grey
+		textureLoader->CreateSolidTexture(128, 128, 255, 255),	// Flat
+		textureLoader->CreateSolidTexture(255, 255, 255, 255),	// Fully rough
+		textureLoader->CreateSolidTexture(0, 0, 0, 255),		// Not metal
+	};
 
-	// Create materials
-	// Cobblestone
-	std::shared_ptr<Material> cobbleMat = std::make_shared<Material>(pixelShader, vertexShader);
-	cobbleMat->AddSampler("BasicSampler", sampler);
-	cobbleMat->AddTextureSRV("Albedo", cobbleA);
-	cobbleMat->AddTextureSRV("NormalMap", cobbleN);
-	cobbleMat->AddTextureSRV("RoughnessMap", cobbleR);
-	cobbleMat->AddTextureSRV("MetalnessMap", cobbleM);
-
-	// Floor
-	std::shared_ptr<Material> floorMat = std::make_shared<Material>(pixelShader, vertexShader);
-	floorMat->AddSampler("BasicSampler", sampler);
-	floorMat->AddTextureSRV("Albedo", floorA);
-	floorMat->AddTextureSRV("NormalMap", floorN);
-	floorMat->AddTextureSRV("RoughnessMap", floorR);
-	floorMat->AddTextureSRV("MetalnessMap", floorM);
-
-	// Paint
-	std::shared_ptr<Material> paintMat = std::make_shared<Material>(pixelShader, vertexShader);
-	paintMat->AddSampler("BasicSampler", sampler);
-	paintMat->AddTextureSRV("Albedo", paintA);
-	paintMat->AddTextureSRV("NormalMap", paintN);
-	paintMat->AddTextureSRV("RoughnessMap", paintR);
-	paintMat->AddTextureSRV("MetalnessMap", paintM);
-
-	// Scratched metal
-	std::shared_ptr<Material> scratchedMat = std::make_shared<Material>(pixelShader, vertexShader);
-	scratchedMat->AddSampler("BasicSampler", sampler);
-	scratchedMat->AddTextureSRV("Albedo", scratchedA);
-	scratchedMat->AddTextureSRV("NormalMap", scratchedN);
-	scratchedMat->AddTextureSRV("RoughnessMap", scratchedR);
-	scratchedMat->AddTextureSRV("MetalnessMap", scratchedM);
-
-	// Bronze
-	std::shared_ptr<Material> bronzeMat = std::make_shared<Material>(pixelShader, vertexShader);
-	bronzeMat->AddSampler("BasicSampler", sampler);
-	bronzeMat->AddTextureSRV("Albedo", bronzeA);
-	bronzeMat->AddTextureSRV("NormalMap", bronzeN);
-	bronzeMat->AddTextureSRV("RoughnessMap", bronzeR);
-	bronzeMat->AddTextureSRV("MetalnessMap", bronzeM);
-
-	// Rough
-	std::shared_ptr<Material> roughMat = std::make_shared<Material>(pixelShader, vertexShader);
-	roughMat->AddSampler("BasicSampler", sampler);
-	roughMat->AddTextureSRV("Albedo", roughA);
-	roughMat->AddTextureSRV("NormalMap", roughN);
-	roughMat->AddTextureSRV("RoughnessMap", roughR);
-	roughMat->AddTextureSRV("MetalnessMap", roughM);
-
-	// Wood
-	std::shared_ptr<Material> woodMat = std::make_shared<Material>(pixelShader, vertexShader);
-	woodMat->AddSampler("BasicSampler", sampler);
-	woodMat->AddTextureSRV("Albedo", woodA);
-	woodMat->AddTextureSRV("NormalMap", woodN);
-	woodMat->AddTextureSRV("RoughnessMap", woodR);
-	woodMat->AddTextureSRV("MetalnessMap", woodM);
+	auto loadTextures = [&](std::shared_ptr<Material> material, const std::wstring& name)
+	{
+		for (int m = 0; m < 4; m++)
+		{
+			std::wstring path = FixPath(L"../../Assets/Textures/" + name + L"_" + mapFiles[m] + L".png");
+			if (AsyncTextureLoading)
+			{
+				std::shared_ptr<TextureHandle> texture = textureLoader->Load(path, placeholders[m]);
+				material->AddTextureSRV(mapNames[m], texture->GetSRV());
+				pendingTextures.push_back({ material, mapNames[m], texture });
+			}
+			else
+			{
+				Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+				CreateWICTextureFromFile(device.Get(), context.Get(), path.c_str(), 0, srv.GetAddressOf());
+				material->AddTextureSRV(mapNames[m], srv);
+			}
+		}
+	};
 
+	// Create materials
+	std::shared_ptr<Material> cobbleMat = std::make_shared<Material>(pixelShader, vertexShader, packedVertexShader);
+	std::shared_ptr<Material> floorMat = std::make_shared<Material>(pixelShader, vertexShader, packedVertexShader);
+	std::shared_ptr<Material> paintMat = std::make_shared<Material>(pixelShader, vertexShader, packedVertexShader);
+	std::shared_ptr<Material> scratchedMat = std::make_shared<Material>(pixelShader, vertexShader, packedVertexShader);
+	std::shared_ptr<Material> bronzeMat = std::make_shared<Material>(pixelShader, vertexShader, packedVertexShader);
+	std::shared_ptr<Material> roughMat = std::make_shared<Material>(pixelShader, vertexShader, packedVertexShader);
+	std::shared_ptr<Material> woodMat = std::make_shared<Material>(pixelShader, vertexShader, packedVertexShader);
 	materials.insert(materials.end(), { cobbleMat, floorMat, paintMat, scratchedMat, bronzeMat, roughMat, woodMat });
+	for (auto& m : materials)
+		m->AddSampler("BasicSampler", sampler);
+
+	loadTextures(cobbleMat, L"cobblestone");
+	loadTextures(floorMat, L"floor");
+	loadTextures(paintMat, L"paint");
+	loadTextures(scratchedMat, L"scratched");
+	loadTextures(bronzeMat, L"bronze");
+	loadTextures(roughMat, L"rough");
+	loadTextures(woodMat, L"wood");
+	startup.TexturesQueued = MillisecondsSince(startupStart);
+	if (!AsyncTextureLoading)
+		startup.TexturesLoaded = startup.TexturesQueued;
+
+	// Load meshes
+	// - Each OBJ is cooked to a binary .mesh file on first load, and later
+	//   launches map that file instead (delete the .mesh files to compare)
+	// - The cube stays full precision since the sky's shader reads it too
+	// - All of them share the arena's buffers, created once they're loaded
+	auto meshLoadStart = std::chrono::high_resolution_clock::now();
+	geometryArena = std::make_shared<GeometryArena>();
+	geometryArena->SetRenderContext(stateCache);
+	std::shared_ptr<Mesh> cubeMesh = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/cube.obj").c_str(), device, geometryArena);
+	std::shared_ptr<Mesh> cylinderMesh = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/cylinder.obj").c_str(), device, geometryArena, VertexFormat::Packed);
+	std::shared_ptr<Mesh> helixMesh = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/helix.obj").c_str(), device, geometryArena, VertexFormat::Packed);
+	std::shared_ptr<Mesh> sphereMesh = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/sphere.obj").c_str(), device, geometryArena, VertexFormat::Packed);
+	std::shared_ptr<Mesh> torusMesh = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/torus.obj").c_str(), device, geometryArena, VertexFormat::Packed);
+	std::shared_ptr<Mesh> quadMesh = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/quad.obj").c_str(), device, geometryArena, VertexFormat::Packed);
+	std::shared_ptr<Mesh> quadDSMesh = std::make_shared<Mesh>(FixPath(L"../../Assets/Models/quad_double_sided.obj").c_str(), device, geometryArena, VertexFormat::Packed);
+	meshes.insert(meshes.end(), { cubeMesh, cylinderMesh, helixMesh, sphereMesh, torusMesh, quadMesh, quadDSMesh });
+	geometryArena->Build(device);
+	printf("Loaded %zu meshes in %.2f ms\n", meshes.size(),
+		std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - meshLoadStart).count());
+	startup.Meshes = MillisecondsSince(startupStart);
+
+	for (auto& m : materials)
+	{
+		m->SetVertexShader(instancedVS, VertexFormat::Full, true);
+		m->SetVertexShader(packedInstancedVS, VertexFormat::Packed, true);
+	}
 
 	// Create entities
 	entities.push_back(std::make_shared<GameEntity>(cubeMesh, cobbleMat));
@@ -487,12 +592,13 @@ void Game::CreateShadowMap()
 
 }
 
-void Game::RenderShadowMap()
+void Game::RenderShadowMap(FrameSnapshot& frame)
 {
 	// Initial pipeline setup - No RTV necessary - Clear shadow map
 	context->OMSetRenderTargets(0, 0, shadowDSV.Get());
 	context->ClearDepthStencilView(shadowDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
-	context->RSSetState(shadowRasterizer.Get());
+	stateCache->SetRasterizerState(shadowRasterizer.Get());
+	stateCache->SetDepthStencilState(0, 0);
 
 	// Change viewport
 	D3D11_VIEWPORT viewport = {};
@@ -501,27 +607,73 @@ void Game::RenderShadowMap()
 	viewport.MaxDepth = 1.0f;
 	context->RSSetViewports(1, &viewport);
 
-	// Turn on ShadowVS
-	std::shared_ptr<SimpleVertexShader> shadowVS = std::make_shared<SimpleVertexShader>(device, context, FixPath(L"ShadowVS.cso").c_str());
-	shadowVS->SetShader();
-	shadowVS->SetMatrix4x4("view", shadowViewMatrix);
-	shadowVS->SetMatrix4x4("projection", shadowProjectionMatrix);
-	context->PSSetShader(0, 0, 0);
+	// Set up every version of the shadow VS, uploading the light's matrices once
+	for (auto& vs : {
+		shadowVS, shadowPackedVS, shadowPositionVS, shadowPackedPositionVS,
+		shadowInstancedVS, shadowPackedInstancedVS, shadowPositionInstancedVS, shadowPackedPositionInstancedVS })
+	{
+		vs->SetMatrix4x4("view", shadowViewMatrix);
+		vs->SetMatrix4x4("projection", shadowProjectionMatrix);
+		vs->CopyBufferData("PerFrame");
+	}
+	stateCache->SetPixelShader(0);
 
-	// Loop and draw all entities
-	for (auto& e : entities)
+	// Loop and draw all entities, a batch (same mesh and level of detail) at a time
+	const std::vector<DrawPacket>& packets = frame.ShadowQueue.GetPackets();
+	for (const DrawBatch& batch : frame.ShadowQueue.GetBatches())
 	{
-		shadowVS->SetMatrix4x4("world", e->GetTransform()->GetWorldMatrix());
-		shadowVS->CopyAllBufferData();
+		// Pick the shader matching the stream, the mesh's vertex layout and instancing
+		ObjectSnapshot& first = frame.Objects[packets[batch.First].Object];
+		std::shared_ptr<Mesh> mesh = entities[first.Entity]->GetMesh();
+		bool positionsOnly = frame.ShadowPositionStream && mesh->HasPositionStream();
+		bool packed = mesh->GetVertexFormat() == VertexFormat::Packed;
+		std::shared_ptr<SimpleVertexShader> vs = batch.Instanced ?
+			(positionsOnly ? (packed ? shadowPackedPositionInstancedVS : shadowPositionInstancedVS) :
+			(packed ? shadowPackedInstancedVS : shadowInstancedVS)) :
+			(positionsOnly ? (packed ? shadowPackedPositionVS : shadowPositionVS) :
+			(packed ? shadowPackedVS : shadowVS));
+		if (packed)
+		{
+			vs->SetFloat3("positionScale", mesh->GetPositionScale());
+			vs->SetFloat3("positionOffset", mesh->GetPositionOffset());
+			vs->CopyBufferData("PerMesh");
+		}
+		vs->SetShader();
+		const SimpleConstantBuffer* perObject = vs->GetBufferInfo("PerObject");
 
 		// Draw the mesh directly to avoid the entity's material
 		// Note: Your code may differ significantly here!
-		e->GetMesh()->Draw(context);
+		if (batch.Instanced)
+		{
+			if (positionsOnly)
+				mesh->DrawPositionsInstanced(context, first.Lod, batch.Count, batch.FirstInstance);
+			else
+				mesh->DrawInstanced(context, first.Lod, batch.Count, batch.FirstInstance);
+			frame.Stats.ShadowDraws++;
+		}
+		else
+		{
+			for (unsigned int p = batch.First; p < batch.First + batch.Count; p++)
+			{
+				ObjectSnapshot& object = frame.Objects[packets[p].Object];
+				vs->SetMatrix4x4("world", object.World);
+				if (!frame.RingConstants || !constantRing->Upload(ShaderStage::Vertex, perObject))
+					vs->CopyBufferData("PerObject");
+				if (positionsOnly)
+					mesh->DrawPositions(context, object.Lod);
+				else
+					mesh->Draw(context, object.Lod);
+				frame.Stats.ShadowDraws++;
+			}
+		}
+
+		frame.Stats.ShadowVertexBytes += batch.Count * (positionsOnly ? mesh->GetPositionStreamBytes() : mesh->GetVertexStreamBytes());
+		frame.Stats.ShadowFullVertexBytes += batch.Count * mesh->GetVertexStreamBytes();
 	}
 
 	// Go back to the screen
-	viewport.Width = (float)this->windowWidth;
-	viewport.Height = (float)this->windowHeight;
+	viewport.Width = (float)frame.Width;
+	viewport.Height = (float)frame.Height;
 	context->RSSetViewports(1, &viewport);
 	context->OMSetRenderTargets(
 		1,
@@ -536,13 +688,84 @@ void Game::SetupUI()
 	{
 		ImGui::Text("Frame rate: %i fps", (int)ImGui::GetIO().Framerate);
 		ImGui::Text("Window size: %i x %i", windowWidth, windowHeight);
+
+		// Milliseconds from the start of Init(); textures keep landing after the first frame
+		StartupTimeline startupTimes = renderStats.Startup;
+		ImGui::Text("Startup: shaders %.0f, meshes %.0f, init %.0f, first frame %.0f ms", startupTimes.Shaders, startupTimes.Meshes, startupTimes.Init, startupTimes.FirstFrame);
+		if (renderStats.TexturesLoading > 0)
+			ImGui::Text("Textures loading: %u", renderStats.TexturesLoading);
+		else
+			ImGui::Text("Every texture in after %.0f ms", startupTimes.TexturesLoaded);
+
+		ImGui::Text("Transforms updated: %u / %u", TransformSystem::GetInstance().GetLastUpdateCount(), TransformSystem::GetInstance().GetCount());
+
+		ImGui::Checkbox("Render on its own thread", &threadedRendering);
+
+		// Per-mesh buffers would need both buffers bound for every draw
+		GeometryBindStats binds = renderStats.Binds;
+		ImGui::Text("IA buffer binds: %u (%u with per-mesh buffers)", binds.VertexBufferBinds + binds.IndexBufferBinds, binds.Draws * 2);
+		ImGui::Text("Geometry arena: %u pools, %.1f KB", geometryArena->GetPoolCount(), (geometryArena->GetVertexBytes() + geometryArena->GetIndexBytes()) / 1024.0f);
+
+		ImGui::Checkbox("Sort draws", &sortDraws);
+		RenderBindStats pipeline = renderStats.Pipeline;
+		ImGui::Text("Draws: %u, shader binds: %u VS / %u PS", pipeline.Draws, pipeline.VertexShaderBinds, pipeline.PixelShaderBinds);
+		ImGui::Text("SRV binds: %u, sampler binds: %u, input layout binds: %u", pipeline.ShaderResourceBinds, pipeline.SamplerBinds, pipeline.InputLayoutBinds);
+
+		// Every pass, before and after the state cache drops what's already bound
+		StateCacheStats state = renderStats.State;
+		ImGui::Text("State calls: %u submitted, %u forwarded", state.TotalSubmitted(), state.TotalForwarded());
+		ImGui::Text("Constant data uploaded: %.1f KB in %u uploads", state.ConstantBytes / 1024.0f, state.ConstantUploads);
+		if (ImGui::TreeNode("State calls by kind (forwarded / submitted)"))
+		{
+			for (int c = 0; c < (int)StateCall::Count; c++)
+				ImGui::Text("%s: %u / %u", StateCallNames[c], state.Forwarded[c], state.Submitted[c]);
+			ImGui::TreePop();
+		}
+
+		// Per-object constants suballocated from one buffer, instead of uploaded to each shader's own
+		if (constantRing->IsSupported())
+		{
+			ConstantBufferRingStats ring = renderStats.Ring;
+			ImGui::Checkbox("Per-object constants from a ring", &ringConstants);
+			ImGui::Text("Ring: %u uploads, %.1f KB, %u wraps, %u discards", ring.Uploads, ring.Bytes / 1024.0f, ring.Wraps, ring.Discards);
+			ImGui::Text("Ring in use: %.1f KB, %u frames in flight", ring.UsedBytes / 1024.0f, ring.FramesInFlight);
+		}
+		else
+			ImGui::Text("Constant buffer ring: needs Direct3D 11.1 offsets");
+
+		// Main pass draws split across deferred contexts, recorded at once
+		if (deferredContexts->GetContextCount() > 1)
+		{
+			RecordingStats recording = renderStats.Recording;
+			ImGui::SliderInt("Recording threads", &recordThreads, 1, (int)deferredContexts->GetContextCount());
+			if (recording.Ranges > 0)
+			{
+				ImGui::Text("Recorded %u ranges in %.2f ms, executed in %.2f ms", recording.Ranges, recording.RecordMs, recording.ExecuteMs);
+				ImGui::Text("Largest range: %u of %u draws' cost", recording.LargestCost, recording.TotalCost);
+			}
+			else
+				ImGui::Text("Recorded on the immediate context (under %u draws per thread)", MinDrawsPerRecording);
+		}
+		else
+			ImGui::Text("Parallel recording: no deferred contexts");
+
+		ImGui::Checkbox("Instancing", &instancing);
+		ImGui::Text("Instanced draws: %u (%u entities), shadow pass draws: %u", pipeline.InstancedDraws, pipeline.Instances, renderStats.ShadowDraws);
+
+		ImGui::Checkbox("Position-only shadow stream", &shadowPositionStream);
+		ImGui::Text("Shadow pass vertex data: %.1f KB (%.1f KB with full vertices)", renderStats.ShadowVertexBytes / 1024.0f, renderStats.ShadowFullVertexBytes / 1024.0f);
 		ImGui::TreePop();
 	}
 
 	// Entities
 	if (ImGui::TreeNode("Entities"))
 	{
-		for (int i = 0; i < entities.size(); i++)
+		if (ImGui::Button("Add 100k cubes"))
+			AddCrowd(100000);
+
+		// Only the first few get their own node, so a crowd doesn't flood the list
+		const int listed = 64;
+		for (int i = 0; i < entities.size() && i < listed; i++)
 		{
 			ImGui::PushID(i);
 			if (ImGui::TreeNode("Entity", "Entity %i", i))
@@ -558,12 +781,38 @@ void Game::SetupUI()
 				if (ImGui::DragFloat3("Rotation (Radians)", &rot.x, 0.01f)) trans->SetRotation(rot);
 				if (ImGui::DragFloat3("Scale", &sc.x, 0.01f)) trans->SetScale(sc);
 
+				// Attach to another entity (-1 for none); position, rotation
+				// and scale above are then relative to it
+				int parent = -1;
+				unsigned int parentId = TransformSystem::GetInstance().GetParent(trans->GetId());
+				for (int p = 0; p < entities.size(); p++)
+					if (entities[p]->GetTransform()->GetId() == parentId)
+						parent = p;
+				if (ImGui::InputInt("Parent entity", &parent))
+				{
+					bool attached = parent >= 0 && parent < entities.size() ?
+						trans->SetParent(entities[parent]->GetTransform()) :
+						trans->SetParent(nullptr);
+					if (!attached)
+						printf("Entity %i can't be attached under its own child\n", i);
+				}
+
+				BoundingBox bounds = entities[i]->GetWorldBoundingBox();
+				ImGui::Text("World bounds center: %.2f, %.2f, %.2f", bounds.Center.x, bounds.Center.y, bounds.Center.z);
+				ImGui::Text("World bounds extents: %.2f, %.2f, %.2f", bounds.Extents.x, bounds.Extents.y, bounds.Extents.z);
+
+				const std::vector<MeshLod>& lods = entities[i]->GetMesh()->GetLods();
+				unsigned int lod = entities[i]->GetLod();
+				ImGui::Text("LOD: %u / %u (%u triangles)", lod, (unsigned int)lods.size() - 1, lods[lod].IndexCount / 3);
+
 				ImGui::Spacing();
 
 				ImGui::TreePop();
 			}
 			ImGui::PopID();
 		}
+		if (entities.size() > listed)
+			ImGui::Text("...and %zu more", entities.size() - listed);
 		ImGui::TreePop();
 	}
 
@@ -608,8 +857,396 @@ void Game::SetupUI()
 		ImGui::SliderInt("Blurriness", &blurriness, 0, 10);
 		ImGui::TreePop();
 	}
+
+	// Meshlet culling
+	if (ImGui::TreeNode("Culling"))
+	{
+		ImGui::Checkbox("Frustum culling", &frustumCulling);
+		ImGui::Text("Entities culled: %u / %u", frustumStats.Culled, frustumStats.Tested);
+
+		ImGui::Checkbox("Meshlet culling", &meshletCulling);
+		MeshletCullStats meshletStats = renderStats.Meshlets;
+		if (meshletCulling && meshletStats.Total > 0)
+		{
+			unsigned int drawn = meshletStats.Total - meshletStats.Backfacing - meshletStats.Outside;
+			ImGui::Text("Meshlets drawn: %u / %u", drawn, meshletStats.Total);
+			ImGui::Text("Backfacing: %u, off screen: %u", meshletStats.Backfacing, meshletStats.Outside);
+		}
+
+		if (ImGui::Button("Camera sweep"))
+		{
+			meshletSweep = SweepMeshletCulling(36);
+			printf("Meshlet cull sweep, %u tests: %.1f%% backfacing, %.1f%% off screen, %.1f%% culled in total\n",
+				meshletSweep.Total,
+				100.0 * meshletSweep.Backfacing / meshletSweep.Total,
+				100.0 * meshletSweep.Outside / meshletSweep.Total,
+				100.0 * (meshletSweep.Backfacing + meshletSweep.Outside) / meshletSweep.Total);
+		}
+
+		if (meshletSweep.Total > 0)
+		{
+			ImGui::Text("Average backfacing: %.1f%%", 100.0f * meshletSweep.Backfacing / meshletSweep.Total);
+			ImGui::Text("Average off screen: %.1f%%", 100.0f * meshletSweep.Outside / meshletSweep.Total);
+			ImGui::Text("Average culled: %.1f%%", 100.0f * (meshletSweep.Backfacing + meshletSweep.Outside) / meshletSweep.Total);
+		}
+
+		ImGui::Spacing();
+		ImGui::SliderFloat("LOD error (pixels)", &lodPixelError, 0.1f, 16.0f, "%.1f");
+		ImGui::TreePop();
+	}
+
+	// Benchmarks
+	if (ImGui::TreeNode("Benchmarks"))
+	{
+		if (ImGui::Button("OBJ parsing (300 MB generated file)"))
+		{
+			objParseBenchmark = BenchmarkObjParsing(300u << 20);
+			double megabytes = objParseBenchmark.Bytes / (1024.0 * 1024.0);
+			printf("OBJ parse benchmark, %.1f MB, %u triangles (generated in %.0f ms): serial %.2f ms (%.1f MB/s, %.2f M triangles/s), %u threads %.2f ms (%.1f MB/s, %.2f M triangles/s, %.2fx), identical: %s\n",
+				megabytes,
+				objParseBenchmark.TriangleCount,
+				objParseBenchmark.GenerateMs,
+				objParseBenchmark.SerialMs,
+				megabytes / objParseBenchmark.SerialMs * 1000.0,
+				objParseBenchmark.TriangleCount / objParseBenchmark.SerialMs / 1000.0,
+				objParseBenchmark.ThreadCount,
+				objParseBenchmark.ParallelMs,
+				megabytes / objParseBenchmark.ParallelMs * 1000.0,
+				objParseBenchmark.TriangleCount / objParseBenchmark.ParallelMs / 1000.0,
+				objParseBenchmark.SerialMs / objParseBenchmark.ParallelMs,
+				objParseBenchmark.Identical ? "yes" : "NO");
+		}
+
+		if (objParseBenchmark.Bytes > 0)
+		{
+			double megabytes = objParseBenchmark.Bytes / (1024.0 * 1024.0);
+			ImGui::Text("File: %.1f MB, %u triangles, %u vertices", megabytes, objParseBenchmark.TriangleCount, objParseBenchmark.VertexCount);
+			ImGui::Text("Serial: %.2f ms (%.1f MB/s, %.2f M triangles/s)", objParseBenchmark.SerialMs, megabytes / objParseBenchmark.SerialMs * 1000.0, objParseBenchmark.TriangleCount / objParseBenchmark.SerialMs / 1000.0);
+			ImGui::Text("%u threads: %.2f ms (%.1f MB/s, %.2f M triangles/s)", objParseBenchmark.ThreadCount, objParseBenchmark.ParallelMs, megabytes / objParseBenchmark.ParallelMs * 1000.0, objParseBenchmark.TriangleCount / objParseBenchmark.ParallelMs / 1000.0);
+			ImGui::Text("Identical: %s", objParseBenchmark.Identical ? "yes" : "NO");
+		}
+
+		if (ImGui::Button("Mesh optimizer self test"))
+		{
+			meshOptimizerTest = TestMeshOptimizer();
+			PrintTestResult("Mesh optimizer test", meshOptimizerTest);
+			printf("  %u triangle grid ACMR/ATVR: input %.3f/%.3f, vertex cache %.3f/%.3f, overdraw %.3f/%.3f, vertex fetch %.3f/%.3f\n",
+				meshOptimizerTest.TriangleCount,
+				meshOptimizerTest.Input.ACMR, meshOptimizerTest.Input.ATVR,
+				meshOptimizerTest.VertexCache.ACMR, meshOptimizerTest.VertexCache.ATVR,
+				meshOptimizerTest.Overdraw.ACMR, meshOptimizerTest.Overdraw.ATVR,
+				meshOptimizerTest.VertexFetch.ACMR, meshOptimizerTest.VertexFetch.ATVR);
+		}
+
+		if (ShowTestResult(meshOptimizerTest))
+		{
+			ImGui::Text("ACMR: input %.3f, vertex cache %.3f, overdraw %.3f, vertex fetch %.3f", meshOptimizerTest.Input.ACMR, meshOptimizerTest.VertexCache.ACMR, meshOptimizerTest.Overdraw.ACMR, meshOptimizerTest.VertexFetch.ACMR);
+			ImGui::Text("ATVR: input %.3f, optimized %.3f", meshOptimizerTest.Input.ATVR, meshOptimizerTest.VertexFetch.ATVR);
+		}
+
+		if (ImGui::Button("Tangents (1M triangles)"))
+		{
+			tangentBenchmark = BenchmarkTangents(1000000);
+			printf("Tangent benchmark, %u triangles: reference %.2f ms, fast %.2f ms (%.2fx), MikkTSpace %.2f ms (%u vertices split), max difference %.4f degrees\n",
+				tangentBenchmark.TriangleCount,
+				tangentBenchmark.ReferenceMs,
+				tangentBenchmark.FastMs,
+				tangentBenchmark.ReferenceMs / tangentBenchmark.FastMs,
+				tangentBenchmark.MikkTSpaceMs,
+				tangentBenchmark.SplitVertices,
+				tangentBenchmark.MaxDifferenceDegrees);
+		}
+
+		if (tangentBenchmark.TriangleCount > 0)
+		{
+			ImGui::Text("Triangles: %u", tangentBenchmark.TriangleCount);
+			ImGui::Text("Reference: %.2f ms", tangentBenchmark.ReferenceMs);
+			ImGui::Text("Fast: %.2f ms (%.2fx)", tangentBenchmark.FastMs, tangentBenchmark.ReferenceMs / tangentBenchmark.FastMs);
+			ImGui::Text("MikkTSpace: %.2f ms (%u vertices split at the mirrored seam)", tangentBenchmark.MikkTSpaceMs, tangentBenchmark.SplitVertices);
+			ImGui::Text("Max difference: %.4f degrees", tangentBenchmark.MaxDifferenceDegrees);
+		}
+
+		if (ImGui::Button("Transforms (100k)"))
+		{
+			transformBenchmark = BenchmarkTransforms(100000);
+			printf("Transform benchmark, %u transforms: reference %.2f ms, batched %.2f ms (%.2fx), parallel %.2f ms (%.2fx), uniform scales %.2f ms, max difference %g\n",
+				transformBenchmark.TransformCount,
+				transformBenchmark.ReferenceMs,
+				transformBenchmark.BatchMs,
+				transformBenchmark.ReferenceMs / transformBenchmark.BatchMs,
+				transformBenchmark.ParallelMs,
+				transformBenchmark.ReferenceMs / transformBenchmark.ParallelMs,
+				transformBenchmark.UniformBatchMs,
+				transformBenchmark.MaxDifference);
+			printf("Inverse transpose error with scales 0.001-1000: batched %g, general inverse %g\n",
+				transformBenchmark.ExtremeScaleDifference,
+				transformBenchmark.ExtremeScaleReferenceDifference);
+		}
+
+		if (transformBenchmark.TransformCount > 0)
+		{
+			ImGui::Text("Transforms: %u", transformBenchmark.TransformCount);
+			ImGui::Text("Reference: %.2f ms", transformBenchmark.ReferenceMs);
+			ImGui::Text("Batched: %.2f ms (%.1f M/s)", transformBenchmark.BatchMs, transformBenchmark.TransformCount / transformBenchmark.BatchMs / 1000.0);
+			ImGui::Text("Parallel: %.2f ms (%.1f M/s)", transformBenchmark.ParallelMs, transformBenchmark.TransformCount / transformBenchmark.ParallelMs / 1000.0);
+			ImGui::Text("Uniform scales: %.2f ms", transformBenchmark.UniformBatchMs);
+			ImGui::Text("Max difference: %g", transformBenchmark.MaxDifference);
+			ImGui::Text("Extreme scale error: %g (general inverse %g)", transformBenchmark.ExtremeScaleDifference, transformBenchmark.ExtremeScaleReferenceDifference);
+		}
+
+		if (ImGui::Button("Transform hierarchy (100k nodes)"))
+		{
+			hierarchyBenchmark = BenchmarkHierarchy(100000);
+			printf("Hierarchy benchmark, %u nodes (depth %u): full update %.2f ms, partial update %.2f ms (%u nodes), 1000 reparents + update %.2f ms, max difference %g, cycles rejected: %s\n",
+				hierarchyBenchmark.NodeCount,
+				hierarchyBenchmark.MaxDepth,
+				hierarchyBenchmark.FullUpdateMs,
+				hierarchyBenchmark.PartialUpdateMs,
+				hierarchyBenchmark.PartialUpdated,
+				hierarchyBenchmark.ReparentMs,
+				hierarchyBenchmark.MaxDifference,
+				hierarchyBenchmark.ReparentCyclesRejected ? "yes" : "NO");
+		}
+
+		if (hierarchyBenchmark.NodeCount > 0)
+		{
+			ImGui::Text("Nodes: %u (depth %u)", hierarchyBenchmark.NodeCount, hierarchyBenchmark.MaxDepth);
+			ImGui::Text("Full update: %.2f ms", hierarchyBenchmark.FullUpdateMs);
+			ImGui::Text("Partial update: %.2f ms (%u nodes)", hierarchyBenchmark.PartialUpdateMs, hierarchyBenchmark.PartialUpdated);
+			ImGui::Text("1000 reparents + update: %.2f ms", hierarchyBenchmark.ReparentMs);
+			ImGui::Text("Max difference: %g, cycles rejected: %s", hierarchyBenchmark.MaxDifference, hierarchyBenchmark.ReparentCyclesRejected ? "yes" : "NO");
+		}
+
+		if (ImGui::Button("Frustum culling (10k, 100k, 1M spheres)"))
+		{
+			unsigned int counts[3] = { 10000, 100000, 1000000 };
+			for (int i = 0; i < 3; i++)
+			{
+				frustumBenchmarks[i] = BenchmarkFrustumCulling(counts[i]);
+				printf("Frustum cull benchmark, %u spheres: %u culled, reference %.2f ms, SIMD %.2f ms (%.2fx), %u mismatches, %u kept conservatively\n",
+					frustumBenchmarks[i].ObjectCount,
+					frustumBenchmarks[i].Culled,
+					frustumBenchmarks[i].ReferenceMs,
+					frustumBenchmarks[i].CullMs,
+					frustumBenchmarks[i].ReferenceMs / frustumBenchmarks[i].CullMs,
+					frustumBenchmarks[i].Mismatches,
+					frustumBenchmarks[i].Conservative);
+			}
+		}
+
+		for (int i = 0; i < 3; i++)
+		{
+			if (frustumBenchmarks[i].ObjectCount == 0)
+				continue;
+			ImGui::Text("%u spheres: %u culled, %.2f ms (reference %.2f ms), %u mismatches",
+				frustumBenchmarks[i].ObjectCount,
+				frustumBenchmarks[i].Culled,
+				frustumBenchmarks[i].CullMs,
+				frustumBenchmarks[i].ReferenceMs,
+				frustumBenchmarks[i].Mismatches);
+		}
+
+		if (ImGui::Button("Frame snapshots (1000 frames, 10k objects)"))
+		{
+			snapshotTest = TestFrameSnapshots(1000, 10000);
+			printf("Frame snapshot test, %u frames of %u objects: serial %.2f ms, threaded %.2f ms, %u updates overlapped a draw, deterministic: %s\n",
+				snapshotTest.FrameCount,
+				snapshotTest.ObjectCount,
+				snapshotTest.SerialMs,
+				snapshotTest.ThreadedMs,
+				snapshotTest.OverlappedFrames,
+				snapshotTest.Deterministic ? "yes" : "NO");
+		}
+
+		if (snapshotTest.FrameCount > 0)
+		{
+			ImGui::Text("Frames: %u (%u objects)", snapshotTest.FrameCount, snapshotTest.ObjectCount);
+			ImGui::Text("Serial: %.2f ms, threaded: %.2f ms", snapshotTest.SerialMs, snapshotTest.ThreadedMs);
+			ImGui::Text("Overlapped updates: %u, deterministic: %s", snapshotTest.OverlappedFrames, snapshotTest.Deterministic ? "yes" : "NO");
+		}
+
+		if (ImGui::Button("State cache self test"))
+		{
+			stateCacheTest = TestStateCache();
+			PrintTestResult("State cache test", stateCacheTest);
+			printf("  Replay of %u draws: %u calls submitted, %u forwarded (%u expected)\n",
+				stateCacheTest.ReplayDraws,
+				stateCacheTest.ReplaySubmitted,
+				stateCacheTest.ReplayForwarded,
+				stateCacheTest.ReplayExpected);
+		}
+
+		if (ShowTestResult(stateCacheTest))
+			ImGui::Text("Replay: %u draws, %u calls submitted, %u forwarded", stateCacheTest.ReplayDraws, stateCacheTest.ReplaySubmitted, stateCacheTest.ReplayForwarded);
+
+		if (ImGui::Button("Constant ring self test"))
+		{
+			constantRingTest = TestConstantRing();
+			PrintTestResult("Constant ring test", constantRingTest);
+			printf("  Stress run of %u frames: %u allocations, %u wraps, %u times full, %u overlaps\n",
+				constantRingTest.StressFrames,
+				constantRingTest.StressAllocations,
+				constantRingTest.StressWraps,
+				constantRingTest.StressFull,
+				constantRingTest.StressOverlaps);
+		}
+
+		if (ShowTestResult(constantRingTest))
+			ImGui::Text("Stress: %u allocations over %u frames, %u wraps, %u overlaps", constantRingTest.StressAllocations, constantRingTest.StressFrames, constantRingTest.StressWraps, constantRingTest.StressOverlaps);
+
+		if (ImGui::Button("Parallel recording self test"))
+		{
+			recordingTest = TestParallelRecording();
+			PrintTestResult("Parallel recording test", recordingTest);
+			printf("  %u stress rounds of %u items: %u mismatched, worst range %u against %u split %u ways\n",
+				recordingTest.StressRounds,
+				recordingTest.StressItems,
+				recordingTest.Mismatches,
+				recordingTest.LargestCost,
+				recordingTest.IdealCost,
+				recordingTest.StressRanges);
+		}
+
+		if (ShowTestResult(recordingTest))
+		{
+			ImGui::Text("Stress: %u rounds of %u items, %u mismatched", recordingTest.StressRounds, recordingTest.StressItems, recordingTest.Mismatches);
+			ImGui::Text("Worst range cost: %u (even split: %u)", recordingTest.LargestCost, recordingTest.IdealCost);
+		}
+
+		if (ImGui::Button("Job system stress test and scaling"))
+		{
+			jobSystemTest = TestJobSystem();
+			PrintTestResult("Job system test", jobSystemTest);
+			printf("  Deque: %u items, %u stolen, %u lost; stress: %u jobs, %u steals, %u errors\n",
+				jobSystemTest.DequeItems,
+				jobSystemTest.DequeStolen,
+				jobSystemTest.DequeLost,
+				jobSystemTest.StressJobs,
+				jobSystemTest.StressSteals,
+				jobSystemTest.StressErrors);
+
+			jobSystemBenchmark = BenchmarkJobSystem();
+			for (unsigned int p = 0; p < jobSystemBenchmark.Points; p++)
+				printf("Job system scaling, %u jobs on %u threads: %.2f ms (%.2fx)\n",
+					jobSystemBenchmark.Jobs,
+					jobSystemBenchmark.Threads[p],
+					jobSystemBenchmark.Ms[p],
+					jobSystemBenchmark.Ms[0] / jobSystemBenchmark.Ms[p]);
+			printf("Job system: a std::thread per range %.2f ms, an empty job %.0f ns\n", jobSystemBenchmark.ThreadPerRangeMs, jobSystemBenchmark.EmptyJobNs);
+		}
+
+		if (ShowTestResult(jobSystemTest))
+		{
+			ImGui::Text("Deque: %u items, %u stolen, %u lost", jobSystemTest.DequeItems, jobSystemTest.DequeStolen, jobSystemTest.DequeLost);
+			ImGui::Text("Stress: %u jobs, %u steals, %u errors", jobSystemTest.StressJobs, jobSystemTest.StressSteals, jobSystemTest.StressErrors);
+			for (unsigned int p = 0; p < jobSystemBenchmark.Points; p++)
+				ImGui::Text("%u threads: %.2f ms (%.2fx)", jobSystemBenchmark.Threads[p], jobSystemBenchmark.Ms[p], jobSystemBenchmark.Ms[0] / jobSystemBenchmark.Ms[p]);
+			ImGui::Text("Thread per range: %.2f ms, empty job: %.0f ns", jobSystemBenchmark.ThreadPerRangeMs, jobSystemBenchmark.EmptyJobNs);
+		}
+
+		if (ImGui::Button("Simplifier report"))
+		{
+			PrintLodReport();
+			lodReport = true;
+		}
+
+		if (lodReport)
+		{
+			for (int i = 0; i < meshes.size(); i++)
+			{
+				const std::vector<MeshLod>& lods = meshes[i]->GetLods();
+				float radius = meshes[i]->GetBoundingSphere().Radius;
+				for (unsigned int l = 0; l < lods.size(); l++)
+				{
+					ImGui::Text("Mesh %i LOD %u: %u triangles (%.1f%%), error %.4f (%.3f%% of radius)",
+						i, l,
+						lods[l].IndexCount / 3,
+						100.0f * lods[l].IndexCount / lods[0].IndexCount,
+						lods[l].Error,
+						radius > 0.0f ? 100.0f * lods[l].Error / radius : 0.0f);
+				}
+			}
+		}
+		ImGui::TreePop();
+	}
+}
+
+// --------------------------------------------------------
+// Prints every mesh's level of detail chain, with each level's
+// error relative to the mesh's size so they can be compared
+// --------------------------------------------------------
+void Game::PrintLodReport()
+{
+	for (int i = 0; i < meshes.size(); i++)
+	{
+		const std::vector<MeshLod>& lods = meshes[i]->GetLods();
+		float radius = meshes[i]->GetBoundingSphere().Radius;
+		printf("Mesh %i, %u levels of detail:\n", i, (unsigned int)lods.size());
+		for (unsigned int l = 0; l < lods.size(); l++)
+		{
+			printf("  LOD %u: %u triangles (%.1f%%), error %.5f (%.3f%% of bounding radius)\n",
+				l,
+				lods[l].IndexCount / 3,
+				100.0f * lods[l].IndexCount / lods[0].IndexCount,
+				lods[l].Error,
+				radius > 0.0f ? 100.0f * lods[l].Error / radius : 0.0f);
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Adds a grid of identical cubes over the scene, to see how
+// instancing copes with a lot of the same thing
+// --------------------------------------------------------
+void Game::AddCrowd(unsigned int count)
+{
+	// The renderer reads the entity list, so it has to be idle while that grows
+	frames.WaitForRender();
+
+	unsigned int side = (unsigned int)ceilf(sqrtf((float)count));
+	const float spacing = 0.5f;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		std::shared_ptr<GameEntity> e = std::make_shared<GameEntity>(meshes[0], materials[6]);
+		e->GetTransform()->SetScale(0.2f, 0.2f, 0.2f);
+		e->GetTransform()->SetPosition((i % side - side * 0.5f) * spacing, 5.0f, (i / side - side * 0.5f) * spacing);
+		entities.push_back(e);
+	}
+	printf("Added %u cubes, %zu entities in all\n", count, entities.size());
 }
 
+// --------------------------------------------------------
+// Orbits a camera around the scene and culls (without drawing)
+// every entity's meshlets from each position along the way
+// --------------------------------------------------------
+MeshletCullStats Game::SweepMeshletCulling(int steps)
+{
+	const float radius = 15.0f;
+	const float height = 1.5f;
+
+	MeshletCullStats total = {};
+	std::vector<SubMesh> visible;
+	for (int i = 0; i < steps; i++)
+	{
+		// Look back at the origin from each point on the circle
+		float angle = XM_2PI * i / steps;
+		Camera sweepCamera(sinf(angle) * radius, height, cosf(angle) * radius, (float)windowWidth / windowHeight, XM_PIDIV4, 0.0f, 0.0f);
+		sweepCamera.GetTransform()->SetRotation(atan2f(height, radius), angle + XM_PI, 0.0f);
+		sweepCamera.UpdateViewMatrix();
+
+		BoundingFrustum frustum = sweepCamera.GetWorldFrustum();
+		XMFLOAT3 eye = sweepCamera.GetTransform()->GetPosition();
+		for (auto& e : entities)
+		{
+			XMFLOAT4X4 world = e->GetTransform()->GetWorldMatrix();
+			MeshletCullStats stats = CullMeshlets(visible, e->GetMesh()->GetMeshlets(e->GetLod()), XMLoadFloat4x4(&world), frustum, eye);
+			total.Total += stats.Total;
+			total.Backfacing += stats.Backfacing;
+			total.Outside += stats.Outside;
+		}
+	}
+	return total;
+}
 
 // --------------------------------------------------------
 // Handle resizing to match the new window size.
@@ -618,6 +1255,9 @@ void Game::SetupUI()
 // --------------------------------------------------------
 void Game::OnResize()
 {
+	// The render thread can't be using the old buffers while they're replaced
+	frames.WaitForRender();
+
 	// Handle base-level DX resize stuff
 	DXCore::OnResize();
 
@@ -657,6 +1297,172 @@ void Game::Update(float deltaTime, float totalTime)
 
 	if (cam) camera->Update(deltaTime);
 	else camera2->Update(deltaTime);
+
+	// Rebuild every changed transform's matrices in one batch, before
+	// anything below (or the draw) asks for them
+	TransformSystem::GetInstance().UpdateMatrices();
+
+	// Pick each entity's level of detail for this frame's camera
+	std::shared_ptr<Camera> activeCamera = (cam) ? camera : camera2;
+	for (auto& e : entities)
+		e->UpdateLod(activeCamera, (float)windowHeight, lodPixelError);
+
+	// Finish the UI's draw lists, so they can go in the snapshot too
+	ImGui::Render();
+
+	if (threadedRendering != renderThread.joinable())
+	{
+		if (threadedRendering) StartRenderThread();
+		else StopRenderThread();
+	}
+
+	// Hand this frame over to the renderer (waiting if it's still two behind)
+	FrameSnapshot& frame = frames.BeginUpdate();
+	renderStats = frame.Stats;
+	CaptureFrame(frame, deltaTime, totalTime);
+	frames.Publish();
+}
+
+// --------------------------------------------------------
+// Copies everything the renderer reads out of the game,
+// so it never has to touch entities, cameras or lights that
+// the next update may be changing
+// --------------------------------------------------------
+void Game::CaptureFrame(FrameSnapshot& frame, float deltaTime, float totalTime)
+{
+	frame.DeltaTime = deltaTime;
+	frame.TotalTime = totalTime;
+	frame.Width = windowWidth;
+	frame.Height = windowHeight;
+	frame.Vsync = vsync || !deviceSupportsTearing || isFullscreen;
+
+	std::shared_ptr<Camera> activeCamera = (cam) ? camera : camera2;
+	frame.Camera.View = activeCamera->GetView();
+	frame.Camera.Projection = activeCamera->GetProjection();
+	frame.Camera.Position = activeCamera->GetTransform()->GetPosition();
+	frame.Camera.WorldFrustum = activeCamera->GetWorldFrustum();
+
+	frame.Objects.resize(entities.size());
+	entityCuller.Resize((unsigned int)entities.size());
+	for (unsigned int i = 0; i < entities.size(); i++)
+	{
+		Transform* transform = entities[i]->GetTransform();
+		ObjectSnapshot& object = frame.Objects[i];
+		object.Entity = i;
+		object.Lod = entities[i]->GetLod();
+		object.World = transform->GetWorldMatrix();
+		object.UniformScale = transform->HasUniformScale();
+		if (!object.UniformScale)
+			object.WorldInverseTranspose = transform->GetWorldInverseTransposeMatrix();
+		entityCuller.SetBounds(i, entities[i]->GetWorldBoundingSphere());
+	}
+
+	// Only what the camera may see gets drawn (the shadow pass still gets everything)
+	if (frustumCulling)
+	{
+		XMFLOAT4 planes[6];
+		activeCamera->GetFrustumPlanes(planes);
+		frustumStats = entityCuller.Cull(planes, frame.Visible);
+	}
+	else
+	{
+		frame.Visible.resize(entities.size());
+		for (unsigned int i = 0; i < entities.size(); i++)
+			frame.Visible[i] = i;
+		frustumStats = { (unsigned int)entities.size(), 0 };
+	}
+
+	// A draw for each of them, keyed by the state it needs and its distance
+	// - The mesh part of the key includes the level of detail, so entities
+	//   with the same key also share index ranges
+	frame.SortDraws = sortDraws;
+	frame.RingConstants = ringConstants;
+	frame.RecordThreads = (unsigned int)recordThreads;
+	frame.Queue.Clear();
+	XMVECTOR eye = XMLoadFloat3(&frame.Camera.Position);
+	for (unsigned int visible : frame.Visible)
+	{
+		std::shared_ptr<GameEntity>& e = entities[visible];
+		std::shared_ptr<Material> material = e->GetMaterial();
+		std::shared_ptr<Mesh> mesh = e->GetMesh();
+
+		XMFLOAT4X4& world = frame.Objects[visible].World;
+		float distance = XMVectorGetX(XMVector3Length(XMVectorSet(world._41, world._42, world._43, 0) - eye));
+		unsigned int materialId = materialIds.Get(material.get());
+		unsigned int meshId = meshIds.Get(mesh.get()) * COOKED_MESH_MAX_LODS + frame.Objects[visible].Lod;
+		uint64_t key = MakeSortKey(
+			RenderPass::Opaque,
+			vertexShaderIds.Get(material->GetVertexShader(mesh->GetVertexFormat()).get()),
+			pixelShaderIds.Get(material->GetPixelShader().get()),
+			materialId,
+			meshId,
+			distance / activeCamera->GetFarClip());
+		frame.Queue.Add(key, visible, materialId, meshId);
+	}
+
+	// The shadow pass draws everything, and only cares about the mesh
+	frame.ShadowQueue.Clear();
+	for (unsigned int i = 0; i < frame.Objects.size(); i++)
+	{
+		unsigned int mesh = meshIds.Get(entities[i]->GetMesh().get()) * COOKED_MESH_MAX_LODS + frame.Objects[i].Lod;
+		frame.ShadowQueue.Add(MakeSortKey(RenderPass::Shadow, 0, 0, 0, mesh, 0.0f), i, 0, mesh);
+	}
+
+	if (sortDraws)
+	{
+		frame.Queue.Sort();
+		frame.ShadowQueue.Sort();
+	}
+
+	// Runs of entities with the same key, material and mesh become instanced
+	// draws, with their matrices copied out here so the renderer only has to
+	// upload them
+	unsigned int minimumInstances = instancing ? 2 : UINT_MAX;
+	unsigned int shadowInstances = frame.ShadowQueue.Batch(minimumInstances, 0);
+	frame.Instances.resize(shadowInstances + frame.Queue.Batch(minimumInstances, shadowInstances));
+	for (RenderQueue* queue : { &frame.ShadowQueue, &frame.Queue })
+	{
+		const std::vector<DrawPacket>& packets = queue->GetPackets();
+		for (const DrawBatch& batch : queue->GetBatches())
+		{
+			for (unsigned int i = 0; batch.Instanced && i < batch.Count; i++)
+			{
+				ObjectSnapshot& object = frame.Objects[packets[batch.First + i].Object];
+				InstanceData& instance = frame.Instances[batch.FirstInstance + i];
+				instance.World = object.World;
+				instance.WorldInverseTranspose = object.UniformScale ? object.World : object.WorldInverseTranspose;
+			}
+		}
+	}
+
+	frame.Lights = lights;
+	frame.MeshletCulling = meshletCulling;
+	frame.ShadowPositionStream = shadowPositionStream;
+	frame.BlurRadius = blurriness;
+	frame.UI.Capture(ImGui::GetDrawData());
+}
+
+void Game::StartRenderThread()
+{
+	renderThread = std::thread([this]()
+	{
+		while (FrameSnapshot* frame = frames.BeginRender())
+		{
+			RenderFrame(*frame);
+			frames.EndRender();
+		}
+	});
+}
+
+// Draws whatever has been published, then lets the thread finish
+void Game::StopRenderThread()
+{
+	if (!renderThread.joinable())
+		return;
+
+	frames.Close();
+	renderThread.join();
+	frames.Reopen();
 }
 
 void Game::PreRender()
@@ -674,7 +1480,7 @@ void Game::PreRender()
 	context->OMSetRenderTargets(1, ppRTV.GetAddressOf(), depthBufferDSV.Get());
 }
 
-void Game::PostRender()
+void Game::PostRender(FrameSnapshot& frame)
 {
 	context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), 0);
 
@@ -682,52 +1488,258 @@ void Game::PostRender()
 	// Also set any required cbuffer data (not shown)
 	ppVS->SetShader();
 	ppPS->SetShader();
+	stateCache->SetRasterizerState(0); // The sky leaves its own set
 
 	ppPS->SetShaderResourceView("Pixels", ppSRV.Get());
 	ppPS->SetSamplerState("ClampSampler", ppSampler.Get());
-	ppPS->SetInt("blurRadius", blurriness);
-	ppPS->SetFloat("pixelWidth", 1.0f / windowWidth);
-	ppPS->SetFloat("pixelHeight", 1.0f / windowHeight);
+	ppPS->SetInt("blurRadius", frame.BlurRadius);
+	ppPS->SetFloat("pixelWidth", 1.0f / frame.Width);
+	ppPS->SetFloat("pixelHeight", 1.0f / frame.Height);
 	ppPS->CopyAllBufferData();
 
 	context->Draw(3, 0); // Draw exactly 3 vertices (one triangle)
 }
 
 // --------------------------------------------------------
-// Clear the screen, redraw everything, present to the user
+// Draws the frame Update just captured, unless the render
+// thread is already taking care of that
 // --------------------------------------------------------
 void Game::Draw(float deltaTime, float totalTime)
 {
-	RenderShadowMap();
+	if (renderThread.joinable())
+		return;
+
+	FrameSnapshot* frame = frames.BeginRender();
+	RenderFrame(*frame);
+	frames.EndRender();
+}
+
+// --------------------------------------------------------
+// Draws a run of the main queue's batches, only binding state that
+// differs from the previous draw (unsorted, everything gets bound for
+// every draw, as a baseline)
+//  - The run's first draw binds everything, so each run can go to a
+//    context of its own
+// --------------------------------------------------------
+void Game::DrawBatches(FrameSnapshot& frame, RecordRange range, Microsoft::WRL::ComPtr<ID3D11DeviceContext> drawContext, ConstantBufferRing* ring, RenderBindStats& pipeline, MeshletCullStats& meshlets)
+{
+	SortKeyFields bound = {};
+	bool boundInstanced = false;
+	bool first = true;
+	auto bindState = [&](uint64_t key, std::shared_ptr<Material> material, std::shared_ptr<Mesh> mesh, bool instanced)
+	{
+		SortKeyFields fields = UnpackSortKey(key);
+		bool bindAll = first || !frame.SortDraws || fields.Overflowed; // Overflowed fields may hide a change
+		bool newVS = bindAll || fields.VertexShader != bound.VertexShader || instanced != boundInstanced;
+		bool newPS = bindAll || fields.PixelShader != bound.PixelShader;
+		bool newMaterial = newPS || fields.Material != bound.Material; // Texture slots and constants belong to the pixel shader
+		bool newMesh = newVS || fields.Mesh / COOKED_MESH_MAX_LODS != bound.Mesh / COOKED_MESH_MAX_LODS; // ...and mesh constants to the vertex shader
+		bound = fields;
+		boundInstanced = instanced;
+		first = false;
+
+		if (newVS)
+		{
+			material->GetVertexShader(mesh->GetVertexFormat(), instanced)->SetShader();
+			pipeline.VertexShaderBinds++;
+			pipeline.InputLayoutBinds++;
+		}
+
+		if (newPS)
+		{
+			std::shared_ptr<SimplePixelShader> ps = material->GetPixelShader();
+			ps->SetShader();
+			ps->SetShaderResourceView("ShadowMap", shadowSRV);
+			ps->SetSamplerState("ShadowSampler", shadowSampler);
+			pipeline.PixelShaderBinds++;
+			pipeline.ShaderResourceBinds++;
+			pipeline.SamplerBinds++;
+		}
+
+		if (newMaterial)
+		{
+			material->BindResources(pipeline);
+			material->SetMaterialData();
+		}
+
+		if (newMesh)
+			material->SetMeshData(mesh, instanced);
+	};
+
+	const std::vector<DrawPacket>& packets = frame.Queue.GetPackets();
+	const std::vector<DrawBatch>& batches = frame.Queue.GetBatches();
+	for (unsigned int b = range.First; b < range.First + range.Count; b++)
+	{
+		const DrawBatch& batch = batches[b];
+
+		// A whole batch at once, without meshlet culling (every instance
+		// would need its own index ranges)
+		ObjectSnapshot& firstObject = frame.Objects[packets[batch.First].Object];
+		std::shared_ptr<Material> material = entities[firstObject.Entity]->GetMaterial();
+		std::shared_ptr<Mesh> mesh = entities[firstObject.Entity]->GetMesh();
+		if (batch.Instanced && material->GetVertexShader(mesh->GetVertexFormat(), true))
+		{
+			bindState(packets[batch.First].Key, material, mesh, true);
+			mesh->DrawInstanced(drawContext, firstObject.Lod, batch.Count, batch.FirstInstance);
+			pipeline.Draws++;
+			pipeline.InstancedDraws++;
+			pipeline.Instances += batch.Count;
+			continue;
+		}
+
+		for (unsigned int p = batch.First; p < batch.First + batch.Count; p++)
+		{
+			ObjectSnapshot& object = frame.Objects[packets[p].Object];
+			std::shared_ptr<GameEntity>& e = entities[object.Entity];
+
+			// Skip meshlets that face away or are off screen, and the whole draw if that's all of them
+			if (frame.MeshletCulling)
+			{
+				MeshletCullStats stats = e->CullMeshlets(object, frame.Camera);
+				meshlets.Total += stats.Total;
+				meshlets.Backfacing += stats.Backfacing;
+				meshlets.Outside += stats.Outside;
+				if (e->GetVisibleRanges().empty())
+					continue;
+			}
+
+			// Draw an entity (the geometry arena skips binding buffers that already are)
+			bindState(packets[p].Key, material, mesh, false);
+			material->SetObjectData(object, mesh, ring);
+			if (frame.MeshletCulling)
+				mesh->DrawRanges(drawContext, e->GetVisibleRanges());
+			else
+				mesh->Draw(drawContext, object.Lod);
+			pipeline.Draws++;
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Clear the screen, redraw everything, present to the user
+//  - Everything that can change between frames comes from
+//    the snapshot, so this can run on the render thread
+// --------------------------------------------------------
+void Game::RenderFrame(FrameSnapshot& frame)
+{
+	ApplyLoadedTextures();
+	frame.Stats = {};
+	geometryArena->BeginFrame();
+	stateCache->ResetStats();
+	constantRing->BeginFrame();
+
+	// Every instanced batch's matrices, for both passes
+	if (!frame.Instances.empty())
+	{
+		instanceBuffer.Upload(device, context, frame.Instances);
+		instanceBuffer.Bind(*stateCache);
+	}
+
+	RenderShadowMap(frame);
 	PreRender();
 
-	// Draw all game entities
-	for (auto& e : entities)
+	// Back to the default states the entities are drawn with
+	stateCache->SetRasterizerState(0);
+	stateCache->SetDepthStencilState(0, 0);
+
+	// Constants that are the same for every draw, uploaded once per frame
+	// to each of the shaders materials can use
+	for (auto& vs : { vertexShader, packedVertexShader, instancedVS, packedInstancedVS })
 	{
-		std::shared_ptr<SimpleVertexShader> vs = e->GetMaterial()->GetVertexShader();
+		vs->SetMatrix4x4("view", frame.Camera.View);
+		vs->SetMatrix4x4("projection", frame.Camera.Projection);
 		vs->SetMatrix4x4("lightView", shadowViewMatrix);
 		vs->SetMatrix4x4("lightProjection", shadowProjectionMatrix);
+		vs->CopyBufferData("PerFrame");
+	}
+	pixelShader->SetFloat3("cameraPosition", frame.Camera.Position);
+	pixelShader->SetData("lights", &frame.Lights[0], sizeof(Light) * (int)frame.Lights.size());
+	pixelShader->CopyBufferData("PerFrame");
+	customPS->SetFloat("time", frame.TotalTime);
+	customPS->CopyBufferData("PerFrame");
+
+	// Draw the queued entities, on several threads when there are enough of
+	// them, each recording a run of batches into its own deferred context
+	const std::vector<DrawBatch>& batches = frame.Queue.GetBatches();
+	std::vector<unsigned int> costs(batches.size());
+	unsigned int draws = 0;
+	for (unsigned int b = 0; b < batches.size(); b++)
+	{
+		costs[b] = batches[b].Instanced ? 1 : batches[b].Count;
+		draws += costs[b];
+	}
 
-		// Set data in shader's buffer
-		std::shared_ptr<SimplePixelShader> ps = e->GetMaterial()->GetPixelShader();
-		ps->SetFloat("time", deltaTime);
-		ps->SetData("lights", &lights[0], sizeof(Light) * (int)lights.size());
-		ps->SetShaderResourceView("ShadowMap", shadowSRV);
-		ps->SetSamplerState("ShadowSampler", shadowSampler);
-
-		// Draw an entity
-		e->Draw(context, (cam) ? camera : camera2);
+	unsigned int rangeCount = (std::min)(frame.RecordThreads, draws / MinDrawsPerRecording);
+	if (rangeCount < 2)
+	{
+		RecordRange all = { 0, (unsigned int)batches.size(), draws };
+		DrawBatches(frame, all, context, frame.RingConstants ? constantRing.get() : 0, frame.Stats.Pipeline, frame.Stats.Meshlets);
+	}
+	else
+	{
+		D3D11_VIEWPORT viewport = {};
+		viewport.Width = (float)frame.Width;
+		viewport.Height = (float)frame.Height;
+		viewport.MaxDepth = 1.0f;
+
+		// Deferred contexts start with nothing set; per-object constants skip
+		// the ring, which maps on the immediate context
+		RenderBindStats rangePipelines[MaxRecordingSlots] = {};
+		MeshletCullStats rangeMeshlets[MaxRecordingSlots] = {};
+		deferredContexts->ResetStats();
+		frame.Stats.Recording = RecordInParallel(*deferredContexts, rangeCount, costs,
+			[&](unsigned int c, RenderContext& state, RecordRange range)
+			{
+				Microsoft::WRL::ComPtr<ID3D11DeviceContext> deferred = deferredContexts->GetDeviceContext(c);
+				deferred->OMSetRenderTargets(1, ppRTV.GetAddressOf(), depthBufferDSV.Get());
+				deferred->RSSetViewports(1, &viewport);
+				state.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+				if (!frame.Instances.empty())
+					instanceBuffer.Bind(state);
+				DrawBatches(frame, range, deferred, 0, rangePipelines[c], rangeMeshlets[c]);
+			});
+
+		// Executing the command lists left the immediate context with default state
+		stateCache->AssumeDefaultState();
+		geometryArena->Invalidate();
+		context->OMSetRenderTargets(1, ppRTV.GetAddressOf(), depthBufferDSV.Get());
+		context->RSSetViewports(1, &viewport);
+		stateCache->SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+		for (unsigned int c = 0; c < frame.Stats.Recording.Ranges; c++)
+		{
+			RenderBindStats& p = frame.Stats.Pipeline;
+			p.Draws += rangePipelines[c].Draws;
+			p.InstancedDraws += rangePipelines[c].InstancedDraws;
+			p.Instances += rangePipelines[c].Instances;
+			p.VertexShaderBinds += rangePipelines[c].VertexShaderBinds;
+			p.PixelShaderBinds += rangePipelines[c].PixelShaderBinds;
+			p.ShaderResourceBinds += rangePipelines[c].ShaderResourceBinds;
+			p.SamplerBinds += rangePipelines[c].SamplerBinds;
+			p.InputLayoutBinds += rangePipelines[c].InputLayoutBinds;
+			frame.Stats.Meshlets.Total += rangeMeshlets[c].Total;
+			frame.Stats.Meshlets.Backfacing += rangeMeshlets[c].Backfacing;
+			frame.Stats.Meshlets.Outside += rangeMeshlets[c].Outside;
+		}
 	}
 
-	sky->Draw(cam ? camera : camera2);
+	sky->Draw(frame.Camera, *stateCache);
 
-	PostRender();
+	PostRender(frame);
 
-	ImGui::Render();
-	ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+	// ImGui's renderer binds straight to the context, but puts back
+	// everything it changes, so the state cache is still right after
+	ImGui_ImplDX11_RenderDrawData(&frame.UI.DrawData);
 
-	ID3D11ShaderResourceView* nullSRVs[128] = {};
-	context->PSSetShaderResources(0, 128, nullSRVs);
+	// The post process input and the shadow map are render targets again
+	// next frame, which would silently unbind them behind the cache's back
+	stateCache->UnbindShaderResources(ShaderStage::Pixel);
+	constantRing->EndFrame();
+	frame.Stats.Binds = geometryArena->GetBindStats();
+	frame.Stats.State = stateCache->GetStats();
+	if (frame.Stats.Recording.Ranges > 0)
+		frame.Stats.State.Add(deferredContexts->GetStats());
+	frame.Stats.Ring = constantRing->GetStats();
 
 	// Frame END
 	// - These should happen exactly ONCE PER FRAME
@@ -736,12 +1748,60 @@ void Game::Draw(float deltaTime, float totalTime)
 		// Present the back buffer to the user
 		//  - Puts the results of what we've drawn onto the window
 		//  - Without this, the user never sees anything
-		bool vsyncNecessary = vsync || !deviceSupportsTearing || isFullscreen;
 		swapChain->Present(
-			vsyncNecessary ? 1 : 0,
-			vsyncNecessary ? 0 : DXGI_PRESENT_ALLOW_TEARING);
+			frame.Vsync ? 1 : 0,
+			frame.Vsync ? 0 : DXGI_PRESENT_ALLOW_TEARING);
 
 		// Must re-bind buffers after presenting, as they become unbound
 		context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthBufferDSV.Get());
 	}
+
+	// Once the first frame is up and every texture is in, starting up is over
+	if (startup.FirstFrame == 0)
+		startup.FirstFrame = MillisecondsSince(startupStart);
+	if (!startupPrinted && startup.TexturesLoaded > 0)
+	{
+		printf("Startup: shaders %.1f ms, textures %s %.1f ms, meshes %.1f ms, init %.1f ms, first frame %.1f ms, every texture in %.1f ms\n",
+			startup.Shaders,
+			AsyncTextureLoading ? "queued" : "loaded",
+			startup.TexturesQueued,
+			startup.Meshes,
+			startup.Init,
+			startup.FirstFrame,
+			startup.TexturesLoaded);
+		startupPrinted = true;
+	}
+	frame.Stats.TexturesLoading = (unsigned int)pendingTextures.size();
+	frame.Stats.Startup = startup;
+}
+
+// --------------------------------------------------------
+// Swaps placeholders for the textures that finished loading
+// since the last frame
+//  - Materials are only read while rendering, so this runs on
+//    the rendering thread, before anything is drawn
+// --------------------------------------------------------
+void Game::ApplyLoadedTextures()
+{
+	if (pendingTextures.empty())
+		return;
+
+	for (size_t t = 0; t < pendingTextures.size();)
+	{
+		PendingTexture& pending = pendingTextures[t];
+		if (!pending.Texture->IsReady())
+		{
+			t++;
+			continue;
+		}
+
+		if (pending.Texture->HasFailed())
+			printf("Couldn't load %ls, keeping its placeholder\n", pending.Texture->GetPath().c_str());
+		pending.Target->SetTextureSRV(pending.Name, pending.Texture->GetSRV());
+		pendingTextures[t] = pendingTextures.back();
+		pendingTextures.pop_back();
+	}
+
+	if (pendingTextures.empty())
+		startup.TexturesLoaded = MillisecondsSince(startupStart);
 }
\ No newline at end of file
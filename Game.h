@@ -5,12 +5,23 @@
 #include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
 #include <vector>
 #include <memory>
+#include <thread>
+#include <chrono>
 #include "Mesh.h"
+#include "ObjParser.h"
 #include "GameEntity.h"
 #include "Camera.h"
 #include "SimpleShader.h"
 #include "Lights.h"
 #include "Sky.h"
+#include "FrameSnapshot.h"
+#include "FrustumCuller.h"
+#include "InstanceBuffer.h"
+#include "StateCache.h"
+#include "ConstantBufferRing.h"
+#include "DeferredRecordingTarget.h"
+#include "JobSystem.h"
+#include "TextureLoader.h"
 
 class Game 
 	: public DXCore
@@ -29,6 +40,7 @@ public:
 
 private:
 	std::vector<std::shared_ptr<Mesh>> meshes;
+	std::shared_ptr<GeometryArena> geometryArena;
 	std::vector<std::shared_ptr<GameEntity>> entities;
 	std::vector<std::shared_ptr<Material>> materials;
 	std::vector<Light> lights;
@@ -38,6 +50,58 @@ private:
 	DirectX::XMFLOAT3 ambientColor;
 	bool cam;
 	int blurriness;
+	ObjParseBenchmarkResult objParseBenchmark;
+	MeshOptimizerTestResult meshOptimizerTest;
+	TangentBenchmarkResult tangentBenchmark;
+	bool meshletCulling;
+	MeshletCullStats meshletSweep;
+	bool frustumCulling;
+	FrustumCuller entityCuller;		// Entities' world bounding spheres
+	FrustumCullStats frustumStats;	// Last frame's
+	FrustumCullBenchmarkResult frustumBenchmarks[3];
+	bool sortDraws;					// Through the render queue, instead of in creation order
+	SortIds vertexShaderIds;
+	SortIds pixelShaderIds;
+	SortIds materialIds;
+	SortIds meshIds;
+	bool instancing;				// Entities sharing a mesh and material, drawn together
+	InstanceBuffer instanceBuffer;	// Only touched by the renderer
+	std::shared_ptr<StateCache> stateCache; // What the renderer binds goes through this, on its way to the context
+	std::shared_ptr<ConstantBufferRing> constantRing; // Per-object constants, when the device supports it
+	bool ringConstants;
+	std::shared_ptr<DeferredRecordingTarget> deferredContexts; // For recording the main pass on several threads
+	int recordThreads;				// 1 draws straight on the immediate context
+	float lodPixelError;			// Largest simplification error allowed on screen
+	bool lodReport;
+	TransformBenchmarkResult transformBenchmark;
+	HierarchyBenchmarkResult hierarchyBenchmark;
+	SnapshotTestResult snapshotTest;
+	StateCacheTestResult stateCacheTest;
+	ConstantRingTestResult constantRingTest;
+	ParallelRecordingTestResult recordingTest;
+	JobSystemTestResult jobSystemTest;
+	JobSystemBenchmarkResult jobSystemBenchmark;
+
+	// Textures load in the background, and go into their materials between
+	// frames (pendingTextures is only touched while rendering)
+	struct PendingTexture
+	{
+		std::shared_ptr<Material> Target;
+		std::string Name;
+		std::shared_ptr<TextureHandle> Texture;
+	};
+	std::shared_ptr<TextureLoader> textureLoader;
+	std::vector<PendingTexture> pendingTextures;
+	std::chrono::high_resolution_clock::time_point startupStart;
+	StartupTimeline startup;		// Init() fills in its part, the renderer the rest
+	bool startupPrinted;
+
+	// Update captures each frame into a snapshot, and the render thread (or
+	// Draw, without one) draws it, so the two can overlap
+	FrameSnapshotQueue frames;
+	std::thread renderThread;
+	bool threadedRendering;
+	RenderStats renderStats;		// From the renderer, a couple of frames behind
 
 	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> shadowDSV;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> shadowSRV;
@@ -47,22 +111,43 @@ private:
 	Microsoft::WRL::ComPtr<ID3D11RasterizerState> shadowRasterizer;
 	int shadowMapResolution;
 	float shadowProjectionSize;
+	bool shadowPositionStream;		// Depth-only draws from the position streams
 
 	// Initialization helper methods - feel free to customize, combine, remove, etc.
 	void LoadShaders();
 	void CreateGeometry();
 	void CreateLight();
 	void CreateShadowMap();
-	void RenderShadowMap();
+	void RenderShadowMap(FrameSnapshot& frame);
+	void PrintLodReport();
+	void AddCrowd(unsigned int count);
+	void CaptureFrame(FrameSnapshot& frame, float deltaTime, float totalTime);
+	void RenderFrame(FrameSnapshot& frame);
+	void ApplyLoadedTextures();
+	void DrawBatches(FrameSnapshot& frame, RecordRange range, Microsoft::WRL::ComPtr<ID3D11DeviceContext> drawContext, ConstantBufferRing* ring, RenderBindStats& pipeline, MeshletCullStats& meshlets);
+	void StartRenderThread();
+	void StopRenderThread();
 	void PreRender();
-	void PostRender();
+	void PostRender(FrameSnapshot& frame);
 	void ResizePostProcess();
+	MeshletCullStats SweepMeshletCulling(int steps);
 	
 	// Shaders and shader-related constructs
 	std::shared_ptr<SimplePixelShader> pixelShader;
 	std::shared_ptr<SimplePixelShader> customPS;
 	std::shared_ptr<SimplePixelShader> skyPS;
 	std::shared_ptr<SimpleVertexShader> vertexShader;
+	std::shared_ptr<SimpleVertexShader> packedVertexShader;
+	std::shared_ptr<SimpleVertexShader> instancedVS;
+	std::shared_ptr<SimpleVertexShader> packedInstancedVS;
+	std::shared_ptr<SimpleVertexShader> shadowVS;
+	std::shared_ptr<SimpleVertexShader> shadowPackedVS;
+	std::shared_ptr<SimpleVertexShader> shadowPositionVS;
+	std::shared_ptr<SimpleVertexShader> shadowPackedPositionVS;
+	std::shared_ptr<SimpleVertexShader> shadowInstancedVS;
+	std::shared_ptr<SimpleVertexShader> shadowPackedInstancedVS;
+	std::shared_ptr<SimpleVertexShader> shadowPositionInstancedVS;
+	std::shared_ptr<SimpleVertexShader> shadowPackedPositionInstancedVS;
 	std::shared_ptr<SimpleVertexShader> skyVS;
 	Microsoft::WRL::ComPtr<ID3D11InputLayout> inputLayout;
 
@@ -1,21 +1,111 @@
 #include "GameEntity.h"
 
+#include <algorithm>
+#include <cmath>
+
 using namespace DirectX;
 
+// How far under the error limit a coarser level has to be before switching to it
+static const float LodHysteresis = 0.25f;
+
 GameEntity::GameEntity(std::shared_ptr<Mesh> mesh, std::shared_ptr<Material> material) :
 	mesh(mesh),
-	material(material) 
+	material(material),
+	lod(0)
 { }
 
 Transform* GameEntity::GetTransform() { return &transform; }
 std::shared_ptr<Mesh> GameEntity::GetMesh() { return mesh; }
 std::shared_ptr<Material> GameEntity::GetMaterial() { return material; }
+unsigned int GameEntity::GetLod() { return lod; }
+
+BoundingBox GameEntity::GetWorldBoundingBox()
+{
+	XMFLOAT4X4 world = transform.GetWorldMatrix();
+	BoundingBox worldBox;
+	mesh->GetBoundingBox().Transform(worldBox, XMLoadFloat4x4(&world));
+	return worldBox;
+}
+
+BoundingSphere GameEntity::GetWorldBoundingSphere()
+{
+	XMFLOAT4X4 world = transform.GetWorldMatrix();
+	BoundingSphere worldSphere;
+	mesh->GetBoundingSphere().Transform(worldSphere, XMLoadFloat4x4(&world));
+	return worldSphere;
+}
+
+BoundingOrientedBox GameEntity::GetWorldOrientedBox()
+{
+	XMFLOAT4X4 world = transform.GetWorldMatrix();
+	BoundingOrientedBox worldBox;
+	mesh->GetOrientedBox().Transform(worldBox, XMLoadFloat4x4(&world));
+	return worldBox;
+}
+
+void GameEntity::UpdateLod(std::shared_ptr<Camera> camera, float screenHeight, float maxPixelError)
+{
+	const std::vector<MeshLod>& lods = mesh->GetLods();
+	if (lods.size() < 2)
+	{
+		lod = 0;
+		return;
+	}
+
+	// Errors are object-space distances, so scale them like the bounds
+	BoundingSphere bounds = GetWorldBoundingSphere();
+	float objectRadius = mesh->GetBoundingSphere().Radius;
+	float scale = objectRadius > 0.0f ? bounds.Radius / objectRadius : 1.0f;
 
-void GameEntity::SetMesh(std::shared_ptr<Mesh> mesh) { this->mesh = mesh; }
+	// Pixels covered by one world unit at the nearest point of the bounds
+	XMFLOAT3 eye = camera->GetTransform()->GetPosition();
+	float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Center) - XMLoadFloat3(&eye))) - bounds.Radius;
+	float pixelsPerUnit = screenHeight / (2.0f * tanf(camera->GetFieldOfView() * 0.5f)) / (std::max)(distance, 0.001f);
+	auto pixelError = [&](unsigned int level) { return lods[level].Error * scale * pixelsPerUnit; };
+
+	// Refine as soon as the current level's error becomes visible...
+	unsigned int next = (std::min)(lod, (unsigned int)lods.size() - 1);
+	while (next > 0 && pixelError(next) > maxPixelError)
+		next--;
+
+	// ...but only coarsen once the next level is well under the limit
+	while (next + 1 < lods.size() && pixelError(next + 1) <= maxPixelError * (1.0f - LodHysteresis))
+		next++;
+
+	lod = next;
+}
+
+void GameEntity::SetMesh(std::shared_ptr<Mesh> mesh) { this->mesh = mesh; lod = 0; }
 void GameEntity::SetMaterial(std::shared_ptr<Material> material) { this->material = material; }
 
-void GameEntity::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::shared_ptr<Camera> camera)
+void GameEntity::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const ObjectSnapshot& object, RenderBindStats& stats)
 {
-	material->PrepareMaterial(&transform, camera);
-	mesh->Draw(context);
+	material->PrepareMaterial(object, mesh, stats);
+	mesh->Draw(context, object.Lod);
+	stats.Draws++;
 }
+
+MeshletCullStats GameEntity::DrawVisible(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const ObjectSnapshot& object, const CameraSnapshot& camera, RenderBindStats& stats)
+{
+	MeshletCullStats cullStats = CullMeshlets(object, camera);
+
+	if (!visibleRanges.empty())
+	{
+		material->PrepareMaterial(object, mesh, stats);
+		mesh->DrawRanges(context, visibleRanges);
+		stats.Draws++;
+	}
+	return cullStats;
+}
+
+MeshletCullStats GameEntity::CullMeshlets(const ObjectSnapshot& object, const CameraSnapshot& camera)
+{
+	return ::CullMeshlets(
+		visibleRanges,
+		mesh->GetMeshlets(object.Lod),
+		XMLoadFloat4x4(&object.World),
+		camera.WorldFrustum,
+		camera.Position);
+}
+
+const std::vector<SubMesh>& GameEntity::GetVisibleRanges() { return visibleRanges; }
@@ -1,7 +1,9 @@
 #pragma once
 #include <wrl/client.h>
 #include <DirectXMath.h>
+#include <DirectXCollision.h>
 #include <memory>
+#include <vector>
 #include "Mesh.h"
 #include "Transform.h"
 #include "Camera.h"
@@ -13,17 +15,37 @@ private:
 	Transform transform;
 	std::shared_ptr<Mesh> mesh;
 	std::shared_ptr<Material> material;
+	std::vector<SubMesh> visibleRanges; // Scratch space for meshlet culling
+	unsigned int lod;
 
 public:
 	Transform* GetTransform(); // Raw pointer version
 
 	std::shared_ptr<Mesh> GetMesh();
 	std::shared_ptr<Material> GetMaterial();
+	unsigned int GetLod();
+
+	// The mesh's bounds moved into world space by the transform
+	DirectX::BoundingBox GetWorldBoundingBox();
+	DirectX::BoundingSphere GetWorldBoundingSphere();
+	DirectX::BoundingOrientedBox GetWorldOrientedBox();
+
+	// Picks the coarsest level of detail whose error stays under maxPixelError
+	// pixels on screen, only switching to a coarser level once it's comfortably
+	// under, so entities near a threshold don't flicker between levels
+	void UpdateLod(std::shared_ptr<Camera> camera, float screenHeight, float maxPixelError);
 
 	void SetMesh(std::shared_ptr<Mesh> mesh);
 	void SetMaterial(std::shared_ptr<Material> material);
 
-	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::shared_ptr<Camera> camera);
+	// Drawing only reads the snapshot (this entity as it was captured), never
+	// the transform, so it's safe while the next frame is being updated
+	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const ObjectSnapshot& object, RenderBindStats& stats);
+	MeshletCullStats DrawVisible(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const ObjectSnapshot& object, const CameraSnapshot& camera, RenderBindStats& stats); // Only the visible meshlets
+
+	// DrawVisible() in two steps, for callers that bind the material themselves
+	MeshletCullStats CullMeshlets(const ObjectSnapshot& object, const CameraSnapshot& camera);
+	const std::vector<SubMesh>& GetVisibleRanges(); // From the last CullMeshlets()
 
 	GameEntity(std::shared_ptr<Mesh> mesh, std::shared_ptr<Material> material);
 };
\ No newline at end of file
@@ -0,0 +1,139 @@
+#include "GeometryArena.h"
+
+#include <cstdio>
+
+GeometryArena::GeometryArena() :
+	boundPool(-1),
+	stats()
+{ }
+
+GeometryAllocation GeometryArena::Add(
+	const void* vertices, unsigned int stride, unsigned int vertexCount,
+	const void* indices, DXGI_FORMAT indexFormat, unsigned int indexCount)
+{
+	// Find (or start) the pool with this layout
+	unsigned int p = 0;
+	while (p < pools.size() && (pools[p].Stride != stride || pools[p].IndexFormat != indexFormat))
+		p++;
+	if (p == pools.size())
+		pools.push_back({ stride, indexFormat, 0, 0 });
+
+	Pool& pool = pools[p];
+	GeometryAllocation allocation = { p, (int)pool.VertexCount, pool.IndexCount };
+
+	// Indices stay relative to the mesh, BaseVertex does the rest
+	unsigned int indexSize = indexFormat == DXGI_FORMAT_R16_UINT ? sizeof(unsigned short) : sizeof(unsigned int);
+	const unsigned char* v = (const unsigned char*)vertices;
+	const unsigned char* i = (const unsigned char*)indices;
+	pool.VertexData.insert(pool.VertexData.end(), v, v + (size_t)stride * vertexCount);
+	pool.IndexData.insert(pool.IndexData.end(), i, i + (size_t)indexSize * indexCount);
+	pool.VertexCount += vertexCount;
+	pool.IndexCount += indexCount;
+
+	return allocation;
+}
+
+void GeometryArena::Build(Microsoft::WRL::ComPtr<ID3D11Device> device)
+{
+	for (Pool& pool : pools)
+	{
+		if (pool.VertexBuffer || pool.VertexData.empty() || pool.IndexData.empty())
+			continue;
+
+		D3D11_BUFFER_DESC vbd = {};
+		vbd.Usage = D3D11_USAGE_IMMUTABLE;
+		vbd.ByteWidth = (UINT)pool.VertexData.size();
+		vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+
+		D3D11_SUBRESOURCE_DATA initialVertexData = {};
+		initialVertexData.pSysMem = &pool.VertexData[0];
+		device->CreateBuffer(&vbd, &initialVertexData, pool.VertexBuffer.GetAddressOf());
+
+		D3D11_BUFFER_DESC ibd = {};
+		ibd.Usage = D3D11_USAGE_IMMUTABLE;
+		ibd.ByteWidth = (UINT)pool.IndexData.size();
+		ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+
+		D3D11_SUBRESOURCE_DATA initialIndexData = {};
+		initialIndexData.pSysMem = &pool.IndexData[0];
+		device->CreateBuffer(&ibd, &initialIndexData, pool.IndexBuffer.GetAddressOf());
+
+		printf("Geometry pool: %u byte vertices, %u-bit indices, %u vertices (%.1f KB), %u indices (%.1f KB)\n",
+			pool.Stride,
+			pool.IndexFormat == DXGI_FORMAT_R16_UINT ? 16 : 32,
+			pool.VertexCount,
+			pool.VertexData.size() / 1024.0,
+			pool.IndexCount,
+			pool.IndexData.size() / 1024.0);
+
+		// The GPU has its own copy now
+		std::vector<unsigned char>().swap(pool.VertexData);
+		std::vector<unsigned char>().swap(pool.IndexData);
+	}
+}
+
+void GeometryArena::Bind(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int pool)
+{
+	// A recording thread binds through its own context, which drops repeats
+	// itself, leaving the arena's tracking to the thread that owns it
+	if (RenderContext* thread = GetThreadRenderContext())
+	{
+		thread->SetVertexBuffer(0, pools[pool].VertexBuffer.Get(), pools[pool].Stride, 0);
+		thread->SetIndexBuffer(pools[pool].IndexBuffer.Get(), pools[pool].IndexFormat, 0);
+		return;
+	}
+
+	stats.Draws++;
+	if (boundPool == (int)pool)
+		return;
+
+	UINT stride = pools[pool].Stride;
+	UINT offset = 0;
+	if (renderContext)
+	{
+		renderContext->SetVertexBuffer(0, pools[pool].VertexBuffer.Get(), stride, offset);
+		renderContext->SetIndexBuffer(pools[pool].IndexBuffer.Get(), pools[pool].IndexFormat, 0);
+	}
+	else
+	{
+		context->IASetVertexBuffers(0, 1, pools[pool].VertexBuffer.GetAddressOf(), &stride, &offset);
+		context->IASetIndexBuffer(pools[pool].IndexBuffer.Get(), pools[pool].IndexFormat, 0);
+	}
+	stats.VertexBufferBinds++;
+	stats.IndexBufferBinds++;
+	boundPool = (int)pool;
+}
+
+void GeometryArena::SetRenderContext(std::shared_ptr<RenderContext> context) { renderContext = context; }
+
+void GeometryArena::BeginFrame()
+{
+	Invalidate();
+	stats = {};
+}
+
+void GeometryArena::Invalidate() { boundPool = -1; }
+
+GeometryBindStats GeometryArena::GetBindStats() { return stats; }
+
+unsigned int GeometryArena::GetPoolCount() { return (unsigned int)pools.size(); }
+
+unsigned int GeometryArena::GetVertexBytes()
+{
+	unsigned int bytes = 0;
+	for (Pool& pool : pools)
+		bytes += pool.Stride * pool.VertexCount;
+	return bytes;
+}
+
+unsigned int GeometryArena::GetIndexBytes()
+{
+	unsigned int bytes = 0;
+	for (Pool& pool : pools)
+		bytes += (pool.IndexFormat == DXGI_FORMAT_R16_UINT ? sizeof(unsigned short) : sizeof(unsigned int)) * pool.IndexCount;
+	return bytes;
+}
+
+Microsoft::WRL::ComPtr<ID3D11Buffer> GeometryArena::GetVertexBuffer(unsigned int pool) { return pools[pool].VertexBuffer; }
+
+Microsoft::WRL::ComPtr<ID3D11Buffer> GeometryArena::GetIndexBuffer(unsigned int pool) { return pools[pool].IndexBuffer; }
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include <vector>
+
+#include "RenderContext.h"
+#include "ParallelRecorder.h"
+
+// --------------------------------------------------------
+// Where a mesh's data landed in the arena
+//  - Add BaseVertex and IndexStart to the mesh's own offsets
+// --------------------------------------------------------
+struct GeometryAllocation
+{
+	unsigned int Pool;
+	int BaseVertex;
+	unsigned int IndexStart;
+};
+
+// --------------------------------------------------------
+// Input assembler binds since the last BeginFrame()
+//  - Draws is how many times a mesh bound its geometry, which
+//    is what per-mesh buffers would have cost (two binds each)
+// --------------------------------------------------------
+struct GeometryBindStats
+{
+	unsigned int Draws;
+	unsigned int VertexBufferBinds;
+	unsigned int IndexBufferBinds;
+};
+
+// --------------------------------------------------------
+// Suballocates static meshes into a few large immutable buffers,
+// one vertex/index buffer pair per vertex stride and index format,
+// so that consecutive draws only need different DrawIndexed offsets
+//  - Meshes are added while loading, then Build() creates the buffers
+//  - Nothing is ever freed, so it's only meant for static geometry
+// --------------------------------------------------------
+class GeometryArena
+{
+private:
+	struct Pool
+	{
+		unsigned int Stride;
+		DXGI_FORMAT IndexFormat;
+		unsigned int VertexCount;
+		unsigned int IndexCount;
+
+		// Staging copies, released once the buffers exist
+		std::vector<unsigned char> VertexData;
+		std::vector<unsigned char> IndexData;
+
+		Microsoft::WRL::ComPtr<ID3D11Buffer> VertexBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer> IndexBuffer;
+	};
+
+	std::vector<Pool> pools;
+	int boundPool; // -1 when unknown
+	GeometryBindStats stats;
+	std::shared_ptr<RenderContext> renderContext; // Null for the device context
+
+public:
+	GeometryArena();
+
+	// Copies a mesh's vertices and indices into the pool matching its
+	// layout; the returned offsets are valid immediately, the buffers
+	// only after Build()
+	GeometryAllocation Add(
+		const void* vertices, unsigned int stride, unsigned int vertexCount,
+		const void* indices, DXGI_FORMAT indexFormat, unsigned int indexCount);
+
+	// Creates every pool's buffers from what has been added so far
+	void Build(Microsoft::WRL::ComPtr<ID3D11Device> device);
+
+	// Binds a pool's buffers unless they're already bound (on a recording
+	// thread, through its context, without counting)
+	void Bind(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int pool);
+
+	// Makes Bind() go through a render context (like a StateCache)
+	void SetRenderContext(std::shared_ptr<RenderContext> context);
+
+	// Forgets what's bound (other code may have changed the IA state)
+	// and starts counting binds for a new frame
+	void BeginFrame();
+
+	// Just forgets what's bound, like after executing a command list
+	void Invalidate();
+
+	GeometryBindStats GetBindStats();
+	unsigned int GetPoolCount();
+	unsigned int GetVertexBytes();
+	unsigned int GetIndexBytes();
+	Microsoft::WRL::ComPtr<ID3D11Buffer> GetVertexBuffer(unsigned int pool);
+	Microsoft::WRL::ComPtr<ID3D11Buffer> GetIndexBuffer(unsigned int pool);
+};
@@ -0,0 +1,64 @@
+#include "InstanceBuffer.h"
+
+#include <cstddef>
+#include <cstring>
+
+// Each matrix row is one float4 element
+#define INSTANCE_ROW(semantic, matrix, row) \
+	{ semantic, row, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, offsetof(InstanceData, matrix) + row * 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 }
+
+const D3D11_INPUT_ELEMENT_DESC InstanceLayout[8] =
+{
+	INSTANCE_ROW("WORLD_PER_INSTANCE", World, 0),
+	INSTANCE_ROW("WORLD_PER_INSTANCE", World, 1),
+	INSTANCE_ROW("WORLD_PER_INSTANCE", World, 2),
+	INSTANCE_ROW("WORLD_PER_INSTANCE", World, 3),
+	INSTANCE_ROW("WORLD_INV_TRANS_PER_INSTANCE", WorldInverseTranspose, 0),
+	INSTANCE_ROW("WORLD_INV_TRANS_PER_INSTANCE", WorldInverseTranspose, 1),
+	INSTANCE_ROW("WORLD_INV_TRANS_PER_INSTANCE", WorldInverseTranspose, 2),
+	INSTANCE_ROW("WORLD_INV_TRANS_PER_INSTANCE", WorldInverseTranspose, 3),
+};
+
+InstanceBuffer::InstanceBuffer() :
+	capacity(0)
+{ }
+
+void InstanceBuffer::Upload(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const std::vector<InstanceData>& instances)
+{
+	if (instances.empty())
+		return;
+
+	if (instances.size() > capacity)
+	{
+		unsigned int size = 256;
+		while (size < instances.size())
+			size *= 2;
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.ByteWidth = size * sizeof(InstanceData);
+		desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+		buffer.Reset();
+		if (FAILED(device->CreateBuffer(&desc, 0, buffer.GetAddressOf())))
+		{
+			capacity = 0;
+			return;
+		}
+		capacity = size;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+	memcpy(mapped.pData, &instances[0], instances.size() * sizeof(InstanceData));
+	context->Unmap(buffer.Get(), 0);
+}
+
+void InstanceBuffer::Bind(RenderContext& state)
+{
+	state.SetVertexBuffer(1, buffer.Get(), sizeof(InstanceData), 0);
+}
+
+unsigned int InstanceBuffer::GetCapacity() { return capacity; }
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <vector>
+
+#include "RenderContext.h"
+
+// --------------------------------------------------------
+// One instance of an instanced draw, as the instanced vertex
+// shaders read it from input slot 1
+//  - Uniformly scaled objects just get a copy of their world
+//    matrix as the inverse transpose
+// --------------------------------------------------------
+struct InstanceData
+{
+	DirectX::XMFLOAT4X4 World;
+	DirectX::XMFLOAT4X4 WorldInverseTranspose;
+};
+
+// Input layout elements for InstanceData (see InstanceInput in ShaderIncludes.hlsli),
+// to append to a mesh's own layout; depth-only shaders only need the first four
+extern const D3D11_INPUT_ELEMENT_DESC InstanceLayout[8];
+
+// --------------------------------------------------------
+// A dynamic vertex buffer holding every instance of a frame
+//  - Filled once per frame (write discard), then each batch
+//    picks out its own instances with the StartInstanceLocation
+//    of DrawIndexedInstanced()
+//  - Grows to the next power of two when a frame needs more
+// --------------------------------------------------------
+class InstanceBuffer
+{
+public:
+	InstanceBuffer();
+
+	// Copies a frame's instances in, replacing the last frame's
+	void Upload(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const std::vector<InstanceData>& instances);
+
+	// Binds the buffer to input slot 1, leaving the mesh's slot 0 alone
+	void Bind(RenderContext& state);
+
+	unsigned int GetCapacity();
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	unsigned int capacity;
+};
@@ -0,0 +1,543 @@
+#include "JobSystem.h"
+
+#include <chrono>
+#include <cmath>
+#include <random>
+
+// Which job system's worker this thread is, if any (1 and up; 0 isn't one)
+static thread_local JobSystem* threadJobSystem = 0;
+static thread_local unsigned int threadWorker = 0;
+
+// Where this thread starts looking for jobs to steal, so thieves spread out
+static thread_local unsigned int threadStealStart = 0;
+
+JobCounter::JobCounter() :
+	pending(0),
+	releasing(0)
+{ }
+
+// A job finishing takes pending to 0 before it's done with the counter, so
+// the counter isn't free to go until releasing is back to 0 too
+bool JobCounter::IsDone() { return pending.load() == 0 && releasing.load() == 0; }
+
+JobSystem::JobSystem(unsigned int workerCount) :
+	steals(0),
+	sharedCount(0),
+	queued(0),
+	sleepers(0),
+	stopping(false)
+{
+	for (unsigned int w = 0; w < workerCount; w++)
+		workers.push_back(std::unique_ptr<Worker>(new Worker()));
+
+	// Every deque exists before any worker starts stealing
+	for (unsigned int w = 0; w < workerCount; w++)
+		workers[w]->Thread = std::thread(&JobSystem::WorkerLoop, this, w);
+}
+
+JobSystem::~JobSystem()
+{
+	stopping = true;
+	{
+		std::lock_guard<std::mutex> lock(sleepLock);
+		wake.notify_all();
+	}
+	for (auto& w : workers)
+		w->Thread.join();
+
+	// Anything nobody waited for still runs, so its counters finish
+	while (Job* job = Take())
+		Execute(job);
+}
+
+unsigned int JobSystem::GetThreadCount() { return (unsigned int)workers.size() + 1; }
+unsigned int JobSystem::GetStealCount() { return steals.load(std::memory_order_relaxed); }
+
+void JobSystem::Run(std::function<void()> job, JobCounter* counter, JobCounter* after)
+{
+	Job* j = new Job();
+	j->Work = std::move(job);
+	j->Counter = counter;
+	if (counter)
+		counter->pending++;
+
+	// Held by the counter it's waiting on, which pushes it once it's done
+	if (after)
+	{
+		std::lock_guard<std::mutex> lock(after->waitingLock);
+		if (after->pending.load() > 0)
+		{
+			after->waiting.push_back(j);
+			return;
+		}
+	}
+	Push(j);
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	while (!counter.IsDone())
+	{
+		Job* job = Take();
+		if (job)
+			Execute(job);
+		else
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::WorkerLoop(unsigned int index)
+{
+	threadJobSystem = this;
+	threadWorker = index + 1;
+	threadStealStart = index + 1;
+
+	const unsigned int SpinsBeforeSleeping = 64;
+	unsigned int idle = 0;
+	while (!stopping.load(std::memory_order_relaxed))
+	{
+		Job* job = Take();
+		if (job)
+		{
+			Execute(job);
+			idle = 0;
+			continue;
+		}
+
+		if (++idle < SpinsBeforeSleeping)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		// Push() counts the job before it looks for sleepers, and sleepers are
+		// counted before looking for jobs, so one of the two always sees the other
+		std::unique_lock<std::mutex> lock(sleepLock);
+		sleepers++;
+		wake.wait(lock, [&]() { return queued.load() > 0 || stopping.load(); });
+		sleepers--;
+		idle = 0;
+	}
+
+	threadJobSystem = 0;
+	threadWorker = 0;
+}
+
+void JobSystem::Push(Job* job)
+{
+	bool pushed = threadJobSystem == this && threadWorker > 0 && workers[threadWorker - 1]->Jobs.Push(job);
+	if (!pushed)
+	{
+		std::lock_guard<std::mutex> lock(sharedLock);
+		shared.push_back(job);
+		sharedCount++;
+	}
+
+	queued++;
+	if (sleepers.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(sleepLock);
+		wake.notify_one();
+	}
+}
+
+JobSystem::Job* JobSystem::Take()
+{
+	// This thread's own newest job first, while it's still in the cache...
+	unsigned int self = threadJobSystem == this ? threadWorker : 0;
+	Job* job = self > 0 ? workers[self - 1]->Jobs.Pop() : 0;
+
+	// ...then whatever threads outside the system started...
+	if (!job && sharedCount.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(sharedLock);
+		if (!shared.empty())
+		{
+			job = shared.front();
+			shared.pop_front();
+			sharedCount--;
+		}
+	}
+
+	// ...then the oldest job of some other worker
+	if (!job && !workers.empty())
+	{
+		unsigned int start = threadStealStart++;
+		for (unsigned int i = 0; i < workers.size() && !job; i++)
+		{
+			unsigned int victim = (start + i) % workers.size();
+			if (victim + 1 == self)
+				continue;
+			job = workers[victim]->Jobs.Steal();
+			if (job)
+				steals.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	if (job)
+		queued--;
+	return job;
+}
+
+void JobSystem::Execute(Job* job)
+{
+	job->Work();
+	Finish(job->Counter);
+	delete job;
+}
+
+void JobSystem::Finish(JobCounter* counter)
+{
+	if (!counter)
+		return;
+
+	counter->releasing++;
+	if (counter->pending.fetch_sub(1) == 1)
+	{
+		std::vector<void*> ready;
+		{
+			std::lock_guard<std::mutex> lock(counter->waitingLock);
+			ready.swap(counter->waiting);
+		}
+		for (void* j : ready)
+			Push((Job*)j);
+	}
+	counter->releasing--;
+}
+
+JobSystem& GetJobSystem()
+{
+	static JobSystem jobs((std::max)(1u, std::thread::hardware_concurrency()) - 1);
+	return jobs;
+}
+
+
+// --------------------------------------------------------
+// Self test and benchmark
+// --------------------------------------------------------
+namespace
+{
+	// Stand-ins for pointers, which the deque only stores
+	int* Fake(uintptr_t id) { return reinterpret_cast<int*>(id * 16); }
+	uintptr_t FakeId(int* item) { return reinterpret_cast<uintptr_t>(item) / 16; }
+
+	double MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// Something for every item to do that the compiler can't skip
+	void BusyWork(std::vector<float>& out, size_t first, size_t last)
+	{
+		for (size_t i = first; i < last; i++)
+		{
+			float x = (float)i;
+			for (int k = 0; k < 16; k++)
+				x = sqrtf(x * 1.0001f + 1.0f);
+			out[i] = x;
+		}
+	}
+}
+
+JobSystemTestResult TestJobSystem()
+{
+	JobSystemTestResult result = {};
+
+	// The deque on one thread
+	{
+		WorkStealingDeque<int> deque(4);
+		result.Check(!deque.Pop() && !deque.Steal() && deque.IsEmpty(), "A new deque is empty");
+
+		deque.Push(Fake(1));
+		deque.Push(Fake(2));
+		deque.Push(Fake(3));
+		result.Check(deque.Pop() == Fake(3), "The owner pops the newest item");
+		result.Check(deque.Steal() == Fake(1), "Thieves steal the oldest item");
+		result.Check(deque.Pop() == Fake(2) && !deque.Pop() && !deque.Steal(), "Popping the last item empties the deque");
+
+		bool filled = true;
+		for (uintptr_t i = 1; i <= 4; i++)
+			filled = filled && deque.Push(Fake(i));
+		result.Check(filled && !deque.Push(Fake(5)), "Pushing onto a full deque fails");
+		result.Check(deque.Steal() == Fake(1) && deque.Push(Fake(5)), "Stealing makes room at the other end");
+	}
+
+	// The owner pushing and popping while three threads steal, with every
+	// item taken exactly once
+	{
+		const unsigned int count = 200000;
+		WorkStealingDeque<int> deque(256);
+		std::unique_ptr<std::atomic<unsigned int>[]> taken(new std::atomic<unsigned int>[count + 1]);
+		for (unsigned int i = 0; i <= count; i++)
+			taken[i] = 0;
+
+		std::atomic<bool> done(false);
+		std::atomic<unsigned int> stolen(0);
+		std::vector<std::thread> thieves;
+		for (int t = 0; t < 3; t++)
+		{
+			thieves.emplace_back([&]()
+			{
+				while (!done || !deque.IsEmpty())
+				{
+					if (int* item = deque.Steal())
+					{
+						taken[FakeId(item)]++;
+						stolen++;
+					}
+				}
+			});
+		}
+
+		std::mt19937 rng(24);
+		for (unsigned int i = 1; i <= count; i++)
+		{
+			while (!deque.Push(Fake(i)))
+			{
+				if (int* item = deque.Pop())
+					taken[FakeId(item)]++;
+			}
+			if (rng() % 3 == 0)
+			{
+				if (int* item = deque.Pop())
+					taken[FakeId(item)]++;
+			}
+		}
+		while (int* item = deque.Pop())
+			taken[FakeId(item)]++;
+		done = true;
+		for (auto& t : thieves)
+			t.join();
+
+		for (unsigned int i = 1; i <= count; i++)
+			if (taken[i] != 1)
+				result.DequeLost++;
+		result.DequeItems = count;
+		result.DequeStolen = stolen;
+		result.Check(result.DequeLost == 0, "Every item is taken once while stealing");
+	}
+
+	// The job system, with more workers than this test needs cores
+	{
+		JobSystem jobs(3);
+
+		JobCounter unused;
+		jobs.Wait(unused);
+		result.Check(unused.IsDone(), "Waiting on an unused counter returns");
+
+		const unsigned int count = 100000;
+		std::vector<std::atomic<unsigned int>> runs(count);
+		for (auto& r : runs)
+			r = 0;
+		JobCounter all;
+		for (unsigned int i = 0; i < count; i++)
+			jobs.Run([&runs, i]() { runs[i]++; }, &all);
+		jobs.Wait(all);
+		bool once = true;
+		for (auto& r : runs)
+			once = once && r == 1;
+		result.Check(once, "Every job runs exactly once");
+
+		// A binary tree of jobs, each waiting on its own two children
+		std::atomic<unsigned int> nodes(0);
+		std::function<void(unsigned int)> fork = [&](unsigned int depth)
+		{
+			nodes++;
+			if (depth == 0)
+				return;
+			JobCounter children;
+			jobs.Run([&, depth]() { fork(depth - 1); }, &children);
+			jobs.Run([&, depth]() { fork(depth - 1); }, &children);
+			jobs.Wait(children);
+		};
+		JobCounter root;
+		jobs.Run([&]() { fork(11); }, &root);
+		jobs.Wait(root);
+		result.Check(nodes == 4095, "Jobs can wait on jobs they started");
+
+		// Later stages run after earlier ones
+		const unsigned int stages = 8, perStage = 200;
+		JobCounter stageCounters[stages];
+		std::atomic<unsigned int> stageDone[stages];
+		std::atomic<unsigned int> early(0);
+		for (auto& s : stageDone)
+			s = 0;
+		for (unsigned int s = 0; s < stages; s++)
+		{
+			for (unsigned int j = 0; j < perStage; j++)
+			{
+				jobs.Run([&, s]()
+				{
+					if (s > 0 && stageDone[s - 1] != perStage)
+						early++;
+					stageDone[s]++;
+				}, &stageCounters[s], s > 0 ? &stageCounters[s - 1] : 0);
+			}
+		}
+		jobs.Wait(stageCounters[stages - 1]);
+		result.Check(early == 0 && stageDone[stages - 1] == perStage, "Jobs don't start before what they run after");
+
+		JobCounter later;
+		bool ran = false;
+		jobs.Run([&]() { ran = true; }, &later, &stageCounters[0]);
+		jobs.Wait(later);
+		result.Check(ran, "Running after a finished counter starts straight away");
+
+		// Every index exactly once, however it's split up
+		std::vector<std::atomic<unsigned int>> covered(count);
+		for (auto& c : covered)
+			c = 0;
+		JobCounter loop;
+		size_t ranges = jobs.ParallelFor(count, 1000, [&](size_t first, size_t last)
+		{
+			for (size_t i = first; i < last; i++)
+				covered[i]++;
+		}, loop);
+		jobs.Wait(loop);
+		once = ranges == jobs.GetThreadCount() * 4;
+		for (auto& c : covered)
+			once = once && c == 1;
+		result.Check(once, "Parallel for covers every index once");
+
+		JobCounter none, one;
+		result.Check(jobs.ParallelFor(0, 10, [](size_t, size_t) {}, none) == 0 && jobs.ParallelFor(5, 10, [](size_t, size_t) {}, one) == 1, "Parallel for makes no ranges for nothing, and one for a few");
+		jobs.Wait(none);
+		jobs.Wait(one);
+
+		// Random stages of random jobs, some forking and waiting on more
+		const unsigned int rounds = 50;
+		std::mt19937 rng(2024);
+		unsigned int stealsBefore = jobs.GetStealCount();
+		for (unsigned int round = 0; round < rounds; round++)
+		{
+			const unsigned int stressStages = 4;
+			unsigned int stageSize[stressStages];
+			unsigned int total = 0;
+			for (auto& s : stageSize)
+			{
+				s = 50 + rng() % 450;
+				total += s;
+			}
+
+			std::vector<std::atomic<unsigned int>> stressRuns(total);
+			for (auto& r : stressRuns)
+				r = 0;
+			std::atomic<unsigned int> finished[stressStages];
+			std::atomic<unsigned int> errors(0);
+			JobCounter counters[stressStages];
+			unsigned int id = 0;
+			for (unsigned int s = 0; s < stressStages; s++)
+			{
+				finished[s] = 0;
+				for (unsigned int j = 0; j < stageSize[s]; j++, id++)
+				{
+					bool forks = rng() % 8 == 0;
+					jobs.Run([&, s, id, forks]()
+					{
+						if (s > 0 && finished[s - 1] != stageSize[s - 1])
+							errors++;
+						if (forks)
+						{
+							JobCounter children;
+							std::atomic<unsigned int> childRuns(0);
+							for (int c = 0; c < 4; c++)
+								jobs.Run([&]() { childRuns++; }, &children);
+							jobs.Wait(children);
+							if (childRuns != 4)
+								errors++;
+						}
+						stressRuns[id]++;
+						finished[s]++;
+					}, &counters[s], s > 0 ? &counters[s - 1] : 0);
+				}
+			}
+			for (auto& c : counters)
+				jobs.Wait(c);
+
+			for (auto& r : stressRuns)
+				if (r != 1)
+					errors++;
+			result.StressErrors += errors;
+			result.StressJobs += total;
+		}
+		result.StressSteals = jobs.GetStealCount() - stealsBefore;
+		result.Check(result.StressErrors == 0, "Stress rounds run every job once, in order");
+	}
+
+	// With no workers, the waiting thread does everything
+	{
+		JobSystem jobs(0);
+		JobCounter counter;
+		unsigned int runs = 0;
+		for (int i = 0; i < 10; i++)
+			jobs.Run([&]() { runs++; }, &counter);
+		jobs.Wait(counter);
+		result.Check(runs == 10 && jobs.GetThreadCount() == 1, "Jobs run in Wait() without workers");
+	}
+
+	return result;
+}
+
+JobSystemBenchmarkResult BenchmarkJobSystem()
+{
+	JobSystemBenchmarkResult result = {};
+	const size_t count = 1 << 21;
+	std::vector<float> out(count);
+
+	// 1, 2, 4... threads, and every core last
+	unsigned int cores = (std::max)(1u, std::thread::hardware_concurrency());
+	std::vector<unsigned int> threadCounts;
+	for (unsigned int t = 1; t < cores && threadCounts.size() + 1 < JobSystemBenchmarkResult::MaxPoints; t *= 2)
+		threadCounts.push_back(t);
+	threadCounts.push_back(cores);
+
+	for (unsigned int threads : threadCounts)
+	{
+		JobSystem jobs(threads - 1);
+		double best = 0;
+		for (int run = 0; run < 3; run++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			JobCounter done;
+			result.Jobs = (unsigned int)jobs.ParallelFor(count, 1024, [&](size_t first, size_t last) { BusyWork(out, first, last); }, done);
+			jobs.Wait(done);
+			double ms = MillisecondsSince(start);
+			best = run == 0 ? ms : (std::min)(best, ms);
+		}
+		result.Threads[result.Points] = threads;
+		result.Ms[result.Points] = best;
+		result.Points++;
+	}
+
+	// A new thread per range, the way RunParallel() used to
+	{
+		double best = 0;
+		for (int run = 0; run < 3; run++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			std::vector<std::thread> threads;
+			for (unsigned int r = 1; r < cores; r++)
+				threads.emplace_back([&, r]() { BusyWork(out, count * r / cores, count * (r + 1) / cores); });
+			BusyWork(out, 0, count / cores);
+			for (auto& t : threads)
+				t.join();
+			double ms = MillisecondsSince(start);
+			best = run == 0 ? ms : (std::min)(best, ms);
+		}
+		result.ThreadPerRangeMs = best;
+	}
+
+	// What a job costs on its own
+	{
+		const unsigned int emptyJobs = 100000;
+		JobSystem& jobs = GetJobSystem();
+		auto start = std::chrono::high_resolution_clock::now();
+		JobCounter done;
+		for (unsigned int i = 0; i < emptyJobs; i++)
+			jobs.Run([]() {}, &done);
+		jobs.Wait(done);
+		result.EmptyJobNs = MillisecondsSince(start) * 1000000.0 / emptyJobs;
+	}
+
+	return result;
+}
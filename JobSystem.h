@@ -0,0 +1,258 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "SelfTest.h"
+
+// --------------------------------------------------------
+// A Chase-Lev work stealing deque of pointers
+//  - The thread that owns it pushes and pops at the bottom,
+//    without locks, newest first
+//  - Any other thread steals from the top, oldest first,
+//    with one compare and swap
+//  - It's a fixed size; Push() fails when it's full
+// --------------------------------------------------------
+template<typename T>
+class WorkStealingDeque
+{
+public:
+	// Capacity has to be a power of two
+	WorkStealingDeque(unsigned int capacity) :
+		items(new std::atomic<T*>[capacity]),
+		mask(capacity - 1),
+		top(0),
+		bottom(0)
+	{ }
+
+	// Owner only
+	bool Push(T* item)
+	{
+		int64_t b = bottom.load(std::memory_order_relaxed);
+		int64_t t = top.load(std::memory_order_acquire);
+		if (b - t > (int64_t)mask)
+			return false;
+
+		items[b & mask].store(item, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// Owner only; null when empty
+	T* Pop()
+	{
+		// Claim the bottom item first, so thieves see it's taken...
+		int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+
+		if (t > b)
+		{
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return 0;
+		}
+
+		// ...and race them for it only when it's the last one
+		T* item = items[b & mask].load(std::memory_order_relaxed);
+		if (t == b)
+		{
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				item = 0;
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return item;
+	}
+
+	// Any thread; null when empty or another thread got there first
+	T* Steal()
+	{
+		int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b = bottom.load(std::memory_order_acquire);
+		if (t >= b)
+			return 0;
+
+		T* item = items[t & mask].load(std::memory_order_relaxed);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return 0;
+		return item;
+	}
+
+	// Only a guess while other threads are using it
+	bool IsEmpty() { return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed); }
+
+private:
+	std::unique_ptr<std::atomic<T*>[]> items;
+	int64_t mask;
+
+	// Apart, so the owner and thieves don't fight over one cache line
+	std::atomic<int64_t> top;
+	char padding[64];
+	std::atomic<int64_t> bottom;
+};
+
+// --------------------------------------------------------
+// How many jobs are still to finish, for waiting on them or
+// starting other jobs after them
+//  - Every job run with a counter adds one to it, and takes
+//    it off again once it's done
+//  - Has to outlive the jobs, so wait on it before it goes
+//  - Can be used again once it's done
+// --------------------------------------------------------
+class JobCounter
+{
+public:
+	JobCounter();
+
+	bool IsDone();
+
+private:
+	friend class JobSystem;
+
+	std::atomic<unsigned int> pending;
+	std::atomic<unsigned int> releasing;	// Threads that may still touch this after finishing a job
+	std::mutex waitingLock;
+	std::vector<void*> waiting;				// Jobs to run once it's done
+};
+
+// --------------------------------------------------------
+// A fixed set of worker threads running small jobs
+//  - Each worker has its own deque: jobs a worker starts go
+//    on its own, and it runs the newest of those first; once
+//    it's out, it steals the oldest from the others
+//  - Jobs started by other threads (the main thread, the
+//    render thread) go on one shared queue instead
+//  - Wait() runs jobs while it waits, so the thread waiting
+//    is one more worker, and a job can wait on jobs it
+//    started without tying up its thread
+//  - Workers spin for a moment when they run out of jobs,
+//    then sleep until more come
+// --------------------------------------------------------
+class JobSystem
+{
+public:
+	// No workers is fine: then jobs only run in Wait()
+	JobSystem(unsigned int workerCount);
+	~JobSystem();
+
+	// Workers, plus one for the thread waiting
+	unsigned int GetThreadCount();
+
+	// Runs job on some thread, counted by counter (optional), and not
+	// before after (optional) is done
+	void Run(std::function<void()> job, JobCounter* counter = 0, JobCounter* after = 0);
+
+	// Runs jobs until counter is done
+	void Wait(JobCounter& counter);
+
+	// Splits [0, count) into contiguous ranges, a few per thread (so one that
+	// finishes early can take another's) but no smaller than minPerRange, and
+	// runs job(first, last) on each, counted by counter; returns how many
+	// ranges there are
+	template<typename RangeJob>
+	size_t ParallelFor(size_t count, size_t minPerRange, RangeJob job, JobCounter& counter, JobCounter* after = 0)
+	{
+		size_t rangeCount = (std::min)((size_t)GetThreadCount() * RangesPerThread, count / (minPerRange > 0 ? minPerRange : 1));
+		if (rangeCount == 0 && count > 0)
+			rangeCount = 1;
+
+		for (size_t r = 0; r < rangeCount; r++)
+		{
+			size_t first = count * r / rangeCount;
+			size_t last = count * (r + 1) / rangeCount;
+			Run([job, first, last]() { job(first, last); }, &counter, after);
+		}
+		return rangeCount;
+	}
+
+	// Jobs taken from another worker's deque so far
+	unsigned int GetStealCount();
+
+private:
+	static const unsigned int RangesPerThread = 4;
+
+	struct Job
+	{
+		std::function<void()> Work;
+		JobCounter* Counter;
+	};
+
+	struct Worker
+	{
+		Worker() : Jobs(1024) { }
+
+		WorkStealingDeque<Job> Jobs;
+		std::thread Thread;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::atomic<unsigned int> steals;
+
+	// Jobs from threads that aren't workers (or whose deque is full)
+	std::mutex sharedLock;
+	std::deque<Job*> shared;
+	std::atomic<size_t> sharedCount;
+
+	// Jobs on a deque or the shared queue, for deciding whether to sleep
+	std::atomic<unsigned int> queued;
+	std::atomic<unsigned int> sleepers;
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	std::atomic<bool> stopping;
+
+	void WorkerLoop(unsigned int index);
+
+	void Push(Job* job);
+	Job* Take();
+	void Execute(Job* job);
+	void Finish(JobCounter* counter);
+};
+
+// The engine's job system, started the first time it's asked for, with a
+// worker for every core but the one asking
+JobSystem& GetJobSystem();
+
+// --------------------------------------------------------
+// Results from hammering the deque and the job system from
+// every thread, and checking every job ran exactly once and
+// never before what it depended on
+// --------------------------------------------------------
+struct JobSystemTestResult : TestResult
+{
+	unsigned int DequeItems;	// Pushed by the owner while the rest stole
+	unsigned int DequeStolen;
+	unsigned int DequeLost;		// Taken no times or more than once (should be 0)
+	unsigned int StressJobs;
+	unsigned int StressSteals;
+	unsigned int StressErrors;	// Jobs run twice, never, or too early (should be 0)
+};
+
+JobSystemTestResult TestJobSystem();
+
+// --------------------------------------------------------
+// Timings from the same work split over more and more threads
+// --------------------------------------------------------
+struct JobSystemBenchmarkResult
+{
+	static const unsigned int MaxPoints = 8;
+
+	unsigned int Points;
+	unsigned int Threads[MaxPoints];
+	double Ms[MaxPoints];
+
+	unsigned int Jobs;			// Per run
+	double ThreadPerRangeMs;	// Starting a std::thread per range instead, at the most threads
+	double EmptyJobNs;			// Running and waiting on jobs that do nothing, per job
+};
+
+JobSystemBenchmarkResult BenchmarkJobSystem();
@@ -0,0 +1,52 @@
+#include "MappedFile.h"
+
+MappedFile::MappedFile(const std::wstring& path) :
+	file(INVALID_HANDLE_VALUE),
+	mapping(0),
+	data(0),
+	size(0)
+{
+	file = CreateFileW(
+		path.c_str(),
+		GENERIC_READ,
+		FILE_SHARE_READ,
+		0,
+		OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+		0);
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+
+	// Zero-length files can't be mapped, so treat them as invalid
+	LARGE_INTEGER fileSize = {};
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		return;
+
+	mapping = CreateFileMappingW(file, 0, PAGE_READONLY, 0, 0, 0);
+	if (!mapping)
+		return;
+
+	data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data)
+		size = (size_t)fileSize.QuadPart;
+}
+
+MappedFile::~MappedFile()
+{
+	if (data) UnmapViewOfFile(data);
+	if (mapping) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+}
+
+bool MappedFile::IsValid() { return data != 0; }
+const char* MappedFile::GetData() { return data; }
+size_t MappedFile::GetSize() { return size; }
+
+unsigned long long MappedFile::GetWriteTime()
+{
+	FILETIME time = {};
+	if (file == INVALID_HANDLE_VALUE || !GetFileTime(file, 0, 0, &time))
+		return 0;
+
+	return ((unsigned long long)time.dwHighDateTime << 32) | time.dwLowDateTime;
+}
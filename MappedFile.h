@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Windows.h>
+#include <string>
+
+// --------------------------------------------------------
+// A read-only, memory-mapped view of an entire file
+//
+// The OS pages the file in on demand, so large assets can
+// be parsed or uploaded straight from the mapping without
+// first being copied into a std::vector
+// --------------------------------------------------------
+class MappedFile
+{
+private:
+	HANDLE file;
+	HANDLE mapping;
+	const char* data;
+	size_t size;
+
+public:
+	MappedFile(const std::wstring& path);
+	~MappedFile();
+
+	MappedFile(MappedFile const&) = delete;
+	void operator=(MappedFile const&) = delete;
+
+	bool IsValid();
+	const char* GetData();
+	size_t GetSize();
+	unsigned long long GetWriteTime();	// As a FILETIME, or 0 if unknown
+};
@@ -1,33 +1,88 @@
 #include "Material.h"
 
 std::shared_ptr<SimplePixelShader> Material::GetPixelShader() { return pixelShader; }
-std::shared_ptr<SimpleVertexShader> Material::GetVertexShader() { return vertexShader; }
+std::shared_ptr<SimpleVertexShader> Material::GetVertexShader(VertexFormat format, bool instanced)
+{
+	if (instanced)
+		return format == VertexFormat::Packed ? packedInstancedVertexShader : instancedVertexShader;
+	return format == VertexFormat::Packed ? packedVertexShader : vertexShader;
+}
 
 void Material::SetPixelShader(std::shared_ptr<SimplePixelShader> ps) { pixelShader = ps; }
-void Material::SetVertexShader(std::shared_ptr<SimpleVertexShader> vs) { vertexShader = vs; }
+void Material::SetVertexShader(std::shared_ptr<SimpleVertexShader> vs, VertexFormat format, bool instanced)
+{
+	if (instanced)
+		(format == VertexFormat::Packed ? packedInstancedVertexShader : instancedVertexShader) = vs;
+	else
+		(format == VertexFormat::Packed ? packedVertexShader : vertexShader) = vs;
+}
 
 void Material::AddTextureSRV(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv) { textureSRVs.insert({ name, srv }); }
+void Material::SetTextureSRV(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv) { textureSRVs[name] = srv; }
 void Material::AddSampler(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler) { samplers.insert({ name, sampler }); }
 
-Material::Material(std::shared_ptr<SimplePixelShader> ps, std::shared_ptr<SimpleVertexShader> vs) :
+DirectX::XMFLOAT3 Material::GetColorTint() { return colorTint; }
+void Material::SetColorTint(DirectX::XMFLOAT3 tint) { colorTint = tint; }
+
+Material::Material(std::shared_ptr<SimplePixelShader> ps, std::shared_ptr<SimpleVertexShader> vs, std::shared_ptr<SimpleVertexShader> packedVS) :
 	pixelShader(ps),
-	vertexShader(vs)
+	vertexShader(vs),
+	packedVertexShader(packedVS),
+	colorTint(1.0f, 1.0f, 1.0f)
 {}
 
-void Material::PrepareMaterial(Transform * transform, std::shared_ptr<Camera> camera)
+void Material::PrepareMaterial(const ObjectSnapshot& object, std::shared_ptr<Mesh> mesh, RenderBindStats& stats)
 {
-	pixelShader->SetShader();
-	vertexShader->SetShader();
+	// The vertex shader has to match the layout of the mesh's vertices
+	std::shared_ptr<SimpleVertexShader> vs = GetVertexShader(mesh->GetVertexFormat());
 
-	vertexShader->SetMatrix4x4("world", transform->GetWorldMatrix());
-	vertexShader->SetMatrix4x4("view", camera->GetView());
-	vertexShader->SetMatrix4x4("projection", camera->GetProjection());
-	vertexShader->SetMatrix4x4("worldInvTrans", transform->GetWorldInverseTransposeMatrix());
-	vertexShader->CopyAllBufferData();
+	pixelShader->SetShader();
+	vs->SetShader();
+	stats.PixelShaderBinds++;
+	stats.VertexShaderBinds++;
+	stats.InputLayoutBinds++;
 
-	pixelShader->SetFloat3("cameraPosition", camera->GetTransform()->GetPosition());
-	pixelShader->CopyAllBufferData();
+	SetMaterialData();
+	SetMeshData(mesh);
+	SetObjectData(object, mesh);
+	BindResources(stats);
+}
 
+void Material::BindResources(RenderBindStats& stats)
+{
 	for (auto& t : textureSRVs) { pixelShader->SetShaderResourceView(t.first.c_str(), t.second); }
 	for (auto& s : samplers) { pixelShader->SetSamplerState(s.first.c_str(), s.second); }
+	stats.ShaderResourceBinds += (unsigned int)textureSRVs.size();
+	stats.SamplerBinds += (unsigned int)samplers.size();
+}
+
+void Material::SetMaterialData()
+{
+	pixelShader->SetFloat3("colorTint", colorTint);
+	pixelShader->CopyBufferData("PerMaterial");
+}
+
+void Material::SetMeshData(std::shared_ptr<Mesh> mesh, bool instanced)
+{
+	if (mesh->GetVertexFormat() != VertexFormat::Packed)
+		return;
+
+	std::shared_ptr<SimpleVertexShader> vs = GetVertexShader(VertexFormat::Packed, instanced);
+	vs->SetFloat3("positionScale", mesh->GetPositionScale());
+	vs->SetFloat3("positionOffset", mesh->GetPositionOffset());
+	vs->CopyBufferData("PerMesh");
+}
+
+void Material::SetObjectData(const ObjectSnapshot& object, std::shared_ptr<Mesh> mesh, ConstantBufferRing* ring)
+{
+	std::shared_ptr<SimpleVertexShader> vs = GetVertexShader(mesh->GetVertexFormat());
+
+	vs->SetMatrix4x4("world", object.World);
+	vs->SetInt("uniformScale", object.UniformScale);
+	if (!object.UniformScale)
+		vs->SetMatrix4x4("worldInvTrans", object.WorldInverseTranspose);
+
+	// From the ring when there is one that works, otherwise the shader's own buffer
+	if (!ring || !ring->Upload(ShaderStage::Vertex, vs->GetBufferInfo("PerObject")))
+		vs->CopyBufferData("PerObject");
 }
@@ -5,29 +5,48 @@
 #include <memory>
 
 #include "SimpleShader.h"
-#include "Camera.h"
-#include "Transform.h"
+#include "FrameSnapshot.h"
+#include "Mesh.h"
 
 class Material
 {
 private:
 	std::shared_ptr<SimplePixelShader> pixelShader;
 	std::shared_ptr<SimpleVertexShader> vertexShader;
+	std::shared_ptr<SimpleVertexShader> packedVertexShader; // Same shader, for PackedVertex meshes
+	std::shared_ptr<SimpleVertexShader> instancedVertexShader; // Both again, for instanced draws
+	std::shared_ptr<SimpleVertexShader> packedInstancedVertexShader;
 
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> textureSRVs;
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11SamplerState>> samplers;
+	DirectX::XMFLOAT3 colorTint;
 
 public:
 	std::shared_ptr<SimplePixelShader> GetPixelShader();
-	std::shared_ptr<SimpleVertexShader> GetVertexShader();
+	std::shared_ptr<SimpleVertexShader> GetVertexShader(VertexFormat format = VertexFormat::Full, bool instanced = false); // Null if there isn't one
 
 	void SetPixelShader(std::shared_ptr<SimplePixelShader> ps);
-	void SetVertexShader(std::shared_ptr<SimpleVertexShader> ps);
+	void SetVertexShader(std::shared_ptr<SimpleVertexShader> vs, VertexFormat format = VertexFormat::Full, bool instanced = false);
 
 	void AddTextureSRV(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
+	void SetTextureSRV(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv); // Replaces one already added
 	void AddSampler(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler);
 
-	void PrepareMaterial(Transform* transform, std::shared_ptr<Camera> camera);
+	DirectX::XMFLOAT3 GetColorTint();
+	void SetColorTint(DirectX::XMFLOAT3 tint);
 
-	Material(std::shared_ptr<SimplePixelShader> ps, std::shared_ptr<SimpleVertexShader> vs);
+	// Binds both shaders and every texture and sampler, then uploads the material's,
+	// mesh's and object's constants
+	//  - The shaders' PerFrame constants (camera, lights) are the caller's to set,
+	//    once per frame
+	void PrepareMaterial(const ObjectSnapshot& object, std::shared_ptr<Mesh> mesh, RenderBindStats& stats);
+
+	// The pieces of PrepareMaterial(), for a sorted queue that only binds and
+	// uploads what changed since the previous draw (the shaders it binds itself)
+	void BindResources(RenderBindStats& stats);
+	void SetMaterialData();
+	void SetMeshData(std::shared_ptr<Mesh> mesh, bool instanced = false); // Only packed meshes have any
+	void SetObjectData(const ObjectSnapshot& object, std::shared_ptr<Mesh> mesh, ConstantBufferRing* ring = 0); // Not for instanced draws, which get it from the instance data
+
+	Material(std::shared_ptr<SimplePixelShader> ps, std::shared_ptr<SimpleVertexShader> vs, std::shared_ptr<SimpleVertexShader> packedVS = 0);
 };
\ No newline at end of file
@@ -1,13 +1,168 @@
 #include "Mesh.h"
+#include "ObjParser.h"
+#include "CookedMesh.h"
+#include "MappedFile.h"
+#include "MeshOptimizer.h"
+#include "VertexPacking.h"
+#include "MeshSimplifier.h"
 #include <DirectXMath.h>
 #include <vector>
-#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <chrono>
+#include <cstdio>
+#include <cmath>
+#include <cassert>
 
 using namespace DirectX;
 
-void Mesh::CreateBuffers(Vertex* vArray, int vCount, unsigned int* iArray, int iCount, Microsoft::WRL::ComPtr<ID3D11Device> device)
+// Packed UVs have to stay within a texel of a 1024x1024 texture,
+// otherwise the mesh falls back to full precision vertices
+static const float MaxPackedUVError = 1.0f / 1024.0f;
+
+// True prints what each load did (parse speed, welding, optimizer and
+// packing stats, LODs, ...) to the debug console
+static const bool VerboseLoading = false;
+
+void Mesh::CreateBuffers(const Vertex* vArray, int vCount, const unsigned int* iArray, int iCount, const CookedMeshLod* lodRanges, unsigned int lodCount, Microsoft::WRL::ComPtr<ID3D11Device> device)
 {
-	CalculateTangents(vArray, vCount, iArray, iCount);
+	const Vertex* sourceVertices = vArray;
+	int sourceVertexCount = vCount;
+
+	lods.assign(lodCount, MeshLod());
+	for (unsigned int l = 0; l < lodCount; l++)
+	{
+		lods[l].IndexCount = lodRanges[l].IndexCount;
+		lods[l].Error = lodRanges[l].Error;
+	}
+
+	// Use 16-bit indices whenever every index fits, and split bigger
+	// meshes (if allowed) so that each piece fits on its own
+	std::vector<Vertex> splitVertices;
+	std::vector<unsigned short> shortIndices;
+	if (vCount <= 65536)
+	{
+		shortIndices.resize(iCount);
+		for (int i = 0; i < iCount; i++)
+			shortIndices[i] = (unsigned short)iArray[i];
+		for (unsigned int l = 0; l < lodCount; l++)
+			lods[l].SubMeshes.push_back({ lodRanges[l].IndexStart, lodRanges[l].IndexCount, 0 });
+	}
+	else if (splitLargeMeshes)
+	{
+		// Each level is split on its own, so no piece straddles two levels
+		std::vector<Vertex> levelVertices;
+		std::vector<unsigned short> levelIndices;
+		std::vector<SubMesh> levelSubMeshes;
+		for (unsigned int l = 0; l < lodCount; l++)
+		{
+			SplitForShortIndices(levelVertices, levelIndices, levelSubMeshes, vArray, vCount, iArray + lodRanges[l].IndexStart, lodRanges[l].IndexCount);
+			for (SubMesh s : levelSubMeshes)
+			{
+				s.IndexStart += (unsigned int)shortIndices.size();
+				s.BaseVertex += (int)splitVertices.size();
+				lods[l].SubMeshes.push_back(s);
+			}
+			splitVertices.insert(splitVertices.end(), levelVertices.begin(), levelVertices.end());
+			shortIndices.insert(shortIndices.end(), levelIndices.begin(), levelIndices.end());
+		}
+
+		if (VerboseLoading)
+			printf("  Split into %zu sub-meshes for 16-bit indices (%d -> %zu vertices)\n",
+				lods[0].SubMeshes.size(),
+				vCount,
+				splitVertices.size());
+
+		vArray = &splitVertices[0];
+		vCount = (int)splitVertices.size();
+	}
+	else
+	{
+		for (unsigned int l = 0; l < lodCount; l++)
+			lods[l].SubMeshes.push_back({ lodRanges[l].IndexStart, lodRanges[l].IndexCount, 0 });
+	}
+	indexFormat = shortIndices.empty() ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+
+	// Meshlets are ranges of the final index buffer, which the split above
+	// kept in triangle order, so build them from the original indices
+	for (MeshLod& lod : lods)
+		for (auto& s : lod.SubMeshes)
+			BuildMeshlets(lod.Meshlets, sourceVertices, sourceVertexCount, iArray, s.IndexStart, s.IndexCount, s.BaseVertex);
+	if (VerboseLoading)
+		printf("  Built %zu meshlets (%.1f triangles each)\n",
+			lods[0].Meshlets.size(),
+			lods[0].Meshlets.empty() ? 0.0 : lods[0].IndexCount / 3.0 / lods[0].Meshlets.size());
+
+	// Packed meshes are compressed right before upload, so
+	// everything up to here (and the cooked file) uses Vertex
+	const void* vertexData = vArray;
+	UINT vertexBytes = sizeof(Vertex) * vCount;
+	std::vector<PackedVertex> packed;
+	if (format == VertexFormat::Packed)
+	{
+		packed.resize(vCount);
+		PackVertices(&packed[0], vArray, vCount, &positionScale, &positionOffset);
+
+		// Round trip everything to make sure the compression is acceptable
+		VertexPackingError error = MeasurePackingError(&packed[0], vArray, vCount, positionScale, positionOffset);
+		if (VerboseLoading)
+			printf("  Packed %d vertices (%.1f KB -> %.1f KB), max error: position %.5f, uv %.5f, normal %.4f deg, tangent %.4f deg, %u tangent sign errors\n",
+				vCount,
+				sizeof(Vertex) * vCount / 1024.0,
+				sizeof(PackedVertex) * vCount / 1024.0,
+				error.Position,
+				error.UV,
+				error.NormalDegrees,
+				error.TangentDegrees,
+				error.TangentSignErrors);
+
+		if (error.UV > MaxPackedUVError)
+		{
+			if (VerboseLoading)
+				printf("  UV error too large, keeping full precision vertices\n");
+			format = VertexFormat::Full;
+			positionScale = XMFLOAT3(1, 1, 1);
+			positionOffset = XMFLOAT3(0, 0, 0);
+		}
+		else
+		{
+			vertexData = &packed[0];
+			vertexBytes = sizeof(PackedVertex) * vCount;
+		}
+	}
+
+	const void* indexData = shortIndices.empty() ? (const void*)iArray : &shortIndices[0];
+	this->iCount = lods[0].IndexCount;
+	vertexStride = vertexBytes / vCount;
+	vertexCount = vCount;
+
+	if (positionStream)
+		CreatePositionStream(vertexData, indexData, iCount, device);
+
+	// Shared geometry goes into the arena's buffers, and every range
+	// of this mesh moves to wherever it landed in them
+	if (arena)
+	{
+		GeometryAllocation allocation = arena->Add(
+			vertexData, vertexStride, vCount,
+			indexData, indexFormat, iCount);
+		arenaPool = allocation.Pool;
+
+		for (MeshLod& lod : lods)
+		{
+			for (SubMesh& s : lod.SubMeshes)
+			{
+				s.IndexStart += allocation.IndexStart;
+				s.BaseVertex += allocation.BaseVertex;
+			}
+			for (Meshlet& m : lod.Meshlets)
+			{
+				m.IndexStart += allocation.IndexStart;
+				m.BaseVertex += allocation.BaseVertex;
+			}
+		}
+		return;
+	}
 
 	// Create a VERTEX BUFFER
 	{
@@ -16,7 +171,7 @@ void Mesh::CreateBuffers(Vertex* vArray, int vCount, unsigned int* iArray, int i
 		//  - After the buffer is created, this description variable is unnecessary
 		D3D11_BUFFER_DESC vbd = {};
 		vbd.Usage = D3D11_USAGE_IMMUTABLE;	// Will NEVER change
-		vbd.ByteWidth = sizeof(Vertex) * vCount;
+		vbd.ByteWidth = vertexBytes;
 		vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER; // Tells Direct3D this is a vertex buffer
 		vbd.CPUAccessFlags = 0;	// Note: We cannot access the data from C++ (this is good)
 		vbd.MiscFlags = 0;
@@ -26,7 +181,7 @@ void Mesh::CreateBuffers(Vertex* vArray, int vCount, unsigned int* iArray, int i
 		// - This is how we initially fill the buffer with data
 		// - Essentially, we're specifying a pointer to the data to copy
 		D3D11_SUBRESOURCE_DATA initialVertexData = {};
-		initialVertexData.pSysMem = vArray; // pSysMem = Pointer to System Memory
+		initialVertexData.pSysMem = vertexData; // pSysMem = Pointer to System Memory
 
 		// Actually create the buffer on the GPU with the initial data
 		// - Once we do this, we'll NEVER CHANGE DATA IN THE BUFFER AGAIN
@@ -40,7 +195,7 @@ void Mesh::CreateBuffers(Vertex* vArray, int vCount, unsigned int* iArray, int i
 		//  - Bind Flag (used as an index buffer instead of a vertex buffer) 
 		D3D11_BUFFER_DESC ibd = {};
 		ibd.Usage = D3D11_USAGE_IMMUTABLE;	// Will NEVER change
-		ibd.ByteWidth = sizeof(unsigned int) * iCount;
+		ibd.ByteWidth = (indexFormat == DXGI_FORMAT_R16_UINT ? sizeof(unsigned short) : sizeof(unsigned int)) * iCount;
 		ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;	// Tells Direct3D this is an index buffer
 		ibd.CPUAccessFlags = 0;	// Note: We cannot access the data from C++ (this is good)
 		ibd.MiscFlags = 0;
@@ -48,328 +203,554 @@ void Mesh::CreateBuffers(Vertex* vArray, int vCount, unsigned int* iArray, int i
 
 		// Specify the initial data for this buffer, similar to above
 		D3D11_SUBRESOURCE_DATA initialIndexData = {};
-		initialIndexData.pSysMem = iArray; // pSysMem = Pointer to System Memory
+		initialIndexData.pSysMem = indexData; // pSysMem = Pointer to System Memory
 
 		// Actually create the buffer with the initial data
 		// - Once we do this, we'll NEVER CHANGE THE BUFFER AGAIN
 		device->CreateBuffer(&ibd, &initialIndexData, ib.GetAddressOf());
-
-		this->iCount = iCount;
 	}
 }
 
 // --------------------------------------------------------
-// Author: Chris Cascioli
-// Purpose: Calculates the tangents of the vertices in a mesh
-// 
-// - You are allowed to directly copy/paste this into your code base
-//   for assignments, given that you clearly cite that this is not
-//   code of your own design.
-//
-// - Code originally adapted from: http://www.terathon.com/code/tangent.html
-//   - Updated version now found here: http://foundationsofgameenginedev.com/FGED2-sample.pdf
-//   - See listing 7.4 in section 7.5 (page 9 of the PDF)
-//
-// - Note: For this code to work, your Vertex format must
-//         contain an XMFLOAT3 called Tangent
-//
-// - Be sure to call this BEFORE creating your D3D vertex/index buffers
+// Computes the object-space bounding volumes
+//  - Box: exact min/max
+//  - Sphere: Ritter's, or one around the box center if tighter
+//  - Oriented box: fitted along the principal axes of the points
 // --------------------------------------------------------
-void Mesh::CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices)
+void Mesh::ComputeBounds(const Vertex* verts, int numVerts)
 {
-	// Reset tangents
+	BoundingBox::CreateFromPoints(boundingBox, numVerts, &verts[0].Position, sizeof(Vertex));
+	BoundingOrientedBox::CreateFromPoints(orientedBox, numVerts, &verts[0].Position, sizeof(Vertex));
+	BoundingSphere::CreateFromPoints(boundingSphere, numVerts, &verts[0].Position, sizeof(Vertex));
+
+	XMVECTOR boxCenter = XMLoadFloat3(&boundingBox.Center);
+	XMVECTOR maxDistanceSq = XMVectorZero();
 	for (int i = 0; i < numVerts; i++)
+		maxDistanceSq = XMVectorMax(maxDistanceSq, XMVector3LengthSq(XMLoadFloat3(&verts[i].Position) - boxCenter));
+
+	float boxCenterRadius = sqrtf(XMVectorGetX(maxDistanceSq));
+	if (boxCenterRadius < boundingSphere.Radius)
+		boundingSphere = BoundingSphere(boundingBox.Center, boxCenterRadius);
+
+#if defined(DEBUG) || defined(_DEBUG)
+	// Check everything against brute force, allowing for float error
+	XMVECTOR minV = XMLoadFloat3(&verts[0].Position);
+	XMVECTOR maxV = minV;
+	for (int i = 1; i < numVerts; i++)
 	{
-		verts[i].Tangent = XMFLOAT3(0, 0, 0);
+		minV = XMVectorMin(minV, XMLoadFloat3(&verts[i].Position));
+		maxV = XMVectorMax(maxV, XMLoadFloat3(&verts[i].Position));
 	}
 
-	// Calculate tangents one whole triangle at a time
-	for (int i = 0; i < numIndices;)
+	float tolerance = 0.0001f * (1.0f + XMVectorGetX(XMVector3Length(maxV - minV)));
+	BoundingBox expectedBox;
+	BoundingBox::CreateFromPoints(expectedBox, minV, maxV);
+	BoundingSphere looseSphere(boundingSphere.Center, boundingSphere.Radius + tolerance);
+	BoundingOrientedBox looseOrientedBox(orientedBox.Center,
+		XMFLOAT3(orientedBox.Extents.x + tolerance, orientedBox.Extents.y + tolerance, orientedBox.Extents.z + tolerance),
+		orientedBox.Orientation);
+
+	int outside = 0;
+	for (int i = 0; i < numVerts; i++)
 	{
-		// Grab indices and vertices of first triangle
-		unsigned int i1 = indices[i++];
-		unsigned int i2 = indices[i++];
-		unsigned int i3 = indices[i++];
-		Vertex* v1 = &verts[i1];
-		Vertex* v2 = &verts[i2];
-		Vertex* v3 = &verts[i3];
-
-		// Calculate vectors relative to triangle positions
-		float x1 = v2->Position.x - v1->Position.x;
-		float y1 = v2->Position.y - v1->Position.y;
-		float z1 = v2->Position.z - v1->Position.z;
-
-		float x2 = v3->Position.x - v1->Position.x;
-		float y2 = v3->Position.y - v1->Position.y;
-		float z2 = v3->Position.z - v1->Position.z;
-
-		// Do the same for vectors relative to triangle uv's
-		float s1 = v2->UV.x - v1->UV.x;
-		float t1 = v2->UV.y - v1->UV.y;
-
-		float s2 = v3->UV.x - v1->UV.x;
-		float t2 = v3->UV.y - v1->UV.y;
-
-		// Create vectors for tangent calculation
-		float r = 1.0f / (s1 * t2 - s2 * t1);
-
-		float tx = (t2 * x1 - t1 * x2) * r;
-		float ty = (t2 * y1 - t1 * y2) * r;
-		float tz = (t2 * z1 - t1 * z2) * r;
-
-		// Adjust tangents of each vert of the triangle
-		v1->Tangent.x += tx;
-		v1->Tangent.y += ty;
-		v1->Tangent.z += tz;
-
-		v2->Tangent.x += tx;
-		v2->Tangent.y += ty;
-		v2->Tangent.z += tz;
-
-		v3->Tangent.x += tx;
-		v3->Tangent.y += ty;
-		v3->Tangent.z += tz;
+		XMVECTOR p = XMLoadFloat3(&verts[i].Position);
+		if (looseSphere.Contains(p) == DISJOINT || looseOrientedBox.Contains(p) == DISJOINT)
+			outside++;
 	}
 
-	// Ensure all of the tangents are orthogonal to the normals
-	for (int i = 0; i < numVerts; i++)
+	XMVECTOR boxError = XMVectorAbs(XMLoadFloat3(&expectedBox.Center) - boxCenter) +
+		XMVectorAbs(XMLoadFloat3(&expectedBox.Extents) - XMLoadFloat3(&boundingBox.Extents));
+	assert(XMVector3LessOrEqual(boxError, XMVectorReplicate(tolerance)) && "Box matches a brute force min/max");
+	assert(outside == 0 && "Every vertex is inside the sphere and the oriented box");
+#endif
+}
+
+// --------------------------------------------------------
+// Generates tangents with the mesh's tangent mode
+//  - See GenerateTangentsReference() for the original version
+//  - MikkTSpace mode may add vertices at mirrored UV seams
+//  - Be sure to call this BEFORE creating your D3D vertex/index buffers
+// --------------------------------------------------------
+void Mesh::CalculateTangents(std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
+	static const char* modeNames[] = { "reference", "fast", "MikkTSpace" };
+	size_t vertexCount = verts.size();
+
+	auto start = std::chrono::high_resolution_clock::now();
+	GenerateTangents(verts, indices, tangentMode);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	if (VerboseLoading)
+		printf("  Tangents (%s) for %zu triangles in %.2f ms, %zu vertices split at mirrored seams\n",
+			modeNames[(int)tangentMode],
+			indices.size() / 3,
+			ms,
+			verts.size() - vertexCount);
+}
+
+// --------------------------------------------------------
+// Builds the position-only stream from the final vertex data
+//  - Positions are copied exactly as stored (floats, or packed
+//    UNORM16 for packed meshes) so depth matches the full stream
+//  - Vertices that only differed in UV/normal/tangent become one
+//  - The index buffer keeps the same layout, so each level of
+//    detail is the same range as in the full index buffer
+// --------------------------------------------------------
+void Mesh::CreatePositionStream(const void* vertexData, const void* indexData, int iCount, Microsoft::WRL::ComPtr<ID3D11Device> device)
+{
+	positionStride = format == VertexFormat::Packed ? sizeof(PackedVertex::Position) : sizeof(Vertex::Position);
+	const unsigned char* vertexBytes = (const unsigned char*)vertexData;
+	auto position = [&](unsigned int v) { return vertexBytes + (size_t)v * vertexStride; };
+
+	// Sort the vertices by position to find the duplicates
+	std::vector<unsigned int> order(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; v++)
+		order[v] = v;
+	std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+		int c = memcmp(position(a), position(b), positionStride);
+		return c < 0 || (c == 0 && a < b);
+	});
+
+	std::vector<unsigned int> remap(vertexCount);
+	std::vector<unsigned char> positions;
+	positions.reserve((size_t)vertexCount * positionStride);
+	for (unsigned int i = 0; i < vertexCount; i++)
+	{
+		if (i == 0 || memcmp(position(order[i]), position(order[i - 1]), positionStride) != 0)
+			positions.insert(positions.end(), position(order[i]), position(order[i]) + positionStride);
+		remap[order[i]] = (unsigned int)(positions.size() / positionStride) - 1;
+	}
+	positionCount = (unsigned int)(positions.size() / positionStride);
+
+	// Sub-mesh indices are relative to their BaseVertex, the new ones aren't
+	std::vector<unsigned int> indices(iCount);
+	for (MeshLod& lod : lods)
+	{
+		for (SubMesh& s : lod.SubMeshes)
+		{
+			for (unsigned int i = s.IndexStart; i < s.IndexStart + s.IndexCount; i++)
+			{
+				unsigned int index = indexFormat == DXGI_FORMAT_R16_UINT ? ((const unsigned short*)indexData)[i] : ((const unsigned int*)indexData)[i];
+				indices[i] = remap[index + s.BaseVertex];
+			}
+		}
+
+		// A level's sub-meshes are next to each other, so one range covers it
+		lod.PositionRange = { lod.SubMeshes.empty() ? 0 : lod.SubMeshes.front().IndexStart, lod.IndexCount, 0 };
+	}
+
+	std::vector<unsigned short> shortIndices;
+	positionIndexFormat = DXGI_FORMAT_R32_UINT;
+	if (positionCount <= 65536)
+	{
+		shortIndices.assign(indices.begin(), indices.end());
+		positionIndexFormat = DXGI_FORMAT_R16_UINT;
+	}
+	const void* positionIndices = shortIndices.empty() ? (const void*)&indices[0] : &shortIndices[0];
+
+	if (VerboseLoading)
+		printf("  Position stream: %u positions (%u vertices), %.1f KB -> %.1f KB\n",
+			positionCount,
+			vertexCount,
+			vertexStride * vertexCount / 1024.0,
+			positionStride * positionCount / 1024.0);
+
+	if (arena)
+	{
+		GeometryAllocation allocation = arena->Add(
+			&positions[0], positionStride, positionCount,
+			positionIndices, positionIndexFormat, iCount);
+		positionPool = allocation.Pool;
+
+		for (MeshLod& lod : lods)
+		{
+			lod.PositionRange.IndexStart += allocation.IndexStart;
+			lod.PositionRange.BaseVertex += allocation.BaseVertex;
+		}
+		return;
+	}
+
+	D3D11_BUFFER_DESC vbd = {};
+	vbd.Usage = D3D11_USAGE_IMMUTABLE;
+	vbd.ByteWidth = positionStride * positionCount;
+	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	D3D11_SUBRESOURCE_DATA initialVertexData = {};
+	initialVertexData.pSysMem = &positions[0];
+	device->CreateBuffer(&vbd, &initialVertexData, positionVB.GetAddressOf());
+
+	D3D11_BUFFER_DESC ibd = {};
+	ibd.Usage = D3D11_USAGE_IMMUTABLE;
+	ibd.ByteWidth = (positionIndexFormat == DXGI_FORMAT_R16_UINT ? sizeof(unsigned short) : sizeof(unsigned int)) * iCount;
+	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	D3D11_SUBRESOURCE_DATA initialIndexData = {};
+	initialIndexData.pSysMem = positionIndices;
+	device->CreateBuffer(&ibd, &initialIndexData, positionIB.GetAddressOf());
+}
+
+// --------------------------------------------------------
+// Appends simplified levels of detail to the index list, each
+// cache optimized on its own, and describes where they landed
+//  - Level 0 is the mesh as it was passed in
+// --------------------------------------------------------
+void Mesh::BuildLods(const std::vector<Vertex>& verts, std::vector<unsigned int>& indices, std::vector<CookedMeshLod>& lodRanges)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<LodLevel> levels = GenerateLodChain(&indices[0], indices.size(), &verts[0], verts.size(), COOKED_MESH_MAX_LODS);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	lodRanges.clear();
+	lodRanges.push_back({ 0, (unsigned int)indices.size(), 0.0f });
+	for (size_t l = 1; l < levels.size(); l++)
 	{
-		// Grab the two vectors
-		XMVECTOR normal = XMLoadFloat3(&verts[i].Normal);
-		XMVECTOR tangent = XMLoadFloat3(&verts[i].Tangent);
+		size_t first = indices.size();
+		indices.resize(first + levels[l].Indices.size());
+		OptimizeVertexCache(&indices[first], &levels[l].Indices[0], levels[l].Indices.size(), verts.size());
+		lodRanges.push_back({ (unsigned int)first, (unsigned int)levels[l].Indices.size(), levels[l].Error });
+	}
+
+	if (VerboseLoading)
+	{
+		printf("  %zu LODs in %.2f ms:", lodRanges.size(), ms);
+		for (auto& r : lodRanges)
+			printf(" %u (%.4f)", r.IndexCount / 3, r.Error);
+		printf("\n");
+	}
+}
+
+// --------------------------------------------------------
+// Reorders triangles for the post-transform vertex cache,
+// then clusters of triangles to reduce overdraw, and finally
+// the vertices themselves to match the new fetch order
+// --------------------------------------------------------
+void Mesh::Optimize(std::vector<Vertex>& verts, std::vector<unsigned int>& indices)
+{
+	// The stats are only worth measuring when they get printed
+	VertexCacheStats input = {}, cache = {}, overdraw = {};
+	if (VerboseLoading)
+		input = AnalyzeVertexCache(&indices[0], indices.size(), verts.size());
 
-		// Use Gram-Schmidt orthonormalize to ensure
-		// the normal and tangent are exactly 90 degrees apart
-		tangent = XMVector3Normalize(
-			tangent - normal * XMVector3Dot(normal, tangent));
+	std::vector<unsigned int> cacheOptimized(indices.size());
+	OptimizeVertexCache(&cacheOptimized[0], &indices[0], indices.size(), verts.size());
+	if (VerboseLoading)
+		cache = AnalyzeVertexCache(&cacheOptimized[0], cacheOptimized.size(), verts.size());
 
-		// Store the tangent
-		XMStoreFloat3(&verts[i].Tangent, tangent);
+	OptimizeOverdraw(&indices[0], &cacheOptimized[0], indices.size(), &verts[0], verts.size());
+	if (VerboseLoading)
+		overdraw = AnalyzeVertexCache(&indices[0], indices.size(), verts.size());
+
+	std::vector<Vertex> fetchOptimized(verts.size());
+	fetchOptimized.resize(OptimizeVertexFetch(&fetchOptimized[0], &indices[0], indices.size(), &verts[0], verts.size()));
+	verts.swap(fetchOptimized);
+
+	if (VerboseLoading)
+	{
+		VertexCacheStats fetch = AnalyzeVertexCache(&indices[0], indices.size(), verts.size());
+		printf("  ACMR/ATVR: input %.3f/%.3f, vertex cache %.3f/%.3f, overdraw %.3f/%.3f, vertex fetch %.3f/%.3f\n",
+			input.ACMR, input.ATVR,
+			cache.ACMR, cache.ATVR,
+			overdraw.ACMR, overdraw.ATVR,
+			fetch.ACMR, fetch.ATVR);
 	}
 }
 
-Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetVertexBuffer() { return vb; }
+Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetVertexBuffer() { return arena ? arena->GetVertexBuffer(arenaPool) : vb; }
 
-Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetIndexBuffer() { return ib; }
+Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetIndexBuffer() { return arena ? arena->GetIndexBuffer(arenaPool) : ib; }
 
 unsigned int Mesh::GetIndexCount() { return iCount; }
 
-Mesh::Mesh(Vertex* vArray, int vCount, unsigned int* iArray, int iCount, Microsoft::WRL::ComPtr<ID3D11Device> device)
+DXGI_FORMAT Mesh::GetIndexFormat() { return indexFormat; }
+
+const std::vector<MeshLod>& Mesh::GetLods() { return lods; }
+
+const std::vector<SubMesh>& Mesh::GetSubMeshes(unsigned int lod) { return lods[lod].SubMeshes; }
+
+const std::vector<Meshlet>& Mesh::GetMeshlets(unsigned int lod) { return lods[lod].Meshlets; }
+
+VertexFormat Mesh::GetVertexFormat() { return format; }
+
+TangentMode Mesh::GetTangentMode() { return tangentMode; }
+
+const BoundingBox& Mesh::GetBoundingBox() { return boundingBox; }
+
+const BoundingSphere& Mesh::GetBoundingSphere() { return boundingSphere; }
+
+const BoundingOrientedBox& Mesh::GetOrientedBox() { return orientedBox; }
+
+bool Mesh::HasPositionStream() { return positionStream; }
+
+unsigned int Mesh::GetVertexStreamBytes() { return vertexStride * vertexCount; }
+
+unsigned int Mesh::GetPositionStreamBytes() { return positionStream ? positionStride * positionCount : 0; }
+
+XMFLOAT3 Mesh::GetPositionScale() { return positionScale; }
+
+XMFLOAT3 Mesh::GetPositionOffset() { return positionOffset; }
+
+Mesh::Mesh(Vertex* vArray, int vCount, unsigned int* iArray, int iCount, Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_ptr<GeometryArena> arena, VertexFormat format, TangentMode tangentMode, bool splitLargeMeshes, bool positionStream) :
+	indexFormat(DXGI_FORMAT_R32_UINT),
+	splitLargeMeshes(splitLargeMeshes),
+	lods(1),
+	arena(arena),
+	arenaPool(0),
+	positionStream(positionStream),
+	positionIndexFormat(DXGI_FORMAT_R32_UINT),
+	positionStride(0),
+	positionCount(0),
+	positionPool(0),
+	vertexStride(0),
+	vertexCount(0),
+	format(format),
+	positionScale(1, 1, 1),
+	positionOffset(0, 0, 0),
+	tangentMode(tangentMode)
 {
-	CreateBuffers(vArray, vCount, iArray, iCount, device);
+	std::vector<Vertex> verts(vArray, vArray + vCount);
+	std::vector<unsigned int> indices(iArray, iArray + iCount);
+	CalculateTangents(verts, indices);
+
+	std::vector<CookedMeshLod> lodRanges;
+	BuildLods(verts, indices, lodRanges);
+	ComputeBounds(&verts[0], (int)verts.size());
+	CreateBuffers(&verts[0], (int)verts.size(), &indices[0], (int)indices.size(), &lodRanges[0], (unsigned int)lodRanges.size(), device);
 }
 
-Mesh::Mesh(const std::wstring& objFile, Microsoft::WRL::ComPtr<ID3D11Device> device)
+Mesh::Mesh(const std::wstring& objFile, Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_ptr<GeometryArena> arena, VertexFormat format, TangentMode tangentMode, bool optimize, bool splitLargeMeshes, bool positionStream) :
+	indexFormat(DXGI_FORMAT_R32_UINT),
+	splitLargeMeshes(splitLargeMeshes),
+	lods(1),
+	arena(arena),
+	arenaPool(0),
+	positionStream(positionStream),
+	positionIndexFormat(DXGI_FORMAT_R32_UINT),
+	positionStride(0),
+	positionCount(0),
+	positionPool(0),
+	vertexStride(0),
+	vertexCount(0),
+	format(format),
+	positionScale(1, 1, 1),
+	positionOffset(0, 0, 0),
+	tangentMode(tangentMode)
 {
 	iCount = 0;
 
-	// File input object
-	std::ifstream obj(objFile);
+	// Cooked files can be mapped and uploaded directly.  There's no
+	// source to rebuild from, so the flags they were cooked with
+	// (optimization, tangent mode) win over the requested ones
+	if (IsCookedMeshPath(objFile))
+	{
+		if (!LoadCooked(objFile, 0, 0, device))
+			LoadFailed();
+		return;
+	}
+
+	// Prefer the cooked copy next to the OBJ, as long as it was
+	// built from exactly the same source bytes and options
+	std::wstring cookedFile = GetCookedMeshPath(objFile);
+	unsigned int cookFlags =
+		(optimize ? COOKED_MESH_FLAG_OPTIMIZED : 0) |
+		(tangentMode == TangentMode::MikkTSpace ? COOKED_MESH_FLAG_MIKKTSPACE : 0);
+	MappedFile source(objFile);
+	if (!source.IsValid())
+	{
+		// Same as above when only the cooked copy is left
+		if (!LoadCooked(cookedFile, 0, 0, device))
+			LoadFailed();
+		return;
+	}
 
-	// Check for successful open
-	if (!obj.is_open())
+	if (LoadCooked(cookedFile, &source, cookFlags, device))
 		return;
 
-	// Variables used while reading the file
-	std::vector<XMFLOAT3> positions;	// Positions from the file
-	std::vector<XMFLOAT3> normals;		// Normals from the file
-	std::vector<XMFLOAT2> uvs;		// UVs from the file
-	std::vector<Vertex> verts;		// Verts we're assembling
-	std::vector<UINT> indices;		// Indices of these verts
-	int vertCounter = 0;			// Count of vertices
-	int indexCounter = 0;			// Count of indices
-	char chars[100];			// String for line reading
-
-	// Still have data left?
-	while (obj.good())
+	// Missing or stale, so parse the whole file (multithreaded), welding
+	// shared corners so tangents get averaged across adjacent faces
+	ObjMeshData obj;
+	if (!ParseObjMemory(source.GetData(), source.GetSize(), obj) || obj.indices.size() == 0)
 	{
-		// Get the line (100 characters should be more than enough)
-		obj.getline(chars, 100);
+		LoadFailed();
+		return;
+	}
 
-		// Check the type of line
-		if (chars[0] == 'v' && chars[1] == 'n')
-		{
-			// Read the 3 numbers directly into an XMFLOAT3
-			XMFLOAT3 norm;
-			sscanf_s(
-				chars,
-				"vn %f %f %f",
-				&norm.x, &norm.y, &norm.z);
-
-			// Add to the list of normals
-			normals.push_back(norm);
-		}
-		else if (chars[0] == 'v' && chars[1] == 't')
-		{
-			// Read the 2 numbers directly into an XMFLOAT2
-			XMFLOAT2 uv;
-			sscanf_s(
-				chars,
-				"vt %f %f",
-				&uv.x, &uv.y);
-
-			// Add to the list of uv's
-			uvs.push_back(uv);
-		}
-		else if (chars[0] == 'v')
-		{
-			// Read the 3 numbers directly into an XMFLOAT3
-			XMFLOAT3 pos;
-			sscanf_s(
-				chars,
-				"v %f %f %f",
-				&pos.x, &pos.y, &pos.z);
-
-			// Add to the positions
-			positions.push_back(pos);
-		}
-		else if (chars[0] == 'f')
+	if (VerboseLoading)
+	{
+		double megabytes = obj.fileBytes / (1024.0 * 1024.0);
+		printf("Parsed %ls: %u triangles, %.2f MB in %.2f ms (%.1f MB/s, %.2f M triangles/s)\n",
+			objFile.c_str(),
+			obj.triangleCount,
+			megabytes,
+			obj.parseSeconds * 1000.0,
+			megabytes / obj.parseSeconds,
+			obj.triangleCount / obj.parseSeconds / 1000000.0);
+
+		// Report how much the vertex welding saved
+		size_t indexBytes = sizeof(unsigned int) * obj.indices.size();
+		printf("  Welded %u -> %zu vertices (%.1f KB -> %.1f KB including indices)\n",
+			obj.unweldedVertexCount,
+			obj.vertices.size(),
+			(sizeof(Vertex) * obj.unweldedVertexCount + indexBytes) / 1024.0,
+			(sizeof(Vertex) * obj.vertices.size() + indexBytes) / 1024.0);
+	}
+
+	if (optimize)
+		Optimize(obj.vertices, obj.indices);
+
+	CalculateTangents(obj.vertices, obj.indices);
+
+	std::vector<CookedMeshLod> lodRanges;
+	BuildLods(obj.vertices, obj.indices, lodRanges);
+	ComputeBounds(&obj.vertices[0], (int)obj.vertices.size());
+	CreateBuffers(&obj.vertices[0], (int)obj.vertices.size(), &obj.indices[0], (int)obj.indices.size(), &lodRanges[0], (unsigned int)lodRanges.size(), device);
+
+	// Save the results so the next launch can skip all of the above
+	if (!WriteCookedMesh(cookedFile, HashBytes(source.GetData(), source.GetSize()), source.GetSize(), source.GetWriteTime(), cookFlags,
+		&obj.vertices[0], (unsigned int)obj.vertices.size(),
+		&obj.indices[0], (unsigned int)obj.indices.size(),
+		&lodRanges[0], (unsigned int)lodRanges.size(),
+		boundingBox, boundingSphere, orientedBox))
+		printf("  Unable to write cooked mesh %ls\n", cookedFile.c_str());
+}
+
+// --------------------------------------------------------
+// Memory-maps a cooked mesh and creates the buffers straight
+// from the mapping.  When the source is given, the file is
+// rejected unless it was cooked from that exact source with
+// the same flags.  The source is only read (and hashed) when
+// its size matches but its last write time doesn't, and then
+// the new time is recorded so the next load won't hash again.
+// Without a source, any flags are accepted.
+// --------------------------------------------------------
+bool Mesh::LoadCooked(const std::wstring& cookedFile, MappedFile* source, unsigned int flags, Microsoft::WRL::ComPtr<ID3D11Device> device)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	unsigned long long sourceWriteTime = source ? source->GetWriteTime() : 0;
+	bool touched = false;
+	{
+		MappedFile file(cookedFile);
+		const CookedMeshHeader* header = 0;
+		const Vertex* vertices = 0;
+		const unsigned int* indices = 0;
+		if (!ReadCookedMesh(file.GetData(), file.GetSize(), &header, &vertices, &indices))
+			return false;
+
+		if (source)
 		{
-			// Read the face indices into an array
-			// NOTE: This assumes the given obj file contains
-			//  vertex positions, uv coordinates AND normals.
-			unsigned int i[12];
-			int numbersRead = sscanf_s(
-				chars,
-				"f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d",
-				&i[0], &i[1], &i[2],
-				&i[3], &i[4], &i[5],
-				&i[6], &i[7], &i[8],
-				&i[9], &i[10], &i[11]);
-
-			// If we only got the first number, chances are the OBJ
-			// file has no UV coordinates.  This isn't great, but we
-			// still want to load the model without crashing, so we
-			// need to re-read a different pattern (in which we assume
-			// there are no UVs denoted for any of the vertices)
-			if (numbersRead == 1)
-			{
-				// Re-read with a different pattern
-				numbersRead = sscanf_s(
-					chars,
-					"f %d//%d %d//%d %d//%d %d//%d",
-					&i[0], &i[2],
-					&i[3], &i[5],
-					&i[6], &i[8],
-					&i[9], &i[11]);
-
-				// The following indices are where the UVs should 
-				// have been, so give them a valid value
-				i[1] = 1;
-				i[4] = 1;
-				i[7] = 1;
-				i[10] = 1;
-
-				// If we have no UVs, create a single UV coordinate
-				// that will be used for all vertices
-				if (uvs.size() == 0)
-					uvs.push_back(XMFLOAT2(0, 0));
-			}
+			if (header->Flags != flags || header->SourceSize != source->GetSize())
+				return false;
 
-			// - Create the verts by looking up
-			//    corresponding data from vectors
-			// - OBJ File indices are 1-based, so
-			//    they need to be adusted
-			Vertex v1;
-			v1.Position = positions[i[0] - 1];
-			v1.UV = uvs[i[1] - 1];
-			v1.Normal = normals[i[2] - 1];
-
-			Vertex v2;
-			v2.Position = positions[i[3] - 1];
-			v2.UV = uvs[i[4] - 1];
-			v2.Normal = normals[i[5] - 1];
-
-			Vertex v3;
-			v3.Position = positions[i[6] - 1];
-			v3.UV = uvs[i[7] - 1];
-			v3.Normal = normals[i[8] - 1];
-
-			// The model is most likely in a right-handed space,
-			// especially if it came from Maya.  We want to convert
-			// to a left-handed space for DirectX.  This means we 
-			// need to:
-			//  - Invert the Z position
-			//  - Invert the normal's Z
-			//  - Flip the winding order
-			// We also need to flip the UV coordinate since DirectX
-			// defines (0,0) as the top left of the texture, and many
-			// 3D modeling packages use the bottom left as (0,0)
-
-			// Flip the UV's since they're probably "upside down"
-			v1.UV.y = 1.0f - v1.UV.y;
-			v2.UV.y = 1.0f - v2.UV.y;
-			v3.UV.y = 1.0f - v3.UV.y;
-
-			// Flip Z (LH vs. RH)
-			v1.Position.z *= -1.0f;
-			v2.Position.z *= -1.0f;
-			v3.Position.z *= -1.0f;
-
-			// Flip normal's Z
-			v1.Normal.z *= -1.0f;
-			v2.Normal.z *= -1.0f;
-			v3.Normal.z *= -1.0f;
-
-			// Add the verts to the vector (flipping the winding order)
-			verts.push_back(v1);
-			verts.push_back(v3);
-			verts.push_back(v2);
-			vertCounter += 3;
-
-			// Add three more indices
-			indices.push_back(indexCounter); indexCounter += 1;
-			indices.push_back(indexCounter); indexCounter += 1;
-			indices.push_back(indexCounter); indexCounter += 1;
-
-			// Was there a 4th face?
-			// - 12 numbers read means 4 faces WITH uv's
-			// - 8 numbers read means 4 faces WITHOUT uv's
-			if (numbersRead == 12 || numbersRead == 8)
-			{
-				// Make the last vertex
-				Vertex v4;
-				v4.Position = positions[i[9] - 1];
-				v4.UV = uvs[i[10] - 1];
-				v4.Normal = normals[i[11] - 1];
-
-				// Flip the UV, Z pos and normal's Z
-				v4.UV.y = 1.0f - v4.UV.y;
-				v4.Position.z *= -1.0f;
-				v4.Normal.z *= -1.0f;
-
-				// Add a whole triangle (flipping the winding order)
-				verts.push_back(v1);
-				verts.push_back(v4);
-				verts.push_back(v3);
-				vertCounter += 3;
-
-				// Add three more indices
-				indices.push_back(indexCounter); indexCounter += 1;
-				indices.push_back(indexCounter); indexCounter += 1;
-				indices.push_back(indexCounter); indexCounter += 1;
-			}
+			touched = sourceWriteTime == 0 || header->SourceWriteTime != sourceWriteTime;
+			if (touched && header->SourceHash != HashBytes(source->GetData(), source->GetSize()))
+				return false;
 		}
+
+		boundingBox = header->Box;
+		boundingSphere = header->Sphere;
+		orientedBox = header->OrientedBox;
+		CreateBuffers(vertices, header->VertexCount, indices, header->IndexCount, header->Lods, header->LodCount, device);
+
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+		if (VerboseLoading)
+			printf("Loaded cooked %ls: %u vertices, %u triangles (%u LODs) in %.2f ms%s\n",
+				cookedFile.c_str(),
+				header->VertexCount,
+				header->Lods[0].IndexCount / 3,
+				header->LodCount,
+				seconds * 1000.0,
+				touched ? " (source touched but unchanged)" : "");
 	}
 
-	// Close the file and create the actual buffers
-	obj.close();
-	CreateBuffers(&verts[0], vertCounter, &indices[0], vertCounter, device);
+	// The mapping is closed by now, so the file can be written
+	if (touched && sourceWriteTime != 0)
+		UpdateCookedMeshWriteTime(cookedFile, sourceWriteTime);
+	return true;
+}
+
+// --------------------------------------------------------
+// Leaves the mesh empty when neither the OBJ nor a cooked copy
+// could be loaded, just like the old loader did when it couldn't
+// open the file: no indices (GetIndexCount() returns 0) and no
+// buffers, so drawing it does nothing
+// --------------------------------------------------------
+void Mesh::LoadFailed()
+{
+	iCount = 0;
+	lods.assign(1, MeshLod());
+	arena.reset();
+	positionStream = false;
 }
 
 Mesh::~Mesh()
 {
 }
 
-void Mesh::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+void Mesh::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int lod)
+{
+	// Draw mesh, one piece at a time if it had to be split
+	DrawRanges(context, lods[lod].SubMeshes);
+}
+
+void Mesh::DrawPositions(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int lod)
+{
+	if (!positionStream)
+		return;
+
+	BindPositionBuffers(context);
+	const SubMesh& r = lods[lod].PositionRange;
+	context->DrawIndexed(r.IndexCount, r.IndexStart, r.BaseVertex);
+}
+
+void Mesh::DrawRanges(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const std::vector<SubMesh>& ranges)
+{
+	BindBuffers(context);
+	for (auto& r : ranges)
+		context->DrawIndexed(r.IndexCount, r.IndexStart, r.BaseVertex);
+}
+
+void Mesh::DrawInstanced(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int lod, unsigned int instanceCount, unsigned int startInstance)
+{
+	BindBuffers(context);
+	for (auto& r : lods[lod].SubMeshes)
+		context->DrawIndexedInstanced(r.IndexCount, instanceCount, r.IndexStart, r.BaseVertex, startInstance);
+}
+
+void Mesh::DrawPositionsInstanced(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int lod, unsigned int instanceCount, unsigned int startInstance)
+{
+	if (!positionStream)
+		return;
+
+	BindPositionBuffers(context);
+	const SubMesh& r = lods[lod].PositionRange;
+	context->DrawIndexedInstanced(r.IndexCount, instanceCount, r.IndexStart, r.BaseVertex, startInstance);
+}
+
+// Sets buffers in the input assembler (IA) stage, which the arena
+// skips when the previous draw used the same pool
+void Mesh::BindBuffers(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	if (arena)
+	{
+		arena->Bind(context, arenaPool);
+	}
+	else
+	{
+		UINT stride = format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex);
+		UINT offset = 0;
+		context->IASetVertexBuffers(0, 1, vb.GetAddressOf(), &stride, &offset);
+		context->IASetIndexBuffer(ib.Get(), indexFormat, 0);
+	}
+}
+
+void Mesh::BindPositionBuffers(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
 {
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
-	
-	// Set buffers in the input assembler (IA) stage
-	context->IASetVertexBuffers(0, 1, vb.GetAddressOf(), &stride, &offset);
-	context->IASetIndexBuffer(ib.Get(), DXGI_FORMAT_R32_UINT, 0);
-
-	// Draw mesh
-	context->DrawIndexed(this->iCount, 0, 0);
+	if (arena)
+	{
+		arena->Bind(context, positionPool);
+	}
+	else
+	{
+		UINT stride = positionStride;
+		UINT offset = 0;
+		context->IASetVertexBuffers(0, 1, positionVB.GetAddressOf(), &stride, &offset);
+		context->IASetIndexBuffer(positionIB.Get(), positionIndexFormat, 0);
+	}
 }
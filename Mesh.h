@@ -2,25 +2,113 @@
 
 #include <d3d11.h>
 #include <wrl/client.h>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
 #include "Vertex.h"
+#include "MeshOptimizer.h"
+#include "TangentGenerator.h"
+#include "Meshlet.h"
+#include "CookedMesh.h"
+#include "GeometryArena.h"
+#include "MappedFile.h"
+#include <memory>
 #include <string>
+#include <vector>
+
+// --------------------------------------------------------
+// One level of detail, drawn from the mesh's shared buffers
+// --------------------------------------------------------
+struct MeshLod
+{
+	std::vector<SubMesh> SubMeshes;	// Ranges of the index buffer
+	std::vector<Meshlet> Meshlets;
+	SubMesh PositionRange;			// Range of the position stream's index buffer
+	unsigned int IndexCount;
+	float Error;					// Object-space simplification error (0 for the full mesh)
+};
 
 class Mesh {
 private:
 	Microsoft::WRL::ComPtr<ID3D11Buffer> vb;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> ib;
 	unsigned int iCount;
-	void CreateBuffers(Vertex* vArray, int vCount, unsigned int* iArray, int iCount, Microsoft::WRL::ComPtr<ID3D11Device> device);
-	void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
+
+	// Index width, and whether big meshes get split to fit 16 bits
+	DXGI_FORMAT indexFormat;
+	bool splitLargeMeshes;
+
+	// Levels of detail, each split into sub-meshes and meshlets
+	std::vector<MeshLod> lods;
+
+	// Shared buffers the mesh lives in (null when it has its own vb/ib)
+	std::shared_ptr<GeometryArena> arena;
+	unsigned int arenaPool;
+
+	// Optional second copy of the geometry for depth-only passes: just the
+	// (stored) positions, with duplicates from UV/normal seams merged
+	bool positionStream;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> positionVB;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> positionIB;
+	DXGI_FORMAT positionIndexFormat;
+	unsigned int positionStride;
+	unsigned int positionCount;
+	unsigned int positionPool;
+	unsigned int vertexStride;
+	unsigned int vertexCount;
+
+	// Vertex buffer layout, plus how to expand packed positions
+	VertexFormat format;
+	DirectX::XMFLOAT3 positionScale;
+	DirectX::XMFLOAT3 positionOffset;
+
+	// How tangents are generated for meshes built on the CPU
+	TangentMode tangentMode;
+
+	// Object-space bounds, computed once at load
+	DirectX::BoundingBox boundingBox;
+	DirectX::BoundingSphere boundingSphere;
+	DirectX::BoundingOrientedBox orientedBox;
+
+	void CreateBuffers(const Vertex* vArray, int vCount, const unsigned int* iArray, int iCount, const CookedMeshLod* lodRanges, unsigned int lodCount, Microsoft::WRL::ComPtr<ID3D11Device> device);
+	bool LoadCooked(const std::wstring& cookedFile, MappedFile* source, unsigned int flags, Microsoft::WRL::ComPtr<ID3D11Device> device);
+	void LoadFailed();
+	void CreatePositionStream(const void* vertexData, const void* indexData, int iCount, Microsoft::WRL::ComPtr<ID3D11Device> device);
+	void ComputeBounds(const Vertex* verts, int numVerts);
+	void Optimize(std::vector<Vertex>& verts, std::vector<unsigned int>& indices);
+	void BuildLods(const std::vector<Vertex>& verts, std::vector<unsigned int>& indices, std::vector<CookedMeshLod>& lodRanges);
+	void CalculateTangents(std::vector<Vertex>& verts, std::vector<unsigned int>& indices);
+	void BindBuffers(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+	void BindPositionBuffers(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
 
 public:
 	Microsoft::WRL::ComPtr<ID3D11Buffer> GetVertexBuffer();
 	Microsoft::WRL::ComPtr<ID3D11Buffer> GetIndexBuffer();
 	unsigned int GetIndexCount();
+	DXGI_FORMAT GetIndexFormat();
+	const std::vector<MeshLod>& GetLods();
+	const std::vector<SubMesh>& GetSubMeshes(unsigned int lod = 0);
+	const std::vector<Meshlet>& GetMeshlets(unsigned int lod = 0);
+	VertexFormat GetVertexFormat();
+	TangentMode GetTangentMode();
+	DirectX::XMFLOAT3 GetPositionScale();
+	DirectX::XMFLOAT3 GetPositionOffset();
+	const DirectX::BoundingBox& GetBoundingBox();
+	const DirectX::BoundingSphere& GetBoundingSphere();
+	const DirectX::BoundingOrientedBox& GetOrientedBox();
+	bool HasPositionStream();
+	unsigned int GetVertexStreamBytes();	// Size of the full vertex buffer data
+	unsigned int GetPositionStreamBytes();	// Size of the position-only data (0 without one)
+
+	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int lod = 0);
+	void DrawRanges(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const std::vector<SubMesh>& ranges); // Like Draw, but only some index ranges
+	void DrawPositions(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int lod = 0); // Like Draw, but with the position stream (needs a position-only shader)
 
-	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+	// Like Draw and DrawPositions, but instanceCount copies at once, with per-instance
+	// data starting at startInstance in whatever's bound to input slot 1
+	void DrawInstanced(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int lod, unsigned int instanceCount, unsigned int startInstance);
+	void DrawPositionsInstanced(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int lod, unsigned int instanceCount, unsigned int startInstance);
 
-	Mesh(Vertex* vArray, int vCount, unsigned int* iArray, int iCount, Microsoft::WRL::ComPtr<ID3D11Device> device);
-	Mesh(const std::wstring& objFile, Microsoft::WRL::ComPtr<ID3D11Device> device);
+	Mesh(Vertex* vArray, int vCount, unsigned int* iArray, int iCount, Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_ptr<GeometryArena> arena = nullptr, VertexFormat format = VertexFormat::Full, TangentMode tangentMode = TangentMode::Reference, bool splitLargeMeshes = true, bool positionStream = true);
+	Mesh(const std::wstring& objFile, Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_ptr<GeometryArena> arena = nullptr, VertexFormat format = VertexFormat::Full, TangentMode tangentMode = TangentMode::Reference, bool optimize = true, bool splitLargeMeshes = true, bool positionStream = true); // .obj (cached) or cooked .mesh
 	~Mesh();
 };
\ No newline at end of file
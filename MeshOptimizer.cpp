@@ -0,0 +1,517 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// Size of the LRU cache modelled by the Forsyth optimizer
+	const unsigned int ForsythCacheSize = 32;
+
+	// Size of the FIFO cache used when splitting into overdraw clusters
+	const unsigned int ClusterCacheSize = 16;
+
+	// --------------------------------------------------------
+	// Forsyth's vertex score: vertices near the front of the
+	// cache and vertices with few remaining triangles score
+	// highest, so triangles using them get emitted first
+	// --------------------------------------------------------
+	float VertexScore(int cachePosition, unsigned int liveTriangles)
+	{
+		if (liveTriangles == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			// The last triangle's vertices get a fixed score so
+			// that we don't favour reusing them in the same order
+			if (cachePosition < 3)
+				score = 0.75f;
+			else
+				score = powf(1.0f - (cachePosition - 3) / (float)(ForsythCacheSize - 3), 1.5f);
+		}
+
+		return score + 2.0f / sqrtf((float)liveTriangles);
+	}
+
+	// A FIFO cache simulated with per-vertex timestamps: a vertex is
+	// still cached if fewer than cacheSize misses happened since it was loaded
+	struct FifoCache
+	{
+		std::vector<unsigned int> timestamps;
+		unsigned int time;
+		unsigned int size;
+
+		FifoCache(size_t vertexCount, unsigned int cacheSize) :
+			timestamps(vertexCount, 0),
+			time(cacheSize + 1),
+			size(cacheSize)
+		{ }
+
+		unsigned int Triangle(const unsigned int* tri)
+		{
+			unsigned int misses = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				if (time - timestamps[tri[k]] > size)
+				{
+					timestamps[tri[k]] = time++;
+					misses++;
+				}
+			}
+			return misses;
+		}
+
+		void Reset() { time += size + 1; }
+	};
+}
+
+VertexCacheStats AnalyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize)
+{
+	VertexCacheStats stats = {};
+	if (indexCount < 3)
+		return stats;
+
+	FifoCache cache(vertexCount, cacheSize);
+	std::vector<bool> referenced(vertexCount, false);
+	unsigned int uniqueVertices = 0;
+
+	for (size_t i = 0; i + 2 < indexCount; i += 3)
+	{
+		stats.VerticesTransformed += cache.Triangle(&indices[i]);
+		for (int k = 0; k < 3; k++)
+		{
+			if (!referenced[indices[i + k]])
+			{
+				referenced[indices[i + k]] = true;
+				uniqueVertices++;
+			}
+		}
+	}
+
+	stats.ACMR = stats.VerticesTransformed / (float)(indexCount / 3);
+	stats.ATVR = stats.VerticesTransformed / (float)uniqueVertices;
+	return stats;
+}
+
+void OptimizeVertexCache(unsigned int* destination, const unsigned int* indices, size_t indexCount, size_t vertexCount)
+{
+	std::vector<unsigned int> input(indices, indices + indexCount);
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	// Build vertex -> triangle adjacency, packed into one array
+	std::vector<unsigned int> liveTriangles(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		liveTriangles[input[i]]++;
+
+	std::vector<unsigned int> offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		offsets[v + 1] = offsets[v] + liveTriangles[v];
+
+	std::vector<unsigned int> adjacency(triangleCount * 3);
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t t = 0; t < triangleCount; t++)
+		for (int k = 0; k < 3; k++)
+			adjacency[fill[input[t * 3 + k]]++] = (unsigned int)t;
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		vertexScores[v] = VertexScore(-1, liveTriangles[v]);
+
+	auto triangleScore = [&](size_t t)
+	{
+		return vertexScores[input[t * 3]] + vertexScores[input[t * 3 + 1]] + vertexScores[input[t * 3 + 2]];
+	};
+
+	// Start with the best triangle overall
+	size_t best = 0;
+	for (size_t t = 1; t < triangleCount; t++)
+		if (triangleScore(t) > triangleScore(best))
+			best = t;
+
+	std::vector<bool> emitted(triangleCount, false);
+	unsigned int cache[ForsythCacheSize + 3];
+	unsigned int newCache[ForsythCacheSize + 3];
+	unsigned int cacheCount = 0;
+	size_t scanCursor = 0;
+
+	for (size_t e = 0; e < triangleCount; e++)
+	{
+		// Nothing in the cache is usable, so take the next unused triangle
+		if (best == SIZE_MAX)
+		{
+			while (emitted[scanCursor]) scanCursor++;
+			best = scanCursor;
+		}
+
+		const unsigned int* tri = &input[best * 3];
+		emitted[best] = true;
+		destination[e * 3 + 0] = tri[0];
+		destination[e * 3 + 1] = tri[1];
+		destination[e * 3 + 2] = tri[2];
+
+		// Remove the triangle from each vertex's list of live triangles
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int* list = &adjacency[offsets[tri[k]]];
+			unsigned int& count = liveTriangles[tri[k]];
+			for (unsigned int i = 0; i < count; i++)
+			{
+				if (list[i] == best)
+				{
+					list[i] = list[count - 1];
+					count--;
+					break;
+				}
+			}
+		}
+
+		// The triangle's vertices move to the front of the cache
+		unsigned int newCount = 0;
+		for (int k = 0; k < 3; k++)
+			if (std::find(newCache, newCache + newCount, tri[k]) == newCache + newCount)
+				newCache[newCount++] = tri[k];
+
+		for (unsigned int i = 0; i < cacheCount; i++)
+			if (cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2])
+				newCache[newCount++] = cache[i];
+
+		// Anything pushed past the end falls out of the cache
+		for (unsigned int i = ForsythCacheSize; i < newCount; i++)
+		{
+			cachePosition[newCache[i]] = -1;
+			vertexScores[newCache[i]] = VertexScore(-1, liveTriangles[newCache[i]]);
+		}
+
+		cacheCount = (std::min)(newCount, ForsythCacheSize);
+		for (unsigned int i = 0; i < cacheCount; i++)
+		{
+			cache[i] = newCache[i];
+			cachePosition[cache[i]] = i;
+			vertexScores[cache[i]] = VertexScore(i, liveTriangles[cache[i]]);
+		}
+
+		// The next triangle is the best scoring one touching the cache
+		best = SIZE_MAX;
+		float bestScore = -FLT_MAX;
+		for (unsigned int i = 0; i < cacheCount; i++)
+		{
+			const unsigned int* list = &adjacency[offsets[cache[i]]];
+			for (unsigned int j = 0; j < liveTriangles[cache[i]]; j++)
+			{
+				float score = triangleScore(list[j]);
+				if (score > bestScore)
+				{
+					bestScore = score;
+					best = list[j];
+				}
+			}
+		}
+	}
+}
+
+void OptimizeOverdraw(unsigned int* destination, const unsigned int* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, float threshold)
+{
+	std::vector<unsigned int> input(indices, indices + indexCount);
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	// Hard boundaries: wherever the cache optimizer had to start over,
+	// which shows up as a triangle missing on all three vertices
+	FifoCache cache(vertexCount, ClusterCacheSize);
+	std::vector<unsigned int> hardClusters;
+	for (size_t t = 0; t < triangleCount; t++)
+		if (cache.Triangle(&input[t * 3]) == 3 || t == 0)
+			hardClusters.push_back((unsigned int)t);
+	hardClusters.push_back((unsigned int)triangleCount);
+
+	// Soft boundaries: split each hard cluster further whenever the run so
+	// far is cache efficient enough (within threshold) to stand on its own
+	std::vector<unsigned int> clusters;
+	for (size_t h = 0; h + 1 < hardClusters.size(); h++)
+	{
+		unsigned int start = hardClusters[h];
+		unsigned int end = hardClusters[h + 1];
+
+		cache.Reset();
+		unsigned int clusterMisses = 0;
+		for (unsigned int t = start; t < end; t++)
+			clusterMisses += cache.Triangle(&input[t * 3]);
+		float targetACMR = threshold * clusterMisses / (end - start);
+
+		cache.Reset();
+		clusters.push_back(start);
+		unsigned int runStart = start;
+		unsigned int runMisses = 0;
+		for (unsigned int t = start; t + 1 < end; t++)
+		{
+			runMisses += cache.Triangle(&input[t * 3]);
+			if (runMisses <= targetACMR * (t + 1 - runStart))
+			{
+				clusters.push_back(t + 1);
+				cache.Reset();
+				runStart = t + 1;
+				runMisses = 0;
+			}
+		}
+	}
+	clusters.push_back((unsigned int)triangleCount);
+
+	// Area weighted centroid and normal of each cluster, and of the whole mesh
+	size_t clusterCount = clusters.size() - 1;
+	std::vector<XMFLOAT3> centroids(clusterCount);
+	std::vector<XMFLOAT3> normals(clusterCount);
+	XMVECTOR meshCentroid = XMVectorZero();
+	float meshArea = 0.0f;
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		XMVECTOR centroid = XMVectorZero();
+		XMVECTOR normal = XMVectorZero();
+		float area = 0.0f;
+		for (unsigned int t = clusters[c]; t < clusters[c + 1]; t++)
+		{
+			XMVECTOR p0 = XMLoadFloat3(&vertices[input[t * 3 + 0]].Position);
+			XMVECTOR p1 = XMLoadFloat3(&vertices[input[t * 3 + 1]].Position);
+			XMVECTOR p2 = XMLoadFloat3(&vertices[input[t * 3 + 2]].Position);
+
+			// Our winding makes this cross product point outward
+			XMVECTOR n = XMVector3Cross(p1 - p0, p2 - p0);
+			float a = XMVectorGetX(XMVector3Length(n));
+
+			centroid += (p0 + p1 + p2) * (a / 3.0f);
+			normal += n;
+			area += a;
+		}
+
+		meshCentroid += centroid;
+		meshArea += area;
+		XMStoreFloat3(&centroids[c], area > 0.0f ? centroid / area : centroid);
+		XMStoreFloat3(&normals[c], XMVector3Normalize(normal));
+	}
+	if (meshArea > 0.0f)
+		meshCentroid /= meshArea;
+
+	// Clusters that face away from the middle of the mesh are likely to
+	// occlude everything else, so they get drawn first
+	std::vector<float> sortKeys(clusterCount);
+	std::vector<unsigned int> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		XMVECTOR toCluster = XMLoadFloat3(&centroids[c]) - meshCentroid;
+		sortKeys[c] = XMVectorGetX(XMVector3Dot(toCluster, XMLoadFloat3(&normals[c])));
+		order[c] = (unsigned int)c;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return sortKeys[a] > sortKeys[b]; });
+
+	size_t written = 0;
+	for (unsigned int c : order)
+		for (unsigned int i = clusters[c] * 3; i < clusters[c + 1] * 3; i++)
+			destination[written++] = input[i];
+}
+
+size_t OptimizeVertexFetch(Vertex* destination, unsigned int* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount)
+{
+	std::vector<unsigned int> remap(vertexCount, UINT_MAX);
+	unsigned int next = 0;
+
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		unsigned int& v = remap[indices[i]];
+		if (v == UINT_MAX)
+		{
+			v = next++;
+			destination[v] = vertices[indices[i]];
+		}
+		indices[i] = v;
+	}
+
+	return next;
+}
+
+MeshOptimizerTestResult TestMeshOptimizer()
+{
+	MeshOptimizerTestResult result = {};
+
+	// A gently curved 100x100 vertex grid, with its vertices and triangles
+	// in a random (but repeatable) order, so every step has work to do
+	const unsigned int side = 100;
+	std::vector<Vertex> vertices(side * side);
+	std::vector<unsigned int> slot(side * side);
+	for (unsigned int i = 0; i < side * side; i++)
+		slot[i] = i;
+
+	uint32_t random = 12345;
+	auto next = [&]() { random = random * 1664525u + 1013904223u; return random >> 8; };
+	for (size_t i = slot.size() - 1; i > 0; i--)
+		std::swap(slot[i], slot[next() % (i + 1)]);
+
+	for (unsigned int y = 0; y < side; y++)
+	{
+		for (unsigned int x = 0; x < side; x++)
+		{
+			Vertex& v = vertices[slot[y * side + x]];
+			v = {};
+			v.Position = XMFLOAT3((float)x, sinf(x * 0.1f) * cosf(y * 0.1f), (float)y);
+			v.Normal = XMFLOAT3(0, 1, 0);
+			v.UV = XMFLOAT2(x / (float)(side - 1), y / (float)(side - 1));
+		}
+	}
+
+	std::vector<unsigned int> indices;
+	for (unsigned int y = 0; y < side - 1; y++)
+	{
+		for (unsigned int x = 0; x < side - 1; x++)
+		{
+			unsigned int a = slot[y * side + x], b = slot[y * side + x + 1];
+			unsigned int c = slot[(y + 1) * side + x], d = slot[(y + 1) * side + x + 1];
+			unsigned int quad[6] = { a, c, d, a, d, b };
+			indices.insert(indices.end(), quad, quad + 6);
+		}
+	}
+
+	size_t triangleCount = indices.size() / 3;
+	for (size_t t = triangleCount - 1; t > 0; t--)
+	{
+		size_t other = next() % (t + 1);
+		for (int k = 0; k < 3; k++)
+			std::swap(indices[t * 3 + k], indices[other * 3 + k]);
+	}
+	result.TriangleCount = (unsigned int)triangleCount;
+
+	// The same triangles (in any order, and starting from any corner,
+	// but with the same winding) as the input
+	auto sortedTriangles = [](const std::vector<unsigned int>& list)
+	{
+		std::vector<uint64_t> triangles(list.size() / 3);
+		for (size_t t = 0; t < triangles.size(); t++)
+		{
+			const unsigned int* i = &list[t * 3];
+			int first = i[0] < i[1] ? (i[0] < i[2] ? 0 : 2) : (i[1] < i[2] ? 1 : 2);
+			triangles[t] =
+				((uint64_t)i[first] << 42) |
+				((uint64_t)i[(first + 1) % 3] << 21) |
+				(uint64_t)i[(first + 2) % 3];
+		}
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	};
+	std::vector<uint64_t> inputTriangles = sortedTriangles(indices);
+
+	// Vertex cache
+	result.Input = AnalyzeVertexCache(&indices[0], indices.size(), vertices.size());
+	std::vector<unsigned int> cacheOptimized(indices.size());
+	OptimizeVertexCache(&cacheOptimized[0], &indices[0], indices.size(), vertices.size());
+	result.VertexCache = AnalyzeVertexCache(&cacheOptimized[0], cacheOptimized.size(), vertices.size());
+	result.Check(sortedTriangles(cacheOptimized) == inputTriangles, "Vertex cache order keeps the same triangles");
+	result.Check(result.VertexCache.ACMR <= result.Input.ACMR, "Vertex cache order doesn't raise the ACMR");
+	result.Check(result.VertexCache.ACMR < 1.0f, "Vertex cache order gets a grid under 1 miss per triangle");
+
+	// Overdraw, which may give back up to its threshold of the ACMR
+	const float threshold = 1.05f;
+	std::vector<unsigned int> overdrawOptimized(indices.size());
+	OptimizeOverdraw(&overdrawOptimized[0], &cacheOptimized[0], cacheOptimized.size(), &vertices[0], vertices.size(), threshold);
+	result.Overdraw = AnalyzeVertexCache(&overdrawOptimized[0], overdrawOptimized.size(), vertices.size());
+	result.Check(sortedTriangles(overdrawOptimized) == inputTriangles, "Overdraw order keeps the same triangles");
+	result.Check(result.Overdraw.ACMR <= result.VertexCache.ACMR * threshold, "Overdraw order stays within its ACMR threshold");
+	result.Check(result.Overdraw.ACMR <= result.Input.ACMR, "Overdraw order doesn't raise the ACMR over the input's");
+
+	// Vertex fetch: same triangle order, only the vertices renumbered
+	std::vector<unsigned int> fetchIndices = overdrawOptimized;
+	std::vector<Vertex> fetchVertices(vertices.size());
+	size_t fetchCount = OptimizeVertexFetch(&fetchVertices[0], &fetchIndices[0], fetchIndices.size(), &vertices[0], vertices.size());
+	result.VertexFetch = AnalyzeVertexCache(&fetchIndices[0], fetchIndices.size(), fetchCount);
+	result.Check(fetchCount == vertices.size(), "Vertex fetch keeps every referenced vertex");
+	result.Check(result.VertexFetch.ACMR == result.Overdraw.ACMR, "Vertex fetch doesn't change the ACMR");
+
+	bool samePositions = true;
+	bool firstUseOrder = true;
+	unsigned int nextVertex = 0;
+	for (size_t i = 0; i < fetchIndices.size(); i++)
+	{
+		unsigned int v = fetchIndices[i];
+		if (v >= fetchCount)
+		{
+			samePositions = false;
+			break;
+		}
+
+		const XMFLOAT3& before = vertices[overdrawOptimized[i]].Position;
+		const XMFLOAT3& after = fetchVertices[v].Position;
+		samePositions &= before.x == after.x && before.y == after.y && before.z == after.z;
+
+		if (v == nextVertex)
+			nextVertex++;
+		else if (v > nextVertex)
+			firstUseOrder = false;
+	}
+	result.Check(samePositions, "Vertex fetch keeps every triangle's positions");
+	result.Check(firstUseOrder, "Vertex fetch numbers vertices in order of first use");
+
+	return result;
+}
+
+void SplitForShortIndices(
+	std::vector<Vertex>& destinationVertices,
+	std::vector<unsigned short>& destinationIndices,
+	std::vector<SubMesh>& subMeshes,
+	const Vertex* vertices, size_t vertexCount,
+	const unsigned int* indices, size_t indexCount,
+	unsigned int maxVertices)
+{
+	destinationVertices.clear();
+	destinationIndices.clear();
+	subMeshes.clear();
+	destinationIndices.reserve(indexCount);
+
+	// Where each vertex landed in the current sub-mesh, valid only if its
+	// stamp matches the sub-mesh number (saves clearing between sub-meshes)
+	std::vector<unsigned int> remap(vertexCount);
+	std::vector<unsigned int> stamp(vertexCount, UINT_MAX);
+	SubMesh current = { 0, 0, 0 };
+	unsigned int currentVertices = 0;
+
+	for (size_t t = 0; t + 2 < indexCount; t += 3)
+	{
+		// Start a new sub-mesh if this triangle's new vertices won't fit
+		unsigned int newVertices = 0;
+		for (int k = 0; k < 3; k++)
+			if (stamp[indices[t + k]] != subMeshes.size())
+				newVertices++;
+
+		if (currentVertices + newVertices > maxVertices)
+		{
+			subMeshes.push_back(current);
+			current.IndexStart += current.IndexCount;
+			current.IndexCount = 0;
+			current.BaseVertex = (int)destinationVertices.size();
+			currentVertices = 0;
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int v = indices[t + k];
+			if (stamp[v] != subMeshes.size())
+			{
+				stamp[v] = (unsigned int)subMeshes.size();
+				remap[v] = currentVertices++;
+				destinationVertices.push_back(vertices[v]);
+			}
+			destinationIndices.push_back((unsigned short)remap[v]);
+		}
+		current.IndexCount += 3;
+	}
+
+	if (current.IndexCount > 0)
+		subMeshes.push_back(current);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "SelfTest.h"
+#include "Vertex.h"
+
+// --------------------------------------------------------
+// Post-transform vertex cache statistics for an index list,
+// measured with a simulated FIFO cache
+//  - ACMR: cache misses per triangle (0.5 is ideal for big grids, 3 is worst)
+//  - ATVR: cache misses per referenced vertex (1.0 is ideal)
+// --------------------------------------------------------
+struct VertexCacheStats
+{
+	unsigned int VerticesTransformed;
+	float ACMR;
+	float ATVR;
+};
+
+VertexCacheStats AnalyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = 16);
+
+// Reorders triangles for post-transform cache locality (Forsyth's algorithm)
+void OptimizeVertexCache(unsigned int* destination, const unsigned int* indices, size_t indexCount, size_t vertexCount);
+
+// Reorders clusters of triangles front-to-back-ish (outward facing first) to cut
+// overdraw, while keeping the ACMR within threshold times the input's
+// - Expects indices that have already been through OptimizeVertexCache
+void OptimizeOverdraw(unsigned int* destination, const unsigned int* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, float threshold = 1.05f);
+
+// Reorders vertices into the order they are first referenced and rewrites the
+// indices to match; unreferenced vertices are dropped
+// - Returns the number of vertices written to destination
+size_t OptimizeVertexFetch(Vertex* destination, unsigned int* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount);
+
+// --------------------------------------------------------
+// Results of running every optimization on a shuffled grid
+// --------------------------------------------------------
+struct MeshOptimizerTestResult : TestResult
+{
+	unsigned int TriangleCount;
+	VertexCacheStats Input;
+	VertexCacheStats VertexCache;
+	VertexCacheStats Overdraw;
+	VertexCacheStats VertexFetch;
+};
+
+// Optimizes a grid whose vertices and triangles were shuffled, and checks that
+// each step keeps the same triangles, never makes the ACMR worse (beyond the
+// overdraw threshold), and that the vertex remap keeps every triangle's positions
+MeshOptimizerTestResult TestMeshOptimizer();
+
+// --------------------------------------------------------
+// A piece of a mesh, drawn with
+//   DrawIndexed(IndexCount, IndexStart, BaseVertex)
+// --------------------------------------------------------
+struct SubMesh
+{
+	unsigned int IndexStart;
+	unsigned int IndexCount;
+	int BaseVertex;
+};
+
+// Splits a mesh (in triangle order) into sub-meshes that each reference at most
+// maxVertices vertices, so every sub-mesh can use 16-bit indices relative to its
+// own base vertex
+// - Vertices shared by two sub-meshes are duplicated
+void SplitForShortIndices(
+	std::vector<Vertex>& destinationVertices,
+	std::vector<unsigned short>& destinationIndices,
+	std::vector<SubMesh>& subMeshes,
+	const Vertex* vertices, size_t vertexCount,
+	const unsigned int* indices, size_t indexCount,
+	unsigned int maxVertices = 65536);
@@ -0,0 +1,573 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	// How strongly open borders resist being pulled inwards
+	const double BorderWeight = 10.0;
+
+	// Each pass only takes collapses up to this multiple of the cost at its
+	// goal, so cheap collapses always go before expensive ones
+	const double PassErrorSlack = 1.5;
+
+	// A level has to lose at least this fraction of the previous one's
+	// triangles, otherwise the chain stops
+	const float MinLevelReduction = 0.1f;
+
+	// --------------------------------------------------------
+	// What a vertex is allowed to collapse along
+	// --------------------------------------------------------
+	enum class VertexKind : unsigned char
+	{
+		Manifold,	// Interior vertex, can collapse to any neighbour
+		Border,		// On an open edge, can only slide along it
+		Seam,		// One of two vertices at a position (UV/normal split), can only slide along the seam
+		Locked		// Anything more complicated, never moves
+	};
+
+	// --------------------------------------------------------
+	// Sum of squared distances to a set of planes, weighted:
+	//   error(p) = p'Ap + 2b'p + c, divided by the total weight
+	// --------------------------------------------------------
+	struct Quadric
+	{
+		double a00, a11, a22, a01, a02, a12;
+		double b0, b1, b2;
+		double c;
+		double w;
+	};
+
+	void AddPlane(Quadric& q, double nx, double ny, double nz, double d, double w)
+	{
+		q.a00 += w * nx * nx;
+		q.a11 += w * ny * ny;
+		q.a22 += w * nz * nz;
+		q.a01 += w * nx * ny;
+		q.a02 += w * nx * nz;
+		q.a12 += w * ny * nz;
+		q.b0 += w * nx * d;
+		q.b1 += w * ny * d;
+		q.b2 += w * nz * d;
+		q.c += w * d * d;
+		q.w += w;
+	}
+
+	void AddQuadric(Quadric& q, const Quadric& r)
+	{
+		q.a00 += r.a00; q.a11 += r.a11; q.a22 += r.a22;
+		q.a01 += r.a01; q.a02 += r.a02; q.a12 += r.a12;
+		q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+		q.c += r.c;
+		q.w += r.w;
+	}
+
+	// Mean squared distance from p to the quadric's planes
+	double QuadricError(const Quadric& q, const XMFLOAT3& p)
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double e =
+			q.a00 * x * x + q.a11 * y * y + q.a22 * z * z +
+			2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+			2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) +
+			q.c;
+		return q.w > 0.0 ? fabs(e) / q.w : 0.0;
+	}
+
+	// --------------------------------------------------------
+	// Directed triangle edges a->b, grouped by a
+	//  - With a remap, edges are between remapped vertices
+	// --------------------------------------------------------
+	struct EdgeList
+	{
+		std::vector<unsigned int> offsets;
+		std::vector<unsigned int> targets;
+
+		void Build(const unsigned int* indices, size_t indexCount, size_t vertexCount, const unsigned int* remap)
+		{
+			auto map = [&](unsigned int v) { return remap ? remap[v] : v; };
+
+			offsets.assign(vertexCount + 1, 0);
+			for (size_t i = 0; i < indexCount; i++)
+				offsets[map(indices[i]) + 1]++;
+			for (size_t i = 0; i < vertexCount; i++)
+				offsets[i + 1] += offsets[i];
+
+			targets.resize(indexCount);
+			std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t t = 0; t + 2 < indexCount; t += 3)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					unsigned int a = map(indices[t + k]);
+					unsigned int b = map(indices[t + (k + 1) % 3]);
+					targets[fill[a]++] = b;
+				}
+			}
+		}
+
+		unsigned int Count(unsigned int a, unsigned int b) const
+		{
+			unsigned int count = 0;
+			for (unsigned int e = offsets[a]; e < offsets[a + 1]; e++)
+				if (targets[e] == b)
+					count++;
+			return count;
+		}
+
+		bool Has(unsigned int a, unsigned int b) const { return Count(a, b) > 0; }
+
+		// An edge only one triangle uses
+		bool Open(unsigned int a, unsigned int b) const { return Has(a, b) != Has(b, a); }
+	};
+
+	// A potential v -> t collapse, plus the seam twin that has to go with it
+	struct Collapse
+	{
+		unsigned int v;
+		unsigned int t;
+		unsigned int twinV;
+		unsigned int twinT;
+		double error;
+	};
+
+	// --------------------------------------------------------
+	// The simplifier's working state, kept between targets so a
+	// whole LOD chain can be built in one go
+	// --------------------------------------------------------
+	struct Simplifier
+	{
+		const Vertex* vertices;
+		size_t vertexCount;
+		std::vector<unsigned int> indices;
+
+		std::vector<unsigned int> remap;	// Vertex -> first vertex at the same position
+		std::vector<unsigned int> wedge;	// Vertex -> next vertex at the same position (a ring)
+		std::vector<VertexKind> kinds;
+		std::vector<Quadric> quadrics;		// Indexed by remapped vertex
+		double maxError;					// Squared
+
+		Simplifier(const unsigned int* sourceIndices, size_t indexCount, const Vertex* vertices, size_t vertexCount) :
+			vertices(vertices),
+			vertexCount(vertexCount),
+			indices(sourceIndices, sourceIndices + indexCount - indexCount % 3),
+			remap(vertexCount),
+			wedge(vertexCount),
+			kinds(vertexCount, VertexKind::Locked),
+			quadrics(vertexCount, Quadric()),
+			maxError(0.0)
+		{
+			BuildPositionRemap();
+			ClassifyVertices();
+			BuildQuadrics();
+		}
+
+		const XMFLOAT3& Position(unsigned int v) const { return vertices[v].Position; }
+
+		// --------------------------------------------------------
+		// Groups vertices with identical positions (seam splits)
+		// --------------------------------------------------------
+		void BuildPositionRemap()
+		{
+			std::vector<unsigned int> order(vertexCount);
+			for (unsigned int i = 0; i < vertexCount; i++)
+				order[i] = i;
+
+			std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b)
+			{
+				const XMFLOAT3& pa = Position(a);
+				const XMFLOAT3& pb = Position(b);
+				if (pa.x != pb.x) return pa.x < pb.x;
+				if (pa.y != pb.y) return pa.y < pb.y;
+				if (pa.z != pb.z) return pa.z < pb.z;
+				return a < b;
+			});
+
+			for (size_t start = 0; start < vertexCount;)
+			{
+				size_t end = start + 1;
+				const XMFLOAT3& p = Position(order[start]);
+				while (end < vertexCount &&
+					Position(order[end]).x == p.x &&
+					Position(order[end]).y == p.y &&
+					Position(order[end]).z == p.z)
+					end++;
+
+				for (size_t i = start; i < end; i++)
+				{
+					remap[order[i]] = order[start];
+					wedge[order[i]] = order[i + 1 < end ? i + 1 : start];
+				}
+				start = end;
+			}
+		}
+
+		unsigned int WedgeCount(unsigned int v) const
+		{
+			unsigned int count = 1;
+			for (unsigned int w = wedge[v]; w != v; w = wedge[w])
+				count++;
+			return count;
+		}
+
+		// --------------------------------------------------------
+		// Works out what each vertex may collapse along, from the
+		// open edges around it (by position and by index)
+		// --------------------------------------------------------
+		void ClassifyVertices()
+		{
+			EdgeList edges;
+			EdgeList positionEdges;
+			edges.Build(&indices[0], indices.size(), vertexCount, 0);
+			positionEdges.Build(&indices[0], indices.size(), vertexCount, &remap[0]);
+
+			// Flipping every triangle gives the edges coming into each vertex
+			std::vector<unsigned int> reversed(indices);
+			for (size_t t = 0; t < reversed.size(); t += 3)
+				std::swap(reversed[t + 1], reversed[t + 2]);
+			EdgeList reversedEdges;
+			reversedEdges.Build(&reversed[0], reversed.size(), vertexCount, 0);
+
+			// Count open edges leaving/entering each position, and lock the
+			// ends of any edge used twice in the same direction (non-manifold)
+			std::vector<unsigned int> openOut(vertexCount, 0), openIn(vertexCount, 0);
+			std::vector<bool> nonManifold(vertexCount, false);
+			for (unsigned int a = 0; a < vertexCount; a++)
+			{
+				for (unsigned int e = positionEdges.offsets[a]; e < positionEdges.offsets[a + 1]; e++)
+				{
+					unsigned int b = positionEdges.targets[e];
+					if (positionEdges.Count(a, b) > 1)
+						nonManifold[a] = nonManifold[b] = true;
+					if (!positionEdges.Has(b, a))
+					{
+						openOut[a]++;
+						openIn[b]++;
+					}
+				}
+			}
+
+			for (unsigned int v = 0; v < vertexCount; v++)
+			{
+				unsigned int r = remap[v];
+				if (nonManifold[r])
+					continue;
+
+				unsigned int wedges = WedgeCount(v);
+				if (wedges == 1)
+				{
+					if (openOut[r] == 0 && openIn[r] == 0)
+						kinds[v] = VertexKind::Manifold;
+					else if (openOut[r] == 1 && openIn[r] == 1)
+						kinds[v] = VertexKind::Border;
+				}
+				else if (wedges == 2 && openOut[r] == 0 && openIn[r] == 0)
+				{
+					// Closed by position, but each wedge is bordered by the seam
+					// on exactly one side in index space
+					bool seam = true;
+					unsigned int w = v;
+					do
+					{
+						unsigned int out = 0, in = 0;
+						for (unsigned int e = edges.offsets[w]; e < edges.offsets[w + 1]; e++)
+							if (!edges.Has(edges.targets[e], w))
+								out++;
+						for (unsigned int e = reversedEdges.offsets[w]; e < reversedEdges.offsets[w + 1]; e++)
+							if (!edges.Has(w, reversedEdges.targets[e]))
+								in++;
+						seam = seam && out == 1 && in == 1;
+						w = wedge[w];
+					} while (w != v);
+
+					if (seam)
+						kinds[v] = VertexKind::Seam;
+				}
+			}
+		}
+
+		// --------------------------------------------------------
+		// Area-weighted triangle planes, plus perpendicular planes
+		// along open borders so they stay put
+		// --------------------------------------------------------
+		void BuildQuadrics()
+		{
+			EdgeList positionEdges;
+			positionEdges.Build(&indices[0], indices.size(), vertexCount, &remap[0]);
+
+			for (size_t t = 0; t < indices.size(); t += 3)
+			{
+				unsigned int r[3] = { remap[indices[t]], remap[indices[t + 1]], remap[indices[t + 2]] };
+				XMVECTOR p0 = XMLoadFloat3(&Position(r[0]));
+				XMVECTOR p1 = XMLoadFloat3(&Position(r[1]));
+				XMVECTOR p2 = XMLoadFloat3(&Position(r[2]));
+
+				XMVECTOR normal = XMVector3Cross(p1 - p0, p2 - p0);
+				float length = XMVectorGetX(XMVector3Length(normal));
+				if (length <= 0.0f)
+					continue;
+
+				normal /= length;
+				XMFLOAT3 n;
+				XMStoreFloat3(&n, normal);
+				double d = -XMVectorGetX(XMVector3Dot(normal, p0));
+				double area = length * 0.5;
+				for (int k = 0; k < 3; k++)
+					AddPlane(quadrics[r[k]], n.x, n.y, n.z, d, area);
+
+				for (int k = 0; k < 3; k++)
+				{
+					unsigned int a = r[k];
+					unsigned int b = r[(k + 1) % 3];
+					if (positionEdges.Has(b, a))
+						continue;
+
+					XMVECTOR pa = XMLoadFloat3(&Position(a));
+					XMVECTOR edge = XMLoadFloat3(&Position(b)) - pa;
+					XMVECTOR borderNormal = XMVector3Normalize(XMVector3Cross(edge, normal));
+					float edgeLengthSq = XMVectorGetX(XMVector3LengthSq(edge));
+
+					XMFLOAT3 bn;
+					XMStoreFloat3(&bn, borderNormal);
+					double bd = -XMVectorGetX(XMVector3Dot(borderNormal, pa));
+					AddPlane(quadrics[a], bn.x, bn.y, bn.z, bd, edgeLengthSq * BorderWeight);
+					AddPlane(quadrics[b], bn.x, bn.y, bn.z, bd, edgeLengthSq * BorderWeight);
+				}
+			}
+		}
+
+		// --------------------------------------------------------
+		// Whether v may move onto t, and for seams, which twin
+		// collapse has to happen along with it
+		// --------------------------------------------------------
+		bool CanCollapse(unsigned int v, unsigned int t, const EdgeList& edges, const EdgeList& positionEdges, Collapse& collapse) const
+		{
+			if (remap[v] == remap[t])
+				return false;
+
+			collapse.v = v;
+			collapse.t = t;
+			collapse.twinV = UINT_MAX;
+			collapse.twinT = UINT_MAX;
+
+			switch (kinds[v])
+			{
+			case VertexKind::Manifold:
+				return true;
+
+			case VertexKind::Border:
+				return kinds[t] != VertexKind::Manifold && positionEdges.Open(remap[v], remap[t]);
+
+			case VertexKind::Seam:
+			{
+				if ((kinds[t] != VertexKind::Seam && kinds[t] != VertexKind::Locked) || !edges.Open(v, t))
+					return false;
+
+				// The other side of the seam has to follow the same edge
+				unsigned int twinV = wedge[v];
+				for (unsigned int w = wedge[t]; w != t; w = wedge[w])
+				{
+					if (edges.Open(twinV, w))
+					{
+						collapse.twinV = twinV;
+						collapse.twinT = w;
+						return true;
+					}
+				}
+				return false;
+			}
+
+			default:
+				return false;
+			}
+		}
+
+		// --------------------------------------------------------
+		// True if moving v onto t turns any of v's remaining
+		// triangles upside down
+		// - Neighbours already collapsed this pass are followed
+		// --------------------------------------------------------
+		bool FlipsTriangles(unsigned int v, unsigned int t, const std::vector<unsigned int>& cornerOffsets, const std::vector<unsigned int>& corners, const std::vector<unsigned int>& collapsed) const
+		{
+			XMVECTOR newPosition = XMLoadFloat3(&Position(t));
+			for (unsigned int c = cornerOffsets[v]; c < cornerOffsets[v + 1]; c++)
+			{
+				unsigned int base = corners[c] - corners[c] % 3;
+				unsigned int k = corners[c] - base;
+				unsigned int b = collapsed[indices[base + (k + 1) % 3]];
+				unsigned int d = collapsed[indices[base + (k + 2) % 3]];
+
+				// Triangles along the collapsing edge disappear anyway
+				if (remap[b] == remap[t] || remap[d] == remap[t])
+					continue;
+
+				XMVECTOR pb = XMLoadFloat3(&Position(b));
+				XMVECTOR pd = XMLoadFloat3(&Position(d));
+				XMVECTOR oldNormal = XMVector3Cross(pb - XMLoadFloat3(&Position(v)), pd - XMLoadFloat3(&Position(v)));
+				XMVECTOR newNormal = XMVector3Cross(pb - newPosition, pd - newPosition);
+				if (XMVectorGetX(XMVector3Dot(oldNormal, newNormal)) <= 0.0f)
+					return true;
+			}
+			return false;
+		}
+
+		// --------------------------------------------------------
+		// Collapses edges, cheapest first, until the index count
+		// is at most target or nothing else can go
+		// --------------------------------------------------------
+		void Simplify(size_t targetIndexCount)
+		{
+			std::vector<Collapse> candidates;
+			std::vector<unsigned int> collapsed(vertexCount);
+			std::vector<bool> touched(vertexCount);
+			std::vector<unsigned int> cornerOffsets;
+			std::vector<unsigned int> corners;
+
+			while (indices.size() > targetIndexCount)
+			{
+				EdgeList edges;
+				EdgeList positionEdges;
+				edges.Build(&indices[0], indices.size(), vertexCount, 0);
+				positionEdges.Build(&indices[0], indices.size(), vertexCount, &remap[0]);
+
+				// Vertex -> triangle corners, for the flip tests
+				cornerOffsets.assign(vertexCount + 1, 0);
+				for (unsigned int i : indices)
+					cornerOffsets[i + 1]++;
+				for (size_t i = 0; i < vertexCount; i++)
+					cornerOffsets[i + 1] += cornerOffsets[i];
+				corners.resize(indices.size());
+				std::vector<unsigned int> fill(cornerOffsets.begin(), cornerOffsets.end() - 1);
+				for (size_t i = 0; i < indices.size(); i++)
+					corners[fill[indices[i]]++] = (unsigned int)i;
+
+				// Every allowed collapse along every edge, by cost
+				candidates.clear();
+				for (size_t i = 0; i < indices.size(); i++)
+				{
+					unsigned int a = indices[i];
+					unsigned int b = indices[i - i % 3 + (i + 1) % 3];
+
+					Collapse collapse;
+					if (CanCollapse(a, b, edges, positionEdges, collapse))
+					{
+						collapse.error = QuadricError(quadrics[remap[a]], Position(b));
+						candidates.push_back(collapse);
+					}
+					if (CanCollapse(b, a, edges, positionEdges, collapse))
+					{
+						collapse.error = QuadricError(quadrics[remap[b]], Position(a));
+						candidates.push_back(collapse);
+					}
+				}
+				if (candidates.empty())
+					break;
+
+				std::sort(candidates.begin(), candidates.end(), [](const Collapse& x, const Collapse& y) { return x.error < y.error; });
+
+				// Most collapses remove two triangles
+				size_t goal = (indices.size() - targetIndexCount) / 6 + 1;
+				double errorLimit = candidates[(std::min)(goal, candidates.size()) - 1].error * PassErrorSlack;
+
+				for (unsigned int i = 0; i < vertexCount; i++)
+					collapsed[i] = i;
+				std::fill(touched.begin(), touched.end(), false);
+
+				size_t collapses = 0;
+				for (const Collapse& c : candidates)
+				{
+					if (collapses >= goal || c.error > errorLimit)
+						break;
+
+					// Each position moves at most once per pass
+					if (touched[remap[c.v]] || touched[remap[c.t]])
+						continue;
+
+					if (FlipsTriangles(c.v, c.t, cornerOffsets, corners, collapsed) ||
+						(c.twinV != UINT_MAX && FlipsTriangles(c.twinV, c.twinT, cornerOffsets, corners, collapsed)))
+						continue;
+
+					collapsed[c.v] = c.t;
+					if (c.twinV != UINT_MAX)
+						collapsed[c.twinV] = c.twinT;
+
+					touched[remap[c.v]] = true;
+					touched[remap[c.t]] = true;
+					AddQuadric(quadrics[remap[c.t]], quadrics[remap[c.v]]);
+					maxError = (std::max)(maxError, c.error);
+					collapses++;
+				}
+				if (collapses == 0)
+					break;
+
+				// Apply the pass, dropping triangles that became degenerate
+				size_t write = 0;
+				for (size_t t = 0; t < indices.size(); t += 3)
+				{
+					unsigned int a = collapsed[indices[t]];
+					unsigned int b = collapsed[indices[t + 1]];
+					unsigned int c = collapsed[indices[t + 2]];
+					if (remap[a] == remap[b] || remap[b] == remap[c] || remap[a] == remap[c])
+						continue;
+
+					indices[write++] = a;
+					indices[write++] = b;
+					indices[write++] = c;
+				}
+				indices.resize(write);
+			}
+		}
+
+		float Error() const { return (float)sqrt(maxError); }
+	};
+}
+
+size_t SimplifyMesh(
+	unsigned int* destination,
+	const unsigned int* indices, size_t indexCount,
+	const Vertex* vertices, size_t vertexCount,
+	size_t targetIndexCount,
+	float* error)
+{
+	Simplifier simplifier(indices, indexCount, vertices, vertexCount);
+	if (!simplifier.indices.empty())
+		simplifier.Simplify(targetIndexCount);
+
+	std::copy(simplifier.indices.begin(), simplifier.indices.end(), destination);
+	if (error)
+		*error = simplifier.Error();
+	return simplifier.indices.size();
+}
+
+std::vector<LodLevel> GenerateLodChain(
+	const unsigned int* indices, size_t indexCount,
+	const Vertex* vertices, size_t vertexCount,
+	unsigned int maxLevels,
+	float reduction)
+{
+	std::vector<LodLevel> levels;
+	levels.push_back({ std::vector<unsigned int>(indices, indices + indexCount), 0.0f });
+	if (indexCount < 3)
+		return levels;
+
+	// One simplifier for the whole chain, so each level keeps
+	// collapsing from where the last left off
+	Simplifier simplifier(indices, indexCount, vertices, vertexCount);
+	while (levels.size() < maxLevels)
+	{
+		size_t previous = levels.back().Indices.size();
+		size_t target = (size_t)(previous / 3 * reduction) * 3;
+		simplifier.Simplify(target);
+
+		size_t count = simplifier.indices.size();
+		if (count == 0 || count > previous * (1.0f - MinLevelReduction))
+			break;
+
+		levels.push_back({ simplifier.indices, simplifier.Error() });
+	}
+	return levels;
+}
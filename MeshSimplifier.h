@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "Vertex.h"
+
+// --------------------------------------------------------
+// One level of detail produced by the simplifier
+//  - Indices reference the same vertices as the source mesh
+//  - Error is the largest collapse error along the way, as an
+//    object-space distance (0 for an untouched mesh)
+// --------------------------------------------------------
+struct LodLevel
+{
+	std::vector<unsigned int> Indices;
+	float Error;
+};
+
+// Simplifies an indexed triangle list with quadric error edge collapses until
+// it has at most targetIndexCount indices (or nothing more can collapse)
+// - Only the indices change, vertices are reused as collapse targets
+// - UV/normal seams (vertices sharing a position) only collapse along the
+//   seam, and open borders only along the border, so neither tears
+// - Returns the new index count, and the error in *error (if given)
+size_t SimplifyMesh(
+	unsigned int* destination,
+	const unsigned int* indices, size_t indexCount,
+	const Vertex* vertices, size_t vertexCount,
+	size_t targetIndexCount,
+	float* error);
+
+// Builds a chain of progressively simpler levels, each aiming for
+// reduction times the previous level's triangles
+// - Level 0 is a copy of the input
+// - Stops early once a level would barely shrink
+std::vector<LodLevel> GenerateLodChain(
+	const unsigned int* indices, size_t indexCount,
+	const Vertex* vertices, size_t vertexCount,
+	unsigned int maxLevels,
+	float reduction = 0.5f);
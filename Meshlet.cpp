@@ -0,0 +1,188 @@
+#include "Meshlet.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	// Triangle normals spread wider than this (dot with the axis) give a
+	// cone that would hardly ever cull, so don't bother with one
+	const float MinConeDot = 0.1f;
+
+	// --------------------------------------------------------
+	// Fills in the bounding sphere and normal cone of a meshlet
+	// whose index range and unique positions are known
+	// --------------------------------------------------------
+	void ComputeMeshletBounds(Meshlet& meshlet, const std::vector<XMFLOAT3>& positions, const Vertex* vertices, const unsigned int* indices)
+	{
+		BoundingSphere sphere;
+		BoundingSphere::CreateFromPoints(sphere, positions.size(), &positions[0], sizeof(XMFLOAT3));
+		meshlet.Center = sphere.Center;
+		meshlet.Radius = sphere.Radius;
+
+		// Unit normals of the non-degenerate triangles, facing the same
+		// way as the (clockwise) front faces the rasterizer keeps
+		XMFLOAT3 normals[MaxMeshletTriangles];
+		unsigned int normalCount = 0;
+		XMVECTOR normalSum = XMVectorZero();
+		for (unsigned int i = meshlet.IndexStart; i < meshlet.IndexStart + meshlet.IndexCount && normalCount < MaxMeshletTriangles; i += 3)
+		{
+			XMVECTOR p0 = XMLoadFloat3(&vertices[indices[i + 0]].Position);
+			XMVECTOR p1 = XMLoadFloat3(&vertices[indices[i + 1]].Position);
+			XMVECTOR p2 = XMLoadFloat3(&vertices[indices[i + 2]].Position);
+			XMVECTOR normal = XMVector3Cross(p1 - p0, p2 - p0);
+
+			float length = XMVectorGetX(XMVector3Length(normal));
+			if (length <= 0.0f)
+				continue;
+
+			normal /= length;
+			XMStoreFloat3(&normals[normalCount++], normal);
+			normalSum += normal;
+		}
+
+		// The axis is the average normal, and the cone has to fit the widest one
+		meshlet.ConeAxis = XMFLOAT3(0, 0, 1);
+		meshlet.ConeCutoff = 1.0f;
+		float sumLength = XMVectorGetX(XMVector3Length(normalSum));
+		if (normalCount == 0 || sumLength <= 0.0f)
+			return;
+
+		XMVECTOR axis = normalSum / sumLength;
+		float minDot = 1.0f;
+		for (unsigned int n = 0; n < normalCount; n++)
+			minDot = (std::min)(minDot, XMVectorGetX(XMVector3Dot(XMLoadFloat3(&normals[n]), axis)));
+
+		if (minDot <= MinConeDot)
+			return;
+
+		// Backfacing needs the view direction within 90 degrees minus the
+		// cone's half angle of the axis, i.e. a dot of at least sin(half angle)
+		XMStoreFloat3(&meshlet.ConeAxis, axis);
+		meshlet.ConeCutoff = sqrtf(1.0f - minDot * minDot);
+	}
+}
+
+void BuildMeshlets(
+	std::vector<Meshlet>& meshlets,
+	const Vertex* vertices, size_t vertexCount,
+	const unsigned int* indices, unsigned int indexStart, unsigned int indexCount,
+	int baseVertex,
+	unsigned int maxVertices,
+	unsigned int maxTriangles)
+{
+	maxTriangles = (std::min)(maxTriangles, MaxMeshletTriangles);
+
+	// Which meshlet each vertex was last added to (saves clearing between meshlets)
+	std::vector<unsigned int> stamp(vertexCount, UINT_MAX);
+	std::vector<XMFLOAT3> positions;
+	positions.reserve(maxVertices);
+
+	Meshlet current = { indexStart, 0, baseVertex, 0 };
+	unsigned int indexEnd = indexStart + indexCount;
+	for (unsigned int t = indexStart; t + 2 < indexEnd; t += 3)
+	{
+		// Start a new meshlet if this triangle doesn't fit in the current one
+		unsigned int id = (unsigned int)meshlets.size();
+		unsigned int newVertices = 0;
+		for (int k = 0; k < 3; k++)
+			if (stamp[indices[t + k]] != id)
+				newVertices++;
+
+		if (current.IndexCount > 0 &&
+			(current.VertexCount + newVertices > maxVertices || current.IndexCount / 3 >= maxTriangles))
+		{
+			ComputeMeshletBounds(current, positions, vertices, indices);
+			meshlets.push_back(current);
+
+			current = { t, 0, baseVertex, 0 };
+			positions.clear();
+			id++;
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int v = indices[t + k];
+			if (stamp[v] != id)
+			{
+				stamp[v] = id;
+				current.VertexCount++;
+				positions.push_back(vertices[v].Position);
+			}
+		}
+		current.IndexCount += 3;
+	}
+
+	if (current.IndexCount > 0)
+	{
+		ComputeMeshletBounds(current, positions, vertices, indices);
+		meshlets.push_back(current);
+	}
+}
+
+bool IsMeshletBackfacing(const Meshlet& meshlet, FXMVECTOR objectEye)
+{
+	if (meshlet.ConeCutoff >= 1.0f)
+		return false;
+
+	XMVECTOR toCenter = XMLoadFloat3(&meshlet.Center) - objectEye;
+	float distance = XMVectorGetX(XMVector3Length(toCenter));
+	float alongAxis = XMVectorGetX(XMVector3Dot(toCenter, XMLoadFloat3(&meshlet.ConeAxis)));
+
+	// The radius covers every point the view direction could come from
+	return alongAxis >= meshlet.ConeCutoff * distance + meshlet.Radius;
+}
+
+bool IsMeshletOutside(const Meshlet& meshlet, FXMMATRIX world, const BoundingFrustum& worldFrustum)
+{
+	BoundingSphere sphere(meshlet.Center, meshlet.Radius);
+	sphere.Transform(sphere, world);
+	return !worldFrustum.Intersects(sphere);
+}
+
+MeshletCullStats CullMeshlets(
+	std::vector<SubMesh>& visible,
+	const std::vector<Meshlet>& meshlets,
+	FXMMATRIX world,
+	const BoundingFrustum& worldFrustum,
+	XMFLOAT3 worldEye)
+{
+	MeshletCullStats stats = {};
+	visible.clear();
+
+	// Backface tests happen in object space, where the cones were built
+	XMVECTOR determinant;
+	XMMATRIX inverseWorld = XMMatrixInverse(&determinant, world);
+	XMVECTOR objectEye = XMVector3TransformCoord(XMLoadFloat3(&worldEye), inverseWorld);
+
+	// Mirroring transforms flip which side the rasterizer culls, so leave them be
+	bool cullBackfaces = XMVectorGetX(determinant) > 0.0f;
+
+	for (const Meshlet& m : meshlets)
+	{
+		stats.Total++;
+		if (cullBackfaces && IsMeshletBackfacing(m, objectEye))
+		{
+			stats.Backfacing++;
+			continue;
+		}
+		if (IsMeshletOutside(m, world, worldFrustum))
+		{
+			stats.Outside++;
+			continue;
+		}
+
+		// Neighbouring survivors can go out in one draw
+		if (!visible.empty() &&
+			visible.back().BaseVertex == m.BaseVertex &&
+			visible.back().IndexStart + visible.back().IndexCount == m.IndexStart)
+			visible.back().IndexCount += m.IndexCount;
+		else
+			visible.push_back({ m.IndexStart, m.IndexCount, m.BaseVertex });
+	}
+
+	return stats;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <cstddef>
+#include <vector>
+#include "Vertex.h"
+#include "MeshOptimizer.h"
+
+// Limits that match what mesh shader hardware likes (and keep culling granular)
+const unsigned int MaxMeshletVertices = 64;
+const unsigned int MaxMeshletTriangles = 124;
+
+// --------------------------------------------------------
+// A small cluster of a mesh's triangles, drawn with
+//   DrawIndexed(IndexCount, IndexStart, BaseVertex)
+// --------------------------------------------------------
+struct Meshlet
+{
+	unsigned int IndexStart;
+	unsigned int IndexCount;
+	int BaseVertex;
+	unsigned int VertexCount;
+
+	// Object-space bounding sphere
+	DirectX::XMFLOAT3 Center;
+	float Radius;
+
+	// Normal cone: every triangle faces away from an eye at e when
+	//   dot(Center - e, ConeAxis) >= ConeCutoff * length(Center - e) + Radius
+	// - A cutoff of 1 means the normals are too spread out to ever cull
+	DirectX::XMFLOAT3 ConeAxis;
+	float ConeCutoff;
+};
+
+// --------------------------------------------------------
+// How many meshlets were tested and why they were rejected
+// --------------------------------------------------------
+struct MeshletCullStats
+{
+	unsigned int Total;
+	unsigned int Backfacing;
+	unsigned int Outside;
+};
+
+// Splits indices[indexStart, indexStart + indexCount) into meshlets, in triangle
+// order, and appends them to meshlets
+// - Keeps the index buffer as is, so each meshlet is a range of it
+// - Feed it cache optimized indices, or the clusters end up scattered
+void BuildMeshlets(
+	std::vector<Meshlet>& meshlets,
+	const Vertex* vertices, size_t vertexCount,
+	const unsigned int* indices, unsigned int indexStart, unsigned int indexCount,
+	int baseVertex,
+	unsigned int maxVertices = MaxMeshletVertices,
+	unsigned int maxTriangles = MaxMeshletTriangles);
+
+// True if all of the meshlet's triangles face away from an object-space eye position
+bool IsMeshletBackfacing(const Meshlet& meshlet, DirectX::FXMVECTOR objectEye);
+
+// True if the meshlet's sphere, moved into world space, is entirely outside the frustum
+bool IsMeshletOutside(const Meshlet& meshlet, DirectX::FXMMATRIX world, const DirectX::BoundingFrustum& worldFrustum);
+
+// Tests every meshlet against a world-space frustum and eye position, and fills
+// visible with the surviving ranges (adjacent survivors merged into one draw)
+MeshletCullStats CullMeshlets(
+	std::vector<SubMesh>& visible,
+	const std::vector<Meshlet>& meshlets,
+	DirectX::FXMMATRIX world,
+	const DirectX::BoundingFrustum& worldFrustum,
+	DirectX::XMFLOAT3 worldEye);
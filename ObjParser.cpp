@@ -0,0 +1,460 @@
+#include "ObjParser.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+using namespace DirectX;
+
+namespace
+{
+	// Chunks smaller than this aren't worth a thread of their own
+	const size_t MinChunkBytes = 1 << 20;
+
+	const double PowersOfTen[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	// One "f" line, stored with the same 12-slot layout the old
+	// sscanf_s loop used: position/uv/normal for up to four corners
+	struct ObjFace
+	{
+		unsigned int i[12];
+		int corners;
+		bool hasUVs;
+	};
+
+	// Everything parsed out of one newline-aligned slice of the file
+	struct ObjChunk
+	{
+		std::vector<XMFLOAT3> positions;
+		std::vector<XMFLOAT3> normals;
+		std::vector<XMFLOAT2> uvs;
+		std::vector<ObjFace> faces;
+		unsigned int triangleCount = 0;
+		bool facesWithoutUVs = false;
+	};
+
+	inline bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+	inline bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+	inline void SkipSpaces(const char*& p, const char* end)
+	{
+		while (p < end && IsSpace(*p)) p++;
+	}
+
+	// Replacement for sscanf's %d - OBJ indices are 1-based,
+	// and relative (negative) indices were never supported
+	bool ParseIndex(const char*& p, const char* end, unsigned int& out)
+	{
+		SkipSpaces(p, end);
+		if (p < end && *p == '+') p++;
+		if (p >= end || !IsDigit(*p)) return false;
+
+		unsigned int value = 0;
+		while (p < end && IsDigit(*p))
+			value = value * 10 + (*p++ - '0');
+
+		out = value;
+		return true;
+	}
+
+	// Replacement for sscanf's %f - accumulates up to 18 significant
+	// digits in an integer and applies the exponent once at the end
+	bool ParseFloat(const char*& p, const char* end, float& out)
+	{
+		SkipSpaces(p, end);
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negative = (*p++ == '-');
+
+		unsigned long long mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		bool any = false;
+
+		// Integer part
+		for (; p < end && IsDigit(*p); p++, any = true)
+		{
+			if (digits < 18) { mantissa = mantissa * 10 + (*p - '0'); if (mantissa) digits++; }
+			else exponent++;
+		}
+
+		// Fractional part
+		if (p < end && *p == '.')
+		{
+			for (p++; p < end && IsDigit(*p); p++, any = true)
+			{
+				if (digits < 18) { mantissa = mantissa * 10 + (*p - '0'); if (mantissa) digits++; exponent--; }
+			}
+		}
+
+		if (!any) return false;
+
+		// Optional exponent
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			const char* q = p + 1;
+			bool negativeExp = false;
+			if (q < end && (*q == '-' || *q == '+'))
+				negativeExp = (*q++ == '-');
+
+			if (q < end && IsDigit(*q))
+			{
+				int e = 0;
+				for (; q < end && IsDigit(*q); q++)
+					if (e < 1000) e = e * 10 + (*q - '0');
+				exponent += negativeExp ? -e : e;
+				p = q;
+			}
+		}
+
+		double value = (double)mantissa;
+		if (exponent < 0)
+		{
+			for (; exponent < -22; exponent += 22) value /= 1e22;
+			value /= PowersOfTen[-exponent];
+		}
+		else
+		{
+			for (; exponent > 22; exponent -= 22) value *= 1e22;
+			value *= PowersOfTen[exponent];
+		}
+
+		out = (float)(negative ? -value : value);
+		return true;
+	}
+
+	bool ParseFloats(const char* p, const char* end, float* out, int count)
+	{
+		for (int i = 0; i < count; i++)
+			if (!ParseFloat(p, end, out[i])) return false;
+		return true;
+	}
+
+	// Corners are either "v/t/n" or, for files without UVs, "v//n"
+	bool ParseFace(const char* p, const char* end, ObjFace& face)
+	{
+		face.corners = 0;
+		face.hasUVs = true;
+
+		for (int c = 0; c < 4; c++)
+		{
+			unsigned int* corner = &face.i[c * 3];
+			if (!ParseIndex(p, end, corner[0])) break;
+			if (p >= end || *p != '/') break;
+			p++;
+
+			if (c == 0 && p < end && *p == '/')
+				face.hasUVs = false;
+
+			if (face.hasUVs)
+			{
+				if (!ParseIndex(p, end, corner[1])) break;
+				if (p >= end || *p != '/') break;
+				p++;
+			}
+			else
+			{
+				// Where the UV should have been, point at the first
+				// UV (a shared 0,0 is added if the file has none)
+				if (p >= end || *p != '/') break;
+				p++;
+				corner[1] = 1;
+			}
+
+			if (!ParseIndex(p, end, corner[2])) break;
+			face.corners++;
+		}
+
+		return face.corners >= 3;
+	}
+
+	void ParseChunk(const char* begin, const char* end, ObjChunk& chunk)
+	{
+		for (const char* p = begin; p < end;)
+		{
+			const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+			if (!lineEnd) lineEnd = end;
+
+			// Missing components are left at zero, but the element is still
+			// added so that every later 1-based index keeps pointing at the
+			// same entry it did before
+			if (lineEnd - p >= 2 && p[0] == 'v' && p[1] == 'n')
+			{
+				XMFLOAT3 norm(0, 0, 0);
+				ParseFloats(p + 2, lineEnd, &norm.x, 3);
+				chunk.normals.push_back(norm);
+			}
+			else if (lineEnd - p >= 2 && p[0] == 'v' && p[1] == 't')
+			{
+				XMFLOAT2 uv(0, 0);
+				ParseFloats(p + 2, lineEnd, &uv.x, 2);
+				chunk.uvs.push_back(uv);
+			}
+			else if (lineEnd - p >= 2 && p[0] == 'v' && IsSpace(p[1]))
+			{
+				XMFLOAT3 pos(0, 0, 0);
+				ParseFloats(p + 1, lineEnd, &pos.x, 3);
+				chunk.positions.push_back(pos);
+			}
+			else if (lineEnd - p >= 2 && p[0] == 'f' && IsSpace(p[1]))
+			{
+				ObjFace face;
+				if (ParseFace(p + 1, lineEnd, face))
+				{
+					chunk.faces.push_back(face);
+					chunk.triangleCount += (face.corners == 4) ? 2 : 1;
+					chunk.facesWithoutUVs |= !face.hasUVs;
+				}
+			}
+
+			p = lineEnd + 1;
+		}
+	}
+
+	template<typename T>
+	inline T Lookup(const std::vector<T>& list, unsigned int objIndex)
+	{
+		// OBJ indices are 1-based; zero wraps around and fails the check too
+		unsigned int i = objIndex - 1;
+		return i < list.size() ? list[i] : T();
+	}
+
+	Vertex MakeVertex(
+		const std::vector<XMFLOAT3>& positions,
+		const std::vector<XMFLOAT2>& uvs,
+		const std::vector<XMFLOAT3>& normals,
+		const unsigned int* i)
+	{
+		Vertex v = {};
+		v.Position = Lookup(positions, i[0]);
+		v.UV = Lookup(uvs, i[1]);
+		v.Normal = Lookup(normals, i[2]);
+
+		// The model is most likely in a right-handed space, so convert
+		// to DirectX's left-handed space by inverting Z on the position
+		// and normal (the winding is flipped by the caller).  The V
+		// coordinate is also flipped since DirectX puts (0,0) at the
+		// top left of the texture
+		v.UV.y = 1.0f - v.UV.y;
+		v.Position.z *= -1.0f;
+		v.Normal.z *= -1.0f;
+		return v;
+	}
+}
+
+bool ParseObjFile(const std::wstring& objFile, ObjMeshData& out)
+{
+	MappedFile file(objFile);
+	if (!file.IsValid())
+		return false;
+
+	return ParseObjMemory(file.GetData(), file.GetSize(), out);
+}
+
+bool ParseObjMemory(const char* data, size_t size, ObjMeshData& out, unsigned int maxThreads)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	// Split the file into newline-aligned chunks, roughly one per core
+	unsigned int threadCount = (std::max)(1u, std::thread::hardware_concurrency());
+	if (maxThreads > 0)
+		threadCount = (std::min)(threadCount, maxThreads);
+	size_t chunkTarget = std::min<size_t>(threadCount, size / MinChunkBytes + 1);
+
+	const char* end = data + size;
+	std::vector<const char*> bounds;
+	bounds.push_back(data);
+	for (size_t c = 1; c < chunkTarget; c++)
+	{
+		const char* split = (std::max)(data + size * c / chunkTarget, bounds.back());
+		const char* newline = (const char*)memchr(split, '\n', end - split);
+		bounds.push_back(newline ? newline + 1 : end);
+	}
+	bounds.push_back(end);
+
+	// Parse every chunk independently
+	size_t chunkCount = bounds.size() - 1;
+	std::vector<ObjChunk> chunks(chunkCount);
+	RunParallel(chunkCount, [&](size_t c) { ParseChunk(bounds[c], bounds[c + 1], chunks[c]); });
+
+	// Merge the attribute lists in file order, so global 1-based
+	// indices resolve exactly as they would in a serial parse
+	std::vector<XMFLOAT3> positions;
+	std::vector<XMFLOAT3> normals;
+	std::vector<XMFLOAT2> uvs;
+	unsigned int triangleCount = 0;
+	bool facesWithoutUVs = false;
+	for (size_t c = 0; c < chunkCount; c++)
+	{
+		positions.insert(positions.end(), chunks[c].positions.begin(), chunks[c].positions.end());
+		normals.insert(normals.end(), chunks[c].normals.begin(), chunks[c].normals.end());
+		uvs.insert(uvs.end(), chunks[c].uvs.begin(), chunks[c].uvs.end());
+
+		triangleCount += chunks[c].triangleCount;
+		facesWithoutUVs |= chunks[c].facesWithoutUVs;
+	}
+
+	// If we have no UVs, create a single UV coordinate
+	// that will be used for all vertices
+	if (facesWithoutUVs && uvs.size() == 0)
+		uvs.push_back(XMFLOAT2(0, 0));
+
+	// Weld corners that share the same position/uv/normal index triple,
+	// so shared corners become one vertex referenced by several indices.
+	// Corners are visited in the order the old triangle soup emitted them
+	// (winding flipped), so the first use of each vertex defines its slot
+	std::vector<const unsigned int*> uniqueCorners;
+	out.indices.clear();
+	out.indices.reserve((size_t)triangleCount * 3);
+	{
+		size_t capacity = 16;
+		while (capacity < (size_t)triangleCount * 3) capacity <<= 1;
+		capacity <<= 1;
+		std::vector<unsigned int> slots(capacity, UINT_MAX);
+
+		auto weld = [&](const unsigned int* i)
+		{
+			unsigned int hash = (i[0] * 73856093u) ^ (i[1] * 19349663u) ^ (i[2] * 83492791u);
+			hash ^= hash >> 16;
+			hash *= 0x85ebca6bu;
+			hash ^= hash >> 13;
+
+			size_t slot = hash & (capacity - 1);
+			for (;; slot = (slot + 1) & (capacity - 1))
+			{
+				unsigned int v = slots[slot];
+				if (v == UINT_MAX)
+				{
+					v = (unsigned int)uniqueCorners.size();
+					slots[slot] = v;
+					uniqueCorners.push_back(i);
+					out.indices.push_back(v);
+					return;
+				}
+
+				const unsigned int* existing = uniqueCorners[v];
+				if (existing[0] == i[0] && existing[1] == i[1] && existing[2] == i[2])
+				{
+					out.indices.push_back(v);
+					return;
+				}
+			}
+		};
+
+		for (auto& chunk : chunks)
+		{
+			for (auto& f : chunk.faces)
+			{
+				weld(&f.i[0]);
+				weld(&f.i[6]);
+				weld(&f.i[3]);
+
+				// Was there a 4th vertex?  Add a whole triangle
+				if (f.corners == 4)
+				{
+					weld(&f.i[0]);
+					weld(&f.i[9]);
+					weld(&f.i[6]);
+				}
+			}
+		}
+	}
+
+	// Build the unique vertices in parallel, one slice per chunk
+	size_t vertexCount = uniqueCorners.size();
+	out.vertices.resize(vertexCount);
+	RunParallel(chunkCount, [&](size_t c)
+	{
+		size_t first = vertexCount * c / chunkCount;
+		size_t last = vertexCount * (c + 1) / chunkCount;
+		for (size_t v = first; v < last; v++)
+			out.vertices[v] = MakeVertex(positions, uvs, normals, uniqueCorners[v]);
+	});
+
+	out.unweldedVertexCount = triangleCount * 3;
+	out.fileBytes = size;
+	out.triangleCount = triangleCount;
+	out.parseSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+	return true;
+}
+
+ObjParseBenchmarkResult BenchmarkObjParsing(size_t targetBytes)
+{
+	ObjParseBenchmarkResult result = {};
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	// A wavy grid, with every cell either one quad or two triangles.  Each
+	// vertex comes to roughly 200 bytes once its share of faces is counted
+	unsigned int side = (std::max)(2u, (unsigned int)sqrt(targetBytes / 200.0));
+	std::string text;
+	text.reserve(targetBytes + targetBytes / 4);
+
+	char line[256];
+	for (unsigned int y = 0; y < side; y++)
+	{
+		for (unsigned int x = 0; x < side; x++)
+		{
+			float u = x / (float)(side - 1);
+			float v = y / (float)(side - 1);
+			float height = sinf(u * 40.0f) * cosf(v * 40.0f);
+			XMFLOAT3 normal;
+			XMStoreFloat3(&normal, XMVector3Normalize(XMVectorSet(-cosf(u * 40.0f) * cosf(v * 40.0f) * 0.4f, 1.0f, sinf(u * 40.0f) * sinf(v * 40.0f) * 0.4f, 0.0f)));
+
+			int length = snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.6f %.6f %.6f\n",
+				u * 100.0f - 50.0f, height, v * 100.0f - 50.0f,
+				u, v,
+				normal.x, normal.y, normal.z);
+			text.append(line, length);
+		}
+	}
+
+	for (unsigned int y = 0; y < side - 1; y++)
+	{
+		for (unsigned int x = 0; x < side - 1; x++)
+		{
+			unsigned int a = y * side + x + 1;
+			unsigned int b = a + 1;
+			unsigned int c = a + side;
+			unsigned int d = c + 1;
+
+			int length = (x + y) % 2 == 0 ?
+				snprintf(line, sizeof(line), "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, c, c, c, d, d, d, b, b, b) :
+				snprintf(line, sizeof(line), "f %u/%u/%u %u/%u/%u %u/%u/%u\nf %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, c, c, c, d, d, d, a, a, a, d, d, d, b, b, b);
+			text.append(line, length);
+		}
+	}
+
+	result.Bytes = text.size();
+	result.ThreadCount = (std::max)(1u, std::thread::hardware_concurrency());
+	result.GenerateMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	// The same text both ways, serial first
+	ObjMeshData serial;
+	ObjMeshData parallel;
+	bool parsed =
+		ParseObjMemory(text.data(), text.size(), serial, 1) &&
+		ParseObjMemory(text.data(), text.size(), parallel);
+
+	result.TriangleCount = parallel.triangleCount;
+	result.VertexCount = (unsigned int)parallel.vertices.size();
+	result.SerialMs = serial.parseSeconds * 1000.0;
+	result.ParallelMs = parallel.parseSeconds * 1000.0;
+	result.Identical = parsed &&
+		serial.triangleCount == 2 * (side - 1) * (side - 1) &&
+		serial.vertices.size() == (size_t)side * side &&
+		serial.triangleCount == parallel.triangleCount &&
+		serial.indices == parallel.indices &&
+		serial.vertices.size() == parallel.vertices.size() &&
+		memcmp(serial.vertices.data(), parallel.vertices.data(), sizeof(Vertex) * serial.vertices.size()) == 0;
+	return result;
+}
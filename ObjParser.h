@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Vertex.h"
+
+// --------------------------------------------------------
+// Indexed triangle list produced by the OBJ parser
+//
+// Corners sharing a position/uv/normal triple are welded
+// into a single vertex.  The data is already converted to
+// DirectX conventions: Z and normal Z flipped, V flipped
+// and winding swapped
+// --------------------------------------------------------
+struct ObjMeshData
+{
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+
+	// Load statistics
+	size_t fileBytes = 0;
+	unsigned int triangleCount = 0;
+	unsigned int unweldedVertexCount = 0;
+	double parseSeconds = 0.0;
+};
+
+// Memory-maps the file and parses it in parallel, newline-aligned chunks
+// (no more than maxThreads of them, when that isn't 0)
+bool ParseObjFile(const std::wstring& objFile, ObjMeshData& out);
+bool ParseObjMemory(const char* data, size_t size, ObjMeshData& out, unsigned int maxThreads = 0);
+
+// --------------------------------------------------------
+// Timings from parsing the same generated file serially
+// and in parallel
+// --------------------------------------------------------
+struct ObjParseBenchmarkResult
+{
+	size_t Bytes;
+	unsigned int TriangleCount;
+	unsigned int VertexCount;
+	unsigned int ThreadCount;
+	double GenerateMs;
+	double SerialMs;
+	double ParallelMs;
+	bool Identical;		// Same vertices and indices both ways, and the counts the grid should give
+};
+
+// Writes a grid of roughly targetBytes of OBJ text to memory (positions, UVs,
+// normals, and a mix of triangles and quads) and times the parser on it
+ObjParseBenchmarkResult BenchmarkObjParsing(size_t targetBytes);
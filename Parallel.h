@@ -0,0 +1,32 @@
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "JobSystem.h"
+
+// Runs job(0..count-1) as jobs on the engine's job system, with job 0 on the
+// calling thread, which then helps with the rest until they're all done
+template<typename Job>
+void RunParallel(size_t count, Job job)
+{
+	JobSystem& jobs = GetJobSystem();
+	JobCounter done;
+	for (size_t i = 1; i < count; i++)
+		jobs.Run([&job, i]() { job(i); }, &done);
+
+	if (count > 0) job(0);
+	jobs.Wait(done);
+}
+
+// Splits [0, count) into contiguous ranges, a few per thread but no smaller
+// than minPerRange, and runs job(first, last) on each in parallel
+template<typename Job>
+void ParallelFor(size_t count, size_t minPerRange, Job job)
+{
+	JobSystem& jobs = GetJobSystem();
+	JobCounter done;
+	jobs.ParallelFor(count, minPerRange, job, done);
+	jobs.Wait(done);
+}
@@ -0,0 +1,267 @@
+#include "ParallelRecorder.h"
+
+#include <atomic>
+#include <cstdint>
+#include <random>
+#include <thread>
+
+static thread_local RenderContext* threadRenderContext = 0;
+static thread_local unsigned int threadRecordingSlot = 0;
+
+void SetThreadRenderContext(RenderContext* context, unsigned int slot)
+{
+	threadRenderContext = context;
+	threadRecordingSlot = context ? slot : 0;
+}
+
+RenderContext* GetThreadRenderContext() { return threadRenderContext; }
+unsigned int GetThreadRecordingSlot() { return threadRecordingSlot; }
+
+std::vector<RecordRange> PartitionRecording(const std::vector<unsigned int>& costs, unsigned int rangeCount)
+{
+	std::vector<RecordRange> ranges;
+	unsigned int count = (unsigned int)costs.size();
+	if (count == 0)
+		return ranges;
+	rangeCount = (std::min)((std::max)(rangeCount, 1u), count);
+
+	uint64_t total = 0;
+	for (unsigned int c : costs)
+		total += (std::max)(c, 1u);
+
+	// Each range ends as soon as the running total reaches its share of the
+	// whole, so none goes past an even split by more than one item
+	RecordRange range = { 0, 0, 0 };
+	uint64_t done = 0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		unsigned int cost = (std::max)(costs[i], 1u);
+		range.Count++;
+		range.Cost += cost;
+		done += cost;
+
+		unsigned int r = (unsigned int)ranges.size();
+		if (r + 1 < rangeCount && done * rangeCount >= total * (r + 1))
+		{
+			ranges.push_back(range);
+			range = { i + 1, 0, 0 };
+		}
+	}
+	if (range.Count > 0)
+		ranges.push_back(range);
+	return ranges;
+}
+
+
+// --------------------------------------------------------
+// Self test
+// --------------------------------------------------------
+namespace
+{
+	// Writes down the vertex shaders bound through it, the only call the test makes
+	class MockRecordingContext : public RenderContext
+	{
+	public:
+		std::vector<uintptr_t> Calls;
+
+		void SetVertexShader(ID3D11VertexShader* shader) { Calls.push_back((uintptr_t)shader); }
+		void SetPixelShader(ID3D11PixelShader* shader) {}
+		void SetInputLayout(ID3D11InputLayout* layout) {}
+		void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) {}
+		void SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, unsigned int stride, unsigned int offset) {}
+		void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset) {}
+		void SetConstantBuffer(ShaderStage stage, unsigned int slot, ID3D11Buffer* buffer) {}
+		void SetShaderResource(ShaderStage stage, unsigned int slot, ID3D11ShaderResourceView* srv) {}
+		void SetSampler(ShaderStage stage, unsigned int slot, ID3D11SamplerState* sampler) {}
+		void SetRasterizerState(ID3D11RasterizerState* state) {}
+		void SetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef) {}
+		void SetBlendState(ID3D11BlendState* state) {}
+		void SetConstantBufferRange(ShaderStage stage, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount) {}
+		void UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, unsigned int size) {}
+	};
+
+	// A context per range like deferred contexts, with executing
+	// a recording appending its calls to one list
+	class MockRecordingTarget : public CommandRecordingTarget
+	{
+	public:
+		std::vector<uintptr_t> Executed;
+		std::vector<unsigned int> ExecuteOrder;
+		bool Balanced = true;		// Every context begun and ended once, on the same thread
+		bool ExecutedHere = true;	// Every execute on the thread that made the target
+
+		MockRecordingTarget(unsigned int contextCount) :
+			contexts(contextCount),
+			owner(std::this_thread::get_id())
+		{ }
+
+		unsigned int GetContextCount() { return (unsigned int)contexts.size(); }
+
+		RenderContext& BeginRecording(unsigned int context)
+		{
+			Recorder& r = contexts[context];
+			r.Begun++;
+			r.Thread = std::this_thread::get_id();
+			r.State.Calls.clear();
+			return r.State;
+		}
+
+		void EndRecording(unsigned int context)
+		{
+			Recorder& r = contexts[context];
+			r.Ended++;
+			r.EndedOnThread = r.Thread == std::this_thread::get_id();
+		}
+
+		void Execute(unsigned int context)
+		{
+			Recorder& r = contexts[context];
+			Executed.insert(Executed.end(), r.State.Calls.begin(), r.State.Calls.end());
+			ExecuteOrder.push_back(context);
+			ExecutedHere = ExecutedHere && std::this_thread::get_id() == owner;
+		}
+
+		// Checks and resets the per-context counts, for the next round
+		void EndRound(unsigned int ranges)
+		{
+			for (unsigned int c = 0; c < contexts.size(); c++)
+			{
+				bool used = c < ranges;
+				Recorder& r = contexts[c];
+				Balanced = Balanced && r.Begun == (used ? 1u : 0u) && r.Ended == r.Begun && (!used || r.EndedOnThread);
+				r.Begun = r.Ended = 0;
+			}
+		}
+
+	private:
+		struct Recorder
+		{
+			MockRecordingContext State;
+			unsigned int Begun = 0;
+			unsigned int Ended = 0;
+			std::thread::id Thread;
+			bool EndedOnThread = false;
+		};
+
+		std::vector<Recorder> contexts;
+		std::thread::id owner;
+	};
+
+	// Stand-ins for Direct3D objects, which are only ever compared
+	template<typename T>
+	T* Fake(uintptr_t id) { return reinterpret_cast<T*>(id * 16); }
+
+	// Whether ranges are contiguous, in order and cover every item
+	bool CoversInOrder(const std::vector<RecordRange>& ranges, unsigned int count)
+	{
+		unsigned int next = 0;
+		for (const RecordRange& r : ranges)
+		{
+			if (r.First != next || r.Count == 0)
+				return false;
+			next += r.Count;
+		}
+		return next == count;
+	}
+}
+
+ParallelRecordingTestResult TestParallelRecording()
+{
+	ParallelRecordingTestResult result = {};
+
+	// Partitioning
+	{
+		result.Check(PartitionRecording({}, 4).empty(), "No items, no ranges");
+		result.Check(PartitionRecording({ 5, 5 }, 4).size() == 2, "Fewer items than ranges gives one range each");
+		result.Check(PartitionRecording({ 1, 2, 3 }, 0).size() == 1, "A range count of 0 records on one context");
+
+		std::vector<RecordRange> zeros = PartitionRecording(std::vector<unsigned int>(8, 0), 4);
+		result.Check(zeros.size() == 4 && CoversInOrder(zeros, 8), "Items that cost nothing are still split up");
+
+		std::vector<RecordRange> skewed = PartitionRecording({ 100, 1, 1, 1, 1, 1, 1, 1 }, 4);
+		result.Check(CoversInOrder(skewed, 8) && skewed[0].Count == 1, "An expensive item gets a range to itself");
+	}
+
+	// One scene recorded into a mock, against the same calls on one thread
+	{
+		const unsigned int count = 1000;
+		std::vector<unsigned int> costs(count);
+		for (unsigned int i = 0; i < count; i++)
+			costs[i] = 1 + i % 7;
+
+		MockRecordingTarget target(4);
+		std::atomic<unsigned int> wrongContext(0);
+		auto record = [&](unsigned int context, RenderContext& state, RecordRange range)
+		{
+			if (GetThreadRenderContext() != &state || GetThreadRecordingSlot() != context + 1)
+				wrongContext++;
+			for (unsigned int i = range.First; i < range.First + range.Count; i++)
+				state.SetVertexShader(Fake<ID3D11VertexShader>(i + 1));
+		};
+
+		RecordingStats stats = RecordInParallel(target, 8, costs, record);
+		target.EndRound(stats.Ranges);
+
+		bool inOrder = target.Executed.size() == count;
+		for (unsigned int i = 0; inOrder && i < count; i++)
+			inOrder = target.Executed[i] == (uintptr_t)Fake<ID3D11VertexShader>(i + 1);
+
+		result.Check(stats.Ranges == 4, "Ranges are capped at the target's contexts");
+		result.Check(inOrder, "Merged calls match recording on one thread");
+		result.Check(target.Balanced, "Every context is begun and ended once, on the same thread");
+		result.Check(target.ExecutedHere && target.ExecuteOrder == std::vector<unsigned int>({ 0, 1, 2, 3 }), "Recordings execute in order on the calling thread");
+		result.Check(wrongContext == 0, "Recording threads see their own context");
+		result.Check(GetThreadRenderContext() == 0 && GetThreadRecordingSlot() == 0, "Thread context is cleared after recording");
+	}
+
+	// Random scenes split every way, each checked against one thread's calls
+	{
+		const unsigned int rounds = 64;
+		const unsigned int count = 10000;
+		std::mt19937 rng(23);
+		std::uniform_int_distribution<unsigned int> costDist(0, 40);
+		MockRecordingTarget target(MaxRecordingSlots);
+		std::vector<unsigned int> costs(count);
+		bool balanced = true;
+
+		for (unsigned int round = 0; round < rounds; round++)
+		{
+			for (unsigned int& c : costs)
+				c = costDist(rng);
+
+			target.Executed.clear();
+			target.ExecuteOrder.clear();
+			RecordingStats stats = RecordInParallel(target, 1 + round % MaxRecordingSlots, costs,
+				[&](unsigned int context, RenderContext& state, RecordRange range)
+				{
+					for (unsigned int i = range.First; i < range.First + range.Count; i++)
+						state.SetVertexShader(Fake<ID3D11VertexShader>(i + 1));
+				});
+			target.EndRound(stats.Ranges);
+
+			bool same = target.Executed.size() == count;
+			for (unsigned int i = 0; same && i < count; i++)
+				same = target.Executed[i] == (uintptr_t)Fake<ID3D11VertexShader>(i + 1);
+			if (!same)
+				result.Mismatches++;
+
+			// Within one item (at most 40) of an even split
+			unsigned int ideal = (stats.TotalCost + stats.Ranges - 1) / stats.Ranges;
+			balanced = balanced && stats.LargestCost <= ideal + 40;
+			if (stats.Ranges == MaxRecordingSlots && stats.LargestCost - ideal >= result.LargestCost - result.IdealCost)
+			{
+				result.StressRanges = stats.Ranges;
+				result.LargestCost = (std::max)(result.LargestCost, stats.LargestCost);
+				result.IdealCost = ideal;
+			}
+		}
+
+		result.StressRounds = rounds;
+		result.StressItems = count;
+		result.Check(result.Mismatches == 0, "Stress rounds merge into one thread's calls");
+		result.Check(balanced, "Stress ranges are within one item of an even split");
+		result.Check(target.Balanced && target.ExecutedHere, "Stress rounds begin, end and execute every context properly");
+	}
+
+	return result;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+#include "Parallel.h"
+#include "RenderContext.h"
+#include "SelfTest.h"
+
+// Recording threads, not counting the thread that owns the immediate context
+static const unsigned int MaxRecordingSlots = 8;
+
+// --------------------------------------------------------
+// A render context for the calling thread to use instead of
+// the ones shaders and the geometry arena were given, while
+// it records part of a frame
+//  - Slot 0, with no context, is any thread that isn't
+//    recording; recording threads get 1 to MaxRecordingSlots,
+//    and SimpleShader keeps a copy of its constant data for
+//    each of them, so their variables don't collide
+// --------------------------------------------------------
+void SetThreadRenderContext(RenderContext* context, unsigned int slot);
+RenderContext* GetThreadRenderContext();
+unsigned int GetThreadRecordingSlot();
+
+// --------------------------------------------------------
+// A run of items (draw batches) for one context to record
+// --------------------------------------------------------
+struct RecordRange
+{
+	unsigned int First;
+	unsigned int Count;
+	unsigned int Cost;
+};
+
+// Splits items into at most rangeCount contiguous runs of about the same cost,
+// in order; every item costs at least 1
+std::vector<RecordRange> PartitionRecording(const std::vector<unsigned int>& costs, unsigned int rangeCount);
+
+// --------------------------------------------------------
+// Somewhere each range is recorded into its own context,
+// and the recordings played back in order afterwards
+//  - Direct3D's is DeferredRecordingTarget; anything else
+//    (like a mock that just writes down the calls) works
+// --------------------------------------------------------
+class CommandRecordingTarget
+{
+public:
+	virtual ~CommandRecordingTarget() {}
+
+	virtual unsigned int GetContextCount() = 0;
+
+	// On the thread recording into that context, around its range
+	virtual RenderContext& BeginRecording(unsigned int context) = 0;
+	virtual void EndRecording(unsigned int context) = 0;
+
+	// Back on the thread that called RecordInParallel(), in range order
+	virtual void Execute(unsigned int context) = 0;
+};
+
+struct RecordingStats
+{
+	unsigned int Ranges;
+	unsigned int TotalCost;
+	unsigned int LargestCost;	// The range everyone waits for
+	float RecordMs;				// Until the last range was recorded
+	float ExecuteMs;
+};
+
+// --------------------------------------------------------
+// Partitions the items across up to rangeCount of the target's
+// contexts, records each range as its own job with
+// record(context, state, range), then executes them in order
+//  - The thread running each range has its context set as its
+//    render context (see SetThreadRenderContext) while it runs
+//  - Items come out exactly as recorded one after another on
+//    a single context would have, only split up
+// --------------------------------------------------------
+template<typename Record>
+RecordingStats RecordInParallel(CommandRecordingTarget& target, unsigned int rangeCount, const std::vector<unsigned int>& costs, Record record)
+{
+	RecordingStats stats = {};
+	std::vector<RecordRange> ranges = PartitionRecording(costs, (std::min)(rangeCount, target.GetContextCount()));
+	stats.Ranges = (unsigned int)ranges.size();
+	for (RecordRange& r : ranges)
+	{
+		stats.TotalCost += r.Cost;
+		stats.LargestCost = (std::max)(stats.LargestCost, r.Cost);
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	RunParallel(ranges.size(), [&](size_t r)
+	{
+		unsigned int context = (unsigned int)r;
+		RenderContext& state = target.BeginRecording(context);
+		SetThreadRenderContext(&state, context + 1);
+		record(context, state, ranges[r]);
+		SetThreadRenderContext(0, 0);
+		target.EndRecording(context);
+	});
+	auto recorded = std::chrono::high_resolution_clock::now();
+
+	for (unsigned int r = 0; r < ranges.size(); r++)
+		target.Execute(r);
+
+	stats.RecordMs = std::chrono::duration<float, std::milli>(recorded - start).count();
+	stats.ExecuteMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - recorded).count();
+	return stats;
+}
+
+// --------------------------------------------------------
+// Results from recording scripted scenes into a mock target
+// that writes down every call, checking the merged calls
+// against recording on one thread
+// --------------------------------------------------------
+struct ParallelRecordingTestResult : TestResult
+{
+	unsigned int StressRounds;
+	unsigned int StressItems;	// Per round
+	unsigned int StressRanges;
+	unsigned int LargestCost;	// Worst range of any round...
+	unsigned int IdealCost;		// ...against an even split
+	unsigned int Mismatches;	// Rounds whose merged calls differed from one thread's (should be 0)
+};
+
+ParallelRecordingTestResult TestParallelRecording();
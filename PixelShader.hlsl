@@ -1,12 +1,17 @@
 
 #include "ShaderIncludes.hlsli"
 
-cbuffer ExternalData : register(b0)
+cbuffer PerFrame : register(b0)
 {
 	float3 cameraPosition;
 	Light lights[5];
 }
 
+cbuffer PerMaterial : register(b1)
+{
+	float3 colorTint;
+}
+
 Texture2D Albedo						: register(t0);
 Texture2D NormalMap						: register(t1);
 Texture2D RoughnessMap					: register(t2);
@@ -21,7 +26,7 @@ float4 main(VertexToPixel input) : SV_TARGET
 
 	float roughness = RoughnessMap.Sample(BasicSampler, input.uv).r;
 	float metalness = MetalnessMap.Sample(BasicSampler, input.uv).r;
-	float3 surfaceColor = pow(Albedo.Sample(BasicSampler, input.uv).rgb, 2.2f);
+	float3 surfaceColor = pow(Albedo.Sample(BasicSampler, input.uv).rgb, 2.2f) * colorTint;
 	float3 outputLight = float3(0, 0, 0);
 
 	// Perform the perspective divide (divide by W) ourselves
@@ -0,0 +1,58 @@
+#include "RenderContext.h"
+
+D3D11RenderContext::D3D11RenderContext(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context) :
+	context(context)
+{
+	context.As(&context1);
+}
+
+void D3D11RenderContext::SetVertexShader(ID3D11VertexShader* shader) { context->VSSetShader(shader, 0, 0); }
+void D3D11RenderContext::SetPixelShader(ID3D11PixelShader* shader) { context->PSSetShader(shader, 0, 0); }
+void D3D11RenderContext::SetInputLayout(ID3D11InputLayout* layout) { context->IASetInputLayout(layout); }
+void D3D11RenderContext::SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) { context->IASetPrimitiveTopology(topology); }
+void D3D11RenderContext::SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset) { context->IASetIndexBuffer(buffer, format, offset); }
+void D3D11RenderContext::SetRasterizerState(ID3D11RasterizerState* state) { context->RSSetState(state); }
+void D3D11RenderContext::SetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef) { context->OMSetDepthStencilState(state, stencilRef); }
+void D3D11RenderContext::SetBlendState(ID3D11BlendState* state) { context->OMSetBlendState(state, 0, 0xFFFFFFFF); }
+void D3D11RenderContext::UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, unsigned int size) { context->UpdateSubresource(buffer, 0, 0, data, 0, 0); }
+
+void D3D11RenderContext::SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, unsigned int stride, unsigned int offset)
+{
+	UINT strides[1] = { stride };
+	UINT offsets[1] = { offset };
+	context->IASetVertexBuffers(slot, 1, &buffer, strides, offsets);
+}
+
+void D3D11RenderContext::SetConstantBuffer(ShaderStage stage, unsigned int slot, ID3D11Buffer* buffer)
+{
+	if (stage == ShaderStage::Vertex)
+		context->VSSetConstantBuffers(slot, 1, &buffer);
+	else
+		context->PSSetConstantBuffers(slot, 1, &buffer);
+}
+
+void D3D11RenderContext::SetConstantBufferRange(ShaderStage stage, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	if (!context1)
+		SetConstantBuffer(stage, slot, buffer);
+	else if (stage == ShaderStage::Vertex)
+		context1->VSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+	else
+		context1->PSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+}
+
+void D3D11RenderContext::SetShaderResource(ShaderStage stage, unsigned int slot, ID3D11ShaderResourceView* srv)
+{
+	if (stage == ShaderStage::Vertex)
+		context->VSSetShaderResources(slot, 1, &srv);
+	else
+		context->PSSetShaderResources(slot, 1, &srv);
+}
+
+void D3D11RenderContext::SetSampler(ShaderStage stage, unsigned int slot, ID3D11SamplerState* sampler)
+{
+	if (stage == ShaderStage::Vertex)
+		context->VSSetSamplers(slot, 1, &sampler);
+	else
+		context->PSSetSamplers(slot, 1, &sampler);
+}
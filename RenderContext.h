@@ -0,0 +1,71 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <wrl/client.h>
+
+enum class ShaderStage
+{
+	Vertex,
+	Pixel
+};
+
+// --------------------------------------------------------
+// The pipeline state calls the renderer makes, one slot at
+// a time, and its constant buffer uploads, so they can go
+// through a filter (see StateCache) or to something that
+// isn't Direct3D at all
+// --------------------------------------------------------
+class RenderContext
+{
+public:
+	virtual ~RenderContext() {}
+
+	virtual void SetVertexShader(ID3D11VertexShader* shader) = 0;
+	virtual void SetPixelShader(ID3D11PixelShader* shader) = 0;
+	virtual void SetInputLayout(ID3D11InputLayout* layout) = 0;
+	virtual void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) = 0;
+	virtual void SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, unsigned int stride, unsigned int offset) = 0;
+	virtual void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset) = 0;
+	virtual void SetConstantBuffer(ShaderStage stage, unsigned int slot, ID3D11Buffer* buffer) = 0;
+	virtual void SetShaderResource(ShaderStage stage, unsigned int slot, ID3D11ShaderResourceView* srv) = 0;
+	virtual void SetSampler(ShaderStage stage, unsigned int slot, ID3D11SamplerState* sampler) = 0;
+	virtual void SetRasterizerState(ID3D11RasterizerState* state) = 0;
+	virtual void SetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef) = 0;
+	virtual void SetBlendState(ID3D11BlendState* state) = 0; // Default factor and sample mask
+
+	// Binds part of a bigger buffer, in 16 byte constants (counts are multiples of 16)
+	virtual void SetConstantBufferRange(ShaderStage stage, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount) = 0;
+
+	// Replaces a whole constant buffer's contents
+	virtual void UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, unsigned int size) = 0;
+};
+
+// --------------------------------------------------------
+// Makes every call straight on a Direct3D device context
+//  - Constant buffer ranges need Direct3D 11.1; without it
+//    they bind the whole buffer
+// --------------------------------------------------------
+class D3D11RenderContext : public RenderContext
+{
+public:
+	D3D11RenderContext(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	void SetVertexShader(ID3D11VertexShader* shader);
+	void SetPixelShader(ID3D11PixelShader* shader);
+	void SetInputLayout(ID3D11InputLayout* layout);
+	void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+	void SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, unsigned int stride, unsigned int offset);
+	void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset);
+	void SetConstantBuffer(ShaderStage stage, unsigned int slot, ID3D11Buffer* buffer);
+	void SetShaderResource(ShaderStage stage, unsigned int slot, ID3D11ShaderResourceView* srv);
+	void SetSampler(ShaderStage stage, unsigned int slot, ID3D11SamplerState* sampler);
+	void SetRasterizerState(ID3D11RasterizerState* state);
+	void SetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef);
+	void SetBlendState(ID3D11BlendState* state);
+	void SetConstantBufferRange(ShaderStage stage, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount);
+	void UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, unsigned int size);
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context1; // Null before Direct3D 11.1
+};
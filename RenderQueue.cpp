@@ -0,0 +1,144 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+	const unsigned int PassBits = 2;
+	const unsigned int ShaderBits = 6;
+	const unsigned int MaterialBits = 13;
+	const unsigned int MeshBits = 19;
+	const unsigned int DepthBits = 18;
+
+	const unsigned int DepthShift = 0;
+	const unsigned int MeshShift = DepthShift + DepthBits;
+	const unsigned int MaterialShift = MeshShift + MeshBits;
+	const unsigned int PixelShaderShift = MaterialShift + MaterialBits;
+	const unsigned int VertexShaderShift = PixelShaderShift + ShaderBits;
+	const unsigned int PassShift = VertexShaderShift + ShaderBits;
+
+	// The top value of a field, only used for ids that don't fit
+	unsigned int Overflow(unsigned int bits) { return (1u << bits) - 1; }
+
+	// Ids that don't fit all share the top value, so the key alone could
+	// merge different state (see SortKeyFields::Overflowed)
+	uint64_t Field(unsigned int value, unsigned int bits, unsigned int shift)
+	{
+		return (uint64_t)(std::min)(value, Overflow(bits)) << shift;
+	}
+
+	unsigned int Extract(uint64_t key, unsigned int bits, unsigned int shift)
+	{
+		return (unsigned int)((key >> shift) & ((1ull << bits) - 1));
+	}
+}
+
+uint64_t MakeSortKey(RenderPass pass, unsigned int vertexShader, unsigned int pixelShader, unsigned int material, unsigned int mesh, float depth)
+{
+	assert(vertexShader < Overflow(ShaderBits) && pixelShader < Overflow(ShaderBits) && "Too many shaders for the sort key");
+	assert(material < Overflow(MaterialBits) && "Too many materials for the sort key");
+	assert(mesh < Overflow(MeshBits) && "Too many meshes (times levels of detail) for the sort key");
+
+	float clamped = (std::min)((std::max)(depth, 0.0f), 1.0f);
+	unsigned int quantized = (unsigned int)(clamped * ((1u << DepthBits) - 1));
+
+	return
+		Field((unsigned int)pass, PassBits, PassShift) |
+		Field(vertexShader, ShaderBits, VertexShaderShift) |
+		Field(pixelShader, ShaderBits, PixelShaderShift) |
+		Field(material, MaterialBits, MaterialShift) |
+		Field(mesh, MeshBits, MeshShift) |
+		Field(quantized, DepthBits, DepthShift);
+}
+
+SortKeyFields UnpackSortKey(uint64_t key)
+{
+	SortKeyFields fields;
+	fields.Pass = Extract(key, PassBits, PassShift);
+	fields.VertexShader = Extract(key, ShaderBits, VertexShaderShift);
+	fields.PixelShader = Extract(key, ShaderBits, PixelShaderShift);
+	fields.Material = Extract(key, MaterialBits, MaterialShift);
+	fields.Mesh = Extract(key, MeshBits, MeshShift);
+	fields.Depth = Extract(key, DepthBits, DepthShift);
+	fields.Overflowed =
+		fields.VertexShader == Overflow(ShaderBits) ||
+		fields.PixelShader == Overflow(ShaderBits) ||
+		fields.Material == Overflow(MaterialBits) ||
+		fields.Mesh == Overflow(MeshBits);
+	return fields;
+}
+
+unsigned int SortIds::Get(const void* thing)
+{
+	auto it = ids.find(thing);
+	if (it != ids.end())
+		return it->second;
+
+	unsigned int id = (unsigned int)ids.size();
+	ids.insert({ thing, id });
+	return id;
+}
+
+void RenderQueue::Clear() { packets.clear(); batches.clear(); }
+void RenderQueue::Add(uint64_t key, unsigned int object, unsigned int material, unsigned int mesh) { packets.push_back({ key, object, material, mesh }); }
+const std::vector<DrawPacket>& RenderQueue::GetPackets() { return packets; }
+const std::vector<DrawBatch>& RenderQueue::GetBatches() { return batches; }
+
+void RenderQueue::Sort()
+{
+	scratch.resize(packets.size());
+	for (unsigned int shift = 0; shift < 64; shift += 8)
+	{
+		// How many keys have each value of this byte
+		unsigned int counts[256] = {};
+		for (const DrawPacket& p : packets)
+			counts[(p.Key >> shift) & 0xFF]++;
+
+		// Nothing to do when every key has the same byte here
+		if (counts[(packets.empty() ? 0 : packets[0].Key >> shift) & 0xFF] == packets.size())
+			continue;
+
+		// Where each value's run starts, then scatter in order
+		unsigned int offsets[256];
+		unsigned int total = 0;
+		for (int b = 0; b < 256; b++)
+		{
+			offsets[b] = total;
+			total += counts[b];
+		}
+		for (const DrawPacket& p : packets)
+			scratch[offsets[(p.Key >> shift) & 0xFF]++] = p;
+
+		packets.swap(scratch);
+	}
+}
+
+unsigned int RenderQueue::Batch(unsigned int minimumInstances, unsigned int firstInstance)
+{
+	const uint64_t stateMask = ~((1ull << DepthBits) - 1) << DepthShift;
+
+	batches.clear();
+	unsigned int instances = 0;
+	for (unsigned int first = 0; first < packets.size();)
+	{
+		// Overflowed keys can match with different state, so they're drawn alone
+		unsigned int end = first + 1;
+		bool overflowed = UnpackSortKey(packets[first].Key).Overflowed;
+		while (!overflowed && end < packets.size() &&
+			((packets[end].Key ^ packets[first].Key) & stateMask) == 0 &&
+			packets[end].Material == packets[first].Material &&
+			packets[end].Mesh == packets[first].Mesh)
+			end++;
+
+		DrawBatch batch = { first, end - first, end - first >= minimumInstances, 0 };
+		if (batch.Instanced)
+		{
+			batch.FirstInstance = firstInstance + instances;
+			instances += batch.Count;
+		}
+		batches.push_back(batch);
+		first = end;
+	}
+	return instances;
+}
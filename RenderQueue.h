@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// --------------------------------------------------------
+// Which pass a draw belongs to, the most significant part of
+// its sort key, so passes are drawn in this order
+// --------------------------------------------------------
+enum class RenderPass
+{
+	Shadow = 0,
+	Opaque = 1
+};
+
+// --------------------------------------------------------
+// The parts of a 64 bit sort key, from the top:
+//  - Pass (2 bits), vertex shader (6), pixel shader (6),
+//    material (13), mesh (19) and depth (18)
+//  - The mesh field has room for 65535 meshes with
+//    COOKED_MESH_MAX_LODS levels of detail each
+//  - Sorting by the whole key groups draws by the state that
+//    is most expensive to change first, and draws each group
+//    front to back
+// --------------------------------------------------------
+struct SortKeyFields
+{
+	unsigned int Pass;
+	unsigned int VertexShader;
+	unsigned int PixelShader;
+	unsigned int Material;
+	unsigned int Mesh;
+	unsigned int Depth;
+	bool Overflowed;	// Some id didn't fit, so its field can't tell draws apart
+};
+
+// Depth is 0 at the camera and 1 at the far clip plane (anything past it is clamped)
+//  - Ids that don't fit their field assert in debug builds.  Otherwise they
+//    get the field's top value, which no id that fits can have, and the
+//    queue gives each of those draws a batch of its own, which the renderer
+//    binds everything for
+uint64_t MakeSortKey(RenderPass pass, unsigned int vertexShader, unsigned int pixelShader, unsigned int material, unsigned int mesh, float depth);
+SortKeyFields UnpackSortKey(uint64_t key);
+
+// --------------------------------------------------------
+// Small numbers for things that go into sort keys, handed
+// out in the order they're first seen and never reused
+// --------------------------------------------------------
+class SortIds
+{
+public:
+	unsigned int Get(const void* thing);
+
+private:
+	std::unordered_map<const void*, unsigned int> ids;
+};
+
+// --------------------------------------------------------
+// One draw waiting to be submitted
+//  - Object is an index into the frame snapshot's Objects
+//  - Material and Mesh are the full ids that went into the
+//    key, which Batch() checks as well before merging draws
+// --------------------------------------------------------
+struct DrawPacket
+{
+	uint64_t Key;
+	unsigned int Object;
+	unsigned int Material;
+	unsigned int Mesh;
+};
+
+// --------------------------------------------------------
+// A run of packets in the queue whose keys only differ in
+// depth, and with the same material and mesh, so they need
+// exactly the same state
+//  - Instanced batches are drawn with one call, their data
+//    starting at FirstInstance in the frame's instances
+// --------------------------------------------------------
+struct DrawBatch
+{
+	unsigned int First;		// Into the queue's packets
+	unsigned int Count;
+	bool Instanced;
+	unsigned int FirstInstance;
+};
+
+// --------------------------------------------------------
+// Pipeline state set while submitting a frame's draws
+//  - Shaders, textures and samplers are only counted when
+//    they're actually bound, so sorted and unsorted
+//    submission can be compared
+//  - Vertex and index buffer binds are counted by the
+//    geometry arena (see GeometryBindStats)
+// --------------------------------------------------------
+struct RenderBindStats
+{
+	unsigned int Draws;				// Calls, with an instanced batch counting once
+	unsigned int InstancedDraws;
+	unsigned int Instances;			// Entities drawn by those
+	unsigned int VertexShaderBinds;
+	unsigned int PixelShaderBinds;
+	unsigned int ShaderResourceBinds;
+	unsigned int SamplerBinds;
+	unsigned int InputLayoutBinds;	// One with every vertex shader
+};
+
+// --------------------------------------------------------
+// Collects a frame's draws and sorts them by key
+//  - The sort is a least significant digit radix sort, a
+//    byte at a time, which skips any byte that's the same in
+//    every key (most of them, with only a few shaders and
+//    materials)
+//  - It's stable, so draws with equal keys keep the order
+//    they were added in
+// --------------------------------------------------------
+class RenderQueue
+{
+public:
+	void Clear();
+	void Add(uint64_t key, unsigned int object, unsigned int material, unsigned int mesh);
+	void Sort();
+
+	// Splits the packets into batches, marking those with at least
+	// minimumInstances packets as instanced and numbering their instances
+	// from firstInstance, then returns how many instances that was
+	unsigned int Batch(unsigned int minimumInstances, unsigned int firstInstance);
+
+	const std::vector<DrawPacket>& GetPackets();
+	const std::vector<DrawBatch>& GetBatches(); // From the last Batch()
+
+private:
+	std::vector<DrawPacket> packets;
+	std::vector<DrawBatch> batches;
+	std::vector<DrawPacket> scratch; // The other half of each radix pass
+};
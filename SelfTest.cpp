@@ -0,0 +1,12 @@
+#include "SelfTest.h"
+
+void TestResult::Check(bool passed, const char* name)
+{
+	Checks++;
+	if (!passed)
+	{
+		Failures++;
+		if (!FirstFailure)
+			FirstFailure = name;
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+// --------------------------------------------------------
+// Pass/fail tally shared by the self tests, which derive
+// their own result structs from it to add details
+// --------------------------------------------------------
+struct TestResult
+{
+	unsigned int Checks;
+	unsigned int Failures;
+	const char* FirstFailure;	// Null when everything passed
+
+	// Counts one check, remembering the name of the first to fail
+	void Check(bool passed, const char* name);
+};
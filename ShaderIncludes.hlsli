@@ -30,15 +30,65 @@ struct VertexShaderInput
 	float3 localPosition	: POSITION;
 	float2 uv				: TEXCOORD;
 	float3 normal			: NORMAL;
-	float3 tangent			: TANGENT;
+	float4 tangent			: TANGENT;	// w is the handedness
 };
 
+// Compressed vertex (PackedVertex in Vertex.h), expanded by DecodePackedVertex()
+struct VertexShaderPackedInput
+{
+	float4 localPosition	: POSITION;	// UNORM16, relative to the mesh bounds
+	float2 uv				: TEXCOORD;	// Half floats
+	float2 normal			: NORMAL;	// SNORM16 octahedral
+	float2 tangent			: TANGENT;	// SNORM16 octahedral, handedness in y's lowest bit
+};
+
+// Position streams for depth-only passes (see Mesh::DrawPositions())
+struct VertexShaderPositionInput
+{
+	float3 localPosition	: POSITION;
+};
+
+struct VertexShaderPackedPositionInput
+{
+	float4 localPosition	: POSITION;	// UNORM16, same as VertexShaderPackedInput
+};
+
+// Per-instance data for instanced draws, from input slot 1
+//  - The rows of InstanceData's matrices (see InstanceBuffer.h),
+//    which InstanceMatrix() turns back into a matrix
+struct InstanceInput
+{
+	float4 world0			: WORLD_PER_INSTANCE0;
+	float4 world1			: WORLD_PER_INSTANCE1;
+	float4 world2			: WORLD_PER_INSTANCE2;
+	float4 world3			: WORLD_PER_INSTANCE3;
+	float4 worldInvTrans0	: WORLD_INV_TRANS_PER_INSTANCE0;
+	float4 worldInvTrans1	: WORLD_INV_TRANS_PER_INSTANCE1;
+	float4 worldInvTrans2	: WORLD_INV_TRANS_PER_INSTANCE2;
+	float4 worldInvTrans3	: WORLD_INV_TRANS_PER_INSTANCE3;
+};
+
+// The same, for depth-only passes that don't need normals
+struct ShadowInstanceInput
+{
+	float4 world0			: WORLD_PER_INSTANCE0;
+	float4 world1			: WORLD_PER_INSTANCE1;
+	float4 world2			: WORLD_PER_INSTANCE2;
+	float4 world3			: WORLD_PER_INSTANCE3;
+};
+
+// Rows of a C++ matrix, as the same matrix the constant buffers give us
+matrix InstanceMatrix(float4 row0, float4 row1, float4 row2, float4 row3)
+{
+	return transpose(float4x4(row0, row1, row2, row3));
+}
+
 struct VertexToPixel
 {
 	float4 screenPosition	: SV_POSITION;
 	float2 uv				: TEXCOORD;
 	float3 normal			: NORMAL;
-	float3 tangent			: TANGENT;
+	float4 tangent			: TANGENT;	// w is the handedness
 	float3 worldPosition    : POSITION;
 	float4 shadowMapPos		: SHADOW_POSITION;
 };
@@ -49,7 +99,29 @@ struct VertexToPixel_Sky
 	float3 sampleDir		: DIRECTION;
 };
 
-float3 NormalMapping(Texture2D normalMap, SamplerState basicSampler, float2 uv, float3 normal, float3 tangent)
+// Inverse of the octahedral encoding in VertexPacking.cpp
+float3 OctDecode(float2 e)
+{
+	float3 n = float3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+	float t = saturate(-n.z);
+	n.xy += n.xy >= 0.0f ? -t : t;
+	return normalize(n);
+}
+
+VertexShaderInput DecodePackedVertex(VertexShaderPackedInput packed, float3 positionScale, float3 positionOffset)
+{
+	VertexShaderInput input;
+	input.localPosition = packed.localPosition.xyz * positionScale + positionOffset;
+	input.uv = packed.uv;
+	input.normal = OctDecode(packed.normal);
+
+	// An odd y means the handedness is -1 (see PackVertices())
+	int tangentY = (int)round(packed.tangent.y * 32767.0f);
+	input.tangent = float4(OctDecode(packed.tangent), (abs(tangentY) & 1) ? -1.0f : 1.0f);
+	return input;
+}
+
+float3 NormalMapping(Texture2D normalMap, SamplerState basicSampler, float2 uv, float3 normal, float4 tangent)
 {
 	float3 unpackedNormal = normalMap.Sample(basicSampler, uv).rgb * 2 - 1;
 	unpackedNormal = normalize(unpackedNormal); // Dont forget to normalize!
@@ -57,9 +129,9 @@ float3 NormalMapping(Texture2D normalMap, SamplerState basicSampler, float2 uv,
 	// Feel free to adjust/simplify this code to fit with your existing shader(s)
 	// Simplifications include not re-normalizing the same vector more than once!
 	float3 N = normalize(normal); // Must be normalized here or before
-	float3 T = normalize(tangent); // Must be normalized here or before
+	float3 T = normalize(tangent.xyz); // Must be normalized here or before
 	T = normalize(T - N * dot(T, N)); // Gram-Schmidt assumes T&N are normalized!
-	float3 B = cross(T, N);
+	float3 B = cross(T, N) * tangent.w; // Flipped where the UVs are mirrored
 	float3x3 TBN = float3x3(T, B, N);
 
 	return normalize(mul(unpackedNormal, TBN));
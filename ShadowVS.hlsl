@@ -1,17 +1,57 @@
 #include "ShaderIncludes.hlsli"
 
-// Constant Buffer for external (C++) data
-cbuffer externalData : register(b0)
+// Constant buffers for external (C++) data, split like VertexShader.hlsl's
+cbuffer PerFrame : register(b0)
 {
-	matrix world;
 	matrix view;
 	matrix projection;
 };
+
+#ifdef PACKED_VERTICES
+cbuffer PerMesh : register(b1)
+{
+	float3 positionScale;
+	float3 positionOffset;
+};
+#endif
+
+#ifndef INSTANCED
+cbuffer PerObject : register(b2)
+{
+	matrix world;
+};
+#endif
 // --------------------------------------------------------
 // A simplified vertex shader for rendering to a shadow map
 // --------------------------------------------------------
-float4 main(VertexShaderInput input) : SV_POSITION
+#ifdef INSTANCED
+#define INSTANCE_INPUT , ShadowInstanceInput instance
+#else
+#define INSTANCE_INPUT
+#endif
+
+#if defined(POSITION_ONLY) && defined(PACKED_VERTICES)
+float4 main(VertexShaderPackedPositionInput input INSTANCE_INPUT) : SV_POSITION
+{
+	float3 localPosition = input.localPosition.xyz * positionScale + positionOffset;
+#elif defined(POSITION_ONLY)
+float4 main(VertexShaderPositionInput input INSTANCE_INPUT) : SV_POSITION
+{
+	float3 localPosition = input.localPosition;
+#elif defined(PACKED_VERTICES)
+float4 main(VertexShaderPackedInput packed INSTANCE_INPUT) : SV_POSITION
+{
+	float3 localPosition = DecodePackedVertex(packed, positionScale, positionOffset).localPosition;
+#else
+float4 main(VertexShaderInput input INSTANCE_INPUT) : SV_POSITION
 {
-	matrix wvp = mul(projection, mul(view, world));
-	return mul(wvp, float4(input.localPosition, 1.0f));
+	float3 localPosition = input.localPosition;
+#endif
+#ifdef INSTANCED
+	matrix worldMatrix = InstanceMatrix(instance.world0, instance.world1, instance.world2, instance.world3);
+#else
+	matrix worldMatrix = world;
+#endif
+	matrix wvp = mul(projection, mul(view, worldMatrix));
+	return mul(wvp, float4(localPosition, 1.0f));
 }
\ No newline at end of file
@@ -0,0 +1,5 @@
+// --------------------------------------------------------
+// ShadowVS.hlsl for instanced draws
+// --------------------------------------------------------
+#define INSTANCED
+#include "ShadowVS.hlsl"
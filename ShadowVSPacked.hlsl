@@ -0,0 +1,5 @@
+// --------------------------------------------------------
+// ShadowVS.hlsl for meshes stored as PackedVertex
+// --------------------------------------------------------
+#define PACKED_VERTICES
+#include "ShadowVS.hlsl"
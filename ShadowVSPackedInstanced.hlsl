@@ -0,0 +1,6 @@
+// --------------------------------------------------------
+// ShadowVS.hlsl for instanced draws of PackedVertex meshes
+// --------------------------------------------------------
+#define PACKED_VERTICES
+#define INSTANCED
+#include "ShadowVS.hlsl"
@@ -0,0 +1,6 @@
+// --------------------------------------------------------
+// ShadowVS.hlsl for a packed mesh's position-only stream
+// --------------------------------------------------------
+#define PACKED_VERTICES
+#define POSITION_ONLY
+#include "ShadowVS.hlsl"
\ No newline at end of file
@@ -0,0 +1,7 @@
+// --------------------------------------------------------
+// ShadowVS.hlsl for instanced draws of packed position-only streams
+// --------------------------------------------------------
+#define PACKED_VERTICES
+#define POSITION_ONLY
+#define INSTANCED
+#include "ShadowVS.hlsl"
@@ -0,0 +1,5 @@
+// --------------------------------------------------------
+// ShadowVS.hlsl for a mesh's position-only stream
+// --------------------------------------------------------
+#define POSITION_ONLY
+#include "ShadowVS.hlsl"
\ No newline at end of file
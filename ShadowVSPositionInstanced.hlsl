@@ -0,0 +1,6 @@
+// --------------------------------------------------------
+// ShadowVS.hlsl for instanced draws of position-only streams
+// --------------------------------------------------------
+#define POSITION_ONLY
+#define INSTANCED
+#include "ShadowVS.hlsl"
@@ -57,6 +57,9 @@ void ISimpleShader::CleanUp()
 		constantBufferCount = 0;
 	}
 
+	for (auto& staging : recordingData)
+		staging.clear();
+
 	for (unsigned int i = 0; i < shaderResourceViews.size(); i++)
 		delete shaderResourceViews[i];
 	
@@ -349,9 +352,7 @@ void ISimpleShader::CopyAllBufferData()
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
 		// Copy the entire local data buffer
-		deviceContext->UpdateSubresource(
-			constantBuffers[i].ConstantBuffer.Get(), 0, 0,
-			constantBuffers[i].LocalDataBuffer, 0, 0);
+		UploadBuffer(&constantBuffers[i]);
 	}
 }
 
@@ -380,9 +381,7 @@ void ISimpleShader::CopyBufferData(unsigned int index)
 	if (!cb) return;
 
 	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer.Get(), 0, 0, 
-		cb->LocalDataBuffer, 0, 0);
+	UploadBuffer(cb);
 }
 
 // --------------------------------------------------------
@@ -402,9 +401,55 @@ void ISimpleShader::CopyBufferData(std::string bufferName)
 	if (!cb) return;
 
 	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer.Get(), 0, 0, 
-		cb->LocalDataBuffer, 0, 0);
+	UploadBuffer(cb);
+}
+
+// --------------------------------------------------------
+// Copies a buffer's local data to the GPU, through the
+// render context when there is one
+// --------------------------------------------------------
+void ISimpleShader::UploadBuffer(SimpleConstantBuffer* cb)
+{
+	unsigned char* data = GetLocalData((unsigned int)(cb - constantBuffers));
+	if (RenderContext* state = GetRenderContext())
+		state->UpdateConstantBuffer(cb->ConstantBuffer.Get(), data, cb->Size);
+	else
+		deviceContext->UpdateSubresource(
+			cb->ConstantBuffer.Get(), 0, 0,
+			data, 0, 0);
+}
+
+// --------------------------------------------------------
+// The render context for the calling thread: its own while
+// it's recording (see SetThreadRenderContext), otherwise the
+// shader's, which may be null for the device context
+// --------------------------------------------------------
+RenderContext* ISimpleShader::GetRenderContext()
+{
+	RenderContext* thread = GetThreadRenderContext();
+	return thread ? thread : renderContext.get();
+}
+
+// --------------------------------------------------------
+// A buffer's local data for the calling thread
+//  - Recording threads each get their own copy, made the
+//    first time they touch it; only that thread ever uses
+//    its slot, so no locking is needed
+// --------------------------------------------------------
+unsigned char* ISimpleShader::GetLocalData(unsigned int index)
+{
+	unsigned int slot = GetThreadRecordingSlot();
+	if (slot == 0)
+		return constantBuffers[index].LocalDataBuffer;
+
+	std::vector<std::vector<unsigned char>>& staging = recordingData[slot - 1];
+	if (staging.empty())
+	{
+		staging.resize(constantBufferCount);
+		for (unsigned int b = 0; b < constantBufferCount; b++)
+			staging[b].assign(constantBuffers[b].LocalDataBuffer, constantBuffers[b].LocalDataBuffer + constantBuffers[b].Size);
+	}
+	return staging[index].data();
 }
 
 
@@ -447,7 +492,7 @@ bool ISimpleShader::SetData(std::string name, const void* data, unsigned int siz
 
 	// Set the data in the local data buffer
 	memcpy(
-		constantBuffers[var->ConstantBufferIndex].LocalDataBuffer + var->ByteOffset,
+		GetLocalData(var->ConstantBufferIndex) + var->ByteOffset,
 		data,
 		size);
 
@@ -867,10 +912,19 @@ void SimpleVertexShader::SetShaderAndCBs()
 {
 	// Is shader valid?
 	if (!shaderValid) return;
+	RenderContext* state = GetRenderContext();
 
 	// Set the shader and input layout
-	deviceContext->IASetInputLayout(inputLayout.Get());
-	deviceContext->VSSetShader(shader.Get(), 0, 0);
+	if (state)
+	{
+		state->SetInputLayout(inputLayout.Get());
+		state->SetVertexShader(shader.Get());
+	}
+	else
+	{
+		deviceContext->IASetInputLayout(inputLayout.Get());
+		deviceContext->VSSetShader(shader.Get(), 0, 0);
+	}
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -880,10 +934,13 @@ void SimpleVertexShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->VSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
-			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+		if (state)
+			state->SetConstantBuffer(ShaderStage::Vertex, constantBuffers[i].BindIndex, constantBuffers[i].ConstantBuffer.Get());
+		else
+			deviceContext->VSSetConstantBuffers(
+				constantBuffers[i].BindIndex,
+				1,
+				constantBuffers[i].ConstantBuffer.GetAddressOf());
 	}
 }
 
@@ -911,7 +968,11 @@ bool SimpleVertexShader::SetShaderResourceView(std::string name, Microsoft::WRL:
 	}
 
 	// Set the shader resource view
-	deviceContext->VSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	RenderContext* state = GetRenderContext();
+	if (state)
+		state->SetShaderResource(ShaderStage::Vertex, srvInfo->BindIndex, srv.Get());
+	else
+		deviceContext->VSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -941,7 +1002,11 @@ bool SimpleVertexShader::SetSamplerState(std::string name, Microsoft::WRL::ComPt
 	}
 
 	// Set the shader resource view
-	deviceContext->VSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	RenderContext* state = GetRenderContext();
+	if (state)
+		state->SetSampler(ShaderStage::Vertex, sampInfo->BindIndex, samplerState.Get());
+	else
+		deviceContext->VSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1010,9 +1075,13 @@ void SimplePixelShader::SetShaderAndCBs()
 {
 	// Is shader valid?
 	if (!shaderValid) return;
+	RenderContext* state = GetRenderContext();
 	
 	// Set the shader
-	deviceContext->PSSetShader(shader.Get(), 0, 0);
+	if (state)
+		state->SetPixelShader(shader.Get());
+	else
+		deviceContext->PSSetShader(shader.Get(), 0, 0);
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1022,10 +1091,13 @@ void SimplePixelShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->PSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
-			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+		if (state)
+			state->SetConstantBuffer(ShaderStage::Pixel, constantBuffers[i].BindIndex, constantBuffers[i].ConstantBuffer.Get());
+		else
+			deviceContext->PSSetConstantBuffers(
+				constantBuffers[i].BindIndex,
+				1,
+				constantBuffers[i].ConstantBuffer.GetAddressOf());
 	}
 }
 
@@ -1053,7 +1125,11 @@ bool SimplePixelShader::SetShaderResourceView(std::string name, Microsoft::WRL::
 	}
 
 	// Set the shader resource view
-	deviceContext->PSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	RenderContext* state = GetRenderContext();
+	if (state)
+		state->SetShaderResource(ShaderStage::Pixel, srvInfo->BindIndex, srv.Get());
+	else
+		deviceContext->PSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1083,7 +1159,11 @@ bool SimplePixelShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr
 	}
 
 	// Set the shader resource view
-	deviceContext->PSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	RenderContext* state = GetRenderContext();
+	if (state)
+		state->SetSampler(ShaderStage::Pixel, sampInfo->BindIndex, samplerState.Get());
+	else
+		deviceContext->PSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
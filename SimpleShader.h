@@ -10,6 +10,10 @@
 #include <unordered_map>
 #include <vector>
 #include <string>
+#include <memory>
+
+#include "RenderContext.h"
+#include "ParallelRecorder.h"
 
 
 // --------------------------------------------------------
@@ -71,6 +75,13 @@ public:
 
 	// Activating the shader and copying data
 	void SetShader();
+
+	// Sends the shader and its buffers, resources and samplers through a
+	// render context (like a StateCache) instead of straight to the device
+	// context; only vertex and pixel shaders use it
+	//  - A thread recording with its own context (see SetThreadRenderContext)
+	//    uses that instead, with its own copy of the local constant data
+	void SetRenderContext(std::shared_ptr<RenderContext> context) { renderContext = context; }
 	void CopyAllBufferData();
 	void CopyBufferData(unsigned int index);
 	void CopyBufferData(std::string bufferName);
@@ -128,6 +139,10 @@ protected:
 	Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob;
 	Microsoft::WRL::ComPtr<ID3D11Device> device;
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext;
+	std::shared_ptr<RenderContext> renderContext; // Null for the device context
+
+	// Each recording slot's copy of every buffer's local data
+	std::vector<std::vector<unsigned char>> recordingData[MaxRecordingSlots];
 
 	// Resource counts
 	unsigned int constantBufferCount;
@@ -154,6 +169,10 @@ protected:
 	SimpleShaderVariable* FindVariable(std::string name, int size);
 	SimpleConstantBuffer* FindConstantBuffer(std::string name);
 
+	void UploadBuffer(SimpleConstantBuffer* cb);
+	RenderContext* GetRenderContext();
+	unsigned char* GetLocalData(unsigned int index);
+
 	// Error logging
 	void Log(std::string message, WORD color);
 	void LogW(std::wstring message, WORD color);
@@ -28,19 +28,19 @@ Sky::Sky(const wchar_t* right, const wchar_t* left, const wchar_t* up, const wch
 	skySRV = CreateCubemap(right, left, up, down, front, back);
 }
 
-void Sky::Draw(std::shared_ptr<Camera> camera)
+void Sky::Draw(const CameraSnapshot& camera, RenderContext& state)
 {
 	// Change rasterizer state
-	context->RSSetState(skyRasterizerState.Get());
-	context->OMSetDepthStencilState(skyDepthStencilState.Get(), 0);
+	state.SetRasterizerState(skyRasterizerState.Get());
+	state.SetDepthStencilState(skyDepthStencilState.Get(), 0);
 
 	// Activate PS and VS shaders
 	skyVS->SetShader();
 	skyPS->SetShader();
 
 	// Set the view and projection matrices for the vertex shader
-	skyVS->SetMatrix4x4("view", camera->GetView());
-	skyVS->SetMatrix4x4("projection", camera->GetProjection());
+	skyVS->SetMatrix4x4("view", camera.View);
+	skyVS->SetMatrix4x4("projection", camera.Projection);
 	skyVS->CopyAllBufferData();
 
 	// Send resources to PS
@@ -49,10 +49,6 @@ void Sky::Draw(std::shared_ptr<Camera> camera)
 
 	// Draw the mesh
 	skyMesh->Draw(context);
-
-	// Reset all render states
-	context->RSSetState(0);
-	context->OMSetDepthStencilState(0, 0);
 }
 
 Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky::CreateCubemap(const wchar_t* right, const wchar_t* left, const wchar_t* up, const wchar_t* down, const wchar_t* front, const wchar_t* back)
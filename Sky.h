@@ -2,7 +2,8 @@
 
 #include "Mesh.h"
 #include "SimpleShader.h"
-#include "Camera.h"
+#include "FrameSnapshot.h"
+#include "RenderContext.h"
 
 #include <memory>
 #include <wrl/client.h>
@@ -47,5 +48,7 @@ public:
 		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context
 	);
 
-	void Draw(std::shared_ptr<Camera> camera);
+	// Leaves the sky's rasterizer and depth states set, so whatever
+	// comes next has to set its own
+	void Draw(const CameraSnapshot& camera, RenderContext& state);
 };
\ No newline at end of file
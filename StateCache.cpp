@@ -0,0 +1,429 @@
+#include "StateCache.h"
+
+#include <cstdint>
+
+const char* const StateCallNames[(int)StateCall::Count] =
+{
+	"Shaders",
+	"Input layouts",
+	"Topology",
+	"Vertex buffers",
+	"Index buffers",
+	"Constant buffers",
+	"Shader resources",
+	"Samplers",
+	"Rasterizer states",
+	"Depth stencil states",
+	"Blend states"
+};
+
+unsigned int StateCacheStats::TotalSubmitted() const
+{
+	unsigned int total = 0;
+	for (unsigned int count : Submitted)
+		total += count;
+	return total;
+}
+
+unsigned int StateCacheStats::TotalForwarded() const
+{
+	unsigned int total = 0;
+	for (unsigned int count : Forwarded)
+		total += count;
+	return total;
+}
+
+void StateCacheStats::Add(const StateCacheStats& other)
+{
+	for (int c = 0; c < (int)StateCall::Count; c++)
+	{
+		Submitted[c] += other.Submitted[c];
+		Forwarded[c] += other.Forwarded[c];
+	}
+	ConstantUploads += other.ConstantUploads;
+	ConstantBytes += other.ConstantBytes;
+}
+
+StateCache::StateCache(std::shared_ptr<RenderContext> target) :
+	target(target),
+	stats()
+{
+	Invalidate();
+}
+
+bool StateCache::Count(StateCall call, bool changed)
+{
+	stats.Submitted[(int)call]++;
+	if (changed)
+		stats.Forwarded[(int)call]++;
+	return changed;
+}
+
+void StateCache::SetVertexShader(ID3D11VertexShader* shader)
+{
+	if (Count(StateCall::Shader, vertexShader.Change(shader)))
+		target->SetVertexShader(shader);
+}
+
+void StateCache::SetPixelShader(ID3D11PixelShader* shader)
+{
+	if (Count(StateCall::Shader, pixelShader.Change(shader)))
+		target->SetPixelShader(shader);
+}
+
+void StateCache::SetInputLayout(ID3D11InputLayout* layout)
+{
+	if (Count(StateCall::InputLayout, inputLayout.Change(layout)))
+		target->SetInputLayout(layout);
+}
+
+void StateCache::SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY newTopology)
+{
+	if (Count(StateCall::Topology, topology.Change(newTopology)))
+		target->SetPrimitiveTopology(newTopology);
+}
+
+void StateCache::SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, unsigned int stride, unsigned int offset)
+{
+	bool changed = slot >= VertexBufferSlots || vertexBuffers[slot].Change({ buffer, stride, offset });
+	if (Count(StateCall::VertexBuffer, changed))
+		target->SetVertexBuffer(slot, buffer, stride, offset);
+}
+
+void StateCache::SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset)
+{
+	if (Count(StateCall::IndexBuffer, indexBuffer.Change({ buffer, format, offset })))
+		target->SetIndexBuffer(buffer, format, offset);
+}
+
+void StateCache::SetConstantBuffer(ShaderStage stage, unsigned int slot, ID3D11Buffer* buffer)
+{
+	bool changed = slot >= ConstantBufferSlots || constantBuffers[(int)stage][slot].Change({ buffer, 0, 0 });
+	if (Count(StateCall::ConstantBuffer, changed))
+		target->SetConstantBuffer(stage, slot, buffer);
+}
+
+void StateCache::SetConstantBufferRange(ShaderStage stage, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	bool changed = slot >= ConstantBufferSlots || constantBuffers[(int)stage][slot].Change({ buffer, firstConstant, constantCount });
+	if (Count(StateCall::ConstantBuffer, changed))
+		target->SetConstantBufferRange(stage, slot, buffer, firstConstant, constantCount);
+}
+
+void StateCache::SetShaderResource(ShaderStage stage, unsigned int slot, ID3D11ShaderResourceView* srv)
+{
+	bool changed = slot >= ShaderResourceSlots || shaderResources[(int)stage][slot].Change(srv);
+	if (Count(StateCall::ShaderResource, changed))
+		target->SetShaderResource(stage, slot, srv);
+}
+
+void StateCache::SetSampler(ShaderStage stage, unsigned int slot, ID3D11SamplerState* sampler)
+{
+	bool changed = slot >= SamplerSlots || samplers[(int)stage][slot].Change(sampler);
+	if (Count(StateCall::Sampler, changed))
+		target->SetSampler(stage, slot, sampler);
+}
+
+void StateCache::SetRasterizerState(ID3D11RasterizerState* state)
+{
+	if (Count(StateCall::Rasterizer, rasterizerState.Change(state)))
+		target->SetRasterizerState(state);
+}
+
+void StateCache::SetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef)
+{
+	if (Count(StateCall::DepthStencil, depthStencilState.Change({ state, stencilRef })))
+		target->SetDepthStencilState(state, stencilRef);
+}
+
+void StateCache::SetBlendState(ID3D11BlendState* state)
+{
+	if (Count(StateCall::Blend, blendState.Change(state)))
+		target->SetBlendState(state);
+}
+
+void StateCache::UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, unsigned int size)
+{
+	stats.ConstantUploads++;
+	stats.ConstantBytes += size;
+	target->UpdateConstantBuffer(buffer, data, size);
+}
+
+void StateCache::UnbindShaderResources(ShaderStage stage)
+{
+	for (unsigned int slot = 0; slot < ShaderResourceSlots; slot++)
+		SetShaderResource(stage, slot, 0);
+}
+
+void StateCache::Invalidate() { Reset(false); }
+void StateCache::AssumeDefaultState() { Reset(true); }
+
+void StateCache::Reset(bool known)
+{
+	auto reset = [known](auto& tracked) { tracked.Value = {}; tracked.Known = known; };
+	reset(vertexShader);
+	reset(pixelShader);
+	reset(inputLayout);
+	reset(topology);
+	for (auto& vb : vertexBuffers) reset(vb);
+	reset(indexBuffer);
+	for (unsigned int stage = 0; stage < StageCount; stage++)
+	{
+		for (auto& cb : constantBuffers[stage]) reset(cb);
+		for (auto& srv : shaderResources[stage]) reset(srv);
+		for (auto& sampler : samplers[stage]) reset(sampler);
+	}
+	reset(rasterizerState);
+	reset(depthStencilState);
+	reset(blendState);
+}
+
+void StateCache::ResetStats() { stats = {}; }
+StateCacheStats StateCache::GetStats() { return stats; }
+
+
+// --------------------------------------------------------
+// Self test
+// --------------------------------------------------------
+namespace
+{
+	// Counts what reaches it, and remembers the last resource bound
+	class MockRenderContext : public RenderContext
+	{
+	public:
+		unsigned int Calls[(int)StateCall::Count] = {};
+		unsigned int LastSlot = 0;
+		const void* LastValue = 0;
+
+		void Clear() { *this = MockRenderContext(); }
+
+		unsigned int Total()
+		{
+			unsigned int total = 0;
+			for (unsigned int c : Calls)
+				total += c;
+			return total;
+		}
+
+		void SetVertexShader(ID3D11VertexShader* shader) { Record(StateCall::Shader, 0, shader); }
+		void SetPixelShader(ID3D11PixelShader* shader) { Record(StateCall::Shader, 0, shader); }
+		void SetInputLayout(ID3D11InputLayout* layout) { Record(StateCall::InputLayout, 0, layout); }
+		void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) { Record(StateCall::Topology, 0, 0); }
+		void SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, unsigned int stride, unsigned int offset) { Record(StateCall::VertexBuffer, slot, buffer); }
+		void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset) { Record(StateCall::IndexBuffer, 0, buffer); }
+		void SetConstantBuffer(ShaderStage stage, unsigned int slot, ID3D11Buffer* buffer) { Record(StateCall::ConstantBuffer, slot, buffer); }
+		void SetShaderResource(ShaderStage stage, unsigned int slot, ID3D11ShaderResourceView* srv) { Record(StateCall::ShaderResource, slot, srv); }
+		void SetSampler(ShaderStage stage, unsigned int slot, ID3D11SamplerState* sampler) { Record(StateCall::Sampler, slot, sampler); }
+		void SetRasterizerState(ID3D11RasterizerState* state) { Record(StateCall::Rasterizer, 0, state); }
+		void SetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef) { Record(StateCall::DepthStencil, 0, state); }
+		void SetBlendState(ID3D11BlendState* state) { Record(StateCall::Blend, 0, state); }
+		void SetConstantBufferRange(ShaderStage stage, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount) { Record(StateCall::ConstantBuffer, slot, buffer); }
+		void UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, unsigned int size) { Uploads++; UploadedBytes += size; }
+
+		unsigned int Uploads = 0;
+		unsigned int UploadedBytes = 0;
+
+	private:
+		void Record(StateCall call, unsigned int slot, const void* value)
+		{
+			Calls[(int)call]++;
+			LastSlot = slot;
+			LastValue = value;
+		}
+	};
+
+	// Stand-ins for Direct3D objects, which are only ever compared
+	template<typename T>
+	T* Fake(uintptr_t id) { return reinterpret_cast<T*>(id * 16); }
+}
+
+StateCacheTestResult TestStateCache()
+{
+	StateCacheTestResult result = {};
+
+	std::shared_ptr<MockRenderContext> mock = std::make_shared<MockRenderContext>();
+	StateCache cache(mock);
+	unsigned int before;
+
+	// Nothing is known to begin with, so unbinding has to null every slot
+	cache.UnbindShaderResources(ShaderStage::Pixel);
+	result.Check(mock->Total() == D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, "Unbinding at the start nulls every slot");
+	mock->Clear();
+	cache.ResetStats();
+
+	// Shaders: the first call always goes through, repeats don't, changes do
+	cache.SetVertexShader(Fake<ID3D11VertexShader>(1));
+	result.Check(mock->Calls[(int)StateCall::Shader] == 1, "First vertex shader is forwarded");
+	cache.SetVertexShader(Fake<ID3D11VertexShader>(1));
+	result.Check(mock->Calls[(int)StateCall::Shader] == 1, "Same vertex shader is dropped");
+	cache.SetVertexShader(Fake<ID3D11VertexShader>(2));
+	result.Check(mock->Calls[(int)StateCall::Shader] == 2, "Different vertex shader is forwarded");
+	cache.SetPixelShader(Fake<ID3D11PixelShader>(2));
+	result.Check(mock->Calls[(int)StateCall::Shader] == 3, "Pixel shader is tracked apart from the vertex shader");
+	cache.SetPixelShader(0);
+	cache.SetPixelShader(0);
+	result.Check(mock->Calls[(int)StateCall::Shader] == 4 && mock->LastValue == 0, "Null shader is forwarded once");
+
+	// Slots are independent, and so are stages
+	cache.SetShaderResource(ShaderStage::Pixel, 0, Fake<ID3D11ShaderResourceView>(1));
+	cache.SetShaderResource(ShaderStage::Pixel, 1, Fake<ID3D11ShaderResourceView>(1));
+	result.Check(mock->Calls[(int)StateCall::ShaderResource] == 2 && mock->LastSlot == 1, "Same resource in another slot is forwarded");
+	cache.SetShaderResource(ShaderStage::Pixel, 0, Fake<ID3D11ShaderResourceView>(1));
+	result.Check(mock->Calls[(int)StateCall::ShaderResource] == 2, "Same resource in the same slot is dropped");
+	cache.SetShaderResource(ShaderStage::Vertex, 0, Fake<ID3D11ShaderResourceView>(1));
+	result.Check(mock->Calls[(int)StateCall::ShaderResource] == 3, "Same slot in another stage is forwarded");
+	cache.SetSampler(ShaderStage::Pixel, 3, Fake<ID3D11SamplerState>(1));
+	cache.SetSampler(ShaderStage::Pixel, 3, Fake<ID3D11SamplerState>(1));
+	result.Check(mock->Calls[(int)StateCall::Sampler] == 1 && mock->LastSlot == 3, "Same sampler is dropped");
+	cache.SetConstantBuffer(ShaderStage::Vertex, 2, Fake<ID3D11Buffer>(1));
+	cache.SetConstantBuffer(ShaderStage::Pixel, 2, Fake<ID3D11Buffer>(1));
+	cache.SetConstantBuffer(ShaderStage::Vertex, 2, Fake<ID3D11Buffer>(1));
+	result.Check(mock->Calls[(int)StateCall::ConstantBuffer] == 2, "Constant buffers are tracked per stage and slot");
+	cache.SetConstantBufferRange(ShaderStage::Vertex, 2, Fake<ID3D11Buffer>(1), 16, 16);
+	cache.SetConstantBufferRange(ShaderStage::Vertex, 2, Fake<ID3D11Buffer>(1), 16, 16);
+	result.Check(mock->Calls[(int)StateCall::ConstantBuffer] == 3, "Same constant buffer range is dropped");
+	cache.SetConstantBufferRange(ShaderStage::Vertex, 2, Fake<ID3D11Buffer>(1), 32, 16);
+	result.Check(mock->Calls[(int)StateCall::ConstantBuffer] == 4, "Same buffer at another offset is forwarded");
+	cache.SetConstantBuffer(ShaderStage::Vertex, 2, Fake<ID3D11Buffer>(1));
+	result.Check(mock->Calls[(int)StateCall::ConstantBuffer] == 5, "Whole buffer after a range of it is forwarded");
+
+	// Every part of a binding counts
+	cache.SetVertexBuffer(0, Fake<ID3D11Buffer>(5), 32, 0);
+	cache.SetVertexBuffer(0, Fake<ID3D11Buffer>(5), 16, 0);
+	cache.SetVertexBuffer(0, Fake<ID3D11Buffer>(5), 16, 64);
+	cache.SetVertexBuffer(0, Fake<ID3D11Buffer>(5), 16, 64);
+	result.Check(mock->Calls[(int)StateCall::VertexBuffer] == 3, "Vertex buffer stride and offset changes are forwarded");
+	cache.SetVertexBuffer(1, Fake<ID3D11Buffer>(5), 16, 64);
+	result.Check(mock->Calls[(int)StateCall::VertexBuffer] == 4, "Vertex buffer slots are independent");
+	cache.SetIndexBuffer(Fake<ID3D11Buffer>(6), DXGI_FORMAT_R32_UINT, 0);
+	cache.SetIndexBuffer(Fake<ID3D11Buffer>(6), DXGI_FORMAT_R16_UINT, 0);
+	cache.SetIndexBuffer(Fake<ID3D11Buffer>(6), DXGI_FORMAT_R16_UINT, 0);
+	result.Check(mock->Calls[(int)StateCall::IndexBuffer] == 2, "Index format changes are forwarded");
+	cache.SetDepthStencilState(Fake<ID3D11DepthStencilState>(1), 0);
+	cache.SetDepthStencilState(Fake<ID3D11DepthStencilState>(1), 1);
+	cache.SetDepthStencilState(Fake<ID3D11DepthStencilState>(1), 1);
+	result.Check(mock->Calls[(int)StateCall::DepthStencil] == 2, "Stencil reference changes are forwarded");
+	cache.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	cache.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	cache.SetRasterizerState(0);
+	cache.SetRasterizerState(0);
+	cache.SetBlendState(0);
+	cache.SetBlendState(0);
+	result.Check(mock->Calls[(int)StateCall::Topology] == 1 && mock->Calls[(int)StateCall::Rasterizer] == 1 && mock->Calls[(int)StateCall::Blend] == 1,
+		"Fixed function state is forwarded once");
+
+	// Slots past what Direct3D has aren't tracked
+	before = mock->Total();
+	cache.SetShaderResource(ShaderStage::Pixel, 1000, 0);
+	cache.SetShaderResource(ShaderStage::Pixel, 1000, 0);
+	result.Check(mock->Total() == before + 2, "Untracked slots are always forwarded");
+
+	// Unbinding only touches slots that aren't known to be null
+	before = mock->Total();
+	cache.UnbindShaderResources(ShaderStage::Pixel);
+	result.Check(mock->Total() == before + 2, "Unbinding forwards only the bound slots");
+	before = mock->Total();
+	cache.UnbindShaderResources(ShaderStage::Pixel);
+	result.Check(mock->Total() == before, "Unbinding twice forwards nothing");
+	cache.SetShaderResource(ShaderStage::Vertex, 0, Fake<ID3D11ShaderResourceView>(1));
+	result.Check(mock->Total() == before, "Unbinding one stage leaves the other alone");
+
+	// Forgetting everything means the same calls go through again
+	cache.Invalidate();
+	before = mock->Total();
+	cache.SetVertexShader(Fake<ID3D11VertexShader>(2));
+	cache.SetSampler(ShaderStage::Pixel, 3, Fake<ID3D11SamplerState>(1));
+	cache.SetRasterizerState(0);
+	result.Check(mock->Total() == before + 3, "Invalidate() forwards the next call for each state");
+	before = mock->Total();
+	cache.UnbindShaderResources(ShaderStage::Pixel);
+	result.Check(mock->Total() == before + D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, "Unbinding after Invalidate() nulls every slot");
+
+	// A context that was cleared only needs what isn't a default
+	cache.SetVertexShader(Fake<ID3D11VertexShader>(2));
+	cache.AssumeDefaultState();
+	before = mock->Total();
+	cache.UnbindShaderResources(ShaderStage::Pixel);
+	cache.SetRasterizerState(0);
+	cache.SetVertexBuffer(0, 0, 0, 0);
+	result.Check(mock->Total() == before, "Defaults are dropped after AssumeDefaultState()");
+	cache.SetVertexShader(Fake<ID3D11VertexShader>(2));
+	result.Check(mock->Total() == before + 1, "Anything else is forwarded after AssumeDefaultState()");
+
+	// The cache's own counters agree with what arrived
+	StateCacheStats stats = cache.GetStats();
+	bool countersMatch = stats.TotalForwarded() == mock->Total();
+	for (int c = 0; c < (int)StateCall::Count; c++)
+		countersMatch = countersMatch && stats.Forwarded[c] == mock->Calls[c] && stats.Submitted[c] >= stats.Forwarded[c];
+	result.Check(countersMatch, "Forwarded counters match the calls that arrived");
+
+	// Uploads are always passed on, however often the same data comes
+	unsigned char constants[64] = {};
+	cache.UpdateConstantBuffer(Fake<ID3D11Buffer>(1), constants, sizeof(constants));
+	cache.UpdateConstantBuffer(Fake<ID3D11Buffer>(1), constants, sizeof(constants));
+	result.Check(mock->Uploads == 2 && cache.GetStats().ConstantUploads == 2 && cache.GetStats().ConstantBytes == 2 * sizeof(constants), "Constant uploads are forwarded and counted");
+
+	cache.ResetStats();
+	result.Check(cache.GetStats().TotalSubmitted() == 0 && cache.GetStats().ConstantBytes == 0, "ResetStats() clears the counters");
+
+	// A scene like the renderer's: draws sorted by shaders then material,
+	// cycling through a few meshes, everything bound for every draw
+	{
+		const unsigned int drawCount = 10000;
+		const unsigned int materialCount = 16;
+		const unsigned int meshCount = 4;
+
+		std::shared_ptr<MockRenderContext> replayMock = std::make_shared<MockRenderContext>();
+		StateCache replay(replayMock);
+		unsigned int expected = 0;
+		unsigned int previousMaterial = 0;
+		unsigned int previousMesh = 0;
+		for (unsigned int d = 0; d < drawCount; d++)
+		{
+			unsigned int material = d * materialCount / drawCount;
+			unsigned int mesh = d % meshCount;
+			uintptr_t vs = 1 + material / 8;
+			uintptr_t ps = 1 + material / 4;
+
+			replay.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			replay.SetRasterizerState(0);
+			replay.SetDepthStencilState(0, 0);
+			replay.SetVertexShader(Fake<ID3D11VertexShader>(vs));
+			replay.SetInputLayout(Fake<ID3D11InputLayout>(vs));
+			replay.SetConstantBuffer(ShaderStage::Vertex, 0, Fake<ID3D11Buffer>(100 + vs));
+			replay.SetPixelShader(Fake<ID3D11PixelShader>(ps));
+			replay.SetConstantBuffer(ShaderStage::Pixel, 0, Fake<ID3D11Buffer>(200 + ps));
+			replay.SetShaderResource(ShaderStage::Pixel, 0, Fake<ID3D11ShaderResourceView>(1 + material * 2));
+			replay.SetShaderResource(ShaderStage::Pixel, 1, Fake<ID3D11ShaderResourceView>(2 + material * 2));
+			replay.SetShaderResource(ShaderStage::Pixel, 2, Fake<ID3D11ShaderResourceView>(1000)); // Shadow map
+			replay.SetSampler(ShaderStage::Pixel, 0, Fake<ID3D11SamplerState>(1));
+			replay.SetVertexBuffer(0, Fake<ID3D11Buffer>(300 + mesh), 32, 0);
+			replay.SetIndexBuffer(Fake<ID3D11Buffer>(400 + mesh), DXGI_FORMAT_R32_UINT, 0);
+
+			// What has to change: everything once, then shaders and their buffers
+			// at shader boundaries, textures at material boundaries, and the
+			// buffers whenever the mesh changes
+			if (d == 0)
+				expected += 14;
+			else
+			{
+				if (1 + previousMaterial / 8 != vs) expected += 3;
+				if (1 + previousMaterial / 4 != ps) expected += 2;
+				if (previousMaterial != material) expected += 2;
+				if (previousMesh != mesh) expected += 2;
+			}
+			previousMaterial = material;
+			previousMesh = mesh;
+		}
+
+		StateCacheStats replayStats = replay.GetStats();
+		result.ReplayDraws = drawCount;
+		result.ReplaySubmitted = replayStats.TotalSubmitted();
+		result.ReplayForwarded = replayStats.TotalForwarded();
+		result.ReplayExpected = expected;
+		result.Check(result.ReplaySubmitted == drawCount * 14, "Replay submits every call");
+		result.Check(result.ReplayForwarded == expected && replayMock->Total() == expected, "Replay forwards only what changes");
+	}
+
+	return result;
+}
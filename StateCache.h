@@ -0,0 +1,189 @@
+#pragma once
+
+#include <memory>
+
+#include "RenderContext.h"
+#include "SelfTest.h"
+
+// --------------------------------------------------------
+// The kinds of state call a StateCache counts
+// --------------------------------------------------------
+enum class StateCall
+{
+	Shader,
+	InputLayout,
+	Topology,
+	VertexBuffer,
+	IndexBuffer,
+	ConstantBuffer,
+	ShaderResource,
+	Sampler,
+	Rasterizer,
+	DepthStencil,
+	Blend,
+	Count
+};
+
+extern const char* const StateCallNames[(int)StateCall::Count];
+
+// --------------------------------------------------------
+// State calls made since the last ResetStats()
+//  - Submitted is everything the renderer asked for, and
+//    Forwarded is what actually changed state
+//  - Constant buffer uploads aren't state, so they're all
+//    passed on, and only counted
+// --------------------------------------------------------
+struct StateCacheStats
+{
+	unsigned int Submitted[(int)StateCall::Count];
+	unsigned int Forwarded[(int)StateCall::Count];
+	unsigned int ConstantUploads;
+	unsigned int ConstantBytes;
+
+	unsigned int TotalSubmitted() const;
+	unsigned int TotalForwarded() const;
+	void Add(const StateCacheStats& other); // Another cache's, for one total
+};
+
+// --------------------------------------------------------
+// Sits in front of another render context and only passes on
+// calls that would change what's bound
+//  - Everything starts out unknown, so the first call for
+//    each piece of state always goes through
+//  - Anything that changes state without going through the
+//    cache (like ImGui's renderer, which puts everything back
+//    the way it found it, or binding a texture as a render
+//    target, which unbinds it as a resource) has to be
+//    followed by Invalidate(), unless it leaves the state
+//    exactly as the cache thinks it is
+//  - Slots past the ones Direct3D has are passed on untracked
+// --------------------------------------------------------
+class StateCache : public RenderContext
+{
+public:
+	StateCache(std::shared_ptr<RenderContext> target);
+
+	void SetVertexShader(ID3D11VertexShader* shader);
+	void SetPixelShader(ID3D11PixelShader* shader);
+	void SetInputLayout(ID3D11InputLayout* layout);
+	void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+	void SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, unsigned int stride, unsigned int offset);
+	void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset);
+	void SetConstantBuffer(ShaderStage stage, unsigned int slot, ID3D11Buffer* buffer);
+	void SetShaderResource(ShaderStage stage, unsigned int slot, ID3D11ShaderResourceView* srv);
+	void SetSampler(ShaderStage stage, unsigned int slot, ID3D11SamplerState* sampler);
+	void SetRasterizerState(ID3D11RasterizerState* state);
+	void SetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef);
+	void SetBlendState(ID3D11BlendState* state);
+	void SetConstantBufferRange(ShaderStage stage, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount);
+	void UpdateConstantBuffer(ID3D11Buffer* buffer, const void* data, unsigned int size);
+
+	// Nulls a stage's resource slots, only touching the ones that aren't
+	// known to be null already (before their textures become render targets)
+	void UnbindShaderResources(ShaderStage stage);
+
+	// Forgets everything that's bound, so the next call for each piece
+	// of state goes through again
+	void Invalidate();
+
+	// Takes everything to be null or its default, for after something cleared
+	// the context (like executing a command list without restoring state)
+	void AssumeDefaultState();
+
+	void ResetStats();
+	StateCacheStats GetStats();
+
+private:
+	static const unsigned int StageCount = 2;
+	static const unsigned int VertexBufferSlots = D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT;
+	static const unsigned int ConstantBufferSlots = D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT;
+	static const unsigned int ShaderResourceSlots = D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT;
+	static const unsigned int SamplerSlots = D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT;
+
+	// One piece of state, and whether the cache knows what it is
+	template<typename T>
+	struct Tracked
+	{
+		T Value;
+		bool Known;
+
+		// Whether setting this value would change anything, remembering it
+		bool Change(const T& value)
+		{
+			if (Known && Value == value)
+				return false;
+			Value = value;
+			Known = true;
+			return true;
+		}
+	};
+
+	struct VertexBufferBinding
+	{
+		ID3D11Buffer* Buffer;
+		unsigned int Stride;
+		unsigned int Offset;
+		bool operator==(const VertexBufferBinding& other) const { return Buffer == other.Buffer && Stride == other.Stride && Offset == other.Offset; }
+	};
+
+	struct IndexBufferBinding
+	{
+		ID3D11Buffer* Buffer;
+		DXGI_FORMAT Format;
+		unsigned int Offset;
+		bool operator==(const IndexBufferBinding& other) const { return Buffer == other.Buffer && Format == other.Format && Offset == other.Offset; }
+	};
+
+	// A whole buffer is a range of 0 constants from 0
+	struct ConstantBufferBinding
+	{
+		ID3D11Buffer* Buffer;
+		unsigned int First;
+		unsigned int Count;
+		bool operator==(const ConstantBufferBinding& other) const { return Buffer == other.Buffer && First == other.First && Count == other.Count; }
+	};
+
+	struct DepthStencilBinding
+	{
+		ID3D11DepthStencilState* State;
+		unsigned int StencilRef;
+		bool operator==(const DepthStencilBinding& other) const { return State == other.State && StencilRef == other.StencilRef; }
+	};
+
+	std::shared_ptr<RenderContext> target;
+	StateCacheStats stats;
+
+	Tracked<ID3D11VertexShader*> vertexShader;
+	Tracked<ID3D11PixelShader*> pixelShader;
+	Tracked<ID3D11InputLayout*> inputLayout;
+	Tracked<D3D11_PRIMITIVE_TOPOLOGY> topology;
+	Tracked<VertexBufferBinding> vertexBuffers[VertexBufferSlots];
+	Tracked<IndexBufferBinding> indexBuffer;
+	Tracked<ConstantBufferBinding> constantBuffers[StageCount][ConstantBufferSlots];
+	Tracked<ID3D11ShaderResourceView*> shaderResources[StageCount][ShaderResourceSlots];
+	Tracked<ID3D11SamplerState*> samplers[StageCount][SamplerSlots];
+	Tracked<ID3D11RasterizerState*> rasterizerState;
+	Tracked<DepthStencilBinding> depthStencilState;
+	Tracked<ID3D11BlendState*> blendState;
+
+	// Counts a call, returning whether to pass it on
+	bool Count(StateCall call, bool changed);
+
+	// Sets every piece of state to its default value, known or not
+	void Reset(bool known);
+};
+
+// --------------------------------------------------------
+// Results from checking the cache against a context that
+// just records what reaches it
+// --------------------------------------------------------
+struct StateCacheTestResult : TestResult
+{
+	// A scripted scene (draws sorted by material) through the cache
+	unsigned int ReplayDraws;
+	unsigned int ReplaySubmitted;
+	unsigned int ReplayForwarded;
+	unsigned int ReplayExpected;	// What the scene actually changes, counted by hand
+};
+
+StateCacheTestResult TestStateCache();
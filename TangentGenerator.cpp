@@ -0,0 +1,415 @@
+#include "TangentGenerator.h"
+#include "Parallel.h"
+
+#include <DirectXMath.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// Ranges smaller than this aren't worth a thread of their own
+	const size_t MinItemsPerRange = 1 << 14;
+
+	// UV areas and tangent lengths below this are treated as degenerate
+	const float DegenerateEpsilon = 1e-12f;
+
+	// Any unit vector perpendicular to n
+	XMVECTOR Perpendicular(XMVECTOR n)
+	{
+		XMVECTOR axis = fabsf(XMVectorGetX(n)) < 0.9f ? XMVectorSet(1, 0, 0, 0) : XMVectorSet(0, 1, 0, 0);
+		return XMVector3Normalize(XMVector3Cross(n, axis));
+	}
+
+	// Removes the normal's component and normalizes, or returns zero if nothing is left
+	XMVECTOR ProjectOntoPlane(XMVECTOR v, XMVECTOR n)
+	{
+		v -= n * XMVector3Dot(n, v);
+		float lengthSq = XMVectorGetX(XMVector3LengthSq(v));
+		return lengthSq > DegenerateEpsilon ? v / sqrtf(lengthSq) : XMVectorZero();
+	}
+
+	double MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+void GenerateTangents(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, TangentMode mode)
+{
+	if (mode == TangentMode::Reference)
+	{
+		GenerateTangentsReference(vertices.data(), vertices.size(), indices.data(), indices.size());
+		return;
+	}
+
+	size_t vertexCount = vertices.size();
+	size_t triangleCount = indices.size() / 3;
+
+	// Split positions and UVs into SoA streams
+	std::vector<float> px(vertexCount), py(vertexCount), pz(vertexCount), u(vertexCount), v(vertexCount);
+	ParallelFor(vertexCount, MinItemsPerRange, [&](size_t first, size_t last)
+	{
+		for (size_t i = first; i < last; i++)
+		{
+			px[i] = vertices[i].Position.x;
+			py[i] = vertices[i].Position.y;
+			pz[i] = vertices[i].Position.z;
+			u[i] = vertices[i].UV.x;
+			v[i] = vertices[i].UV.y;
+		}
+	});
+
+	// Per-triangle tangents and bitangents, four triangles per lane-wise XMVECTOR
+	// op.  The streams are padded to a multiple of four so the last group can store freely
+	size_t groupCount = (triangleCount + 3) / 4;
+	std::vector<float> tx(groupCount * 4), ty(groupCount * 4), tz(groupCount * 4);
+	std::vector<float> bx(groupCount * 4), by(groupCount * 4), bz(groupCount * 4);
+	ParallelFor(groupCount, MinItemsPerRange / 4, [&](size_t first, size_t last)
+	{
+		XMVECTOR epsilon = XMVectorReplicate(DegenerateEpsilon);
+		for (size_t g = first; g < last; g++)
+		{
+			// Gather the corners of four triangles (repeating the last one as padding)
+			unsigned int c[3][4];
+			for (int lane = 0; lane < 4; lane++)
+			{
+				size_t t = (std::min)(g * 4 + lane, triangleCount - 1);
+				c[0][lane] = indices[t * 3 + 0];
+				c[1][lane] = indices[t * 3 + 1];
+				c[2][lane] = indices[t * 3 + 2];
+			}
+
+			auto gather = [&](const std::vector<float>& stream, int corner)
+			{
+				return XMVectorSet(stream[c[corner][0]], stream[c[corner][1]], stream[c[corner][2]], stream[c[corner][3]]);
+			};
+
+			XMVECTOR x0 = gather(px, 0), y0 = gather(py, 0), z0 = gather(pz, 0);
+			XMVECTOR u0 = gather(u, 0), v0 = gather(v, 0);
+
+			XMVECTOR x1 = gather(px, 1) - x0, y1 = gather(py, 1) - y0, z1 = gather(pz, 1) - z0;
+			XMVECTOR x2 = gather(px, 2) - x0, y2 = gather(py, 2) - y0, z2 = gather(pz, 2) - z0;
+			XMVECTOR s1 = gather(u, 1) - u0, t1 = gather(v, 1) - v0;
+			XMVECTOR s2 = gather(u, 2) - u0, t2 = gather(v, 2) - v0;
+
+			// Twice the signed UV area, and the (unscaled) tangent direction
+			XMVECTOR det = s1 * t2 - s2 * t1;
+			XMVECTOR dx = t2 * x1 - t1 * x2;
+			XMVECTOR dy = t2 * y1 - t1 * y2;
+			XMVECTOR dz = t2 * z1 - t1 * z2;
+			XMVECTOR usable = XMVectorGreater(XMVectorAbs(det), epsilon);
+
+			// The bitangent points up the texture (toward smaller V, which
+			// is what cross(T, N) gives the shaders on unmirrored UVs)
+			XMVECTOR ex = s2 * x1 - s1 * x2;
+			XMVECTOR ey = s2 * y1 - s1 * y2;
+			XMVECTOR ez = s2 * z1 - s1 * z2;
+
+			XMVECTOR scale;
+			if (mode == TangentMode::Fast)
+			{
+				// Same as the original: divide by the UV area
+				scale = XMVectorReciprocal(det);
+			}
+			else
+			{
+				// MikkTSpace: unit length, flipped to match the UV winding
+				XMVECTOR lengthSq = dx * dx + dy * dy + dz * dz;
+				usable = XMVectorAndInt(usable, XMVectorGreater(lengthSq, epsilon));
+				scale = XMVectorReciprocalSqrt(lengthSq);
+				scale = XMVectorSelect(scale, -scale, XMVectorLess(det, XMVectorZero()));
+			}
+
+			// Degenerate triangles contribute nothing (instead of inf/NaN)
+			scale = XMVectorSelect(XMVectorZero(), scale, usable);
+
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&tx[g * 4]), dx * scale);
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&ty[g * 4]), dy * scale);
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&tz[g * 4]), dz * scale);
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&bx[g * 4]), ex * scale);
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&by[g * 4]), ey * scale);
+			XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(&bz[g * 4]), ez * scale);
+		}
+	});
+
+	// Vertex -> triangle corner adjacency, packed into one array
+	std::vector<unsigned int> offsets;
+	std::vector<unsigned int> corners(triangleCount * 3);
+	auto buildAdjacency = [&]()
+	{
+		offsets.assign(vertices.size() + 1, 0);
+		for (size_t i = 0; i < triangleCount * 3; i++)
+			offsets[indices[i] + 1]++;
+		for (size_t i = 0; i < vertices.size(); i++)
+			offsets[i + 1] += offsets[i];
+
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; i++)
+			corners[fill[indices[i]]++] = (unsigned int)i;
+	};
+	buildAdjacency();
+
+	// Which side of the tangent a triangle's bitangent is on, as seen from
+	// one of its vertices: 1, -1 where its UVs are mirrored, or 0 if degenerate
+	auto handedness = [&](size_t vertex, unsigned int t)
+	{
+		XMVECTOR normal = XMLoadFloat3(&vertices[vertex].Normal);
+		XMVECTOR tangent = XMVectorSet(tx[t], ty[t], tz[t], 0);
+		XMVECTOR bitangent = XMVectorSet(bx[t], by[t], bz[t], 0);
+		float side = XMVectorGetX(XMVector3Dot(XMVector3Cross(tangent, normal), bitangent));
+		return side > 0.0f ? 1 : (side < 0.0f ? -1 : 0);
+	};
+
+	// MikkTSpace never averages across a mirrored seam: the mirrored corners
+	// of a vertex on one move to a copy of it (appended, so this runs serially)
+	if (mode == TangentMode::MikkTSpace)
+	{
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			bool unmirrored = false, mirrored = false;
+			for (unsigned int a = offsets[i]; a < offsets[i + 1]; a++)
+			{
+				int side = handedness(i, corners[a] / 3);
+				unmirrored |= side > 0;
+				mirrored |= side < 0;
+			}
+			if (!unmirrored || !mirrored)
+				continue;
+
+			unsigned int copy = (unsigned int)vertices.size();
+			Vertex vertex = vertices[i];
+			vertices.push_back(vertex);
+			px.push_back(px[i]);
+			py.push_back(py[i]);
+			pz.push_back(pz[i]);
+			for (unsigned int a = offsets[i]; a < offsets[i + 1]; a++)
+			{
+				if (handedness(i, corners[a] / 3) < 0)
+					indices[corners[a]] = copy;
+			}
+		}
+
+		if (vertices.size() != vertexCount)
+			buildAdjacency();
+	}
+
+	// Each vertex sums its own triangles, so no two threads write the same data
+	ParallelFor(vertices.size(), MinItemsPerRange, [&](size_t first, size_t last)
+	{
+		for (size_t i = first; i < last; i++)
+		{
+			XMVECTOR normal = XMVector3Normalize(XMLoadFloat3(&vertices[i].Normal));
+			XMVECTOR sum = XMVectorZero();
+			XMVECTOR bitangentSum = XMVectorZero();
+
+			for (unsigned int a = offsets[i]; a < offsets[i + 1]; a++)
+			{
+				unsigned int corner = corners[a];
+				unsigned int t = corner / 3;
+				XMVECTOR tangent = XMVectorSet(tx[t], ty[t], tz[t], 0);
+				XMVECTOR bitangent = XMVectorSet(bx[t], by[t], bz[t], 0);
+
+				if (mode == TangentMode::Fast)
+				{
+					sum += tangent;
+					bitangentSum += bitangent;
+					continue;
+				}
+
+				// MikkTSpace weights each triangle by its angle at this corner,
+				// measured after projecting everything onto the tangent plane
+				unsigned int base = t * 3;
+				unsigned int next = indices[base + (corner - base + 1) % 3];
+				unsigned int prev = indices[base + (corner - base + 2) % 3];
+				XMVECTOR p = XMVectorSet(px[i], py[i], pz[i], 0);
+				XMVECTOR e1 = ProjectOntoPlane(XMVectorSet(px[next], py[next], pz[next], 0) - p, normal);
+				XMVECTOR e2 = ProjectOntoPlane(XMVectorSet(px[prev], py[prev], pz[prev], 0) - p, normal);
+				float cosAngle = (std::min)((std::max)(XMVectorGetX(XMVector3Dot(e1, e2)), -1.0f), 1.0f);
+				float angle = acosf(cosAngle);
+
+				sum += ProjectOntoPlane(tangent, normal) * angle;
+				bitangentSum += bitangent * angle;
+			}
+
+			// Gram-Schmidt so the tangent is exactly perpendicular to the normal
+			XMVECTOR tangent = ProjectOntoPlane(sum, normal);
+			if (XMVector3Equal(tangent, XMVectorZero()))
+				tangent = Perpendicular(normal);
+
+			// Handedness: which side of the tangent the bitangents were on
+			float w = XMVectorGetX(XMVector3Dot(XMVector3Cross(tangent, normal), bitangentSum)) < 0.0f ? -1.0f : 1.0f;
+			XMStoreFloat4(&vertices[i].Tangent, XMVectorSetW(tangent, w));
+		}
+	});
+}
+
+// --------------------------------------------------------
+// Author: Chris Cascioli
+// Purpose: Calculates the tangents of the vertices in a mesh
+//
+// - You are allowed to directly copy/paste this into your code base
+//   for assignments, given that you clearly cite that this is not
+//   code of your own design.
+//
+// - Code originally adapted from: http://www.terathon.com/code/tangent.html
+//   - Updated version now found here: http://foundationsofgameenginedev.com/FGED2-sample.pdf
+//   - See listing 7.4 in section 7.5 (page 9 of the PDF)
+// --------------------------------------------------------
+void GenerateTangentsReference(Vertex* verts, size_t numVerts, const unsigned int* indices, size_t numIndices)
+{
+	// Reset tangents, and sum the bitangents on the side (only
+	// their direction is needed, for the handedness)
+	std::vector<XMFLOAT3> bitangents(numVerts, XMFLOAT3(0, 0, 0));
+	for (size_t i = 0; i < numVerts; i++)
+	{
+		verts[i].Tangent = XMFLOAT4(0, 0, 0, 0);
+	}
+
+	// Calculate tangents one whole triangle at a time
+	for (size_t i = 0; i < numIndices;)
+	{
+		// Grab indices and vertices of first triangle
+		unsigned int i1 = indices[i++];
+		unsigned int i2 = indices[i++];
+		unsigned int i3 = indices[i++];
+		Vertex* v1 = &verts[i1];
+		Vertex* v2 = &verts[i2];
+		Vertex* v3 = &verts[i3];
+
+		// Calculate vectors relative to triangle positions
+		float x1 = v2->Position.x - v1->Position.x;
+		float y1 = v2->Position.y - v1->Position.y;
+		float z1 = v2->Position.z - v1->Position.z;
+
+		float x2 = v3->Position.x - v1->Position.x;
+		float y2 = v3->Position.y - v1->Position.y;
+		float z2 = v3->Position.z - v1->Position.z;
+
+		// Do the same for vectors relative to triangle uv's
+		float s1 = v2->UV.x - v1->UV.x;
+		float t1 = v2->UV.y - v1->UV.y;
+
+		float s2 = v3->UV.x - v1->UV.x;
+		float t2 = v3->UV.y - v1->UV.y;
+
+		// Create vectors for tangent calculation
+		float r = 1.0f / (s1 * t2 - s2 * t1);
+
+		float tx = (t2 * x1 - t1 * x2) * r;
+		float ty = (t2 * y1 - t1 * y2) * r;
+		float tz = (t2 * z1 - t1 * z2) * r;
+
+		// Bitangent pointing up the texture (toward smaller V, which
+		// is what cross(T, N) gives the shaders on unmirrored UVs)
+		float bx = (s2 * x1 - s1 * x2) * r;
+		float by = (s2 * y1 - s1 * y2) * r;
+		float bz = (s2 * z1 - s1 * z2) * r;
+
+		// Adjust tangents of each vert of the triangle
+		v1->Tangent.x += tx;
+		v1->Tangent.y += ty;
+		v1->Tangent.z += tz;
+
+		v2->Tangent.x += tx;
+		v2->Tangent.y += ty;
+		v2->Tangent.z += tz;
+
+		v3->Tangent.x += tx;
+		v3->Tangent.y += ty;
+		v3->Tangent.z += tz;
+
+		for (unsigned int v : { i1, i2, i3 })
+		{
+			bitangents[v].x += bx;
+			bitangents[v].y += by;
+			bitangents[v].z += bz;
+		}
+	}
+
+	// Ensure all of the tangents are orthogonal to the normals
+	for (size_t i = 0; i < numVerts; i++)
+	{
+		// Grab the two vectors
+		XMVECTOR normal = XMLoadFloat3(&verts[i].Normal);
+		XMVECTOR tangent = XMLoadFloat4(&verts[i].Tangent);
+
+		// Use Gram-Schmidt orthonormalize to ensure
+		// the normal and tangent are exactly 90 degrees apart
+		tangent = XMVector3Normalize(
+			tangent - normal * XMVector3Dot(normal, tangent));
+
+		// Handedness: which side of the tangent the bitangents were on
+		float w = XMVectorGetX(XMVector3Dot(XMVector3Cross(tangent, normal), XMLoadFloat3(&bitangents[i]))) < 0.0f ? -1.0f : 1.0f;
+
+		// Store the tangent
+		XMStoreFloat4(&verts[i].Tangent, XMVectorSetW(tangent, w));
+	}
+}
+
+TangentBenchmarkResult BenchmarkTangents(unsigned int triangleCount)
+{
+	// A wavy grid with tiled UVs, so tangents vary from vertex to vertex,
+	// and mirrored across the middle like a symmetric character's
+	unsigned int side = (std::max)(2u, (unsigned int)sqrtf(triangleCount / 2.0f) + 1);
+	std::vector<Vertex> vertices(side * side);
+	for (unsigned int z = 0; z < side; z++)
+	{
+		for (unsigned int x = 0; x < side; x++)
+		{
+			float fx = x / (float)(side - 1);
+			float fz = z / (float)(side - 1);
+			float slopeX = 0.5f * cosf(fx * 20.0f);
+			float slopeZ = 0.5f * cosf(fz * 15.0f);
+
+			Vertex& vertex = vertices[z * side + x];
+			vertex.Position = XMFLOAT3(fx * 10.0f, 0.025f * sinf(fx * 20.0f) + 0.033f * sinf(fz * 15.0f), fz * 10.0f);
+			vertex.UV = XMFLOAT2((std::min)(fx, 1.0f - fx) * 16.0f, fz * 8.0f);
+			XMStoreFloat3(&vertex.Normal, XMVector3Normalize(XMVectorSet(-slopeX * 0.05f, 1.0f, -slopeZ * 0.05f, 0.0f)));
+		}
+	}
+
+	std::vector<unsigned int> indices;
+	indices.reserve((side - 1) * (side - 1) * 6);
+	for (unsigned int z = 0; z + 1 < side; z++)
+	{
+		for (unsigned int x = 0; x + 1 < side; x++)
+		{
+			unsigned int i = z * side + x;
+			indices.insert(indices.end(), { i, i + side, i + side + 1, i, i + side + 1, i + 1 });
+		}
+	}
+
+	TangentBenchmarkResult result = {};
+	result.TriangleCount = (unsigned int)(indices.size() / 3);
+
+	std::vector<Vertex> reference = vertices;
+	auto start = std::chrono::high_resolution_clock::now();
+	GenerateTangentsReference(&reference[0], reference.size(), &indices[0], indices.size());
+	result.ReferenceMs = MillisecondsSince(start);
+
+	start = std::chrono::high_resolution_clock::now();
+	GenerateTangents(vertices, indices, TangentMode::Fast);
+	result.FastMs = MillisecondsSince(start);
+
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		XMVECTOR a = XMLoadFloat4(&vertices[i].Tangent);
+		XMVECTOR b = XMLoadFloat4(&reference[i].Tangent);
+		float angle = atan2f(XMVectorGetX(XMVector3Length(XMVector3Cross(a, b))), XMVectorGetX(XMVector3Dot(a, b)));
+		result.MaxDifferenceDegrees = (std::max)(result.MaxDifferenceDegrees, XMConvertToDegrees(angle));
+	}
+
+	// Splits the seam, so it gets its own copy of the mesh
+	std::vector<Vertex> mikkVertices = vertices;
+	std::vector<unsigned int> mikkIndices = indices;
+	start = std::chrono::high_resolution_clock::now();
+	GenerateTangents(mikkVertices, mikkIndices, TangentMode::MikkTSpace);
+	result.MikkTSpaceMs = MillisecondsSince(start);
+	result.SplitVertices = (unsigned int)(mikkVertices.size() - vertices.size());
+
+	return result;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "Vertex.h"
+
+// --------------------------------------------------------
+// How per-triangle tangents are combined at each vertex
+// --------------------------------------------------------
+enum class TangentMode
+{
+	Reference,	// The original scalar generator (see GenerateTangentsReference())
+	Fast,		// Same sums as the reference, on SIMD streams across several threads
+	MikkTSpace	// Normalized per triangle, weighted by corner angle and split at mirrored UVs, to match MikkTSpace bakers
+};
+
+// Fills in Vertex::Tangent for an indexed triangle list
+//  - Tangent.w is the handedness: the bitangent is cross(T, N) * w, which
+//    is -1 where the UVs are mirrored
+//  - Works on SoA position/UV streams, four triangles per SIMD op
+//  - Each vertex gathers its own triangles, so the parallel passes never write the same vertex
+//  - Triangles with degenerate UVs are ignored, and vertices without any usable
+//    triangle get an arbitrary tangent perpendicular to their normal
+//  - MikkTSpace mode duplicates vertices shared by mirrored and unmirrored
+//    triangles (appending them and updating the indices), so each side of
+//    the seam keeps its own handedness
+void GenerateTangents(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, TangentMode mode);
+
+// The original scalar, single-threaded generator, kept as a reference
+void GenerateTangentsReference(Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount);
+
+// --------------------------------------------------------
+// Timings from running all generators on the same mesh
+// --------------------------------------------------------
+struct TangentBenchmarkResult
+{
+	unsigned int TriangleCount;
+	double ReferenceMs;
+	double FastMs;
+	double MikkTSpaceMs;
+	float MaxDifferenceDegrees;	// Between the reference and Fast mode
+	unsigned int SplitVertices;	// Added by MikkTSpace mode at mirrored seams
+};
+
+// Builds a grid of roughly triangleCount triangles and times each generator on it
+//  - The right half of the UVs is mirrored, so MikkTSpace mode has a seam to split
+TangentBenchmarkResult BenchmarkTangents(unsigned int triangleCount);
@@ -0,0 +1,276 @@
+#include "TextureLoader.h"
+
+#include <wincodec.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#pragma comment(lib, "windowscodecs.lib")
+
+namespace
+{
+	double MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// COM for the length of one load, on whatever thread runs it
+	struct ComScope
+	{
+		HRESULT Result;
+		ComScope() : Result(CoInitializeEx(0, COINIT_MULTITHREADED)) { }
+		~ComScope() { if (SUCCEEDED(Result)) CoUninitialize(); }
+	};
+
+	// A decoded image and every mip below it, tightly packed
+	struct DecodedImage
+	{
+		unsigned int Width;
+		unsigned int Height;
+		unsigned int Channels;	// 1 or 4
+		bool SRGB;
+		std::vector<std::vector<uint8_t>> Mips;
+	};
+
+	// The same check CreateWICTextureFromFile() makes: PNGs with an sRGB chunk
+	// (or the gamma sRGB has), and anything else tagged as sRGB
+	bool IsSRGB(IWICBitmapFrameDecode* frame)
+	{
+		Microsoft::WRL::ComPtr<IWICMetadataQueryReader> metadata;
+		GUID container = {};
+		if (FAILED(frame->GetMetadataQueryReader(metadata.GetAddressOf())) || FAILED(metadata->GetContainerFormat(&container)))
+			return false;
+
+		bool srgb = false;
+		PROPVARIANT value;
+		PropVariantInit(&value);
+		if (container == GUID_ContainerFormatPng)
+		{
+			if (SUCCEEDED(metadata->GetMetadataByName(L"/sRGB/RenderingIntent", &value)) && value.vt == VT_UI1)
+				srgb = true;
+			else if (SUCCEEDED(metadata->GetMetadataByName(L"/gAMA/ImageGamma", &value)) && value.vt == VT_UI4)
+				srgb = value.uintVal == 45455;
+		}
+		else if (SUCCEEDED(metadata->GetMetadataByName(L"System.Image.ColorSpace", &value)) && value.vt == VT_UI2)
+			srgb = value.uiVal == 1;
+		PropVariantClear(&value);
+		return srgb;
+	}
+
+	bool Decode(const std::wstring& path, DecodedImage& image)
+	{
+		Microsoft::WRL::ComPtr<IWICImagingFactory> factory;
+		Microsoft::WRL::ComPtr<IWICBitmapDecoder> decoder;
+		Microsoft::WRL::ComPtr<IWICBitmapFrameDecode> frame;
+		if (FAILED(CoCreateInstance(CLSID_WICImagingFactory, 0, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(factory.GetAddressOf()))) ||
+			FAILED(factory->CreateDecoderFromFilename(path.c_str(), 0, GENERIC_READ, WICDecodeMetadataCacheOnDemand, decoder.GetAddressOf())) ||
+			FAILED(decoder->GetFrame(0, frame.GetAddressOf())) ||
+			FAILED(frame->GetSize(&image.Width, &image.Height)))
+			return false;
+		if (image.Width == 0 || image.Height == 0 ||
+			image.Width > D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION || image.Height > D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION)
+			return false;
+
+		WICPixelFormatGUID format = {};
+		frame->GetPixelFormat(&format);
+		image.Channels = format == GUID_WICPixelFormat8bppGray ? 1 : 4;
+		image.SRGB = image.Channels == 4 && IsSRGB(frame.Get());
+
+		Microsoft::WRL::ComPtr<IWICFormatConverter> converter;
+		if (FAILED(factory->CreateFormatConverter(converter.GetAddressOf())) ||
+			FAILED(converter->Initialize(frame.Get(), image.Channels == 1 ? GUID_WICPixelFormat8bppGray : GUID_WICPixelFormat32bppRGBA,
+				WICBitmapDitherTypeNone, 0, 0, WICBitmapPaletteTypeMedianCut)))
+			return false;
+
+		unsigned int rowPitch = image.Width * image.Channels;
+		image.Mips.resize(1);
+		image.Mips[0].resize((size_t)rowPitch * image.Height);
+		return SUCCEEDED(converter->CopyPixels(0, rowPitch, (UINT)image.Mips[0].size(), image.Mips[0].data()));
+	}
+
+	// sRGB to linear for every byte value, and back for a linear value
+	struct SRGBTable
+	{
+		float ToLinear[256];
+		SRGBTable()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				float c = i / 255.0f;
+				ToLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+			}
+		}
+	};
+
+	uint8_t FromLinear(float c)
+	{
+		c = c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+		return (uint8_t)(std::min)(255.0f, (std::max)(0.0f, c * 255.0f + 0.5f));
+	}
+
+	// Every mip down to 1x1, each a box filter of the one above (clamped at
+	// odd edges), averaged in linear space for sRGB color like the GPU does
+	void BuildMips(DecodedImage& image)
+	{
+		static const SRGBTable table;
+		unsigned int width = image.Width, height = image.Height;
+		unsigned int channels = image.Channels;
+
+		while (width > 1 || height > 1)
+		{
+			unsigned int mipWidth = (std::max)(1u, width / 2);
+			unsigned int mipHeight = (std::max)(1u, height / 2);
+			const std::vector<uint8_t>& source = image.Mips.back();
+			std::vector<uint8_t> mip((size_t)mipWidth * mipHeight * channels);
+
+			for (unsigned int y = 0; y < mipHeight; y++)
+			{
+				unsigned int y0 = y * 2, y1 = (std::min)(y * 2 + 1, height - 1);
+				for (unsigned int x = 0; x < mipWidth; x++)
+				{
+					unsigned int x0 = x * 2, x1 = (std::min)(x * 2 + 1, width - 1);
+					const uint8_t* texels[4] =
+					{
+						&source[((size_t)y0 * width + x0) * channels],
+						&source[((size_t)y0 * width + x1) * channels],
+						&source[((size_t)y1 * width + x0) * channels],
+						&source[((size_t)y1 * width + x1) * channels],
+					};
+					uint8_t* out = &mip[((size_t)y * mipWidth + x) * channels];
+
+					for (unsigned int c = 0; c < channels; c++)
+					{
+						if (image.SRGB && c < 3)
+						{
+							float sum = 0;
+							for (auto t : texels)
+								sum += table.ToLinear[t[c]];
+							out[c] = FromLinear(sum * 0.25f);
+						}
+						else
+							out[c] = (uint8_t)((texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) / 4);
+					}
+				}
+			}
+
+			image.Mips.push_back(std::move(mip));
+			width = mipWidth;
+			height = mipHeight;
+		}
+	}
+}
+
+TextureHandle::TextureHandle(const std::wstring& path, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> placeholder) :
+	path(path),
+	placeholder(placeholder),
+	stats(),
+	failed(false),
+	ready(false)
+{ }
+
+bool TextureHandle::IsReady() { return ready.load(std::memory_order_acquire); }
+bool TextureHandle::HasFailed() { return IsReady() && failed; }
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> TextureHandle::GetSRV() { return IsReady() && srv ? srv : placeholder; }
+const std::wstring& TextureHandle::GetPath() { return path; }
+TextureLoadStats TextureHandle::GetStats() { return IsReady() ? stats : TextureLoadStats(); }
+
+// A worker for every core but the one the game runs on, and at least one
+// so nothing waits on WaitAll()
+TextureLoader::TextureLoader(Microsoft::WRL::ComPtr<ID3D11Device> device) :
+	device(device),
+	jobs((std::max)(2u, std::thread::hardware_concurrency()) - 1),
+	pending(0),
+	created(std::chrono::high_resolution_clock::now())
+{ }
+
+TextureLoader::~TextureLoader() { WaitAll(); }
+
+std::shared_ptr<TextureHandle> TextureLoader::Load(const std::wstring& path, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> placeholder)
+{
+	std::shared_ptr<TextureHandle> texture = std::make_shared<TextureHandle>(path, placeholder);
+	pending++;
+	jobs.Run([this, texture]()
+	{
+		LoadNow(*texture);
+		pending--;
+	}, &loads);
+	return texture;
+}
+
+void TextureLoader::WaitAll() { jobs.Wait(loads); }
+unsigned int TextureLoader::GetPendingCount() { return pending.load(); }
+
+void TextureLoader::LoadNow(TextureHandle& texture)
+{
+	ComScope com;
+	TextureLoadStats& stats = texture.stats;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	DecodedImage image = {};
+	bool decoded = Decode(texture.path, image);
+	stats.DecodeMs = MillisecondsSince(start);
+
+	if (decoded)
+	{
+		start = std::chrono::high_resolution_clock::now();
+		BuildMips(image);
+		stats.MipMs = MillisecondsSince(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		D3D11_TEXTURE2D_DESC desc = {};
+		desc.Width = image.Width;
+		desc.Height = image.Height;
+		desc.MipLevels = (UINT)image.Mips.size();
+		desc.ArraySize = 1;
+		desc.Format = image.Channels == 1 ? DXGI_FORMAT_R8_UNORM : (image.SRGB ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM);
+		desc.SampleDesc.Count = 1;
+		desc.Usage = D3D11_USAGE_IMMUTABLE;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+		std::vector<D3D11_SUBRESOURCE_DATA> mips(image.Mips.size());
+		for (size_t m = 0; m < mips.size(); m++)
+		{
+			mips[m].pSysMem = image.Mips[m].data();
+			mips[m].SysMemPitch = (std::max)(1u, image.Width >> m) * image.Channels;
+		}
+
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> resource;
+		if (SUCCEEDED(device->CreateTexture2D(&desc, mips.data(), resource.GetAddressOf())))
+			device->CreateShaderResourceView(resource.Get(), 0, texture.srv.GetAddressOf());
+		stats.CreateMs = MillisecondsSince(start);
+
+		stats.Width = image.Width;
+		stats.Height = image.Height;
+		stats.MipLevels = desc.MipLevels;
+		stats.SRGB = image.SRGB;
+	}
+
+	texture.failed = !texture.srv;
+	stats.DoneMs = MillisecondsSince(created);
+	texture.ready.store(true, std::memory_order_release);
+}
+
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> TextureLoader::CreateSolidTexture(unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+{
+	unsigned char texel[4] = { r, g, b, a };
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = 1;
+	desc.Height = 1;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	D3D11_SUBRESOURCE_DATA data = {};
+	data.pSysMem = texel;
+	data.SysMemPitch = sizeof(texel);
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> resource;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	if (SUCCEEDED(device->CreateTexture2D(&desc, &data, resource.GetAddressOf())))
+		device->CreateShaderResourceView(resource.Get(), 0, srv.GetAddressOf());
+	return srv;
+}
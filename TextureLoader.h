@@ -0,0 +1,91 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "JobSystem.h"
+
+// --------------------------------------------------------
+// How one texture's load went, in milliseconds
+// --------------------------------------------------------
+struct TextureLoadStats
+{
+	unsigned int Width;
+	unsigned int Height;
+	unsigned int MipLevels;
+	bool SRGB;
+	double DecodeMs;
+	double MipMs;
+	double CreateMs;	// The texture and its view, on the device
+	double DoneMs;		// Since the loader was made
+};
+
+// --------------------------------------------------------
+// One texture on its way in
+//  - GetSRV() is the placeholder it was given until the real
+//    texture exists, and then the real one (or the placeholder
+//    for good, if the file couldn't be loaded)
+// --------------------------------------------------------
+class TextureHandle
+{
+public:
+	TextureHandle(const std::wstring& path, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> placeholder);
+
+	bool IsReady();		// Loaded, or failed to
+	bool HasFailed();
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSRV();
+	const std::wstring& GetPath();
+	TextureLoadStats GetStats();	// Once it's ready
+
+private:
+	friend class TextureLoader;
+
+	std::wstring path;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> placeholder;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	TextureLoadStats stats;
+	bool failed;
+	std::atomic<bool> ready;	// Set last, once everything above is
+};
+
+// --------------------------------------------------------
+// Loads image files into textures in the background
+//  - Each file is decoded (WIC), and its mips built, on one
+//    of the loader's own threads, into memory; the texture is
+//    then made with every mip at once, straight from there,
+//    since the device (unlike the immediate context) can be
+//    used from any thread
+//  - Formats follow CreateWICTextureFromFile(): 8-bit grey
+//    images stay one channel, everything else becomes RGBA,
+//    as sRGB when the file says it is
+//  - The loader has its own job system, so frames waiting on
+//    jobs of their own never end up decoding a texture
+// --------------------------------------------------------
+class TextureLoader
+{
+public:
+	TextureLoader(Microsoft::WRL::ComPtr<ID3D11Device> device);
+	~TextureLoader(); // Finishes every load first
+
+	std::shared_ptr<TextureHandle> Load(const std::wstring& path, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> placeholder);
+
+	// Helps with the loads until they're all done
+	void WaitAll();
+	unsigned int GetPendingCount();
+
+	// A 1x1 texture, for a placeholder
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateSolidTexture(unsigned char r, unsigned char g, unsigned char b, unsigned char a);
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	JobSystem jobs;
+	JobCounter loads;
+	std::atomic<unsigned int> pending;
+	std::chrono::high_resolution_clock::time_point created;
+
+	void LoadNow(TextureHandle& texture);
+};
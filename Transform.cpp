@@ -2,82 +2,76 @@
 
 using namespace DirectX;
 
+static TransformSystem& Transforms() { return TransformSystem::GetInstance(); }
+
 void Transform::SetPosition(float x, float y, float z)
 {
-	position.x = x;
-	position.y = y;
-	position.z = z;
-	matrixChanged = true;
+	Transforms().SetPosition(id, XMFLOAT3(x, y, z));
 }
 
 void Transform::SetPosition(DirectX::XMFLOAT3 position)
 {
-	this->position = position;
-	matrixChanged = true;
+	Transforms().SetPosition(id, position);
 }
 
 void Transform::SetRotation(float pitch, float yaw, float roll)
 {
-	pitchYawRoll.x = pitch;
-	pitchYawRoll.y = yaw;
-	pitchYawRoll.z = roll;
-	matrixChanged = true;
+	Transforms().SetPitchYawRoll(id, XMFLOAT3(pitch, yaw, roll));
 	vectorChanged = true;
 }
 
 void Transform::SetRotation(DirectX::XMFLOAT3 rotation)
 {
-	pitchYawRoll = rotation;
-	matrixChanged = true;
+	Transforms().SetPitchYawRoll(id, rotation);
+	vectorChanged = true;
+}
+
+void Transform::SetRotation(DirectX::XMFLOAT4 quaternion)
+{
+	Transforms().SetRotation(id, quaternion);
 	vectorChanged = true;
 }
 
 void Transform::SetScale(float x, float y, float z)
 {
-	scale.x = x;
-	scale.y = y;
-	scale.z = z;
-	matrixChanged = true;
+	Transforms().SetScale(id, XMFLOAT3(x, y, z));
 }
 
 void Transform::SetScale(DirectX::XMFLOAT3 scale)
 {
-	this->scale = scale;
-	matrixChanged = true;
+	Transforms().SetScale(id, scale);
 }
 
-DirectX::XMFLOAT3 Transform::GetPosition() { return position; }
-DirectX::XMFLOAT3 Transform::GetPitchYawRoll() { return pitchYawRoll; }
-DirectX::XMFLOAT3 Transform::GetScale() { return scale; }
-DirectX::XMFLOAT4X4 Transform::GetWorldMatrix() { UpdateMatrices(); return worldMatrix; }
-DirectX::XMFLOAT4X4 Transform::GetWorldInverseTransposeMatrix() { UpdateMatrices(); return worldInverseTransposeMatrix; }
+DirectX::XMFLOAT3 Transform::GetPosition() { return Transforms().GetPosition(id); }
+DirectX::XMFLOAT3 Transform::GetPitchYawRoll() { return Transforms().GetPitchYawRoll(id); }
+DirectX::XMFLOAT4 Transform::GetRotation() { return Transforms().GetRotation(id); }
+DirectX::XMFLOAT3 Transform::GetScale() { return Transforms().GetScale(id); }
+DirectX::XMFLOAT4X4 Transform::GetWorldMatrix() { return Transforms().GetWorldMatrix(id); }
+DirectX::XMFLOAT4X4 Transform::GetWorldInverseTransposeMatrix() { return Transforms().GetWorldInverseTransposeMatrix(id); }
+bool Transform::HasUniformScale() { return Transforms().HasUniformScale(id); }
 DirectX::XMFLOAT3 Transform::GetUp() { UpdateVectors(); return up; }
 DirectX::XMFLOAT3 Transform::GetRight() { UpdateVectors(); return right; }
 DirectX::XMFLOAT3 Transform::GetForward() { UpdateVectors(); return forward; }
 
 void Transform::MoveAbsolute(float x, float y, float z)
 {
-	position.x += x;
-	position.y += y;
-	position.z += z;
-	matrixChanged = true;
+	XMFLOAT3 position = GetPosition();
+	SetPosition(position.x + x, position.y + y, position.z + z);
 }
 
 void Transform::MoveAbsolute(DirectX::XMFLOAT3 offset)
 {
-	position.x += offset.x;
-	position.y += offset.y;
-	position.z += offset.z;
-	matrixChanged = true;
+	MoveAbsolute(offset.x, offset.y, offset.z);
 }
 
 void Transform::MoveRelative(float x, float y, float z)
 {
+	XMFLOAT3 position = GetPosition();
+	XMFLOAT4 quaternion = GetRotation();
 	XMVECTOR movement = XMVectorSet(x, y, z, 0);
-	XMVECTOR rotation = XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&pitchYawRoll));
-	XMVECTOR direction = XMVector3Rotate(movement, rotation);
+	XMVECTOR direction = XMVector3Rotate(movement, XMLoadFloat4(&quaternion));
 	XMStoreFloat3(&position, XMLoadFloat3(&position) + direction);
-	matrixChanged = true;
+	SetPosition(position);
 }
 
 void Transform::MoveRelative(DirectX::XMFLOAT3 offset)
@@ -87,62 +81,46 @@ void Transform::MoveRelative(DirectX::XMFLOAT3 offset)
 
 void Transform::Rotate(float pitch, float yaw, float roll)
 {
-	pitchYawRoll.x += pitch;
-	pitchYawRoll.y += yaw;
-	pitchYawRoll.z += roll;
-	matrixChanged = true;
-	vectorChanged = true;
+	XMFLOAT3 pitchYawRoll = GetPitchYawRoll();
+	SetRotation(pitchYawRoll.x + pitch, pitchYawRoll.y + yaw, pitchYawRoll.z + roll);
 }
 
 void Transform::Rotate(DirectX::XMFLOAT3 rotation)
 {
-	pitchYawRoll.x += rotation.x;
-	pitchYawRoll.y += rotation.y;
-	pitchYawRoll.z += rotation.z;
-	matrixChanged = true;
-	vectorChanged = true;
+	Rotate(rotation.x, rotation.y, rotation.z);
 }
 
 void Transform::Scale(float x, float y, float z)
 {
-	scale.x *= x;
-	scale.y *= y;
-	scale.z *= z;
-	matrixChanged = true;
+	XMFLOAT3 scale = GetScale();
+	SetScale(scale.x * x, scale.y * y, scale.z * z);
 }
 
 void Transform::Scale(DirectX::XMFLOAT3 scale)
 {
-	this->scale.x *= scale.x;
-	this->scale.y *= scale.y;
-	this->scale.z *= scale.z;
-	matrixChanged = true;
+	Scale(scale.x, scale.y, scale.z);
 }
 
-void Transform::UpdateMatrices()
+bool Transform::SetParent(Transform* parent)
 {
-	if (!matrixChanged) return;
-
-	XMMATRIX pos = XMMatrixTranslationFromVector(XMLoadFloat3(&position));
-	XMMATRIX rot = XMMatrixRotationRollPitchYawFromVector(XMLoadFloat3(&pitchYawRoll));
-	XMMATRIX sc = XMMatrixScalingFromVector(XMLoadFloat3(&scale));
-
-	// Note: Overloaded operators are defined in the DirectX namespace!
-	// Alternatively, you can call XMMatrixMultiply(XMMatrixMultiply(s, r), t))
-	XMMATRIX wMatrix = pos * rot * sc;
+	return Transforms().SetParent(id, parent ? parent->id : TransformSystem::NoParent);
+}
 
-	XMStoreFloat4x4(&worldMatrix, wMatrix);
-	XMStoreFloat4x4(&worldInverseTransposeMatrix,
-		XMMatrixInverse(0, XMMatrixTranspose(wMatrix)));
+unsigned int Transform::GetId() { return id; }
 
-	matrixChanged = false;
+// Matrices normally come from TransformSystem's batch update,
+// this just makes sure this one is current right now
+void Transform::UpdateMatrices()
+{
+	Transforms().UpdateMatrices(id);
 }
 
 void Transform::UpdateVectors()
 {
 	if (!vectorChanged) return;
 
-	XMVECTOR rot = XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&pitchYawRoll));
+	XMFLOAT4 quaternion = GetRotation();
+	XMVECTOR rot = XMLoadFloat4(&quaternion);
 	XMStoreFloat3(&right, XMVector3Rotate(XMVectorSet(1, 0, 0, 0), rot));
 	XMStoreFloat3(&up, XMVector3Rotate(XMVectorSet(0, 1, 0, 0), rot));
 	XMStoreFloat3(&forward, XMVector3Rotate(XMVectorSet(0, 0, 1, 0), rot));
@@ -151,15 +129,36 @@ void Transform::UpdateVectors()
 }
 
 Transform::Transform() :
-	position(0, 0, 0),
-	pitchYawRoll(0, 0, 0),
-	scale(1, 1, 1),
+	id(Transforms().Create()),
 	up(0, 1, 0),
 	right(1, 0, 0),
 	forward(0, 0, 1),
-	matrixChanged(false),
 	vectorChanged(false)
 {
-	XMStoreFloat4x4(&worldMatrix, XMMatrixIdentity());
-	XMStoreFloat4x4(&worldInverseTransposeMatrix, XMMatrixIdentity());
+}
+
+// Copies get a transform of their own with the same values (and parent)
+Transform::Transform(const Transform& other) :
+	id(Transforms().Create()),
+	up(other.up),
+	right(other.right),
+	forward(other.forward),
+	vectorChanged(other.vectorChanged)
+{
+	Transforms().Copy(id, other.id);
+}
+
+Transform& Transform::operator=(const Transform& other)
+{
+	Transforms().Copy(id, other.id);
+	up = other.up;
+	right = other.right;
+	forward = other.forward;
+	vectorChanged = other.vectorChanged;
+	return *this;
+}
+
+Transform::~Transform()
+{
+	Transforms().Destroy(id);
 }
@@ -1,16 +1,17 @@
 #pragma once
 
 #include <DirectXMath.h>
-
+#include "TransformSystem.h"
+
+// A handle to one transform in TransformSystem::GetInstance(), which
+// stores the values and rebuilds the matrices in batches
+//  - With a parent, position/rotation/scale (and the vectors) are
+//    relative to it, while the matrices are world space
+//  - Rotation is a quaternion underneath; the Euler versions are
+//    there for the camera and UI, and are exact on the way back out
 class Transform {
 private:
-	DirectX::XMFLOAT3 position;
-	DirectX::XMFLOAT3 pitchYawRoll;
-	DirectX::XMFLOAT3 scale;
-
-	DirectX::XMFLOAT4X4 worldMatrix;
-	DirectX::XMFLOAT4X4 worldInverseTransposeMatrix;
-	bool matrixChanged;
+	unsigned int id;
 
 	DirectX::XMFLOAT3 up;
 	DirectX::XMFLOAT3 right;
@@ -21,15 +22,18 @@ public:
 	void SetPosition(float x, float y, float z);
 	void SetPosition(DirectX::XMFLOAT3 position);
 	void SetRotation(float pitch, float yaw, float roll);
-	void SetRotation(DirectX::XMFLOAT3 rotation); // XMFLOAT4 for quaternion
+	void SetRotation(DirectX::XMFLOAT3 rotation);
+	void SetRotation(DirectX::XMFLOAT4 quaternion);
 	void SetScale(float x, float y, float z);
 	void SetScale(DirectX::XMFLOAT3 scale);
 
 	DirectX::XMFLOAT3 GetPosition();
-	DirectX::XMFLOAT3 GetPitchYawRoll(); // XMFLOAT4 GetRotation() for quaternion
+	DirectX::XMFLOAT3 GetPitchYawRoll();
+	DirectX::XMFLOAT4 GetRotation(); // Quaternion
 	DirectX::XMFLOAT3 GetScale();
 	DirectX::XMFLOAT4X4 GetWorldMatrix();
 	DirectX::XMFLOAT4X4 GetWorldInverseTransposeMatrix();
+	bool HasUniformScale(); // If so, the world matrix works for normals too
 	DirectX::XMFLOAT3 GetUp();
 	DirectX::XMFLOAT3 GetRight();
 	DirectX::XMFLOAT3 GetForward();
@@ -43,8 +47,16 @@ public:
 	void Scale(float x, float y, float z);
 	void Scale(DirectX::XMFLOAT3 scale);
 
+	// Attaches this under another transform (nullptr to detach)
+	// - Returns false, changing nothing, if that would make a loop
+	bool SetParent(Transform* parent);
+	unsigned int GetId();
+
 	void UpdateMatrices();
 	void UpdateVectors();
 
 	Transform();
+	Transform(const Transform& other);
+	Transform& operator=(const Transform& other);
+	~Transform();
 };
\ No newline at end of file
@@ -0,0 +1,711 @@
+#include "TransformSystem.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+	// Transforms per dirty word; storage always grows by a whole word so
+	// every SIMD group of four is in bounds
+	const unsigned int WordBits = 64;
+
+	// Don't bother waking threads for fewer words than this (4096 transforms)
+	const size_t MinWordsPerThread = 64;
+
+	const unsigned int None = TransformSystem::NoParent;
+
+	XMVECTOR LoadGroup(const std::vector<float>& values, size_t first) { return XMLoadFloat4((const XMFLOAT4*)&values[first]); }
+
+	// The angles XMMatrixRotationRollPitchYaw would need for this rotation
+	XMFLOAT3 PitchYawRollFromQuaternion(FXMVECTOR quaternion)
+	{
+		XMFLOAT4X4 r;
+		XMStoreFloat4x4(&r, XMMatrixRotationQuaternion(quaternion));
+
+		// Its third row is (cos(pitch) sin(yaw), -sin(pitch), cos(pitch) cos(yaw)),
+		// and roll is in the second column; straight up or down, yaw and roll
+		// do the same thing, so it's all yaw
+		float pitch = asinf((std::max)(-1.0f, (std::min)(1.0f, -r.m[2][1])));
+		if (fabsf(r.m[2][1]) > 0.9999f)
+			return XMFLOAT3(pitch, atan2f(-r.m[0][2], r.m[0][0]), 0.0f);
+		return XMFLOAT3(pitch, atan2f(r.m[2][0], r.m[2][2]), atan2f(r.m[0][1], r.m[1][1]));
+	}
+
+	// A uniformly scaled matrix's inverse transpose is the matrix over the
+	// scale squared, with -(translation * inverse) as its last column
+	XMMATRIX UniformInverseTranspose(FXMMATRIX m)
+	{
+		XMVECTOR inverseScaleSquared = XMVectorReciprocal(XMVector3Dot(m.r[0], m.r[0]));
+		XMMATRIX result;
+		for (int r = 0; r < 3; r++)
+		{
+			result.r[r] = m.r[r] * inverseScaleSquared;
+			result.r[r] = XMVectorSetW(result.r[r], -XMVectorGetX(XMVector3Dot(m.r[3], result.r[r])));
+		}
+		result.r[3] = XMVectorSet(0, 0, 0, 1);
+		return result;
+	}
+
+	double MillisecondsSince(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+}
+
+TransformSystem& TransformSystem::GetInstance()
+{
+	static TransformSystem instance;
+	return instance;
+}
+
+TransformSystem::TransformSystem() :
+	liveCount(0),
+	lastUpdateCount(0),
+	orderStale(false)
+{ }
+
+unsigned int TransformSystem::Create()
+{
+	// Reuse a free slot, or grow everything by a whole dirty word
+	if (freeIds.empty())
+	{
+		size_t first = positionX.size();
+		size_t size = first + WordBits;
+		for (auto* values : { &positionX, &positionY, &positionZ, &rotationX, &rotationY, &rotationZ })
+			values->resize(size, 0.0f);
+		for (auto* values : { &rotationW, &scaleX, &scaleY, &scaleZ })
+			values->resize(size, 1.0f);
+		pitchYawRolls.resize(size, XMFLOAT3(0, 0, 0));
+		uniformScales.resize(size, 1);
+		worldUniformScales.resize(size, 1);
+
+		XMFLOAT4X4 identity;
+		XMStoreFloat4x4(&identity, XMMatrixIdentity());
+		for (auto* matrices : { &localMatrices, &localInverseTransposeMatrices, &worldMatrices, &worldInverseTransposeMatrices })
+			matrices->resize(size, identity);
+		for (auto* links : { &parents, &firstChildren, &nextSiblings })
+			links->resize(size, None);
+		alive.resize(size, 0);
+		dirty.push_back(0);
+
+		// Hand out the lowest ids first
+		for (size_t id = size; id > first; id--)
+			freeIds.push_back((unsigned int)id - 1);
+	}
+
+	unsigned int id = freeIds.back();
+	freeIds.pop_back();
+	liveCount++;
+	alive[id] = 1;
+	orderStale = true;
+
+	positionX[id] = positionY[id] = positionZ[id] = 0.0f;
+	rotationX[id] = rotationY[id] = rotationZ[id] = 0.0f;
+	rotationW[id] = 1.0f;
+	pitchYawRolls[id] = XMFLOAT3(0, 0, 0);
+	scaleX[id] = scaleY[id] = scaleZ[id] = 1.0f;
+	uniformScales[id] = 1;
+	MarkDirty(id);
+	return id;
+}
+
+void TransformSystem::Destroy(unsigned int id)
+{
+	// Children keep their local values, now relative to the grandparent
+	unsigned int parent = parents[id];
+	while (firstChildren[id] != None)
+		SetParent(firstChildren[id], parent);
+
+	Unlink(id);
+	alive[id] = 0;
+	orderStale = true;
+	freeIds.push_back(id);
+	liveCount--;
+}
+
+void TransformSystem::Copy(unsigned int id, unsigned int from)
+{
+	// Field by field, so the Euler angles come along exactly too
+	for (auto* values : { &positionX, &positionY, &positionZ, &rotationX, &rotationY, &rotationZ, &rotationW, &scaleX, &scaleY, &scaleZ })
+		(*values)[id] = (*values)[from];
+	pitchYawRolls[id] = pitchYawRolls[from];
+	uniformScales[id] = uniformScales[from];
+	MarkDirty(id);
+	SetParent(id, parents[from]);
+}
+
+bool TransformSystem::SetParent(unsigned int id, unsigned int parent)
+{
+	for (unsigned int a = parent; a != None; a = parents[a])
+		if (a == id)
+			return false;
+
+	Unlink(id);
+	if (parent != None)
+	{
+		parents[id] = parent;
+		nextSiblings[id] = firstChildren[parent];
+		firstChildren[parent] = id;
+	}
+
+	MarkDirty(id);
+	orderStale = true;
+	return true;
+}
+
+unsigned int TransformSystem::GetParent(unsigned int id) { return parents[id]; }
+
+XMFLOAT3 TransformSystem::GetPosition(unsigned int id) { return XMFLOAT3(positionX[id], positionY[id], positionZ[id]); }
+XMFLOAT3 TransformSystem::GetPitchYawRoll(unsigned int id) { return pitchYawRolls[id]; }
+XMFLOAT4 TransformSystem::GetRotation(unsigned int id) { return XMFLOAT4(rotationX[id], rotationY[id], rotationZ[id], rotationW[id]); }
+XMFLOAT3 TransformSystem::GetScale(unsigned int id) { return XMFLOAT3(scaleX[id], scaleY[id], scaleZ[id]); }
+
+void TransformSystem::SetPosition(unsigned int id, XMFLOAT3 position)
+{
+	positionX[id] = position.x;
+	positionY[id] = position.y;
+	positionZ[id] = position.z;
+	MarkDirty(id);
+}
+
+void TransformSystem::SetPitchYawRoll(unsigned int id, XMFLOAT3 pitchYawRoll)
+{
+	XMFLOAT4 quaternion;
+	XMStoreFloat4(&quaternion, XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&pitchYawRoll)));
+	rotationX[id] = quaternion.x;
+	rotationY[id] = quaternion.y;
+	rotationZ[id] = quaternion.z;
+	rotationW[id] = quaternion.w;
+	pitchYawRolls[id] = pitchYawRoll;
+	MarkDirty(id);
+}
+
+void TransformSystem::SetRotation(unsigned int id, XMFLOAT4 quaternion)
+{
+	XMVECTOR q = XMQuaternionNormalize(XMLoadFloat4(&quaternion));
+	XMStoreFloat4(&quaternion, q);
+	rotationX[id] = quaternion.x;
+	rotationY[id] = quaternion.y;
+	rotationZ[id] = quaternion.z;
+	rotationW[id] = quaternion.w;
+	pitchYawRolls[id] = PitchYawRollFromQuaternion(q);
+	MarkDirty(id);
+}
+
+void TransformSystem::SetScale(unsigned int id, XMFLOAT3 scale)
+{
+	scaleX[id] = scale.x;
+	scaleY[id] = scale.y;
+	scaleZ[id] = scale.z;
+	uniformScales[id] = scale.x == scale.y && scale.y == scale.z;
+	MarkDirty(id);
+}
+
+XMFLOAT4X4 TransformSystem::GetWorldMatrix(unsigned int id) { UpdateMatrices(id); return World(id); }
+
+XMFLOAT4X4 TransformSystem::GetWorldInverseTransposeMatrix(unsigned int id)
+{
+	UpdateMatrices(id);
+	XMFLOAT4X4 inverseTranspose;
+	XMStoreFloat4x4(&inverseTranspose, WorldInverseTranspose(id));
+	return inverseTranspose;
+}
+
+bool TransformSystem::HasUniformScale(unsigned int id) { UpdateMatrices(id); return WorldUniformScale(id); }
+
+void TransformSystem::UpdateMatrices(unsigned int id)
+{
+	// Find the highest stale transform on the way up to the root...
+	unsigned int top = None;
+	for (unsigned int a = id; a != None; a = parents[a])
+		if (IsDirty(a))
+			top = a;
+	if (top == None)
+		return;
+
+	// ...and rebuild from there back down to this one
+	// - Dirty bits stay set, since the batch update still has to
+	//   reach everything else under those transforms
+	std::vector<unsigned int> chain;
+	for (unsigned int a = id; a != top; a = parents[a])
+		chain.push_back(a);
+	chain.push_back(top);
+
+	for (auto a = chain.rbegin(); a != chain.rend(); a++)
+	{
+		if (IsDirty(*a))
+			UpdateGroup(*a & ~3u);
+		if (parents[*a] != None)
+			UpdateWorld(*a);
+	}
+}
+
+unsigned int TransformSystem::UpdateMatrices(bool parallel)
+{
+	if (orderStale)
+		RebuildOrder();
+
+	// Local matrices don't depend on each other, so threads can split them
+	// - Threads own whole dirty words, so they never read a changing one
+	if (parallel)
+		ParallelFor(dirty.size(), MinWordsPerThread, [&](size_t first, size_t last) { LocalsFromWords(first, last); });
+	else
+		LocalsFromWords(0, dirty.size());
+
+	// One pass down the hierarchy: a world matrix changes when its own
+	// transform or its parent's world matrix did, and parents come first
+	unsigned int updated = 0;
+	for (size_t k = 0; k < order.size(); k++)
+	{
+		unsigned int id = order[k];
+		unsigned int parent = orderParents[k];
+		bool changed = IsDirty(id) || (parent != None && orderChanged[parent]);
+		orderChanged[k] = changed;
+		if (!changed)
+			continue;
+
+		if (parent != None)
+			UpdateWorld(id);
+		updated++;
+	}
+
+	std::fill(dirty.begin(), dirty.end(), 0);
+	lastUpdateCount = updated;
+	return lastUpdateCount;
+}
+
+void TransformSystem::MarkAllDirty()
+{
+	std::fill(dirty.begin(), dirty.end(), ~0ull);
+}
+
+unsigned int TransformSystem::GetCount() { return liveCount; }
+
+unsigned int TransformSystem::GetLastUpdateCount() { return lastUpdateCount; }
+
+void TransformSystem::MarkDirty(unsigned int id)
+{
+	dirty[id / WordBits] |= 1ull << (id % WordBits);
+}
+
+bool TransformSystem::IsDirty(unsigned int id)
+{
+	return (dirty[id / WordBits] >> (id % WordBits)) & 1;
+}
+
+void TransformSystem::Unlink(unsigned int id)
+{
+	unsigned int parent = parents[id];
+	if (parent == None)
+		return;
+
+	unsigned int* link = &firstChildren[parent];
+	while (*link != id)
+		link = &nextSiblings[*link];
+	*link = nextSiblings[id];
+
+	parents[id] = None;
+	nextSiblings[id] = None;
+}
+
+// --------------------------------------------------------
+// Lays the hierarchy out depth first, so parents always come
+// before their children and each subtree is contiguous
+// --------------------------------------------------------
+void TransformSystem::RebuildOrder()
+{
+	order.clear();
+	orderParents.clear();
+
+	std::vector<unsigned int> position(parents.size(), None);
+	std::vector<unsigned int> stack;
+	for (unsigned int root = 0; root < parents.size(); root++)
+	{
+		if (!alive[root] || parents[root] != None)
+			continue;
+
+		stack.push_back(root);
+		while (!stack.empty())
+		{
+			unsigned int id = stack.back();
+			stack.pop_back();
+
+			position[id] = (unsigned int)order.size();
+			order.push_back(id);
+			orderParents.push_back(parents[id] == None ? None : position[parents[id]]);
+
+			for (unsigned int child = firstChildren[id]; child != None; child = nextSiblings[child])
+				stack.push_back(child);
+		}
+	}
+
+	orderChanged.resize(order.size());
+	orderStale = false;
+}
+
+void TransformSystem::LocalsFromWords(size_t firstWord, size_t lastWord)
+{
+	for (size_t w = firstWord; w < lastWord; w++)
+	{
+		uint64_t bits = dirty[w];
+		for (unsigned int g = 0; bits && g < WordBits; g += 4)
+			if ((bits >> g) & 0xF)
+				UpdateGroup(w * WordBits + g);
+	}
+}
+
+// The inverse transpose of a product is the product of the inverse transposes,
+// and uniform scales times uniform scales stay uniform
+void TransformSystem::UpdateWorld(unsigned int id)
+{
+	unsigned int parent = parents[id];
+	XMStoreFloat4x4(&worldMatrices[id],
+		XMLoadFloat4x4(&localMatrices[id]) * XMLoadFloat4x4(&World(parent)));
+
+	worldUniformScales[id] = uniformScales[id] && WorldUniformScale(parent);
+	if (!worldUniformScales[id])
+		XMStoreFloat4x4(&worldInverseTransposeMatrices[id], LocalInverseTranspose(id) * WorldInverseTranspose(parent));
+}
+
+const XMFLOAT4X4& TransformSystem::World(unsigned int id)
+{
+	return parents[id] == None ? localMatrices[id] : worldMatrices[id];
+}
+
+bool TransformSystem::WorldUniformScale(unsigned int id)
+{
+	return parents[id] == None ? uniformScales[id] != 0 : worldUniformScales[id] != 0;
+}
+
+XMMATRIX TransformSystem::LocalInverseTranspose(unsigned int id)
+{
+	return uniformScales[id] ?
+		UniformInverseTranspose(XMLoadFloat4x4(&localMatrices[id])) :
+		XMLoadFloat4x4(&localInverseTransposeMatrices[id]);
+}
+
+XMMATRIX TransformSystem::WorldInverseTranspose(unsigned int id)
+{
+	if (parents[id] == None)
+		return LocalInverseTranspose(id);
+	return worldUniformScales[id] ?
+		UniformInverseTranspose(XMLoadFloat4x4(&worldMatrices[id])) :
+		XMLoadFloat4x4(&worldInverseTransposeMatrices[id]);
+}
+
+// --------------------------------------------------------
+// Rebuilds the local matrices of four neighbouring transforms
+// at once, with one transform in each SIMD lane
+//  - Same result as translation * rotation * scale, and the
+//    inverse transpose of that, built one at a time
+//  - Lanes with a uniform scale skip the inverse transpose
+// --------------------------------------------------------
+void TransformSystem::UpdateGroup(size_t first)
+{
+	// Rotation straight from the quaternions, like XMMatrixRotationQuaternion
+	XMVECTOR qx = LoadGroup(rotationX, first);
+	XMVECTOR qy = LoadGroup(rotationY, first);
+	XMVECTOR qz = LoadGroup(rotationZ, first);
+	XMVECTOR qw = LoadGroup(rotationW, first);
+	XMVECTOR one = XMVectorSplatOne();
+	XMVECTOR two = one + one;
+	XMVECTOR xx = qx * qx, yy = qy * qy, zz = qz * qz;
+	XMVECTOR xy = qx * qy, xz = qx * qz, yz = qy * qz;
+	XMVECTOR wx = qw * qx, wy = qw * qy, wz = qw * qz;
+
+	XMVECTOR r00 = one - two * (yy + zz);
+	XMVECTOR r01 = two * (xy + wz);
+	XMVECTOR r02 = two * (xz - wy);
+	XMVECTOR r10 = two * (xy - wz);
+	XMVECTOR r11 = one - two * (xx + zz);
+	XMVECTOR r12 = two * (yz + wx);
+	XMVECTOR r20 = two * (xz + wy);
+	XMVECTOR r21 = two * (yz - wx);
+	XMVECTOR r22 = one - two * (xx + yy);
+
+	// Scaling last multiplies each column, translation first goes through both
+	XMVECTOR sx = LoadGroup(scaleX, first);
+	XMVECTOR sy = LoadGroup(scaleY, first);
+	XMVECTOR sz = LoadGroup(scaleZ, first);
+	XMVECTOR px = LoadGroup(positionX, first);
+	XMVECTOR py = LoadGroup(positionY, first);
+	XMVECTOR pz = LoadGroup(positionZ, first);
+
+	XMVECTOR a00 = r00 * sx, a01 = r01 * sy, a02 = r02 * sz;
+	XMVECTOR a10 = r10 * sx, a11 = r11 * sy, a12 = r12 * sz;
+	XMVECTOR a20 = r20 * sx, a21 = r21 * sy, a22 = r22 * sz;
+	XMVECTOR t0 = (px * r00 + py * r10 + pz * r20) * sx;
+	XMVECTOR t1 = (px * r01 + py * r11 + pz * r21) * sy;
+	XMVECTOR t2 = (px * r02 + py * r12 + pz * r22) * sz;
+
+	// Transposing a set of lane vectors gives that row for each of the four transforms
+	XMVECTOR zero = XMVectorZero();
+	XMMATRIX world[4] =
+	{
+		XMMatrixTranspose(XMMATRIX(a00, a01, a02, zero)),
+		XMMatrixTranspose(XMMATRIX(a10, a11, a12, zero)),
+		XMMatrixTranspose(XMMATRIX(a20, a21, a22, zero)),
+		XMMatrixTranspose(XMMATRIX(t0, t1, t2, one)),
+	};
+	for (size_t k = 0; k < 4; k++)
+	{
+		XMFLOAT4X4& w = localMatrices[first + k];
+		for (int r = 0; r < 4; r++)
+			XMStoreFloat4((XMFLOAT4*)w.m[r], world[r].r[k]);
+	}
+
+	if (uniformScales[first] && uniformScales[first + 1] && uniformScales[first + 2] && uniformScales[first + 3])
+		return;
+
+	// The rotation's inverse is its transpose, so the inverse transpose of
+	// rotation * scale is rotation * (1 / scale), and the translation
+	// column, -(t * inverse), works out to minus the position
+	XMVECTOR inverseX = XMVectorReciprocal(sx);
+	XMVECTOR inverseY = XMVectorReciprocal(sy);
+	XMVECTOR inverseZ = XMVectorReciprocal(sz);
+	XMMATRIX inverseTranspose[3] =
+	{
+		XMMatrixTranspose(XMMATRIX(r00 * inverseX, r01 * inverseY, r02 * inverseZ, -px)),
+		XMMatrixTranspose(XMMATRIX(r10 * inverseX, r11 * inverseY, r12 * inverseZ, -py)),
+		XMMatrixTranspose(XMMATRIX(r20 * inverseX, r21 * inverseY, r22 * inverseZ, -pz)),
+	};
+	for (size_t k = 0; k < 4; k++)
+	{
+		if (uniformScales[first + k])
+			continue;
+
+		XMFLOAT4X4& it = localInverseTransposeMatrices[first + k];
+		for (int r = 0; r < 3; r++)
+			XMStoreFloat4((XMFLOAT4*)it.m[r], inverseTranspose[r].r[k]);
+		XMStoreFloat4((XMFLOAT4*)it.m[3], XMVectorSet(0, 0, 0, 1));
+	}
+}
+
+TransformBenchmarkResult BenchmarkTransforms(unsigned int transformCount)
+{
+	TransformSystem system;
+	std::vector<unsigned int> ids(transformCount);
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> angle(-XM_PI, XM_PI);
+	std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+	for (unsigned int& id : ids)
+	{
+		id = system.Create();
+		system.SetPosition(id, XMFLOAT3(position(random), position(random), position(random)));
+		system.SetPitchYawRoll(id, XMFLOAT3(angle(random), angle(random), angle(random)));
+		system.SetScale(id, XMFLOAT3(scale(random), scale(random), scale(random)));
+	}
+
+	TransformBenchmarkResult result = {};
+	result.TransformCount = transformCount;
+
+	// The old Transform::UpdateMatrices(), into arrays of its own
+	std::vector<XMFLOAT4X4> world(transformCount);
+	std::vector<XMFLOAT4X4> worldInverseTranspose(transformCount);
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i < transformCount; i++)
+	{
+		XMFLOAT3 p = system.GetPosition(ids[i]);
+		XMFLOAT3 r = system.GetPitchYawRoll(ids[i]);
+		XMFLOAT3 s = system.GetScale(ids[i]);
+		XMMATRIX wMatrix =
+			XMMatrixTranslationFromVector(XMLoadFloat3(&p)) *
+			XMMatrixRotationRollPitchYawFromVector(XMLoadFloat3(&r)) *
+			XMMatrixScalingFromVector(XMLoadFloat3(&s));
+		XMStoreFloat4x4(&world[i], wMatrix);
+		XMStoreFloat4x4(&worldInverseTranspose[i], XMMatrixInverse(0, XMMatrixTranspose(wMatrix)));
+	}
+	result.ReferenceMs = MillisecondsSince(start);
+
+	system.MarkAllDirty();
+	start = std::chrono::high_resolution_clock::now();
+	system.UpdateMatrices(false);
+	result.BatchMs = MillisecondsSince(start);
+
+	system.MarkAllDirty();
+	start = std::chrono::high_resolution_clock::now();
+	system.UpdateMatrices(true);
+	result.ParallelMs = MillisecondsSince(start);
+
+	for (unsigned int i = 0; i < transformCount; i++)
+	{
+		XMFLOAT4X4 w = system.GetWorldMatrix(ids[i]);
+		XMFLOAT4X4 it = system.GetWorldInverseTransposeMatrix(ids[i]);
+		for (int r = 0; r < 4; r++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				result.MaxDifference = (std::max)(result.MaxDifference, fabsf(w.m[r][c] - world[i].m[r][c]));
+				result.MaxDifference = (std::max)(result.MaxDifference, fabsf(it.m[r][c] - worldInverseTranspose[i].m[r][c]));
+			}
+		}
+	}
+
+	// Same work with every scale uniform, which is most of what a scene has
+	for (unsigned int id : ids)
+	{
+		float s = scale(random);
+		system.SetScale(id, XMFLOAT3(s, s, s));
+	}
+	system.UpdateMatrices(false);
+	system.MarkAllDirty();
+	start = std::chrono::high_resolution_clock::now();
+	system.UpdateMatrices(false);
+	result.UniformBatchMs = MillisecondsSince(start);
+
+	// Wildly non-uniform scales, against the exact inverse transpose worked
+	// out in doubles: rotation * (1 / scale), with minus the position
+	TransformSystem extremes;
+	std::uniform_real_distribution<float> exponent(-3.0f, 3.0f);
+	for (unsigned int i = 0; i < (std::min)(transformCount, 10000u); i++)
+	{
+		unsigned int id = extremes.Create();
+		XMFLOAT3 p(position(random), position(random), position(random));
+		XMFLOAT3 r(angle(random), angle(random), angle(random));
+		XMFLOAT3 s(powf(10.0f, exponent(random)), powf(10.0f, exponent(random)), powf(10.0f, exponent(random)));
+		extremes.SetPosition(id, p);
+		extremes.SetPitchYawRoll(id, r);
+		extremes.SetScale(id, s);
+
+		double sinP = sin(r.x), cosP = cos(r.x);
+		double sinY = sin(r.y), cosY = cos(r.y);
+		double sinR = sin(r.z), cosR = cos(r.z);
+		double rotation[3][3] =
+		{
+			{ cosR * cosY + sinR * sinP * sinY, sinR * cosP, sinR * sinP * cosY - cosR * sinY },
+			{ cosR * sinP * sinY - sinR * cosY, cosR * cosP, sinR * sinY + cosR * sinP * cosY },
+			{ cosP * sinY, -sinP, cosP * cosY },
+		};
+		double inverseScale[3] = { 1.0 / s.x, 1.0 / s.y, 1.0 / s.z };
+		double translation[3] = { -p.x, -p.y, -p.z };
+		double expected[4][4] = {};
+		for (int row = 0; row < 3; row++)
+		{
+			for (int c = 0; c < 3; c++)
+				expected[row][c] = rotation[row][c] * inverseScale[c];
+			expected[row][3] = translation[row];
+		}
+		expected[3][3] = 1.0;
+
+		// ...and the old general inverse against the same thing
+		XMFLOAT4X4 reference;
+		XMStoreFloat4x4(&reference, XMMatrixInverse(0, XMMatrixTranspose(
+			XMMatrixTranslation(p.x, p.y, p.z) *
+			XMMatrixRotationRollPitchYaw(r.x, r.y, r.z) *
+			XMMatrixScaling(s.x, s.y, s.z))));
+
+		XMFLOAT4X4 it = extremes.GetWorldInverseTransposeMatrix(id);
+		for (int row = 0; row < 4; row++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				// Relative to the column's scale, since rotation rounding gets multiplied by it
+				double size = (std::max)(1.0, c < 3 ? inverseScale[c] : fabs(expected[row][c]));
+				result.ExtremeScaleDifference = (std::max)(result.ExtremeScaleDifference, (float)(fabs(it.m[row][c] - expected[row][c]) / size));
+				result.ExtremeScaleReferenceDifference = (std::max)(result.ExtremeScaleReferenceDifference, (float)(fabs(reference.m[row][c] - expected[row][c]) / size));
+			}
+		}
+	}
+
+	return result;
+}
+
+HierarchyBenchmarkResult BenchmarkHierarchy(unsigned int nodeCount)
+{
+	HierarchyBenchmarkResult result = {};
+	result.NodeCount = nodeCount;
+	if (nodeCount < 2)
+		return result;
+
+	// Small offsets and scales close to 1, so deep chains stay reasonable
+	TransformSystem system;
+	std::vector<unsigned int> ids(nodeCount);
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> position(-5.0f, 5.0f);
+	std::uniform_real_distribution<float> angle(-XM_PI, XM_PI);
+	std::uniform_real_distribution<float> scale(0.8f, 1.25f);
+	std::uniform_real_distribution<float> chance(0.0f, 1.0f);
+	for (unsigned int i = 0; i < nodeCount; i++)
+	{
+		ids[i] = system.Create();
+		system.SetPosition(ids[i], XMFLOAT3(position(random), position(random), position(random)));
+		system.SetPitchYawRoll(ids[i], XMFLOAT3(angle(random), angle(random), angle(random)));
+		system.SetScale(ids[i], XMFLOAT3(scale(random), scale(random), scale(random)));
+
+		// A random earlier node as the parent gives a bushy tree (depth ~ log n)
+		if (i > 0 && chance(random) > 0.05f)
+			system.SetParent(ids[i], ids[std::uniform_int_distribution<unsigned int>(0, i - 1)(random)]);
+	}
+
+	// Composes every node's ancestors one at a time, and compares
+	auto check = [&]()
+	{
+		for (unsigned int id : ids)
+		{
+			XMMATRIX world = XMMatrixIdentity();
+			unsigned int depth = 0;
+			for (unsigned int a = id; a != TransformSystem::NoParent; a = system.GetParent(a), depth++)
+			{
+				XMFLOAT3 p = system.GetPosition(a);
+				XMFLOAT3 r = system.GetPitchYawRoll(a);
+				XMFLOAT3 s = system.GetScale(a);
+				world = world *
+					XMMatrixTranslationFromVector(XMLoadFloat3(&p)) *
+					XMMatrixRotationRollPitchYawFromVector(XMLoadFloat3(&r)) *
+					XMMatrixScalingFromVector(XMLoadFloat3(&s));
+			}
+			result.MaxDepth = (std::max)(result.MaxDepth, depth);
+
+			XMFLOAT4X4 expected[2];
+			XMStoreFloat4x4(&expected[0], world);
+			XMStoreFloat4x4(&expected[1], XMMatrixInverse(0, XMMatrixTranspose(world)));
+			XMFLOAT4X4 actual[2] = { system.GetWorldMatrix(id), system.GetWorldInverseTransposeMatrix(id) };
+
+			// Relative to the size of the element, once that's over 1
+			for (int m = 0; m < 2; m++)
+				for (int r = 0; r < 4; r++)
+					for (int c = 0; c < 4; c++)
+						result.MaxDifference = (std::max)(result.MaxDifference,
+							fabsf(actual[m].m[r][c] - expected[m].m[r][c]) / (std::max)(1.0f, fabsf(expected[m].m[r][c])));
+		}
+	};
+
+	auto start = std::chrono::high_resolution_clock::now();
+	system.UpdateMatrices();
+	result.FullUpdateMs = MillisecondsSince(start);
+	check();
+
+	// Move a hundred random nodes, which drags their subtrees along
+	for (int i = 0; i < 100; i++)
+		system.SetPosition(ids[random() % nodeCount], XMFLOAT3(position(random), position(random), position(random)));
+	start = std::chrono::high_resolution_clock::now();
+	result.PartialUpdated = system.UpdateMatrices();
+	result.PartialUpdateMs = MillisecondsSince(start);
+	check();
+
+	// Nodes can't become their own ancestors...
+	unsigned int child = ids[nodeCount - 1];
+	unsigned int parent = system.GetParent(child);
+	result.ReparentCyclesRejected =
+		!system.SetParent(child, child) &&
+		(parent == TransformSystem::NoParent || !system.SetParent(parent, child));
+
+	// ...but otherwise can move anywhere, including to the root
+	start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < 1000; i++)
+	{
+		unsigned int node = ids[random() % nodeCount];
+		system.SetParent(node, i % 10 == 0 ? TransformSystem::NoParent : ids[random() % nodeCount]);
+	}
+	system.UpdateMatrices();
+	result.ReparentMs = MillisecondsSince(start);
+	check();
+
+	return result;
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+// --------------------------------------------------------
+// Timings from updating the same transforms every way
+// --------------------------------------------------------
+struct TransformBenchmarkResult
+{
+	unsigned int TransformCount;
+	double ReferenceMs;		// One matrix at a time, the way Transform used to
+	double BatchMs;			// SIMD batches on this thread
+	double ParallelMs;		// SIMD batches split across threads
+	double UniformBatchMs;	// SIMD batches again, with uniform scales (no normal matrices)
+	float MaxDifference;	// Largest matrix element difference from the reference
+
+	// Inverse transposes only, against exact ones worked out in doubles and
+	// relative to each column's scale, with scales from 0.001 to 1000
+	float ExtremeScaleDifference;			// Batched
+	float ExtremeScaleReferenceDifference;	// The old general inverse
+};
+
+// --------------------------------------------------------
+// Timings and checks from updating a random hierarchy
+//  - Differences are against composing each node's ancestors
+//    one by one, and should stay at float rounding levels
+// --------------------------------------------------------
+struct HierarchyBenchmarkResult
+{
+	unsigned int NodeCount;
+	unsigned int MaxDepth;
+	double FullUpdateMs;		// Every node dirty
+	double PartialUpdateMs;		// A few nodes moved, plus everything under them
+	unsigned int PartialUpdated;
+	double ReparentMs;			// Moving subtrees around, then updating
+	float MaxDifference;		// Over all three updates
+	bool ReparentCyclesRejected;	// Making a node its own ancestor has to fail
+};
+
+// --------------------------------------------------------
+// Storage for every Transform, kept as structure of arrays
+//  - Position, rotation and scale are one float array per
+//    component, so four transforms load into one SIMD register
+//  - Rotation is stored as a quaternion; pitch/yaw/roll are
+//    kept alongside only so the Euler setters and getters
+//    round trip exactly (the camera and UI work in those)
+//  - With rotation and scale known separately, the inverse
+//    transpose is just rotation * (1 / scale), and it isn't
+//    built at all for uniform scales, where the world matrix
+//    transforms normals fine once they're normalized
+//  - A dirty bit per transform says its matrices are stale
+//  - UpdateMatrices() rebuilds all the stale ones in one pass,
+//    four at a time, optionally split across threads
+//  - Transforms can have a parent, in which case position,
+//    rotation and scale are relative to it; the hierarchy is
+//    kept in depth first order, so one linear pass over it
+//    updates every world matrix whose transform or ancestor
+//    changed, and nothing else
+//
+// Transform is a handle into the shared instance, so entities
+// and cameras don't need to know about any of this
+// --------------------------------------------------------
+class TransformSystem
+{
+public:
+	// The instance Transforms allocate from
+	static TransformSystem& GetInstance();
+
+	TransformSystem();
+	TransformSystem(TransformSystem const&) = delete;
+	void operator=(TransformSystem const&) = delete;
+
+	// Allocates an identity transform (without a parent) and returns its id
+	unsigned int Create();
+	void Destroy(unsigned int id); // Its children move up to its parent
+
+	// Gives id the same local values and parent as another transform
+	void Copy(unsigned int id, unsigned int from);
+
+	// Attaches id under parent (NoParent to detach), keeping its local values
+	// - Fails, changing nothing, if parent is id or one of its descendants
+	bool SetParent(unsigned int id, unsigned int parent);
+	unsigned int GetParent(unsigned int id);
+	static const unsigned int NoParent = 0xFFFFFFFF;
+
+	// Local values, relative to the parent if there is one
+	DirectX::XMFLOAT3 GetPosition(unsigned int id);
+	DirectX::XMFLOAT3 GetPitchYawRoll(unsigned int id);
+	DirectX::XMFLOAT4 GetRotation(unsigned int id); // Quaternion
+	DirectX::XMFLOAT3 GetScale(unsigned int id);
+	void SetPosition(unsigned int id, DirectX::XMFLOAT3 position);
+	void SetPitchYawRoll(unsigned int id, DirectX::XMFLOAT3 pitchYawRoll);
+	void SetRotation(unsigned int id, DirectX::XMFLOAT4 quaternion); // Normalized on the way in
+	void SetScale(unsigned int id, DirectX::XMFLOAT3 scale);
+
+	// World space, rebuilt first if stale so they're never out of date
+	DirectX::XMFLOAT4X4 GetWorldMatrix(unsigned int id);
+	DirectX::XMFLOAT4X4 GetWorldInverseTransposeMatrix(unsigned int id);
+
+	// True when the world matrix scales uniformly (this transform and all
+	// of its ancestors), so shaders can use it for normals as well
+	bool HasUniformScale(unsigned int id);
+
+	// Rebuilds one transform's matrices now, if they're stale
+	void UpdateMatrices(unsigned int id);
+
+	// Rebuilds every stale transform's matrices, and returns how many world
+	// matrices changed (stale transforms plus everything under them)
+	unsigned int UpdateMatrices(bool parallel = true);
+
+	void MarkAllDirty();
+	unsigned int GetCount();			// Live transforms
+	unsigned int GetLastUpdateCount();	// Returned by the last batch update
+
+private:
+	// One float per transform in each, padded to a whole number of dirty words
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+	std::vector<float> scaleX, scaleY, scaleZ;
+	std::vector<DirectX::XMFLOAT3> pitchYawRolls;	// Never read by the update
+	std::vector<unsigned char> uniformScales;
+
+	// Built from the values above; roots use these as their world matrices
+	// - Inverse transposes are left stale for uniform scales
+	std::vector<DirectX::XMFLOAT4X4> localMatrices;
+	std::vector<DirectX::XMFLOAT4X4> localInverseTransposeMatrices;
+
+	// Only filled in for transforms with a parent, again leaving the inverse
+	// transpose stale when the whole chain is uniformly scaled
+	std::vector<DirectX::XMFLOAT4X4> worldMatrices;
+	std::vector<DirectX::XMFLOAT4X4> worldInverseTransposeMatrices;
+	std::vector<unsigned char> worldUniformScales;
+
+	std::vector<uint64_t> dirty;	// One bit per transform
+	std::vector<unsigned int> freeIds;
+	std::vector<unsigned char> alive;
+	unsigned int liveCount;
+	unsigned int lastUpdateCount;
+
+	// Hierarchy links (NoParent for none) and the depth first order, with
+	// each entry's parent as a position in that order
+	std::vector<unsigned int> parents;
+	std::vector<unsigned int> firstChildren;
+	std::vector<unsigned int> nextSiblings;
+	std::vector<unsigned int> order;
+	std::vector<unsigned int> orderParents;
+	std::vector<unsigned char> orderChanged;	// Scratch for UpdateMatrices()
+	bool orderStale;
+
+	void MarkDirty(unsigned int id);
+	bool IsDirty(unsigned int id);
+	void Unlink(unsigned int id);
+	void RebuildOrder();
+	void UpdateGroup(size_t first);	// Local matrices of transforms first..first+3
+	void UpdateWorld(unsigned int id);	// From its local matrices and its parent's world ones
+	void LocalsFromWords(size_t firstWord, size_t lastWord);
+	const DirectX::XMFLOAT4X4& World(unsigned int id);
+	bool WorldUniformScale(unsigned int id);
+
+	// The stored ones, or built from the plain matrix for uniform scales
+	DirectX::XMMATRIX LocalInverseTranspose(unsigned int id);
+	DirectX::XMMATRIX WorldInverseTranspose(unsigned int id);
+};
+
+// Fills a TransformSystem with transformCount random transforms and times
+// the old per-object update against the batched ones
+TransformBenchmarkResult BenchmarkTransforms(unsigned int transformCount);
+
+// Builds a random hierarchy of nodeCount transforms, then times and checks
+// full updates, partial updates and reparenting
+HierarchyBenchmarkResult BenchmarkHierarchy(unsigned int nodeCount);
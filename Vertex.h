@@ -12,5 +12,26 @@ struct Vertex
 	DirectX::XMFLOAT3 Position;	    // The local position of the vertex
 	DirectX::XMFLOAT2 UV;			// UV texture coords
 	DirectX::XMFLOAT3 Normal;		// Normal for lighting
-	DirectX::XMFLOAT3 Tangent;
-};
\ No newline at end of file
+	DirectX::XMFLOAT4 Tangent;		// w is the handedness (-1 where the UVs are mirrored)
+};
+
+// --------------------------------------------------------
+// Layouts a mesh's vertex buffer can be stored in
+// --------------------------------------------------------
+enum class VertexFormat
+{
+	Full,	// Vertex (48 bytes)
+	Packed	// PackedVertex (20 bytes)
+};
+
+// --------------------------------------------------------
+// A compressed version of Vertex, decoded in the vertex shader
+// (see VertexPacking.h for the encoding)
+// --------------------------------------------------------
+struct PackedVertex
+{
+	unsigned short Position[4];		// UNORM16, quantized against the mesh bounds (w unused)
+	unsigned short UV[2];			// Half floats
+	short Normal[2];				// SNORM16, octahedral encoding
+	short Tangent[2];				// SNORM16, octahedral encoding (lowest bit of y set for -1 handedness)
+};
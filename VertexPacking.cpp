@@ -0,0 +1,171 @@
+#include "VertexPacking.h"
+
+#include <DirectXPackedVector.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+const D3D11_INPUT_ELEMENT_DESC PackedVertexLayout[4] =
+{
+	{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, offsetof(PackedVertex, Position), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, offsetof(PackedVertex, UV), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, offsetof(PackedVertex, Normal), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TANGENT", 0, DXGI_FORMAT_R16G16_SNORM, 0, offsetof(PackedVertex, Tangent), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+};
+
+const D3D11_INPUT_ELEMENT_DESC PackedPositionLayout[1] =
+{
+	{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+};
+
+namespace
+{
+	float SignNotZero(float v) { return v >= 0.0f ? 1.0f : -1.0f; }
+
+	short ToSnorm16(float v) { return (short)std::lround((std::min)((std::max)(v, -1.0f), 1.0f) * 32767.0f); }
+	float FromSnorm16(short v) { return (std::max)(v / 32767.0f, -1.0f); }
+
+	unsigned short ToUnorm16(float v) { return (unsigned short)std::lround((std::min)((std::max)(v, 0.0f), 1.0f) * 65535.0f); }
+	float FromUnorm16(unsigned short v) { return v / 65535.0f; }
+
+	// Unit vector -> point on the octahedron, unfolded onto [-1, 1]^2
+	XMFLOAT2 OctWrap(XMFLOAT3 n)
+	{
+		float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+		if (l1 == 0.0f)
+			return XMFLOAT2(0.0f, 0.0f);
+
+		XMFLOAT2 p(n.x / l1, n.y / l1);
+		if (n.z < 0.0f)
+			return XMFLOAT2((1.0f - fabsf(p.y)) * SignNotZero(p.x), (1.0f - fabsf(p.x)) * SignNotZero(p.y));
+		return p;
+	}
+
+	XMVECTOR OctDecode(const short encoded[2])
+	{
+		float x = FromSnorm16(encoded[0]);
+		float y = FromSnorm16(encoded[1]);
+		float z = 1.0f - fabsf(x) - fabsf(y);
+		float t = (std::max)(-z, 0.0f);
+		x += x >= 0.0f ? -t : t;
+		y += y >= 0.0f ? -t : t;
+		return XMVector3Normalize(XMVectorSet(x, y, z, 0.0f));
+	}
+
+	// Rounding each component to nearest isn't always the closest
+	// direction, so try every floor/ceil combination.  A yParity of
+	// 0 or 1 only allows y values with that lowest bit, which takes
+	// widening the search by one step either side
+	void OctEncode(XMFLOAT3 n, short encoded[2], int yParity = -1)
+	{
+		XMFLOAT2 p = OctWrap(n);
+		XMVECTOR original = XMLoadFloat3(&n);
+		float bestDot = -FLT_MAX;
+		float widen = yParity < 0 ? 0.0f : 1.0f;
+
+		for (float x = floorf(p.x * 32767.0f); x <= ceilf(p.x * 32767.0f); x++)
+		{
+			for (float y = floorf(p.y * 32767.0f) - widen; y <= ceilf(p.y * 32767.0f) + widen; y++)
+			{
+				short candidate[2] = { ToSnorm16(x / 32767.0f), ToSnorm16(y / 32767.0f) };
+				if (yParity >= 0 && (candidate[1] & 1) != yParity)
+					continue;
+
+				float dot = XMVectorGetX(XMVector3Dot(OctDecode(candidate), original));
+				if (dot > bestDot)
+				{
+					bestDot = dot;
+					encoded[0] = candidate[0];
+					encoded[1] = candidate[1];
+				}
+			}
+		}
+	}
+
+	// atan2 rather than acos, which loses too much precision near 0
+	float AngleDegrees(XMVECTOR a, XMVECTOR b)
+	{
+		float sin = XMVectorGetX(XMVector3Length(XMVector3Cross(a, b)));
+		float cos = XMVectorGetX(XMVector3Dot(a, b));
+		return XMConvertToDegrees(atan2f(sin, cos));
+	}
+}
+
+void PackVertices(PackedVertex* destination, const Vertex* vertices, size_t vertexCount, XMFLOAT3* positionScale, XMFLOAT3* positionOffset)
+{
+	XMVECTOR minV = XMVectorReplicate(vertexCount ? FLT_MAX : 0.0f);
+	XMVECTOR maxV = XMVectorReplicate(vertexCount ? -FLT_MAX : 0.0f);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		XMVECTOR p = XMLoadFloat3(&vertices[i].Position);
+		minV = XMVectorMin(minV, p);
+		maxV = XMVectorMax(maxV, p);
+	}
+	XMStoreFloat3(positionScale, maxV - minV);
+	XMStoreFloat3(positionOffset, minV);
+
+	// Flat axes (like a quad's Y) just quantize to zero
+	XMFLOAT3 invScale(
+		positionScale->x > 0.0f ? 1.0f / positionScale->x : 0.0f,
+		positionScale->y > 0.0f ? 1.0f / positionScale->y : 0.0f,
+		positionScale->z > 0.0f ? 1.0f / positionScale->z : 0.0f);
+
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		const Vertex& v = vertices[i];
+		PackedVertex& p = destination[i];
+
+		p.Position[0] = ToUnorm16((v.Position.x - positionOffset->x) * invScale.x);
+		p.Position[1] = ToUnorm16((v.Position.y - positionOffset->y) * invScale.y);
+		p.Position[2] = ToUnorm16((v.Position.z - positionOffset->z) * invScale.z);
+		p.Position[3] = 0;
+
+		p.UV[0] = XMConvertFloatToHalf(v.UV.x);
+		p.UV[1] = XMConvertFloatToHalf(v.UV.y);
+
+		OctEncode(v.Normal, p.Normal);
+		OctEncode(XMFLOAT3(v.Tangent.x, v.Tangent.y, v.Tangent.z), p.Tangent, v.Tangent.w < 0.0f ? 1 : 0);
+	}
+}
+
+Vertex UnpackVertex(const PackedVertex& packed, XMFLOAT3 positionScale, XMFLOAT3 positionOffset)
+{
+	Vertex v;
+	v.Position.x = FromUnorm16(packed.Position[0]) * positionScale.x + positionOffset.x;
+	v.Position.y = FromUnorm16(packed.Position[1]) * positionScale.y + positionOffset.y;
+	v.Position.z = FromUnorm16(packed.Position[2]) * positionScale.z + positionOffset.z;
+	v.UV.x = XMConvertHalfToFloat(packed.UV[0]);
+	v.UV.y = XMConvertHalfToFloat(packed.UV[1]);
+	XMStoreFloat3(&v.Normal, OctDecode(packed.Normal));
+	XMStoreFloat4(&v.Tangent, XMVectorSetW(OctDecode(packed.Tangent), (packed.Tangent[1] & 1) ? -1.0f : 1.0f));
+	return v;
+}
+
+VertexPackingError MeasurePackingError(const PackedVertex* packed, const Vertex* vertices, size_t vertexCount, XMFLOAT3 positionScale, XMFLOAT3 positionOffset)
+{
+	VertexPackingError error = {};
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		Vertex v = UnpackVertex(packed[i], positionScale, positionOffset);
+		const Vertex& original = vertices[i];
+
+		XMVECTOR positionDelta = XMLoadFloat3(&v.Position) - XMLoadFloat3(&original.Position);
+		XMVECTOR uvDelta = XMLoadFloat2(&v.UV) - XMLoadFloat2(&original.UV);
+		error.Position = (std::max)(error.Position, XMVectorGetX(XMVector3Length(positionDelta)));
+		error.UV = (std::max)(error.UV, XMVectorGetX(XMVector2Length(uvDelta)));
+
+		// Degenerate (zero length) directions have nothing to preserve
+		XMVECTOR normal = XMLoadFloat3(&original.Normal);
+		XMVECTOR tangent = XMLoadFloat4(&original.Tangent);
+		if (XMVectorGetX(XMVector3LengthSq(normal)) > 0.0f)
+			error.NormalDegrees = (std::max)(error.NormalDegrees, AngleDegrees(XMLoadFloat3(&v.Normal), normal));
+		if (XMVectorGetX(XMVector3LengthSq(tangent)) > 0.0f)
+			error.TangentDegrees = (std::max)(error.TangentDegrees, AngleDegrees(XMLoadFloat4(&v.Tangent), tangent));
+		if ((v.Tangent.w < 0.0f) != (original.Tangent.w < 0.0f))
+			error.TangentSignErrors++;
+	}
+	return error;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <d3d11.h>
+#include <DirectXMath.h>
+#include <cstddef>
+#include "Vertex.h"
+
+// Input layout matching PackedVertex (see VertexShaderPackedInput in ShaderIncludes.hlsli)
+extern const D3D11_INPUT_ELEMENT_DESC PackedVertexLayout[4];
+
+// Input layout for a packed mesh's position-only stream (just PackedVertex::Position)
+extern const D3D11_INPUT_ELEMENT_DESC PackedPositionLayout[1];
+
+// --------------------------------------------------------
+// Maximum round-trip error of a set of packed vertices
+//  - Position and UV are absolute distances
+//  - Normal and tangent are angles in degrees
+//  - Tangent sign errors count flipped handedness (should be zero)
+// --------------------------------------------------------
+struct VertexPackingError
+{
+	float Position;
+	float UV;
+	float NormalDegrees;
+	float TangentDegrees;
+	unsigned int TangentSignErrors;
+};
+
+// --------------------------------------------------------
+// Packs vertices, quantizing positions against their bounds
+//
+// The shader gets the position back with:
+//   localPosition = quantized * positionScale + positionOffset
+// --------------------------------------------------------
+void PackVertices(
+	PackedVertex* destination,
+	const Vertex* vertices,
+	size_t vertexCount,
+	DirectX::XMFLOAT3* positionScale,
+	DirectX::XMFLOAT3* positionOffset);
+
+// The CPU mirror of DecodePackedVertex() in ShaderIncludes.hlsli
+Vertex UnpackVertex(const PackedVertex& packed, DirectX::XMFLOAT3 positionScale, DirectX::XMFLOAT3 positionOffset);
+
+VertexPackingError MeasurePackingError(
+	const PackedVertex* packed,
+	const Vertex* vertices,
+	size_t vertexCount,
+	DirectX::XMFLOAT3 positionScale,
+	DirectX::XMFLOAT3 positionOffset);
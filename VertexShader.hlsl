@@ -1,39 +1,82 @@
 
 #include "ShaderIncludes.hlsli"
 
-cbuffer ExternalData : register(b0)
+// Constants are split by how often they change, so each upload
+// only carries what's new since the last one
+cbuffer PerFrame : register(b0)
 {
-	matrix world;
 	matrix view;
 	matrix projection;
-	matrix worldInvTrans;
-
 	matrix lightView;
 	matrix lightProjection;
 }
 
+#ifdef PACKED_VERTICES
+cbuffer PerMesh : register(b1)
+{
+	float3 positionScale;
+	float3 positionOffset;
+}
+#endif
+
+// Instances get these from their instance data instead
+#ifndef INSTANCED
+cbuffer PerObject : register(b2)
+{
+	matrix world;
+	matrix worldInvTrans;
+
+	// Uniformly scaled objects skip worldInvTrans, since the
+	// world matrix only changes a normal's length then
+	int uniformScale;
+}
+#endif
+
 // --------------------------------------------------------
 // The entry point (main method) for our vertex shader
 // 
 // - Input is exactly one vertex worth of data (defined by a struct)
 // - Output is a single struct of data to pass down the pipeline
 // - Named "main" because that's the default the shader compiler looks for
+// - Instanced versions also take one instance's data
 // --------------------------------------------------------
-VertexToPixel main(VertexShaderInput input)
+#ifdef INSTANCED
+#define INSTANCE_INPUT , InstanceInput instance
+#else
+#define INSTANCE_INPUT
+#endif
+
+#ifdef PACKED_VERTICES
+VertexToPixel main(VertexShaderPackedInput packed INSTANCE_INPUT)
+{
+	VertexShaderInput input = DecodePackedVertex(packed, positionScale, positionOffset);
+#else
+VertexToPixel main(VertexShaderInput input INSTANCE_INPUT)
 {
+#endif
+	// Instances always come with an inverse transpose (a copy of
+	// the world matrix when the scale is uniform)
+#ifdef INSTANCED
+	matrix worldMatrix = InstanceMatrix(instance.world0, instance.world1, instance.world2, instance.world3);
+	float3x3 normalMatrix = (float3x3)InstanceMatrix(instance.worldInvTrans0, instance.worldInvTrans1, instance.worldInvTrans2, instance.worldInvTrans3);
+#else
+	matrix worldMatrix = world;
+	float3x3 normalMatrix = uniformScale ? (float3x3)world : (float3x3)worldInvTrans;
+#endif
+
 	// Set up output struct
 	VertexToPixel output;
 
 	// Calculate screen position of this vertex
-	matrix wvp = mul(projection, mul(view, world));
+	matrix wvp = mul(projection, mul(view, worldMatrix));
 	output.screenPosition = mul(wvp, float4(input.localPosition, 1.0f));
 
 	output.uv = input.uv;
-	output.normal = normalize(mul((float3x3)worldInvTrans, input.normal));
-	output.tangent = normalize(mul((float3x3)worldInvTrans, input.tangent));
-	output.worldPosition = mul(world, float4(input.localPosition, 1.0f)).xyz;
+	output.normal = normalize(mul(normalMatrix, input.normal));
+	output.tangent = float4(normalize(mul(normalMatrix, input.tangent.xyz)), input.tangent.w);
+	output.worldPosition = mul(worldMatrix, float4(input.localPosition, 1.0f)).xyz;
 
-	matrix shadowWVP = mul(lightProjection, mul(lightView, world));
+	matrix shadowWVP = mul(lightProjection, mul(lightView, worldMatrix));
 	output.shadowMapPos = mul(shadowWVP, float4(input.localPosition, 1.0f));
 
 	return output;
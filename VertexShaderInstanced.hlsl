@@ -0,0 +1,5 @@
+// --------------------------------------------------------
+// VertexShader.hlsl for instanced draws
+// --------------------------------------------------------
+#define INSTANCED
+#include "VertexShader.hlsl"
@@ -0,0 +1,5 @@
+// --------------------------------------------------------
+// VertexShader.hlsl for meshes stored as PackedVertex
+// --------------------------------------------------------
+#define PACKED_VERTICES
+#include "VertexShader.hlsl"
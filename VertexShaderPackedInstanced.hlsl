@@ -0,0 +1,6 @@
+// --------------------------------------------------------
+// VertexShader.hlsl for instanced draws of PackedVertex meshes
+// --------------------------------------------------------
+#define PACKED_VERTICES
+#define INSTANCED
+#include "VertexShader.hlsl"